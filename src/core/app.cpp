@@ -1,18 +1,37 @@
 #include "app.h"
 
 const char* App::CONFIG_FILE = "/config.json";
+const char* App::OUTBOX_DIRECTORY = "/outbox";
+const char* App::DISCOVERY_HASH_FILE = "/discovery.hash";
+const char* App::MQTT_CA_FILE = "/mqtt_ca.pem";
 
 App::App() 
-    : initialized(false), lastSensorRead(0), lastDisplayUpdate(0), 
-      lastMqttPublish(0), ledOnTime(0), ledTimerActive(false),
+    : sensingTaskHandle(nullptr), networkTaskHandle(nullptr),
+      initialized(false), ledOnTime(0), ledTimerActive(false),
       showingLedStatus(false), ledStatusShowTime(0), manualLedControl(false),
-      roomWasBright(false) {
+      roomWasBright(false), hasReading(false), hasSample(false),
+      hasReported(false), lastReportTime(0), reportsSent(0), reportsSuppressed(0),
+      reportRequested(false), configPatches(0), configPatchesRejected(0), configWrites(0),
+      sensorTask(Scheduler::INVALID_TASK), displayTask(Scheduler::INVALID_TASK),
+      ledTimerTask(Scheduler::INVALID_TASK), wifiTask(Scheduler::INVALID_TASK),
+      mqttTask(Scheduler::INVALID_TASK), publishTask(Scheduler::INVALID_TASK),
+      heartbeatTask(Scheduler::INVALID_TASK), diagnosticsTask(Scheduler::INVALID_TASK),
+      batchTask(Scheduler::INVALID_TASK), batchNextTimestamp(0), batchStarted(false),
+      batchesSent(0), batchedSamples(0) {
 }
 
 App::~App() {
     // Cleanup handled by smart pointers
 }
 
+void App::useHardware(std::unique_ptr<ISensorReader> sensorReader,
+                      std::unique_ptr<IDisplayDriver> displayDriver,
+                      std::unique_ptr<ILedController> led) {
+    sensor = std::move(sensorReader);
+    display = std::move(displayDriver);
+    ledController = std::move(led);
+}
+
 ErrorCode App::initialize() {
     Logger::setLevel(LogLevel::INFO);
     LOG_INFO("Starting ESP32 Environmental Monitor");
@@ -47,13 +66,6 @@ ErrorCode App::initialize() {
             config.saveToFile(CONFIG_FILE);
             LOG_INFOF("Applied MQTT defaults - WiFi SSID preserved: '%s'", config.wifi.ssid);
         }
-        
-        // FORCE: Override nightLightDuration to use code default (10 minutes)
-        if (config.sensor.nightLightDuration != 600000) {
-            LOG_WARNF("Forcing nightLightDuration from %lu ms to 600000 ms (10 minutes)", config.sensor.nightLightDuration);
-            config.sensor.nightLightDuration = 600000;
-            config.saveToFile(CONFIG_FILE);
-        }
     }
     
     result = initializeHardware();
@@ -62,12 +74,31 @@ ErrorCode App::initialize() {
         return result;
     }
     
+    // After the hardware, so the history is sized for the rate the sensor really reads at
+    result = initializeHistory();
+    if (result != ErrorCode::SUCCESS) {
+        LOG_ERROR("Failed to allocate sample history");
+        return result;
+    }
+    
     result = setupEventHandlers();
     if (result != ErrorCode::SUCCESS) {
         LOG_ERROR("Failed to setup event handlers");
         return result;
     }
     
+    result = setupTasks();
+    if (result != ErrorCode::SUCCESS) {
+        LOG_ERROR("Failed to setup loop tasks");
+        return result;
+    }
+    
+    result = setupCommands();
+    if (result != ErrorCode::SUCCESS) {
+        LOG_ERROR("Failed to setup MQTT commands");
+        return result;
+    }
+    
     initialized = true;
     LOG_INFO("App initialization completed successfully");
     return ErrorCode::SUCCESS;
@@ -79,32 +110,89 @@ void App::run() {
         return;
     }
     
+#if APP_DUAL_CORE
+    runDualCore();
+#else
+    start();
+    
+    while (true) {
+        idle(runOnce());
+    }
+#endif
+}
+
+void App::runDualCore() {
+    LOG_INFO("*** STARTING DUAL-CORE TASKS (sensing: this task, network: core 0) ***");
+    
+    // Set before the network task exists so it can always notify us
+    sensingTaskHandle = xTaskGetCurrentTaskHandle();
+    if (xTaskCreatePinnedToCore(networkTaskEntry, "network", NETWORK_TASK_STACK_SIZE, this, 1,
+                                &networkTaskHandle, NETWORK_CORE) != pdPASS) {
+        LOG_ERROR("Failed to create network task, falling back to a single loop");
+        sensingTaskHandle = nullptr;
+        start();
+        while (true) {
+            idle(runOnce());
+        }
+    }
+    
+    while (true) {
+        unsigned long idleMs = runSensing();
+        // Commands from the network task end the wait early
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(idleMs));
+    }
+}
+
+void App::networkTaskEntry(void* param) {
+    App* app = static_cast<App*>(param);
+    app->start();
+    while (true) {
+        app->idle(app->runNetwork());
+    }
+}
+
+void App::start() {
     LOG_INFO("*** STARTING MAIN APPLICATION LOOP ***");
     
     // Try to connect to WiFi initially
     wifiManager->connect();
+}
+
+unsigned long App::runOnce() {
+    // Sensing first so fresh samples are handed over in the same pass
+    unsigned long sensingIdle = runSensing();
+    unsigned long networkIdle = runNetwork();
     
-    unsigned long lastHeartbeat = 0;
-    
-    while (true) {
-        // Print heartbeat every 60 seconds
-        if (millis() - lastHeartbeat > 60000) {
-            LOG_INFOF("*** HEARTBEAT *** Uptime: %lu seconds, Free heap: %u bytes", 
-                     millis() / 1000, ESP.getFreeHeap());
-            lastHeartbeat = millis();
-        }
-        
-        updateWiFi();
-        updateMQTT();
-        updateSensor();
-        updateDisplay();
-        updateLedController();
-        checkLedTimer();
-        
-        delay(50); // Small delay to prevent watchdog issues
+    // A command just received should be applied without waiting
+    if (!commandQueue.empty()) {
+        return 0;
+    }
+    return sensingIdle < networkIdle ? sensingIdle : networkIdle;
+}
+
+void App::idle(unsigned long ms) {
+    // Sleeping in the MQTT socket wait lets inbound commands (LED control)
+    // run immediately instead of waiting for the next poll
+    if (mqttClient->waitForTraffic(ms)) {
+        networkScheduler.wake(mqttTask);
     }
 }
 
+unsigned long App::runSensing() {
+    applyCommands();
+    sensingScheduler.runDue();
+    
+    // Events posted by the tasks above, by ISRs or by the other core are
+    // handled here in one batch, after the tasks rather than nested in them
+    eventBus.dispatchQueued(EVENT_BATCH_SIZE);
+    return eventBus.hasQueued() ? 0 : sensingScheduler.timeUntilNext();
+}
+
+unsigned long App::runNetwork() {
+    drainSamples();
+    return networkScheduler.runDue();
+}
+
 ErrorCode App::initializeFileSystem() {
     if (!SPIFFS.begin(true)) {
         return ErrorCode::FILE_READ_FAILED;
@@ -113,29 +201,58 @@ ErrorCode App::initializeFileSystem() {
     return ErrorCode::SUCCESS;
 }
 
+ErrorCode App::initializeHistory() {
+    // Reads closer together than the sensor allows only repeat the last one
+    unsigned long interval = config.sensor.sensorReadingInterval;
+    if (sensor && interval < sensor->minReadInterval()) {
+        interval = sensor->minReadInterval();
+    }
+    size_t wanted = SampleHistory::bytesFor(config.sensor.historyDuration, interval,
+                                            config.sensor.historyMaxBytes);
+    ErrorCode result = history.allocate(wanted);
+    if (result != ErrorCode::SUCCESS) {
+        return result;
+    }
+    if (history.getFootprint() * 2 <= wanted) {
+        LOG_WARNF("Sample history shrunk to %u of %u bytes to fit the heap",
+                  (unsigned)history.getFootprint(), (unsigned)wanted);
+    }
+    LOG_INFOF("Sample history: %u bytes, about %u samples compressed",
+              (unsigned)history.getFootprint(), (unsigned)history.getCapacity());
+    return ErrorCode::SUCCESS;
+}
+
 ErrorCode App::initializeHardware() {
     // Initialize sensor
-    sensor.reset(new DHTSensor(
-        config.sensor.dhtPin, 
-        config.sensor.dhtType,
-        config.sensor.photoresisterPin,
-        config.sensor.ledPin
-    ));
+    if (!sensor) {
+        sensor.reset(new DHTSensor(
+            config.sensor.dhtPin, 
+            config.sensor.dhtType,
+            config.sensor.photoresisterPin,
+            config.sensor.ledPin
+        ));
+    }
     
     // Initialize display
-    display.reset(new OLEDDisplay(
-        128, 64, // OLED dimensions
-        config.sensor.sdaPin,
-        config.sensor.sclPin
-    ));
+    if (!display) {
+        display.reset(new OLEDDisplay(
+            128, 64, // OLED dimensions
+            config.sensor.sdaPin,
+            config.sensor.sclPin
+        ));
+    }
     
     ErrorCode result = display->initialize();
     if (result != ErrorCode::SUCCESS) {
         return result;
     }
     
+    sensor->setReadInterval(config.sensor.sensorReadingInterval);
+    
     // Initialize LED controller
-    ledController.reset(new LEDController(config.sensor.ledPin));
+    if (!ledController) {
+        ledController.reset(new LEDController(config.sensor.ledPin));
+    }
     
     // Initialize WiFi and MQTT
     wifiManager.reset(new WiFiManager(config.wifi));
@@ -150,11 +267,20 @@ ErrorCode App::initializeHardware() {
     if (result != ErrorCode::SUCCESS) {
         return result;
     }
+    mqttClient->setDiscoveryCache(SPIFFS, DISCOVERY_HASH_FILE);
+    // Without it MQTT stays offline rather than falling back to plaintext;
+    // sensing and the web UI carry on
+    if (config.mqtt.tls && mqttClient->loadCaCertificate(SPIFFS, MQTT_CA_FILE) != ErrorCode::SUCCESS) {
+        LOG_ERRORF("MQTT over TLS disabled until a valid CA is at %s", MQTT_CA_FILE);
+    }
     
-    // Set LED control callback for MQTT
-    mqttClient->setLedCallback([this](bool ledOn) {
-        this->onLedControlMessage(ledOn);
-    });
+    // Whatever the last boot could not send is picked up here
+    outbox.reset(new Outbox(SPIFFS, OUTBOX_DIRECTORY, config.mqtt.outboxMaxBytes));
+    result = outbox->begin();
+    if (result != ErrorCode::SUCCESS) {
+        return result;
+    }
+    mqttClient->setOutbox(outbox.get());
     
     // Initialize web server for debugging
     webServer.reset(new AsyncWebServer(80));
@@ -165,52 +291,80 @@ ErrorCode App::initializeHardware() {
 }
 
 ErrorCode App::setupEventHandlers() {
-    eventBus.subscribe(EventType::SENSOR_DATA_UPDATED, 
-        [this](const Event& e) { onSensorDataUpdated(e); });
-    
-    eventBus.subscribe(EventType::LED_STATUS_CHANGED, 
-        [this](const Event& e) { onLedStatusChanged(e); });
+    bool subscribed = eventBus.subscribe<App, &App::onSensorDataUpdated>(EventType::SENSOR_DATA_UPDATED, this) &&
+                      eventBus.subscribe<App, &App::onLedStatusChanged>(EventType::LED_STATUS_CHANGED, this) &&
+                      eventBus.subscribe<App, &App::onErrorOccurred>(EventType::ERROR_OCCURRED, this);
+    if (!subscribed) {
+        return ErrorCode::MEMORY_ALLOCATION_FAILED;
+    }
     
-    eventBus.subscribe(EventType::ERROR_OCCURRED, 
-        [this](const Event& e) { onErrorOccurred(e); });
+    // Only the newest reading matters if several queue up before dispatch
+    eventBus.setCoalescing(EventType::SENSOR_DATA_UPDATED, true);
     
     LOG_INFO("Event handlers setup completed");
     return ErrorCode::SUCCESS;
 }
 
+ErrorCode App::setupTasks() {
+    sensorTask = sensingScheduler.addTask("sensor", config.sensor.sensorReadingInterval, [this]() { updateSensor(); });
+    displayTask = sensingScheduler.addTask("display", DISPLAY_REFRESH_INTERVAL, [this]() { updateDisplay(); });
+    ledTimerTask = sensingScheduler.addTask("ledTimer", LED_TIMER_CHECK_INTERVAL, [this]() { checkLedTimer(); });
+    
+    wifiTask = networkScheduler.addTask("wifi", WIFI_POLL_INTERVAL, [this]() { updateWiFi(); });
+    mqttTask = networkScheduler.addTask("mqtt", MQTT_POLL_INTERVAL, [this]() { updateMQTT(); });
+    publishTask = networkScheduler.addTask("publish", config.sensor.uploadFrequency, [this]() { publishLatestSample(); });
+    heartbeatTask = networkScheduler.addTask("heartbeat", HEARTBEAT_INTERVAL, [this]() { logHeartbeat(); });
+    if (config.mqtt.diagnosticsInterval > 0) {
+        diagnosticsTask = networkScheduler.addTask("diagnostics", config.mqtt.diagnosticsInterval,
+                                                   [this]() { publishDiagnostics(); });
+    }
+    if (mqttClient->batchLimit() > 0) {
+        batchTask = networkScheduler.addTask("batch", BATCH_CHECK_INTERVAL, [this]() { publishBatch(); });
+    }
+    
+    if (ledTimerTask == Scheduler::INVALID_TASK || heartbeatTask == Scheduler::INVALID_TASK) {
+        return ErrorCode::MEMORY_ALLOCATION_FAILED;
+    }
+    
+    LOG_INFO("Loop tasks scheduled");
+    return ErrorCode::SUCCESS;
+}
+
 void App::updateSensor() {
     static unsigned long lastDebugPrint = 0;
     
-    if (!shouldReadSensor()) return;
-    
     auto result = sensor->read();
     if (result.isSuccess()) {
-        lastSensorRead = millis();
-        
         // Debug print every 30 seconds
         if (millis() - lastDebugPrint > 30000) {
             LOG_INFOF("[Sensor] *** READ SUCCESS *** Temp: %.1f°C, Humidity: %.1f%%, Light: %d", 
-                     result.value.temperture, result.value.humidity, result.value.photoresisterValue);
+                     result.value.temperature(), result.value.humidity(), result.value.photoresisterValue);
             lastDebugPrint = millis();
         }
         
+        // The sensor hands back its cached reading until the next one is due;
+        // only new readings go into the history
+        if (!hasReading || result.value.timestamp != lastReading.timestamp) {
+            std::lock_guard<std::mutex> lock(historyMutex);
+            history.append(result.value);
+        }
+        
+        lastReading = result.value;
+        hasReading = true;
         handleLedAutoControl(result.value);
-        eventBus.publish(Event(EventType::SENSOR_DATA_UPDATED, result.value));
+        eventBus.post(Event(EventType::SENSOR_DATA_UPDATED, result.value));
     } else {
         LOG_ERRORF("[Sensor] *** READ FAILED *** Error: %d", (int)result.error);
-        eventBus.publish(Event(EventType::ERROR_OCCURRED, result.error, "Sensor read failed"));
+        eventBus.post(Event(EventType::ERROR_OCCURRED, result.error, "Sensor read failed"));
     }
 }
 
 void App::updateDisplay() {
-    if (!shouldUpdateDisplay()) return;
-    
-    // Get current sensor data
-    auto sensorResult = sensor->read();
-    if (!sensorResult.isSuccess()) return;
+    // Show the latest reading rather than sampling the sensor a second time
+    if (!hasReading) return;
     
     DisplayData displayData;
-    displayData.sensorData = sensorResult.value;
+    displayData.sensorData = lastReading;
     
     // Check if we should show LED status
     if (showingLedStatus && millis() - ledStatusShowTime < LED_STATUS_DISPLAY_DURATION) {
@@ -236,12 +390,6 @@ void App::updateDisplay() {
     }
     
     display->show(displayData);
-    lastDisplayUpdate = millis();
-}
-
-void App::updateLedController() {
-    // LED control is handled through events and auto-control
-    // This method can be used for additional LED logic if needed
 }
 
 void App::checkLedTimer() {
@@ -261,22 +409,21 @@ void App::checkLedTimer() {
         if (elapsed >= config.sensor.nightLightDuration) {
             ledController->turnOff();
             ledTimerActive = false;
-            eventBus.publish(Event(EventType::LED_STATUS_CHANGED, false));
+            eventBus.post(Event(EventType::LED_STATUS_CHANGED, false));
             LOG_INFOF("*** LED TIMER EXPIRED *** after %lu ms (target: %lu ms), turning off. LED will not turn on again until room becomes bright first.", elapsed, config.sensor.nightLightDuration);
         }
     }
 }
 
-bool App::shouldReadSensor() {
-    return millis() - lastSensorRead >= config.sensor.sensorReadingInterval;
-}
-
-bool App::shouldUpdateDisplay() {
-    return millis() - lastDisplayUpdate >= 100; // Update display at 10Hz
+void App::logHeartbeat() {
+    LOG_INFOF("*** HEARTBEAT *** Uptime: %lu seconds, Free heap: %u bytes", 
+             millis() / 1000, ESP.getFreeHeap());
 }
 
-bool App::shouldPublishMqtt() {
-    return millis() - lastMqttPublish >= config.sensor.uploadFrequency;
+void App::armLedTimer() {
+    ledOnTime = millis();
+    ledTimerActive = true;
+    sensingScheduler.runAt(ledTimerTask, ledOnTime + config.sensor.nightLightDuration);
 }
 
 void App::handleLedAutoControl(const SensorData& data) {
@@ -311,16 +458,15 @@ void App::handleLedAutoControl(const SensorData& data) {
     if (roomIsBright && currentlyOn) {
         ledController->turnOff();
         ledTimerActive = false;  // Cancel timer when turning off due to bright light
-        eventBus.publish(Event(EventType::LED_STATUS_CHANGED, false));
+        eventBus.post(Event(EventType::LED_STATUS_CHANGED, false));
         LOG_INFOF("Auto-turning LED OFF (room is bright) - Light: %d >= %d", data.photoresisterValue, config.sensor.photoresisterThreshold);
     } 
     // Only turn on if: room is dark AND room was bright since last activation AND LED is not currently on
     else if (roomIsDark && !currentlyOn && roomWasBright) {
         ledController->turnOn();
-        ledOnTime = millis();
-        ledTimerActive = true;
+        armLedTimer();
         roomWasBright = false;  // Reset the flag - LED won't turn on again until room is bright again
-        eventBus.publish(Event(EventType::LED_STATUS_CHANGED, true));
+        eventBus.post(Event(EventType::LED_STATUS_CHANGED, true));
         LOG_INFOF("Auto-turning LED ON (dark room detected after bright period) - Light: %d < %d, Timer set for %lu ms", data.photoresisterValue, config.sensor.photoresisterThreshold, config.sensor.nightLightDuration);
     }
 }
@@ -333,22 +479,296 @@ ErrorCode App::publishSensorData(const SensorData& data) {
     return mqttClient->publishSensorData(data);
 }
 
+// Commands arrive on Advantech/<edgeId>/...:
+//   led            "on" or "off" (Home Assistant's light entity)
+//   cmd/interval   sensor read interval in ms
+//   cmd/threshold  photoresistor level below which the room counts as dark
+//   cmd/publish    publish the current reading now, past the deadbands
+//   cmd/reboot     restart the device; the payload must be its edgeId
+//   config         retained {"sensor":{...}} patch, see onConfigPatch()
+// cmd/interval and cmd/threshold last until the next restart or patch.
+ErrorCode App::setupCommands() {
+    savedSensor = config.sensor;
+    bool routed = mqttClient->route<App, &App::onLedCommand>("led", this) &&
+                  mqttClient->route<App, &App::onConfigPatch>("config", this) &&
+                  mqttClient->route<App, &App::onIntervalCommand>("cmd/interval", this) &&
+                  mqttClient->route<App, &App::onThresholdCommand>("cmd/threshold", this) &&
+                  mqttClient->route<App, &App::onPublishCommand>("cmd/publish", this) &&
+                  mqttClient->route<App, &App::onRebootCommand>("cmd/reboot", this);
+    return routed ? ErrorCode::SUCCESS : ErrorCode::MEMORY_ALLOCATION_FAILED;
+}
+
+void App::onLedCommand(const MqttMessage& message) {
+    sendToSensing(SensingCommand::LED, message.equals("on") ? 1 : 0);
+}
+
+void App::onIntervalCommand(const MqttMessage& message) {
+    unsigned long interval;
+    if (!message.toUnsigned(interval) || interval < SensorConfig::MIN_READ_INTERVAL ||
+        interval > SensorConfig::MAX_READ_INTERVAL) {
+        LOG_WARNF("[MQTT] Ignoring read interval %.*s", (int)message.length, (const char*)message.payload);
+        return;
+    }
+    sendToSensing(SensingCommand::READ_INTERVAL, interval);
+}
+
+void App::onThresholdCommand(const MqttMessage& message) {
+    unsigned long threshold;
+    if (!message.toUnsigned(threshold) || threshold > SensorConfig::MAX_LIGHT_THRESHOLD) {
+        LOG_WARNF("[MQTT] Ignoring light threshold %.*s", (int)message.length, (const char*)message.payload);
+        return;
+    }
+    sendToSensing(SensingCommand::LIGHT_THRESHOLD, threshold);
+}
+
+void App::onPublishCommand(const MqttMessage& /* message */) {
+    reportRequested = true;
+    networkScheduler.wake(publishTask);
+}
+
+// A retained or queued reboot would arrive again on every connect and
+// restart the device in a loop, so a stray message (or our own clear, which
+// is empty) is ignored and an accepted one is deleted from the broker first
+void App::onRebootCommand(const MqttMessage& message) {
+    if (!message.equals(config.mqtt.edgeId)) {
+        LOG_WARNF("[MQTT] Ignoring reboot, payload %.*s is not this device's edgeId", (int)message.length,
+                  (const char*)message.payload);
+        return;
+    }
+    LOG_WARN("[MQTT] Reboot requested");
+    mqttClient->clearRetained(message.topic);
+    mqttClient->disconnect();
+    ESP.restart();
+}
+
+// The patch is merged into the saved settings and all four live settings
+// are applied from the result, so it also undoes cmd/interval and
+// cmd/threshold. Being retained, it arrives again on every connect; flash
+// is only written when it changes what /config.json holds. The outcome is
+// published, retained, on config/status.
+void App::onConfigPatch(const MqttMessage& message) {
+    char error[128];
+    SensorConfig patched = savedSensor;
+    if (Config::patchSensorConfig((const char*)message.payload, message.length, patched, error, sizeof(error)) !=
+        ErrorCode::SUCCESS) {
+        configPatchesRejected++;
+        LOG_WARNF("[Config] Patch rejected: %s", error);
+        publishConfigError(error);
+        return;
+    }
+    configPatches++;
+    
+    unsigned changed = (patched.sensorReadingInterval != savedSensor.sensorReadingInterval) +
+                       (patched.uploadFrequency != savedSensor.uploadFrequency) +
+                       (patched.photoresisterThreshold != savedSensor.photoresisterThreshold) +
+                       (patched.nightLightDuration != savedSensor.nightLightDuration);
+    
+    // Upload frequency belongs to this side; the rest go to sensing
+    config.sensor.uploadFrequency = patched.uploadFrequency;
+    networkScheduler.setPeriod(publishTask, patched.uploadFrequency);
+    sendToSensing(SensingCommand::READ_INTERVAL, patched.sensorReadingInterval);
+    sendToSensing(SensingCommand::LIGHT_THRESHOLD, (uint32_t)patched.photoresisterThreshold);
+    sendToSensing(SensingCommand::NIGHT_LIGHT_DURATION, patched.nightLightDuration);
+    
+    bool persisted = false;
+    if (changed > 0) {
+        persisted = saveConfig(patched) == ErrorCode::SUCCESS;
+        if (persisted) {
+            savedSensor = patched;
+            configWrites++;
+        } else {
+            LOG_ERROR("[Config] Could not save the patched configuration");
+        }
+    }
+    LOG_INFOF("[Config] Patch applied, %u setting(s) changed%s", changed, persisted ? ", saved" : "");
+    publishConfigStatus(patched, changed, persisted);
+}
+
+// Writes /config.json with wifi and mqtt from the shared config and the
+// given sensor settings. The live sensor fields are never saved: sensing
+// may be writing them right now, and values from cmd/interval or
+// cmd/threshold only last until the next restart.
+ErrorCode App::saveConfig(const SensorConfig& sensor) {
+    Config saved;
+    saved.wifi = config.wifi;
+    saved.mqtt = config.mqtt;
+    saved.sensor = sensor;
+    return saved.saveToFile(CONFIG_FILE);
+}
+
+// {"ok":true,"changed":n,"persisted":bool,<the four settings now in effect>}
+void App::publishConfigStatus(const SensorConfig& applied, unsigned changed, bool persisted) {
+    char payload[256];
+    PayloadWriter json(payload, sizeof(payload));
+    json.raw("{\"ok\":true,\"changed\":").number(changed);
+    json.raw(",\"persisted\":").raw(persisted ? "true" : "false");
+    json.raw(",\"sensorReadingInterval\":").number(applied.sensorReadingInterval);
+    json.raw(",\"uploadFrequency\":").number(applied.uploadFrequency);
+    json.raw(",\"photoresisterThreshold\":").number((unsigned long)applied.photoresisterThreshold);
+    json.raw(",\"nightLightDuration\":").number(applied.nightLightDuration).raw("}");
+    if (json.ok()) {
+        mqttClient->publishConfigStatus(json.c_str());
+    }
+}
+
+void App::publishConfigError(const char* error) {
+    char payload[192];
+    PayloadWriter json(payload, sizeof(payload));
+    json.raw("{\"ok\":false,\"error\":\"").raw(error).raw("\"}");
+    if (json.ok()) {
+        mqttClient->publishConfigStatus(json.c_str());
+    }
+}
+
+void App::sendToSensing(SensingCommand::Type type, uint32_t value) {
+    if (!commandQueue.push(SensingCommand{type, value})) {
+        LOG_WARN("[MQTT] Command queue full, command dropped");
+        return;
+    }
+    if (sensingTaskHandle) {
+        xTaskNotifyGive(sensingTaskHandle);
+    }
+}
+
 void App::onSensorDataUpdated(const Event& event) {
-    // Publish to MQTT if it's time
-    if (shouldPublishMqtt()) {
-        if (mqttClient->isConnected()) {
-            LOG_INFOF("[MQTT] Publishing sensor data - Temp: %.1f°C, Humidity: %.1f%%, Light: %d", 
-                     event.sensorData.temperture, event.sensorData.humidity, event.sensorData.photoresisterValue);
-            ErrorCode result = publishSensorData(event.sensorData);
-            if (result == ErrorCode::SUCCESS) {
-                LOG_INFO("[MQTT] Sensor data published successfully");
-            } else {
-                LOG_ERROR("[MQTT] Failed to publish sensor data");
+    // Hand the sample to the networking side; publishing happens there
+    sampleQueue.push(event.sensorData);
+}
+
+void App::applyCommands() {
+    SensingCommand command;
+    while (commandQueue.pop(command)) {
+        switch (command.type) {
+        case SensingCommand::LED:
+            onLedControlMessage(command.value != 0);
+            break;
+        case SensingCommand::READ_INTERVAL:
+            config.sensor.sensorReadingInterval = command.value;
+            sensor->setReadInterval(command.value);
+            sensingScheduler.setPeriod(sensorTask, command.value);
+            LOG_INFOF("Sensor read interval set to %lu ms", (unsigned long)command.value);
+            break;
+        case SensingCommand::LIGHT_THRESHOLD:
+            config.sensor.photoresisterThreshold = (int)command.value;
+            LOG_INFOF("Light threshold set to %lu", (unsigned long)command.value);
+            break;
+        case SensingCommand::NIGHT_LIGHT_DURATION:
+            config.sensor.nightLightDuration = command.value;
+            if (ledTimerActive) {
+                // Pulls a shortened timer's expiry forward; a longer one is
+                // picked up by the periodic check
+                sensingScheduler.runAt(ledTimerTask, ledOnTime + command.value);
             }
+            LOG_INFOF("Night light duration set to %lu ms", (unsigned long)command.value);
+            break;
+        }
+    }
+}
+
+void App::drainSamples() {
+    SensorData sample;
+    bool received = false;
+    while (sampleQueue.pop(sample)) {
+        received = true;
+    }
+    if (received) {
+        std::lock_guard<std::mutex> lock(sampleMutex);
+        latestSample = sample;
+        hasSample = true;
+    }
+}
+
+void App::publishLatestSample() {
+    SensorData sample;
+    {
+        std::lock_guard<std::mutex> lock(sampleMutex);
+        if (!hasSample) return;
+        sample = latestSample;
+    }
+    
+    if (!reportRequested && !worthReporting(sample)) {
+        reportsSuppressed++;
+        return;
+    }
+    reportRequested = false;
+    lastReported = sample;
+    hasReported = true;
+    lastReportTime = millis();
+    reportsSent++;
+    
+    if (mqttClient->isConnected()) {
+        LOG_INFOF("[MQTT] Publishing sensor data - Temp: %.1f°C, Humidity: %.1f%%, Light: %d", 
+                 sample.temperature(), sample.humidity(), sample.photoresisterValue);
+        ErrorCode result = publishSensorData(sample);
+        if (result == ErrorCode::SUCCESS) {
+            LOG_INFO("[MQTT] Sensor data published successfully");
         } else {
-            LOG_WARN("[MQTT] Cannot publish - not connected");
+            LOG_ERROR("[MQTT] Failed to publish sensor data");
+            keepUnsent(sample);
         }
-        lastMqttPublish = millis();
+    } else {
+        keepUnsent(sample);
+        LOG_WARNF("[MQTT] Cannot publish - not connected, %u samples kept for later", (unsigned)outbox->pending());
+    }
+}
+
+// A reading goes out when it differs from the last one reported by more
+// than a deadband, or the LED changed, or the heartbeat is due. A sample
+// kept in the outbox counts as reported, so outages store changes only too.
+bool App::worthReporting(const SensorData& sample) {
+    const SensorConfig& sensorConfig = config.sensor;
+    if (sensorConfig.publishHeartbeat == 0 || !hasReported) return true;
+    if (millis() - lastReportTime >= sensorConfig.publishHeartbeat) return true;
+    if (sample.ledOn() != lastReported.ledOn()) return true;
+    
+    int temperatureChange = abs(sample.temperatureCenti - lastReported.temperatureCenti);
+    int humidityChange = abs(sample.humidityPermille - lastReported.humidityPermille);
+    int lightChange = abs(sample.photoresisterValue - lastReported.photoresisterValue);
+    return temperatureChange > sensorConfig.temperatureDeadband * 100 ||
+           humidityChange > sensorConfig.humidityDeadband * 10 ||
+           lightChange > sensorConfig.photoresisterDeadband;
+}
+
+// Sends the readings the history gained since the last batch once there
+// are batchMaxSamples of them or the oldest is batchMaxAge old. Unsent
+// readings stay in the history, so a batch that fails is retried whole,
+// and a backlog after an outage goes out one full batch per check.
+void App::publishBatch() {
+    if (!mqttClient->isConnected()) {
+        return;
+    }
+    
+    size_t limit = mqttClient->batchLimit();
+    size_t count = 0;
+    size_t waiting;
+    {
+        // Decoded into batchSamples so the sensing side isn't held up while we publish
+        std::lock_guard<std::mutex> lock(historyMutex);
+        auto collect = [this, limit, &count](const SensorData& sample) {
+            if (count < limit) batchSamples[count++] = sample;
+        };
+        waiting = batchStarted ? history.forEachSince(batchNextTimestamp, collect) : history.forEach(collect);
+    }
+    if (waiting == 0) {
+        return;
+    }
+    if (waiting < limit && millis() - batchSamples[0].timestamp < config.mqtt.batchMaxAge) {
+        return;
+    }
+    
+    if (mqttClient->publishBatch(batchSamples, count) != ErrorCode::SUCCESS) {
+        return;
+    }
+    batchNextTimestamp = batchSamples[count - 1].timestamp + 1;
+    batchStarted = true;
+    batchesSent++;
+    batchedSamples += count;
+}
+
+void App::keepUnsent(const SensorData& sample) {
+    ErrorCode result = outbox->append(sample);
+    if (result != ErrorCode::SUCCESS) {
+        LOG_ERRORF("[Outbox] Failed to store sample (error: %d), it is lost", (int)result);
     }
 }
 
@@ -356,6 +776,7 @@ void App::onLedStatusChanged(const Event& event) {
     // Show LED status on display
     showingLedStatus = true;
     ledStatusShowTime = millis();
+    sensingScheduler.wake(displayTask);
     LOG_INFOF("LED status changed to: %s", event.boolValue ? "ON" : "OFF");
 }
 
@@ -370,6 +791,7 @@ void App::updateWiFi() {
     static unsigned long lastStatusPrint = 0;
     
     wifiManager->update();
+    wifiScanner.update(wifiManager->isRadioBusy());
     
     // Print WiFi status every 10 seconds for debugging
     if (millis() - lastStatusPrint > 10000) {
@@ -392,6 +814,8 @@ void App::updateWiFi() {
             if (wifiManager->isInAPMode()) {
                 LOG_INFOF("[AP Mode] *** ACCESS POINT ACTIVE *** IP: %s", wifiManager->getLocalIP().c_str());
                 LOG_INFO("[AP Mode] Connect to configure WiFi credentials");
+                // Have networks ready for the configuration page
+                wifiScanner.requestScan();
             } else {
                 LOG_INFOF("[WiFi] *** CONNECTED! *** IP: %s", wifiManager->getLocalIP().c_str());
                 LOG_INFOF("[WiFi] Gateway: %s", WiFi.gatewayIP().toString().c_str());
@@ -416,7 +840,6 @@ void App::updateWiFi() {
 
 void App::updateMQTT() {
     static bool lastMqttConnectedState = false;
-    static unsigned long lastConnectionAttempt = 0;
     static unsigned long lastStatusPrint = 0;
     
     // Only attempt MQTT if WiFi is connected to a network (not in AP mode)
@@ -426,21 +849,14 @@ void App::updateMQTT() {
         // Print MQTT status every 15 seconds for debugging
         if (millis() - lastStatusPrint > 15000) {
             if (!currentMqttState) {
-                LOG_INFOF("[MQTT] Not connected. Broker: %s:%d", config.mqtt.broker, config.mqtt.port);
+                size_t broker = mqttClient->getActiveBroker();
+                LOG_INFOF("[MQTT] Not connected. Broker: %s:%d of %u", config.mqtt.brokerHost(broker),
+                          config.mqtt.brokerPort(broker), (unsigned)config.mqtt.brokerCount());
                 LOG_INFOF("[MQTT] EdgeId: %s, Username: %s", config.mqtt.edgeId, config.mqtt.username);
             }
             lastStatusPrint = millis();
         }
         
-        if (!currentMqttState && millis() - lastConnectionAttempt > 5000) {
-            LOG_INFO("[MQTT] Attempting to connect...");
-            ErrorCode result = mqttClient->connect();
-            if (result != ErrorCode::SUCCESS) {
-                LOG_ERRORF("[MQTT] Connection attempt failed with error: %d", (int)result);
-            }
-            lastConnectionAttempt = millis();
-        }
-        
         if (currentMqttState != lastMqttConnectedState) {
             if (currentMqttState) {
                 LOG_INFO("[MQTT] *** CONNECTED SUCCESSFULLY! ***");
@@ -450,6 +866,7 @@ void App::updateMQTT() {
             lastMqttConnectedState = currentMqttState;
         }
         
+        // Connects in the background, retrying with backoff
         mqttClient->update();
     } else {
         if (lastMqttConnectedState) {
@@ -470,14 +887,13 @@ void App::onLedControlMessage(bool ledOn) {
     if (ledOn) {
         // Turn on when manually controlled (bypasses brightness cycle requirement)
         ledController->turnOn();
-        ledOnTime = millis();
-        ledTimerActive = true;
-        eventBus.publish(Event(EventType::LED_STATUS_CHANGED, true));
+        armLedTimer();
+        eventBus.post(Event(EventType::LED_STATUS_CHANGED, true));
         LOG_INFOF("Manual LED ON from Home Assistant, Timer set for %lu ms", config.sensor.nightLightDuration);
     } else {
         ledController->turnOff();
         ledTimerActive = false;
-        eventBus.publish(Event(EventType::LED_STATUS_CHANGED, false));
+        eventBus.post(Event(EventType::LED_STATUS_CHANGED, false));
         // When manually turned off, go back to automatic mode
         this->manualLedControl = false;
         LOG_INFO("*** Returning to automatic light sensor control ***");
@@ -504,9 +920,14 @@ void App::setupWebServer() {
         handleWiFiConfig(request);
     });
     
-    // WiFi scan endpoint
+    // Loop stage latency (Prometheus text format)
+    webServer->on("/metrics", HTTP_GET, [this](AsyncWebServerRequest *request){
+        request->send(200, "text/plain; version=0.0.4", getMetricsText());
+    });
+    
+    // WiFi scan endpoint: the last background scan, never a scan in the handler
     webServer->on("/scan", HTTP_GET, [this](AsyncWebServerRequest *request){
-        request->send(200, "application/json", scanWiFiNetworks());
+        serveWiFiScan(request);
     });
     
     LOG_INFO("Web server configured (will start when WiFi connects)");
@@ -559,8 +980,19 @@ String App::getStatusHTML() {
         html += "<strong>Status:</strong> ✅ Connected to WiFi<br>";
         html += "<strong>SSID:</strong> " + WiFi.SSID() + "<br>";
         html += "<strong>IP Address:</strong> " + wifiManager->getLocalIP() + "<br>";
-        html += "<strong>Signal Strength:</strong> " + String(WiFi.RSSI()) + " dBm<br>";
-        html += "<strong>Gateway:</strong> " + WiFi.gatewayIP().toString();
+        WiFiManager::LinkStats linkStats = wifiManager->getLinkStats();
+        html += "<strong>Signal Strength:</strong> " + String(WiFi.RSSI()) + " dBm (average " +
+                String((int)linkStats.rssiAverage) + ", weakest " + String(linkStats.rssiMin) + ")<br>";
+        html += "<strong>Access Point:</strong> " + WiFi.BSSIDstr() + " on channel " + String(WiFi.channel()) + "<br>";
+        html += "<strong>Gateway:</strong> " + WiFi.gatewayIP().toString() + "<br>";
+        const WiFiManager::ConnectStats& wifiStats = wifiManager->getConnectStats();
+        html += "<strong>Connected In:</strong> " + String(wifiStats.lastConnectMs) + " ms (" +
+                (wifiStats.lastCached ? "cached access point" : "full scan") + ")<br>";
+        html += "<strong>Reconnects:</strong> " + String(linkStats.reconnects) + ", roams " + String(linkStats.roams);
+        if (linkStats.reconnects > 0) {
+            html += String(" (last lost: reason ") + String((unsigned)linkStats.lastDisconnectReason) + ", " +
+                    WiFiManager::causeName(WiFiManager::causeOf(linkStats.lastDisconnectReason)) + ")";
+        }
     } else if (wifiManager->isConnecting()) {
         html += "<div class='status warning'>";
         html += "<strong>Status:</strong> ⏳ Connecting to WiFi...<br>";
@@ -582,7 +1014,9 @@ String App::getStatusHTML() {
     } else if (mqttClient->isConnected()) {
         html += "<div class='status success'>";
         html += "<strong>Status:</strong> ✅ Connected<br>";
-        html += "<strong>Broker:</strong> " + String(config.mqtt.broker) + ":" + String(config.mqtt.port) + "<br>";
+        size_t broker = mqttClient->getActiveBroker();
+        html += "<strong>Broker:</strong> " + String(config.mqtt.brokerHost(broker)) + ":" +
+                String(config.mqtt.brokerPort(broker)) + (broker > 0 ? " (fallback)" : "") + "<br>";
         html += "<strong>Client ID:</strong> " + String(config.mqtt.edgeId) + "<br>";
         html += "<strong>Username:</strong> " + String(config.mqtt.username);
     } else {
@@ -596,25 +1030,59 @@ String App::getStatusHTML() {
     
     // Sensor Data
     html += "<h2>🌡️ Sensor Data</h2>";
-    auto sensorResult = sensor->read();
-    if (sensorResult.isSuccess()) {
-        SensorData data = sensorResult.value;
+    // Served from the networking side's copy; handlers run outside both loops
+    SensorData data;
+    bool haveData;
+    {
+        std::lock_guard<std::mutex> lock(sampleMutex);
+        data = latestSample;
+        haveData = hasSample;
+    }
+    if (haveData) {
         html += "<div class='status success'>";
-        html += "<strong>Temperature:</strong> " + String(data.temperture, 1) + "°C<br>";
-        html += "<strong>Humidity:</strong> " + String(data.humidity, 1) + "%<br>";
+        html += "<strong>Temperature:</strong> " + String(data.temperature(), 1) + "°C<br>";
+        html += "<strong>Humidity:</strong> " + String(data.humidity(), 1) + "%<br>";
         html += "<strong>Light Level:</strong> " + String(data.photoresisterValue) + "<br>";
-        html += "<strong>LED State:</strong> " + (data.ledOn ? String("🟢 ON") : String("🔴 OFF")) + "<br>";
+        html += "<strong>LED State:</strong> " + (data.ledOn() ? String("🟢 ON") : String("🔴 OFF")) + "<br>";
         html += "<strong>Manual Control:</strong> " + (manualLedControl ? String("✋ Active") : String("🤖 Auto"));
     } else {
         html += "<div class='status error'>";
-        html += "<strong>Status:</strong> ❌ Sensor Read Failed";
+        html += "<strong>Status:</strong> ⏳ Waiting for first reading";
     }
     html += "</div>";
     
+    // Sample History
+    size_t historySize;
+    size_t historyCapacity;
+    size_t historyFootprint;
+    uint32_t historySpan;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        historySize = history.size();
+        historyCapacity = history.getCapacity();
+        historyFootprint = history.getFootprint();
+        historySpan = history.span();
+    }
+    html += "<div class='status info'>";
+    html += "<strong>History:</strong> " + String((unsigned long)historySize) + " / " +
+            String((unsigned long)historyCapacity) + " samples, " + String(historySpan / 60000) + " minutes<br>";
+    html += "<strong>History Memory:</strong> " + String((unsigned long)historyFootprint) + " bytes, compressed<br>";
+    const Outbox::Stats& outboxStats = outbox->getStats();
+    html += "<strong>Unsent (flash):</strong> " + String((unsigned long)outbox->pending()) + " / " +
+            String((unsigned long)outbox->getCapacity()) + " samples, " + String(outboxStats.sent) + " sent late, " +
+            String(outboxStats.evicted) + " evicted";
+    html += "</div>";
+    
     // MQTT Topics
     html += "<h2>📋 MQTT Topics</h2>";
     html += "<div class='status info'>";
-    html += "<strong>Data Topic:</strong> Advantech/" + String(config.mqtt.edgeId) + "/data<br>";
+    html += "<strong>Data Topic:</strong> Advantech/" + String(config.mqtt.edgeId) + "/data (" +
+            (config.mqtt.payloadFormat == PayloadFormat::CBOR ? "CBOR" : "JSON") + ", " + String(reportsSent) +
+            " sent, " + String(reportsSuppressed) + " unchanged)<br>";
+    if (mqttClient->batchLimit() > 0) {
+        html += "<strong>Batch Topic:</strong> Advantech/" + String(config.mqtt.edgeId) + "/batch (" +
+                String(batchesSent) + " sent)<br>";
+    }
     html += "<strong>LED Control:</strong> Advantech/" + String(config.mqtt.edgeId) + "/led<br>";
     html += "<strong>Discovery:</strong> homeassistant/sensor/" + String(config.mqtt.edgeId) + "/*/config";
     html += "</div>";
@@ -700,13 +1168,18 @@ String App::getWiFiConfigHTML() {
                 .then(response => response.json())
                 .then(data => {
                     const select = document.getElementById('ssid');
-                    select.innerHTML = '<option value="">Select a network</option>';
+                    select.innerHTML = '<option value="">' + (data.age === null ? 'Scanning...' :
+                        'Select a network (scanned ' + data.age + ' s ago)') + '</option>';
                     data.networks.forEach(network => {
                         const option = document.createElement('option');
                         option.value = network.ssid;
                         option.textContent = network.ssid + ' (' + network.rssi + ' dBm)';
                         select.appendChild(option);
                     });
+                    // These are the last scan's; ask again once the one running is done
+                    if (data.scanning) {
+                        setTimeout(scanNetworks, 3000);
+                    }
                 })
                 .catch(err => console.error('Scan failed:', err));
         }
@@ -731,25 +1204,282 @@ String App::getWiFiConfigHTML() {
     return html;
 }
 
-String App::scanWiFiNetworks() {
-    String json = "{\"networks\":[";
+// Streamed from a copy of the results, so a scan finishing while the
+// response goes out can't change it halfway
+void App::serveWiFiScan(AsyncWebServerRequest* request) {
+    std::shared_ptr<WiFiScanner::Snapshot> scan = std::make_shared<WiFiScanner::Snapshot>();
+    wifiScanner.snapshot(*scan);
+    request->send(request->beginChunkedResponse("application/json",
+                                                [scan](uint8_t* buffer, size_t maxLength, size_t index) {
+        return scan->render(buffer, maxLength, index);
+    }));
+}
+
+void App::forEachLatency(const LatencyVisitor& visitor) {
+    for (int id = 0; id < sensingScheduler.getTaskCount(); id++) {
+        visitor("sensing", sensingScheduler.getTaskName(id), *sensingScheduler.getLatency(id));
+    }
+    for (int id = 0; id < networkScheduler.getTaskCount(); id++) {
+        visitor("network", networkScheduler.getTaskName(id), *networkScheduler.getLatency(id));
+    }
+    eventBus.forEachLatency([](void* context, EventType type, const LatencyHistogram& latency) {
+        (*static_cast<const LatencyVisitor*>(context))("event", eventTypeName(type), latency);
+    }, const_cast<LatencyVisitor*>(&visitor));
+}
+
+String App::getMetricsText() {
+    String text = "# HELP loop_stage_latency_us Time spent per run of a main loop stage or event dispatch\n";
+    text += "# TYPE loop_stage_latency_us summary\n";
+    String maxText = "# HELP loop_stage_latency_max_us Slowest run seen since boot\n";
+    maxText += "# TYPE loop_stage_latency_max_us gauge\n";
     
-    int n = WiFi.scanNetworks();
-    for (int i = 0; i < n; i++) {
-        if (i > 0) json += ",";
-        json += "{";
-        json += "\"ssid\":\"" + WiFi.SSID(i) + "\",";
-        json += "\"rssi\":" + String(WiFi.RSSI(i)) + ",";
-        json += "\"encryption\":" + String(WiFi.encryptionType(i));
-        json += "}";
+    forEachLatency([&text, &maxText](const char* group, const char* stage, const LatencyHistogram& latency) {
+        String labels = String("group=\"") + group + "\",stage=\"" + stage + "\"";
+        text += "loop_stage_latency_us{" + labels + ",quantile=\"0.5\"} " + String(latency.percentile(50)) + "\n";
+        text += "loop_stage_latency_us{" + labels + ",quantile=\"0.99\"} " + String(latency.percentile(99)) + "\n";
+        text += "loop_stage_latency_us_sum{" + labels + "} " + String((double)latency.getTotal(), 0) + "\n";
+        text += "loop_stage_latency_us_count{" + labels + "} " + String(latency.getCount()) + "\n";
+        maxText += "loop_stage_latency_max_us{" + labels + "} " + String(latency.getMax()) + "\n";
+    });
+    
+    auto queueStats = eventBus.getQueueStats();
+    String queueText = "# HELP event_queue_posted_total Events posted for deferred dispatch\n";
+    queueText += "# TYPE event_queue_posted_total counter\n";
+    queueText += "event_queue_posted_total " + String(queueStats.posted) + "\n";
+    queueText += "# HELP event_queue_coalesced_total Posts merged into an event that was already pending\n";
+    queueText += "# TYPE event_queue_coalesced_total counter\n";
+    queueText += "event_queue_coalesced_total " + String(queueStats.coalesced) + "\n";
+    queueText += "# HELP event_queue_overflow_total Posts dropped because the queue was full\n";
+    queueText += "# TYPE event_queue_overflow_total counter\n";
+    queueText += "event_queue_overflow_total " + String(queueStats.overflowed) + "\n";
+    queueText += "# HELP event_queue_high_water Most events pending at once\n";
+    queueText += "# TYPE event_queue_high_water gauge\n";
+    queueText += "event_queue_high_water " + String(queueStats.highWater) + "\n";
+    
+    size_t historySize;
+    size_t historyCapacity;
+    size_t historyFootprint;
+    uint32_t historySpan;
+    {
+        std::lock_guard<std::mutex> lock(historyMutex);
+        historySize = history.size();
+        historyCapacity = history.getCapacity();
+        historyFootprint = history.getFootprint();
+        historySpan = history.span();
+    }
+    String historyText = "# HELP sensor_history_samples Readings held in the in-RAM history\n";
+    historyText += "# TYPE sensor_history_samples gauge\n";
+    historyText += "sensor_history_samples " + String((unsigned long)historySize) + "\n";
+    historyText += "# HELP sensor_history_capacity Readings the history can hold before overwriting, at the compression so far\n";
+    historyText += "# TYPE sensor_history_capacity gauge\n";
+    historyText += "sensor_history_capacity " + String((unsigned long)historyCapacity) + "\n";
+    historyText += "# HELP sensor_history_bytes RAM allocated to the compressed history\n";
+    historyText += "# TYPE sensor_history_bytes gauge\n";
+    historyText += "sensor_history_bytes " + String((unsigned long)historyFootprint) + "\n";
+    historyText += "# HELP sensor_history_span_seconds Time between the oldest and newest held reading\n";
+    historyText += "# TYPE sensor_history_span_seconds gauge\n";
+    historyText += "sensor_history_span_seconds " + String(historySpan / 1000) + "\n";
+    historyText += "# HELP data_reports_sent_total Readings published on <edgeId>/data, or kept for later\n";
+    historyText += "# TYPE data_reports_sent_total counter\n";
+    historyText += "data_reports_sent_total " + String(reportsSent) + "\n";
+    historyText += "# HELP data_reports_suppressed_total Readings not published as nothing moved past a deadband\n";
+    historyText += "# TYPE data_reports_suppressed_total counter\n";
+    historyText += "data_reports_suppressed_total " + String(reportsSuppressed) + "\n";
+    historyText += "# HELP batch_published_total Batch publishes on <edgeId>/batch\n";
+    historyText += "# TYPE batch_published_total counter\n";
+    historyText += "batch_published_total " + String(batchesSent) + "\n";
+    historyText += "# HELP batch_samples_total Readings sent in batches\n";
+    historyText += "# TYPE batch_samples_total counter\n";
+    historyText += "batch_samples_total " + String(batchedSamples) + "\n";
+    
+    const Outbox::Stats& outboxStats = outbox->getStats();
+    String outboxText = "# HELP outbox_pending Samples in flash waiting for the broker\n";
+    outboxText += "# TYPE outbox_pending gauge\n";
+    outboxText += "outbox_pending " + String((unsigned long)outbox->pending()) + "\n";
+    outboxText += "# HELP outbox_appended_total Samples stored because they could not be published\n";
+    outboxText += "# TYPE outbox_appended_total counter\n";
+    outboxText += "outbox_appended_total " + String(outboxStats.appended) + "\n";
+    outboxText += "# HELP outbox_sent_total Stored samples published after reconnecting\n";
+    outboxText += "# TYPE outbox_sent_total counter\n";
+    outboxText += "outbox_sent_total " + String(outboxStats.sent) + "\n";
+    outboxText += "# HELP outbox_evicted_total Unsent samples dropped because the outbox was full\n";
+    outboxText += "# TYPE outbox_evicted_total counter\n";
+    outboxText += "outbox_evicted_total " + String(outboxStats.evicted) + "\n";
+    outboxText += "# HELP outbox_corrupt_total Stored samples that failed their CRC check\n";
+    outboxText += "# TYPE outbox_corrupt_total counter\n";
+    outboxText += "outbox_corrupt_total " + String(outboxStats.corrupt) + "\n";
+    
+    const WiFiManager::ConnectStats& wifiStats = wifiManager->getConnectStats();
+    String wifiText = "# HELP wifi_connects_total Connections made, straight to the cached access point or after a scan\n";
+    wifiText += "# TYPE wifi_connects_total counter\n";
+    wifiText += "wifi_connects_total{path=\"cached\"} " + String(wifiStats.cachedConnects) + "\n";
+    wifiText += "wifi_connects_total{path=\"scan\"} " + String(wifiStats.scanConnects) + "\n";
+    wifiText += "# HELP wifi_cached_connect_misses_total Cached access point not found, so a scan followed\n";
+    wifiText += "# TYPE wifi_cached_connect_misses_total counter\n";
+    wifiText += "wifi_cached_connect_misses_total " + String(wifiStats.cachedMisses) + "\n";
+    wifiText += "# HELP wifi_connect_failures_total Scans that found no access point or timed out\n";
+    wifiText += "# TYPE wifi_connect_failures_total counter\n";
+    wifiText += "wifi_connect_failures_total " + String(wifiStats.failures) + "\n";
+    wifiText += "# HELP wifi_connect_ms Time from starting to connect until connected, the last time\n";
+    wifiText += "# TYPE wifi_connect_ms gauge\n";
+    wifiText += "wifi_connect_ms " + String(wifiStats.lastConnectMs) + "\n";
+    WiFiManager::LinkStats linkStats = wifiManager->getLinkStats();
+    wifiText += "# HELP wifi_rssi_dbm Signal strength, last sample and moving average on the current access point\n";
+    wifiText += "# TYPE wifi_rssi_dbm gauge\n";
+    wifiText += "wifi_rssi_dbm{stat=\"last\"} " + String(linkStats.rssi) + "\n";
+    wifiText += "wifi_rssi_dbm{stat=\"average\"} " + String(linkStats.rssiAverage, 1) + "\n";
+    wifiText += "wifi_rssi_dbm{stat=\"min\"} " + String(linkStats.rssiMin) + "\n";
+    wifiText += "# HELP wifi_reconnects_total Connections made again after the link was lost\n";
+    wifiText += "# TYPE wifi_reconnects_total counter\n";
+    wifiText += "wifi_reconnects_total " + String(linkStats.reconnects) + "\n";
+    wifiText += "# HELP wifi_disconnects_total Links lost, by cause\n";
+    wifiText += "# TYPE wifi_disconnects_total counter\n";
+    for (size_t i = 0; i < WiFiManager::DISCONNECT_CAUSES; i++) {
+        wifiText += String("wifi_disconnects_total{cause=\"") + WiFiManager::causeName((DisconnectCause)i) + "\"} " +
+                    String(linkStats.disconnects[i]) + "\n";
     }
+    wifiText += "# HELP wifi_state_seconds_total Time spent in each connection state\n";
+    wifiText += "# TYPE wifi_state_seconds_total counter\n";
+    for (size_t i = 0; i < WiFiManager::WIFI_STATES; i++) {
+        wifiText += String("wifi_state_seconds_total{state=\"") + WiFiManager::stateName((WiFiState)i) + "\"} " +
+                    String((unsigned long)(linkStats.stateMs[i] / 1000)) + "\n";
+    }
+    wifiText += "# HELP wifi_roams_total Moves to a stronger access point of the same network\n";
+    wifiText += "# TYPE wifi_roams_total counter\n";
+    wifiText += "wifi_roams_total " + String(linkStats.roams) + "\n";
+    wifiText += "# HELP wifi_roam_scans_total Scans for a stronger access point after a weak-signal window\n";
+    wifiText += "# TYPE wifi_roam_scans_total counter\n";
+    wifiText += "wifi_roam_scans_total " + String(linkStats.roamScans) + "\n";
+    WiFiScanner::Stats scanStats = wifiScanner.getStats();
+    wifiText += "# HELP wifi_scans_total Background network scans completed for /scan\n";
+    wifiText += "# TYPE wifi_scans_total counter\n";
+    wifiText += "wifi_scans_total " + String(scanStats.completed) + "\n";
+    wifiText += "# HELP wifi_scan_failures_total Background scans that failed or timed out\n";
+    wifiText += "# TYPE wifi_scan_failures_total counter\n";
+    wifiText += "wifi_scan_failures_total " + String(scanStats.failed) + "\n";
+    wifiText += "# HELP wifi_scan_requests_total /scan requests, served from the last scan\n";
+    wifiText += "# TYPE wifi_scan_requests_total counter\n";
+    wifiText += "wifi_scan_requests_total " + String(scanStats.served) + "\n";
+    
+    String mqttText = "# HELP mqtt_connect_attempts_total Broker connects started since boot\n";
+    mqttText += "# TYPE mqtt_connect_attempts_total counter\n";
+    mqttText += "mqtt_connect_attempts_total " + String(mqttClient->getConnectAttempts()) + "\n";
+    mqttText += "# HELP mqtt_reconnect_delay_ms Time until the next connect attempt\n";
+    mqttText += "# TYPE mqtt_reconnect_delay_ms gauge\n";
+    mqttText += "mqtt_reconnect_delay_ms " + String(mqttClient->getReconnectDelay()) + "\n";
+    mqttText += "# HELP mqtt_broker_active Broker in use: 0 is the configured one, 1+ its fallbacks in order\n";
+    mqttText += "# TYPE mqtt_broker_active gauge\n";
+    mqttText += "mqtt_broker_active " + String((unsigned long)mqttClient->getActiveBroker()) + "\n";
+    mqttText += "# HELP mqtt_broker_switches_total Connections made to a different broker than the last\n";
+    mqttText += "# TYPE mqtt_broker_switches_total counter\n";
+    mqttText += "mqtt_broker_switches_total " + String(mqttClient->getBrokerSwitches()) + "\n";
+    mqttText += "# HELP mqtt_broker_failbacks_total Switches back once the configured broker was reachable again\n";
+    mqttText += "# TYPE mqtt_broker_failbacks_total counter\n";
+    mqttText += "mqtt_broker_failbacks_total " + String(mqttClient->getFailbacks()) + "\n";
+    String failuresText = "# HELP mqtt_broker_connect_failures_total Failed connects per broker\n";
+    failuresText += "# TYPE mqtt_broker_connect_failures_total counter\n";
+    String latencyText = "# HELP mqtt_broker_connect_ms Smoothed time to connect per broker\n";
+    latencyText += "# TYPE mqtt_broker_connect_ms gauge\n";
+    for (size_t i = 0; i < config.mqtt.brokerCount(); i++) {
+        const MQTTClient::BrokerHealth& health = mqttClient->getBrokerHealth(i);
+        String label = "{broker=\"" + String(config.mqtt.brokerHost(i)) + ":" + String(config.mqtt.brokerPort(i)) + "\"} ";
+        failuresText += "mqtt_broker_connect_failures_total" + label + String(health.failures) + "\n";
+        latencyText += "mqtt_broker_connect_ms" + label + String(health.connectMs) + "\n";
+    }
+    mqttText += failuresText + latencyText;
+    if (mqttClient->usesTls()) {
+        const TlsClient::Stats& tls = mqttClient->getTlsStats();
+        mqttText += "# HELP mqtt_tls_handshakes_total Completed TLS handshakes, by whether the session was resumed\n";
+        mqttText += "# TYPE mqtt_tls_handshakes_total counter\n";
+        mqttText += "mqtt_tls_handshakes_total{resumed=\"false\"} " + String(tls.fullHandshakes) + "\n";
+        mqttText += "mqtt_tls_handshakes_total{resumed=\"true\"} " + String(tls.resumedHandshakes) + "\n";
+        mqttText += "# HELP mqtt_tls_handshake_failures_total TLS handshakes that failed or timed out\n";
+        mqttText += "# TYPE mqtt_tls_handshake_failures_total counter\n";
+        mqttText += "mqtt_tls_handshake_failures_total " + String(tls.failedHandshakes) + "\n";
+        mqttText += "# HELP mqtt_tls_handshake_ms Duration of the last TLS handshake\n";
+        mqttText += "# TYPE mqtt_tls_handshake_ms gauge\n";
+        mqttText += "mqtt_tls_handshake_ms " + String(tls.lastHandshakeMs) + "\n";
+        mqttText += "# HELP mqtt_tls_handshake_heap_bytes Peak heap taken by the last TLS handshake\n";
+        mqttText += "# TYPE mqtt_tls_handshake_heap_bytes gauge\n";
+        mqttText += "mqtt_tls_handshake_heap_bytes " + String((unsigned long)tls.lastHandshakeHeap) + "\n";
+        mqttText += "# HELP mqtt_tls_handshake_heap_max_bytes Peak heap taken by any TLS handshake since boot\n";
+        mqttText += "# TYPE mqtt_tls_handshake_heap_max_bytes gauge\n";
+        mqttText += "mqtt_tls_handshake_heap_max_bytes " + String((unsigned long)tls.maxHandshakeHeap) + "\n";
+        mqttText += "# HELP mqtt_connect_stack_free_bytes Least free stack the connect task has had\n";
+        mqttText += "# TYPE mqtt_connect_stack_free_bytes gauge\n";
+        mqttText += "mqtt_connect_stack_free_bytes " + String((unsigned long)mqttClient->getConnectStackHeadroom()) +
+                    "\n";
+    }
+    mqttText += "# HELP mqtt_commands_total Inbound messages handled by a command route\n";
+    mqttText += "# TYPE mqtt_commands_total counter\n";
+    mqttText += "mqtt_commands_total " + String(mqttClient->getCommandsReceived()) + "\n";
+    mqttText += "# HELP mqtt_commands_unrouted_total Inbound messages no route matched\n";
+    mqttText += "# TYPE mqtt_commands_unrouted_total counter\n";
+    mqttText += "mqtt_commands_unrouted_total " + String(mqttClient->getCommandsUnrouted()) + "\n";
+    mqttText += "# HELP config_patches_total Config topic patches applied\n";
+    mqttText += "# TYPE config_patches_total counter\n";
+    mqttText += "config_patches_total " + String(configPatches) + "\n";
+    mqttText += "# HELP config_patches_rejected_total Config topic patches that failed validation\n";
+    mqttText += "# TYPE config_patches_rejected_total counter\n";
+    mqttText += "config_patches_rejected_total " + String(configPatchesRejected) + "\n";
+    mqttText += "# HELP config_writes_total Times a patch was saved to /config.json\n";
+    mqttText += "# TYPE config_writes_total counter\n";
+    mqttText += "config_writes_total " + String(configWrites) + "\n";
+    
+    return text + maxText + queueText + historyText + outboxText + wifiText + mqttText;
+}
+
+// {"uptime":s,"sensing":{"sensor":[count,p50,p99,max],...},"network":{...},"event":{...},
+//  "queue":[posted,coalesced,overflowed,highWater],"outbox":[pending,sent,evicted,corrupt],
+//  "reports":[sent,suppressed],"broker":[active,switches,failbacks],
+//  "tls":[full,resumed,failed,lastMs,lastHeap] (with mqtt.tls)}
+String App::getDiagnosticsJson() {
+    String json = "{\"uptime\":" + String(millis() / 1000);
+    String currentGroup;
     
-    json += "]}";
-    WiFi.scanDelete(); // Free memory
+    forEachLatency([&json, &currentGroup](const char* group, const char* stage, const LatencyHistogram& latency) {
+        if (currentGroup != group) {
+            json += currentGroup.length() > 0 ? "}," : ",";
+            json += String("\"") + group + "\":{";
+            currentGroup = group;
+        } else {
+            json += ",";
+        }
+        json += String("\"") + stage + "\":[" + String(latency.getCount()) + "," + String(latency.percentile(50)) +
+                "," + String(latency.percentile(99)) + "," + String(latency.getMax()) + "]";
+    });
+    
+    if (currentGroup.length() > 0) {
+        json += "}";
+    }
     
+    auto queueStats = eventBus.getQueueStats();
+    json += ",\"queue\":[" + String(queueStats.posted) + "," + String(queueStats.coalesced) + "," +
+            String(queueStats.overflowed) + "," + String(queueStats.highWater) + "]";
+    const Outbox::Stats& outboxStats = outbox->getStats();
+    json += ",\"outbox\":[" + String((unsigned long)outbox->pending()) + "," + String(outboxStats.sent) + "," +
+            String(outboxStats.evicted) + "," + String(outboxStats.corrupt) + "]";
+    json += ",\"reports\":[" + String(reportsSent) + "," + String(reportsSuppressed) + "]";
+    json += ",\"broker\":[" + String((unsigned long)mqttClient->getActiveBroker()) + "," +
+            String(mqttClient->getBrokerSwitches()) + "," + String(mqttClient->getFailbacks()) + "]";
+    if (mqttClient->usesTls()) {
+        const TlsClient::Stats& tls = mqttClient->getTlsStats();
+        json += ",\"tls\":[" + String(tls.fullHandshakes) + "," + String(tls.resumedHandshakes) + "," +
+                String(tls.failedHandshakes) + "," + String(tls.lastHandshakeMs) + "," +
+                String((unsigned long)tls.lastHandshakeHeap) + "," +
+                String((unsigned long)mqttClient->getConnectStackHeadroom()) + "]";
+    }
+    json += "}";
     return json;
 }
 
+void App::publishDiagnostics() {
+    if (!mqttClient->isConnected()) {
+        return;
+    }
+    mqttClient->publishDiagnostics(getDiagnosticsJson());
+}
+
 void App::handleWiFiConfig(AsyncWebServerRequest *request) {
     String ssid = "";
     String password = "";
@@ -772,8 +1502,8 @@ void App::handleWiFiConfig(AsyncWebServerRequest *request) {
         config.wifi.ssid[sizeof(config.wifi.ssid) - 1] = '\0';
         config.wifi.password[sizeof(config.wifi.password) - 1] = '\0';
         
-        // Save to file
-        ErrorCode saveResult = config.saveToFile(CONFIG_FILE);
+        // Save to file, with the sensor settings as last saved
+        ErrorCode saveResult = saveConfig(savedSensor);
         
         if (saveResult == ErrorCode::SUCCESS) {
             LOG_INFOF("[WiFi Config] New credentials saved successfully - SSID: %s", ssid.c_str());
@@ -2,84 +2,219 @@
 #define CORE_APP_H
 
 #include <memory>
+#include <mutex>
 #include <SPIFFS.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include "interfaces.h"
-#include "event_bus.h"
+#include "static_event_bus.h"
 #include "config.h"
 #include "logger.h"
+#include "payload_writer.h"
+#include "outbox.h"
+#include "sample_history.h"
+#include "scheduler.h"
+#include "spsc_queue.h"
 #include "../hardware/dht_sensor.h"
 #include "../hardware/oled_display.h"
 #include "../hardware/led_controller.h"
 #include "../hardware/wifi_manager.h"
+#include "../hardware/wifi_scanner.h"
 #include "../hardware/mqtt_client.h"
 #include <ESPAsyncWebServer.h>
 
+// Build with -DAPP_DUAL_CORE=1 to make run() split the app across both cores
+#ifndef APP_DUAL_CORE
+#define APP_DUAL_CORE 0
+#endif
+
+// Work is split into a sensing side (sensor, display, LED) and a networking
+// side (WiFi, MQTT, web server). The two sides only exchange SensorData
+// samples and commands received over MQTT through SPSC queues, so they can run in one loop
+// or as separate FreeRTOS tasks without sharing any other state.
 class App {
 public:
     App();
     ~App();
     
+    // Optional: supply sensor/display/LED implementations before initialize()
+    // instead of the DHT/SSD1306/GPIO ones (used by the host simulator).
+    void useHardware(std::unique_ptr<ISensorReader> sensorReader,
+                     std::unique_ptr<IDisplayDriver> displayDriver,
+                     std::unique_ptr<ILedController> led);
+    
     ErrorCode initialize();
     void run();
     
+    // Sensing keeps running in the calling task (the Arduino loop task on
+    // core 1); networking moves to its own task pinned to core 0, so a
+    // blocking connect or scan cannot delay sampling. Never returns.
+    void runDualCore();
+    
+    // Single-loop building blocks; run() is start() followed by
+    // idle(runOnce()) forever. Exposed so host builds can drive and time
+    // individual iterations.
+    void start();
+    unsigned long runOnce();  // Runs due tasks, returns ms until the next one
+    void idle(unsigned long ms);  // Sleeps that long, or less if MQTT traffic arrives
+    
 private:
     // Core components
-    EventBus eventBus;
+    static const size_t EVENT_HANDLERS_PER_TYPE = 4;
+    static const size_t EVENT_QUEUE_CAPACITY = 16;
+    static const size_t EVENT_BATCH_SIZE = 8;  // Events dispatched per sensing pass
+    StaticEventBus<EVENT_HANDLERS_PER_TYPE, EVENT_QUEUE_CAPACITY> eventBus;
     Config config;
+    Scheduler sensingScheduler;
+    Scheduler networkScheduler;
+    
+    // Commands from MQTT that change sensing-side state
+    struct SensingCommand {
+        enum Type : uint8_t { LED, READ_INTERVAL, LIGHT_THRESHOLD, NIGHT_LIGHT_DURATION };
+        Type type;
+        uint32_t value;
+    };
+    
+    // Cross-side traffic: samples flow to networking, commands to sensing
+    SpscQueue<SensorData, 8> sampleQueue;
+    SpscQueue<SensingCommand, 8> commandQueue;
+    TaskHandle_t sensingTaskHandle;  // Null unless running dual-core
+    TaskHandle_t networkTaskHandle;
     
     // Hardware components
     std::unique_ptr<ISensorReader> sensor;
     std::unique_ptr<IDisplayDriver> display;
     std::unique_ptr<ILedController> ledController;
     std::unique_ptr<WiFiManager> wifiManager;
+    WiFiScanner wifiScanner;  // Networks for /scan, scanned in the background
     std::unique_ptr<MQTTClient> mqttClient;
+    std::unique_ptr<Outbox> outbox;  // Samples awaiting a broker; drained by mqttClient
     std::unique_ptr<AsyncWebServer> webServer;
     
     // State tracking
     bool initialized;
-    unsigned long lastSensorRead;
-    unsigned long lastDisplayUpdate;
-    unsigned long lastMqttPublish;
     unsigned long ledOnTime;
     bool ledTimerActive;
     bool showingLedStatus;
     unsigned long ledStatusShowTime;
     bool manualLedControl;
     bool roomWasBright;  // Track if room was bright since last LED activation
+    SensorData lastReading;  // Sensing side: what the display shows
+    bool hasReading;
+    SensorData latestSample;  // Networking side: newest sample to publish/serve
+    bool hasSample;
+    std::mutex sampleMutex;   // latestSample is also read by web server handlers
+    SampleHistory history;    // Every fresh reading, appended by the sensing side
+    std::mutex historyMutex;  // Held for each append and while a reader decodes
+    
+    // Report-by-exception on the networking side: what /data last carried
+    SensorData lastReported;
+    bool hasReported;
+    unsigned long lastReportTime;
+    unsigned long reportsSent;        // Published, or kept in the outbox for later
+    unsigned long reportsSuppressed;  // Within every deadband and the heartbeat
+    bool reportRequested;             // cmd/publish: send the next reading regardless
+    
+    // Networking side: the live-changeable settings as /config.json holds
+    // them, so a config patch is only written to flash if it changes one
+    SensorConfig savedSensor;
+    unsigned long configPatches;
+    unsigned long configPatchesRejected;
+    unsigned long configWrites;
+    
+    // Scheduled loop tasks
+    Scheduler::TaskId sensorTask;
+    Scheduler::TaskId displayTask;
+    Scheduler::TaskId ledTimerTask;
+    Scheduler::TaskId wifiTask;
+    Scheduler::TaskId mqttTask;
+    Scheduler::TaskId publishTask;
+    Scheduler::TaskId heartbeatTask;
+    Scheduler::TaskId diagnosticsTask;
+    Scheduler::TaskId batchTask;
+    
+    // Batched uploads, read from the history on the networking side
+    SensorData batchSamples[MQTTClient::MAX_BATCH_SAMPLES];
+    uint32_t batchNextTimestamp;  // Readings from here on are not batched yet
+    bool batchStarted;
+    unsigned long batchesSent;
+    unsigned long batchedSamples;
     
     // Configuration
     static const char* CONFIG_FILE;
+    static const char* OUTBOX_DIRECTORY;
+    static const char* DISCOVERY_HASH_FILE;
+    static const char* MQTT_CA_FILE;
     static const unsigned long LED_STATUS_DISPLAY_DURATION = 1000;
+    static const unsigned long WIFI_POLL_INTERVAL = 500;
+    static const unsigned long MQTT_POLL_INTERVAL = 1000;      // Inbound traffic wakes it sooner
+    static const unsigned long DISPLAY_REFRESH_INTERVAL = 1000; // Countdown tick; LED status changes wake it sooner
+    static const unsigned long LED_TIMER_CHECK_INTERVAL = 2000; // Expiry itself is scheduled exactly
+    static const unsigned long HEARTBEAT_INTERVAL = 60000;
+    static const unsigned long BATCH_CHECK_INTERVAL = 1000;
+    static const uint32_t NETWORK_TASK_STACK_SIZE = 8192;
+    static const int NETWORK_CORE = 0;
     
     // Initialization methods
     ErrorCode initializeFileSystem();
+    ErrorCode initializeHistory();
     ErrorCode initializeHardware();
     ErrorCode setupEventHandlers();
+    ErrorCode setupTasks();
     
     // Event handlers
     void onSensorDataUpdated(const Event& event);
     void onLedStatusChanged(const Event& event);
     void onErrorOccurred(const Event& event);
     
+    // MQTT command handlers, on the networking side (see setupCommands())
+    ErrorCode setupCommands();
+    void onLedCommand(const MqttMessage& message);
+    void onIntervalCommand(const MqttMessage& message);
+    void onThresholdCommand(const MqttMessage& message);
+    void onPublishCommand(const MqttMessage& message);
+    void onRebootCommand(const MqttMessage& message);
+    void onConfigPatch(const MqttMessage& message);
+    ErrorCode saveConfig(const SensorConfig& sensor);
+    void publishConfigStatus(const SensorConfig& applied, unsigned changed, bool persisted);
+    void publishConfigError(const char* error);
+    void sendToSensing(SensingCommand::Type type, uint32_t value);
+    
+    // Per-side loop passes; each returns ms until that side is next due
+    unsigned long runSensing();
+    unsigned long runNetwork();
+    static void networkTaskEntry(void* param);
+    
     // Core loop methods
     void updateSensor();
     void updateDisplay();
-    void updateLedController();
     void updateWiFi();
     void updateMQTT();
     void checkLedTimer();
+    void logHeartbeat();
+    void applyCommands();
+    void drainSamples();
+    void publishLatestSample();
+    bool worthReporting(const SensorData& sample);
+    void keepUnsent(const SensorData& sample);
+    void publishDiagnostics();
+    void publishBatch();
     
     // Helper methods
-    bool shouldReadSensor();
-    bool shouldUpdateDisplay();
-    bool shouldPublishMqtt();
+    void armLedTimer();
     void handleLedAutoControl(const SensorData& data);
     void onLedControlMessage(bool ledOn);
     ErrorCode publishSensorData(const SensorData& data);
     void setupWebServer();
     String getStatusHTML();
     String getWiFiConfigHTML();
-    String scanWiFiNetworks();
+    void serveWiFiScan(AsyncWebServerRequest* request);
+    
+    // Latency histograms: every scheduled task on both sides plus event dispatch
+    typedef std::function<void(const char* group, const char* stage, const LatencyHistogram&)> LatencyVisitor;
+    void forEachLatency(const LatencyVisitor& visitor);
+    String getMetricsText();
+    String getDiagnosticsJson();
     void handleWiFiConfig(AsyncWebServerRequest *request);
 };
 
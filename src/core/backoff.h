@@ -0,0 +1,41 @@
+#ifndef CORE_BACKOFF_H
+#define CORE_BACKOFF_H
+
+#include <Arduino.h>
+
+// Capped exponential backoff with jitter, for retrying connections. The
+// n-th delay after a failure is drawn uniformly from
+// [minDelay, min(maxDelay, minDelay * 2^(n+1))]. Devices that all lost the
+// same broker therefore spread their retries out instead of reconnecting
+// in lockstep when it comes back.
+class Backoff {
+public:
+    Backoff(unsigned long minDelay, unsigned long maxDelay)
+        : minDelay(minDelay), maxDelay(maxDelay), failures(0) {}
+
+    // Delay before the next attempt; call once per failed attempt
+    unsigned long next() {
+        unsigned long window = minDelay;
+        for (unsigned long i = 0; i <= failures && window < maxDelay; i++) {
+            window *= 2;
+        }
+        if (window > maxDelay) window = maxDelay;
+        failures++;
+        return (unsigned long)random((long)minDelay, (long)window + 1);
+    }
+
+    void reset() {
+        failures = 0;
+    }
+
+    unsigned long getFailures() const {
+        return failures;
+    }
+
+private:
+    unsigned long minDelay;
+    unsigned long maxDelay;
+    unsigned long failures;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "config.h"
+#include "logger.h"
 #include <SPIFFS.h>
 #include <string>
 
@@ -66,6 +67,9 @@ void Config::setDefaults() {
     strcpy(wifi.password, "");
     strcpy(wifi.username, "");
     wifi.isEnterprise = false;
+    wifi.reuseIp = false;
+    wifi.roamRssi = 0;
+    wifi.roamWindow = 30000;
     
     // MQTT defaults - matching original working config
     strcpy(mqtt.broker, "192.168.31.21");
@@ -73,6 +77,15 @@ void Config::setDefaults() {
     strcpy(mqtt.password, "passwd");
     strcpy(mqtt.edgeId, "24dcc3a736ec");
     mqtt.port = 1883;
+    mqtt.tls = false;
+    mqtt.diagnosticsInterval = 0;
+    mqtt.outboxMaxBytes = 65536;
+    mqtt.outboxDrainRate = 10;
+    mqtt.batchMaxSamples = 0;
+    mqtt.batchMaxAge = 60000;
+    mqtt.payloadFormat = PayloadFormat::JSON;
+    mqtt.fallbackBrokerCount = 0;
+    mqtt.brokerProbeInterval = 300000;
     
     // Sensor defaults from original define.h
     sensor.dhtPin = 13;
@@ -85,6 +98,12 @@ void Config::setDefaults() {
     sensor.sensorReadingInterval = 200;
     sensor.uploadFrequency = 5000;
     sensor.nightLightDuration = 600000; // 10 minutes
+    sensor.historyDuration = 14400000;  // 4 hours
+    sensor.historyMaxBytes = 32768;     // Compressed: 3.5 to 7 hours at the DHT's one read a second
+    sensor.temperatureDeadband = 0.5f;  // Any whole-degree DHT11 step
+    sensor.humidityDeadband = 1.0f;     // Ignores 1% flicker
+    sensor.photoresisterDeadband = 100;
+    sensor.publishHeartbeat = 300000;   // 5 minutes
 }
 
 ErrorCode Config::parseWiFiConfig(JsonObject& obj) {
@@ -102,6 +121,15 @@ ErrorCode Config::parseWiFiConfig(JsonObject& obj) {
         if (wifiObj.containsKey("isEnterprise")) {
             wifi.isEnterprise = wifiObj["isEnterprise"];
         }
+        if (wifiObj.containsKey("reuseIp")) {
+            wifi.reuseIp = wifiObj["reuseIp"];
+        }
+        if (wifiObj.containsKey("roamRssi")) {
+            wifi.roamRssi = wifiObj["roamRssi"];
+        }
+        if (wifiObj.containsKey("roamWindow")) {
+            wifi.roamWindow = wifiObj["roamWindow"];
+        }
     }
     return ErrorCode::SUCCESS;
 }
@@ -124,7 +152,106 @@ ErrorCode Config::parseMQTTConfig(JsonObject& obj) {
         if (mqttObj.containsKey("port")) {
             mqtt.port = mqttObj["port"];
         }
+        if (mqttObj.containsKey("tls")) {
+            mqtt.tls = mqttObj["tls"];
+        }
+        if (mqttObj.containsKey("diagnosticsInterval")) {
+            mqtt.diagnosticsInterval = mqttObj["diagnosticsInterval"];
+        }
+        if (mqttObj.containsKey("outboxMaxBytes")) {
+            mqtt.outboxMaxBytes = mqttObj["outboxMaxBytes"];
+        }
+        if (mqttObj.containsKey("outboxDrainRate")) {
+            mqtt.outboxDrainRate = mqttObj["outboxDrainRate"];
+        }
+        if (mqttObj.containsKey("batchMaxSamples")) {
+            mqtt.batchMaxSamples = mqttObj["batchMaxSamples"];
+        }
+        if (mqttObj.containsKey("batchMaxAge")) {
+            mqtt.batchMaxAge = mqttObj["batchMaxAge"];
+        }
+        if (mqttObj.containsKey("payloadFormat")) {
+            // Anything but "cbor" keeps Home Assistant working
+            const char* format = mqttObj["payloadFormat"];
+            mqtt.payloadFormat = format && strcmp(format, "cbor") == 0 ? PayloadFormat::CBOR : PayloadFormat::JSON;
+        }
+        if (mqttObj["fallbackBrokers"].is<JsonArray>()) {
+            // [{"broker":"10.0.0.2","port":1883},...]; port defaults to the main one
+            JsonArray fallbacks = mqttObj["fallbackBrokers"];
+            mqtt.fallbackBrokerCount = 0;
+            for (JsonObject fallback : fallbacks) {
+                int port = fallback.containsKey("port") ? fallback["port"].as<int>() : mqtt.port;
+                if (!mqtt.addFallbackBroker(fallback["broker"], port)) {
+                    LOG_WARNF("Ignoring a fallback broker: no host, too long, or past the %u allowed",
+                              (unsigned)(MQTTConfig::MAX_BROKERS - 1));
+                }
+            }
+        }
+        if (mqttObj.containsKey("brokerProbeInterval")) {
+            mqtt.brokerProbeInterval = mqttObj["brokerProbeInterval"];
+        }
+    }
+    return ErrorCode::SUCCESS;
+}
+
+namespace {
+
+// Reads one optional patch setting. False if it is there but not a whole
+// number in [min, max].
+bool readLiveSetting(JsonObject& obj, const char* key, unsigned long min, unsigned long max, unsigned long& value,
+                     size_t& found, char* error, size_t errorSize) {
+    if (!obj.containsKey(key)) {
+        return true;
+    }
+    found++;
+    JsonVariant setting = obj[key];
+    if (!setting.is<unsigned long>() || setting.as<unsigned long>() < min || setting.as<unsigned long>() > max) {
+        snprintf(error, errorSize, "%s must be %lu-%lu", key, min, max);
+        return false;
     }
+    value = setting.as<unsigned long>();
+    return true;
+}
+
+}  // namespace
+
+ErrorCode Config::patchSensorConfig(const char* json, size_t length, SensorConfig& sensor, char* error,
+                                    size_t errorSize) {
+    JsonDocument doc;
+    if (deserializeJson(doc, json, length) || !doc.is<JsonObject>()) {
+        snprintf(error, errorSize, "not a JSON object");
+        return ErrorCode::CONFIG_INVALID;
+    }
+    JsonObject root = doc.as<JsonObject>();
+    if (root.size() != 1 || !root.containsKey("sensor") || !root["sensor"].is<JsonObject>()) {
+        snprintf(error, errorSize, "expected one sensor object");
+        return ErrorCode::CONFIG_INVALID;
+    }
+    JsonObject sensorObj = root["sensor"];
+    
+    SensorConfig patched = sensor;
+    unsigned long threshold = patched.photoresisterThreshold;
+    size_t found = 0;
+    bool valid =
+        readLiveSetting(sensorObj, "sensorReadingInterval", SensorConfig::MIN_READ_INTERVAL,
+                        SensorConfig::MAX_READ_INTERVAL, patched.sensorReadingInterval, found, error, errorSize) &&
+        readLiveSetting(sensorObj, "uploadFrequency", SensorConfig::MIN_UPLOAD_FREQUENCY,
+                        SensorConfig::MAX_UPLOAD_FREQUENCY, patched.uploadFrequency, found, error, errorSize) &&
+        readLiveSetting(sensorObj, "photoresisterThreshold", 0, SensorConfig::MAX_LIGHT_THRESHOLD, threshold, found,
+                        error, errorSize) &&
+        readLiveSetting(sensorObj, "nightLightDuration", SensorConfig::MIN_NIGHT_LIGHT, SensorConfig::MAX_NIGHT_LIGHT,
+                        patched.nightLightDuration, found, error, errorSize);
+    if (!valid) {
+        return ErrorCode::CONFIG_INVALID;
+    }
+    if (found != sensorObj.size()) {
+        snprintf(error, errorSize, "only sensorReadingInterval, uploadFrequency, photoresisterThreshold and "
+                                   "nightLightDuration can change without a restart");
+        return ErrorCode::CONFIG_INVALID;
+    }
+    
+    patched.photoresisterThreshold = (int)threshold;
+    sensor = patched;
     return ErrorCode::SUCCESS;
 }
 
@@ -161,6 +288,24 @@ ErrorCode Config::parseSensorConfig(JsonObject& obj) {
         if (sensorObj.containsKey("nightLightDuration")) {
             sensor.nightLightDuration = sensorObj["nightLightDuration"];
         }
+        if (sensorObj.containsKey("historyDuration")) {
+            sensor.historyDuration = sensorObj["historyDuration"];
+        }
+        if (sensorObj.containsKey("historyMaxBytes")) {
+            sensor.historyMaxBytes = sensorObj["historyMaxBytes"];
+        }
+        if (sensorObj.containsKey("temperatureDeadband")) {
+            sensor.temperatureDeadband = sensorObj["temperatureDeadband"];
+        }
+        if (sensorObj.containsKey("humidityDeadband")) {
+            sensor.humidityDeadband = sensorObj["humidityDeadband"];
+        }
+        if (sensorObj.containsKey("photoresisterDeadband")) {
+            sensor.photoresisterDeadband = sensorObj["photoresisterDeadband"];
+        }
+        if (sensorObj.containsKey("publishHeartbeat")) {
+            sensor.publishHeartbeat = sensorObj["publishHeartbeat"];
+        }
     }
     return ErrorCode::SUCCESS;
 }
@@ -171,6 +316,9 @@ void Config::serializeToJson(JsonDocument& doc) {
     wifiObj["password"] = wifi.password;
     wifiObj["username"] = wifi.username;
     wifiObj["isEnterprise"] = wifi.isEnterprise;
+    wifiObj["reuseIp"] = wifi.reuseIp;
+    wifiObj["roamRssi"] = wifi.roamRssi;
+    wifiObj["roamWindow"] = wifi.roamWindow;
     
     JsonObject mqttObj = doc["mqtt"].to<JsonObject>();
     mqttObj["broker"] = mqtt.broker;
@@ -178,6 +326,20 @@ void Config::serializeToJson(JsonDocument& doc) {
     mqttObj["password"] = mqtt.password;
     mqttObj["edgeId"] = mqtt.edgeId;
     mqttObj["port"] = mqtt.port;
+    mqttObj["tls"] = mqtt.tls;
+    mqttObj["diagnosticsInterval"] = mqtt.diagnosticsInterval;
+    mqttObj["outboxMaxBytes"] = mqtt.outboxMaxBytes;
+    mqttObj["outboxDrainRate"] = mqtt.outboxDrainRate;
+    mqttObj["batchMaxSamples"] = mqtt.batchMaxSamples;
+    mqttObj["batchMaxAge"] = mqtt.batchMaxAge;
+    mqttObj["payloadFormat"] = mqtt.payloadFormat == PayloadFormat::CBOR ? "cbor" : "json";
+    JsonArray fallbacks = mqttObj["fallbackBrokers"].to<JsonArray>();
+    for (size_t i = 0; i < mqtt.fallbackBrokerCount; i++) {
+        JsonObject fallback = fallbacks.add<JsonObject>();
+        fallback["broker"] = mqtt.fallbackBrokers[i].host;
+        fallback["port"] = mqtt.fallbackBrokers[i].port;
+    }
+    mqttObj["brokerProbeInterval"] = mqtt.brokerProbeInterval;
     
     JsonObject sensorObj = doc["sensor"].to<JsonObject>();
     sensorObj["dhtPin"] = sensor.dhtPin;
@@ -190,4 +352,10 @@ void Config::serializeToJson(JsonDocument& doc) {
     sensorObj["sensorReadingInterval"] = sensor.sensorReadingInterval;
     sensorObj["uploadFrequency"] = sensor.uploadFrequency;
     sensorObj["nightLightDuration"] = sensor.nightLightDuration;
+    sensorObj["historyDuration"] = sensor.historyDuration;
+    sensorObj["historyMaxBytes"] = sensor.historyMaxBytes;
+    sensorObj["temperatureDeadband"] = sensor.temperatureDeadband;
+    sensorObj["humidityDeadband"] = sensor.humidityDeadband;
+    sensorObj["photoresisterDeadband"] = sensor.photoresisterDeadband;
+    sensorObj["publishHeartbeat"] = sensor.publishHeartbeat;
 }
\ No newline at end of file
@@ -10,8 +10,16 @@ struct WiFiConfig {
 	char password[64];
 	char username[64];	// For enterprise WiFi
 	bool isEnterprise;
+	// Reconnect with the address from the last DHCP lease instead of asking
+	// again. The address is then set statically and never renewed, so only
+	// for networks whose DHCP server reserves it for this device.
+	bool reuseIp;
+	// Roam to a stronger access point of the same SSID once every RSSI
+	// sample for roamWindow ms has been below roamRssi dBm; 0 = never roam
+	int roamRssi;
+	unsigned long roamWindow;
 
-	WiFiConfig() : isEnterprise(false) {
+	WiFiConfig() : isEnterprise(false), reuseIp(false), roamRssi(0), roamWindow(30000) {
 		ssid[0] = '\0';
 		password[0] = '\0';
 		username[0] = '\0';
@@ -22,14 +30,48 @@ struct WiFiConfig {
 	}
 };
 
+// Encoding of the data, batch and backlog topics. JSON is what Home
+// Assistant reads; CBOR is for bulk ingestion (see sample_codec.h).
+enum class PayloadFormat {
+	JSON,
+	CBOR
+};
+
 struct MQTTConfig {
+	static const size_t MAX_BROKERS = 3;	// broker/port, then fallbackBrokers in order of preference
+
+	struct BrokerAddress {
+		char host[128];
+		int port;
+	};
+
 	char broker[128];
 	char username[64];
 	char password[64];
 	char edgeId[32];
 	int port;
+	bool tls;							// Verify the broker against /mqtt_ca.pem and encrypt; usually port 8883
+	unsigned long diagnosticsInterval;	// Stage latency report on <edgeId>/diagnostics; 0 = off
+	unsigned long outboxMaxBytes;		// Flash kept for samples that could not be sent
+	unsigned long outboxDrainRate;		// Backlog samples sent per second after reconnecting
+	unsigned long batchMaxSamples;		// Readings per <edgeId>/batch publish; 0 = batching off
+	unsigned long batchMaxAge;			// Publish a partial batch once its oldest reading is this old
+	PayloadFormat payloadFormat;		// "json" or "cbor" in config.json
+	BrokerAddress fallbackBrokers[MAX_BROKERS - 1];	// Tried when broker is down
+	size_t fallbackBrokerCount;
+	unsigned long brokerProbeInterval;	// While on a fallback, check this often whether broker is back; 0 = never
 
-	MQTTConfig() : port(1883) {
+	MQTTConfig()
+		: port(1883),
+		  tls(false),
+		  diagnosticsInterval(0),
+		  outboxMaxBytes(65536),
+		  outboxDrainRate(10),
+		  batchMaxSamples(0),
+		  batchMaxAge(60000),
+		  payloadFormat(PayloadFormat::JSON),
+		  fallbackBrokerCount(0),
+		  brokerProbeInterval(300000) {
 		broker[0] = '\0';
 		username[0] = '\0';
 		password[0] = '\0';
@@ -39,9 +81,42 @@ struct MQTTConfig {
 	bool isValid() const {
 		return strlen(broker) > 0 && strlen(edgeId) > 0;
 	}
+
+	// Index 0 is broker/port, the rest are the fallbacks
+	size_t brokerCount() const {
+		return 1 + fallbackBrokerCount;
+	}
+
+	const char* brokerHost(size_t index) const {
+		return index == 0 ? broker : fallbackBrokers[index - 1].host;
+	}
+
+	int brokerPort(size_t index) const {
+		return index == 0 ? port : fallbackBrokers[index - 1].port;
+	}
+
+	bool addFallbackBroker(const char* host, int hostPort) {
+		if (fallbackBrokerCount >= MAX_BROKERS - 1 || !host || strlen(host) == 0 ||
+			strlen(host) >= sizeof(fallbackBrokers[0].host)) {
+			return false;
+		}
+		BrokerAddress& address = fallbackBrokers[fallbackBrokerCount++];
+		strcpy(address.host, host);
+		address.port = hostPort;
+		return true;
+	}
 };
 
 struct SensorConfig {
+	// Ranges accepted over MQTT (cmd/* and the config topic)
+	static const unsigned long MIN_READ_INTERVAL = 100;
+	static const unsigned long MAX_READ_INTERVAL = 3600000;
+	static const unsigned long MIN_UPLOAD_FREQUENCY = 1000;
+	static const unsigned long MAX_UPLOAD_FREQUENCY = 86400000;
+	static const unsigned long MAX_LIGHT_THRESHOLD = 4095;	// 12-bit ADC
+	static const unsigned long MIN_NIGHT_LIGHT = 1000;
+	static const unsigned long MAX_NIGHT_LIGHT = 86400000;
+
 	int dhtPin;
 	int dhtType;
 	int photoresisterPin;
@@ -52,6 +127,12 @@ struct SensorConfig {
 	unsigned long sensorReadingInterval;
 	unsigned long uploadFrequency;
 	unsigned long nightLightDuration;
+	unsigned long historyDuration;	// How far back the in-RAM sample history should reach
+	unsigned long historyMaxBytes;	// Upper bound on that history's RAM; wins over historyDuration
+	float temperatureDeadband;		// /data is only published when a field moves more than its deadband
+	float humidityDeadband;			//   from the last published value, the LED changes,
+	int photoresisterDeadband;		//   or publishHeartbeat ms have passed since the last publish
+	unsigned long publishHeartbeat;	// 0 = publish every uploadFrequency regardless
 
 	SensorConfig()
 		: dhtPin(13),
@@ -63,7 +144,13 @@ struct SensorConfig {
 		  photoresisterThreshold(800),
 		  sensorReadingInterval(1000),
 		  uploadFrequency(5000),
-		  nightLightDuration(600000) {
+		  nightLightDuration(600000),
+		  historyDuration(14400000),
+		  historyMaxBytes(32768),
+		  temperatureDeadband(0.5f),
+		  humidityDeadband(1.0f),
+		  photoresisterDeadband(100),
+		  publishHeartbeat(300000) {
 	}
 };
 
@@ -78,6 +165,13 @@ class Config {
 	bool validate();
 	void setDefaults();
 
+	// Applies a {"sensor":{...}} patch to `sensor`. Only the settings the
+	// app can change while running are accepted: sensorReadingInterval,
+	// uploadFrequency, photoresisterThreshold and nightLightDuration. On a
+	// bad value or any other key nothing is applied and `error` says why.
+	static ErrorCode patchSensorConfig(const char* json, size_t length, SensorConfig& sensor, char* error,
+									   size_t errorSize);
+
    private:
 	ErrorCode parseWiFiConfig(JsonObject& obj);
 	ErrorCode parseMQTTConfig(JsonObject& obj);
@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include "interfaces.h"
+#include "latency_histogram.h"
 
 enum class EventType {
     SENSOR_DATA_UPDATED,
@@ -14,9 +15,25 @@ enum class EventType {
     MQTT_CONNECTED,
     MQTT_DISCONNECTED,
     DISPLAY_UPDATE_REQUIRED,
-    ERROR_OCCURRED
+    ERROR_OCCURRED  // Keep last: sizes per-type tables
 };
 
+static const size_t EVENT_TYPE_COUNT = (size_t)EventType::ERROR_OCCURRED + 1;
+
+inline const char* eventTypeName(EventType type) {
+    switch (type) {
+        case EventType::SENSOR_DATA_UPDATED: return "sensor_data_updated";
+        case EventType::LED_STATUS_CHANGED: return "led_status_changed";
+        case EventType::WIFI_CONNECTED: return "wifi_connected";
+        case EventType::WIFI_DISCONNECTED: return "wifi_disconnected";
+        case EventType::MQTT_CONNECTED: return "mqtt_connected";
+        case EventType::MQTT_DISCONNECTED: return "mqtt_disconnected";
+        case EventType::DISPLAY_UPDATE_REQUIRED: return "display_update_required";
+        case EventType::ERROR_OCCURRED: return "error_occurred";
+        default: return "unknown";
+    }
+}
+
 struct Event {
     EventType type;
     SensorData sensorData;
@@ -24,6 +41,7 @@ struct Event {
     ErrorCode errorCode;
     const char* message;
     
+    Event() : Event(EventType::DISPLAY_UPDATE_REQUIRED) {}  // Placeholder for fixed-size queues
     Event(EventType t) : type(t), boolValue(false), errorCode(ErrorCode::SUCCESS), message(nullptr) {}
     Event(EventType t, const SensorData& data) : type(t), sensorData(data), boolValue(false), errorCode(ErrorCode::SUCCESS), message(nullptr) {}
     Event(EventType t, bool value) : type(t), boolValue(value), errorCode(ErrorCode::SUCCESS), message(nullptr) {}
@@ -33,17 +51,27 @@ struct Event {
 class EventBus {
 public:
     using EventHandler = std::function<void(const Event&)>;
+    using LatencyVisitor = std::function<void(EventType, const LatencyHistogram&)>;
     
     void subscribe(EventType type, EventHandler handler) {
-        handlers[type].push_back(handler);
+        handlers[type].callbacks.push_back(handler);
     }
     
+    // Time spent in all handlers of an event type is recorded per publish
     void publish(const Event& event) {
         auto it = handlers.find(event.type);
         if (it != handlers.end()) {
-            for (auto& handler : it->second) {
+            StageTimer timer;
+            for (auto& handler : it->second.callbacks) {
                 handler(event);
             }
+            it->second.latency.record(timer.elapsedMicros());
+        }
+    }
+    
+    void forEachLatency(const LatencyVisitor& visitor) const {
+        for (const auto& entry : handlers) {
+            visitor(entry.first, entry.second.latency);
         }
     }
     
@@ -52,7 +80,12 @@ public:
     }
     
 private:
-    std::map<EventType, std::vector<EventHandler>> handlers;
+    struct Subscribers {
+        std::vector<EventHandler> callbacks;
+        LatencyHistogram latency;
+    };
+    
+    std::map<EventType, Subscribers> handlers;
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+#ifndef CORE_EVENT_QUEUE_H
+#define CORE_EVENT_QUEUE_H
+
+#include <freertos/FreeRTOS.h>
+#include <stdint.h>
+#include <type_traits>
+#include "event_bus.h"
+
+// Fixed ring of events waiting to be dispatched. post() may be called from
+// any task on either core or from an ISR: it only copies the event into a
+// slot inside a short critical section and never blocks or allocates.
+//
+// Event types marked as coalescing keep at most one pending entry: a new
+// post overwrites the pending one in place, so a burst of
+// SENSOR_DATA_UPDATED dispatches once with the latest data.
+template <size_t Capacity>
+class DeferredEventQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+    static_assert(std::is_trivially_copyable<Event>::value, "Events are copied inside a critical section");
+
+public:
+    struct Stats {
+        uint32_t posted;
+        uint32_t coalesced;
+        uint32_t overflowed;  // Posts dropped because the ring was full
+        uint32_t highWater;   // Most entries ever pending at once
+    };
+
+    DeferredEventQueue() : head(0), tail(0) {
+        portMUX_INITIALIZE(&lock);
+        stats = Stats{0, 0, 0, 0};
+        for (size_t i = 0; i < EVENT_TYPE_COUNT; i++) {
+            coalescing[i] = false;
+            pendingSlot[i] = NO_SLOT;
+        }
+    }
+
+    // Configure before events start flowing
+    void setCoalescing(EventType type, bool enabled) {
+        if ((size_t)type < EVENT_TYPE_COUNT) {
+            coalescing[(size_t)type] = enabled;
+        }
+    }
+
+    bool post(const Event& event) {
+        size_t type = (size_t)event.type;
+        bool accepted = true;
+
+        portENTER_CRITICAL_SAFE(&lock);
+        stats.posted++;
+        if (type < EVENT_TYPE_COUNT && coalescing[type] && pendingSlot[type] != NO_SLOT) {
+            slots[pendingSlot[type] & (Capacity - 1)] = event;
+            stats.coalesced++;
+        } else if (tail - head >= Capacity) {
+            stats.overflowed++;
+            accepted = false;
+        } else {
+            if (type < EVENT_TYPE_COUNT && coalescing[type]) {
+                pendingSlot[type] = tail;
+            }
+            slots[tail & (Capacity - 1)] = event;
+            tail++;
+            if (tail - head > stats.highWater) {
+                stats.highWater = tail - head;
+            }
+        }
+        portEXIT_CRITICAL_SAFE(&lock);
+        return accepted;
+    }
+
+    // Consumer side: moves up to maxEvents into out, oldest first
+    size_t take(Event* out, size_t maxEvents) {
+        size_t taken = 0;
+        portENTER_CRITICAL_SAFE(&lock);
+        while (taken < maxEvents && head != tail) {
+            Event& event = slots[head & (Capacity - 1)];
+            size_t type = (size_t)event.type;
+            if (type < EVENT_TYPE_COUNT && pendingSlot[type] == head) {
+                pendingSlot[type] = NO_SLOT;
+            }
+            out[taken++] = event;
+            head++;
+        }
+        portEXIT_CRITICAL_SAFE(&lock);
+        return taken;
+    }
+
+    bool empty() {
+        portENTER_CRITICAL_SAFE(&lock);
+        bool isEmpty = head == tail;
+        portEXIT_CRITICAL_SAFE(&lock);
+        return isEmpty;
+    }
+
+    Stats getStats() {
+        portENTER_CRITICAL_SAFE(&lock);
+        Stats snapshot = stats;
+        portEXIT_CRITICAL_SAFE(&lock);
+        return snapshot;
+    }
+
+private:
+    static const size_t NO_SLOT = (size_t)-1;
+
+    Event slots[Capacity];
+    size_t head;  // Free-running; slot index is position & (Capacity - 1)
+    size_t tail;
+    size_t pendingSlot[EVENT_TYPE_COUNT];  // Position of the pending entry of a coalescing type
+    bool coalescing[EVENT_TYPE_COUNT];
+    Stats stats;
+    portMUX_TYPE lock;
+};
+
+#endif
@@ -0,0 +1,265 @@
+#ifndef CORE_GORILLA_CODEC_H
+#define CORE_GORILLA_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "interfaces.h"
+
+// Gorilla-style compression for blocks of SensorData, after Facebook's
+// in-memory time-series store. Timestamps are stored as the change in the
+// gap between samples (delta-of-delta), fixed-point values as the change
+// from the previous sample, and each field takes a short prefix picking how
+// many bits follow. DHT11 readings rarely change from one second to the
+// next, so a steady sample costs 5 bits instead of 96.
+//
+// Block layout: a 2-byte little-endian sample count, then a bit stream
+// (most significant bit first). The first sample is stored in full:
+//   timestamp 32 | temperature 16 | humidity 16 | light 16 | flags 8
+// every later one as
+//   timestamp  '0' same gap | '10' +4 | '110' +9 | '1110' +12 | '1111' +32
+//   value x3   '0' same     | '10' +4 | '110' +8 | '111' +16 (raw value)
+//   flags      '0' same     | '1' +8
+// where the +N bits hold the zigzag-encoded difference.
+//
+// Blocks are self-contained and live in caller-owned buffers, so the same
+// format serves RAM history and flash files. Neither side allocates.
+
+class BitWriter {
+public:
+    BitWriter(uint8_t* buffer, size_t capacityBytes)
+        : buffer(buffer), capacityBits(capacityBytes * 8), position(0) {}
+
+    // Writes the low `bits` bits of value; the caller checks room first
+    void write(uint32_t value, int bits) {
+        while (bits > 0) {
+            size_t index = position >> 3;
+            int used = (int)(position & 7);
+            int room = 8 - used;
+            int take = bits < room ? bits : room;
+            uint8_t chunk = (uint8_t)((value >> (bits - take)) & ((1u << take) - 1));
+            if (used == 0) buffer[index] = 0;
+            buffer[index] |= (uint8_t)(chunk << (room - take));
+            position += take;
+            bits -= take;
+        }
+    }
+
+    size_t getBits() const { return position; }
+    size_t remainingBits() const { return capacityBits - position; }
+
+private:
+    uint8_t* buffer;
+    size_t capacityBits;
+    size_t position;
+};
+
+class BitReader {
+public:
+    BitReader(const uint8_t* buffer, size_t sizeBytes)
+        : buffer(buffer), sizeBits(sizeBytes * 8), position(0), overrun(false) {}
+
+    // Reads past the end return zeros and set the overrun flag
+    uint32_t read(int bits) {
+        if (position + bits > sizeBits) {
+            overrun = true;
+            position = sizeBits;
+            return 0;
+        }
+        uint32_t value = 0;
+        while (bits > 0) {
+            int used = (int)(position & 7);
+            int room = 8 - used;
+            int take = bits < room ? bits : room;
+            uint8_t chunk = (uint8_t)((buffer[position >> 3] >> (room - take)) & ((1u << take) - 1));
+            value = (value << take) | chunk;
+            position += take;
+            bits -= take;
+        }
+        return value;
+    }
+
+    bool readBit() { return read(1) != 0; }
+    bool hasOverrun() const { return overrun; }
+
+private:
+    const uint8_t* buffer;
+    size_t sizeBits;
+    size_t position;
+    bool overrun;
+};
+
+namespace gorilla {
+
+static const size_t HEADER_BYTES = 2;
+static const size_t FIRST_SAMPLE_BITS = 32 + 16 * 3 + 8;
+static const size_t MAX_SAMPLE_BITS = (4 + 32) + (3 + 16) * 3 + (1 + 8);
+
+inline uint32_t zigzag(int32_t value) {
+    return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+inline int32_t unzigzag(uint32_t value) {
+    return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+}  // namespace gorilla
+
+class GorillaBlockEncoder {
+public:
+    // buffer must hold at least HEADER_BYTES + 12 bytes to fit one sample
+    GorillaBlockEncoder(uint8_t* buffer, size_t capacityBytes)
+        : header(buffer),
+          bits(buffer + gorilla::HEADER_BYTES, capacityBytes > gorilla::HEADER_BYTES ? capacityBytes - gorilla::HEADER_BYTES : 0),
+          count(0), lastDelta(0) {
+        writeCount();
+    }
+
+    // False once the block can't be guaranteed room for another sample;
+    // start a new block then. Leaves at most 13 bytes unused.
+    bool append(const SensorData& sample) {
+        if (count == UINT16_MAX) return false;
+        if (count == 0) {
+            if (bits.remainingBits() < gorilla::FIRST_SAMPLE_BITS) return false;
+            bits.write(sample.timestamp, 32);
+            bits.write((uint16_t)sample.temperatureCenti, 16);
+            bits.write(sample.humidityPermille, 16);
+            bits.write(sample.photoresisterValue, 16);
+            bits.write(sample.flags, 8);
+        } else {
+            if (bits.remainingBits() < gorilla::MAX_SAMPLE_BITS) return false;
+            uint32_t delta = sample.timestamp - previous.timestamp;
+            writeTimestamp((int32_t)(delta - lastDelta));
+            lastDelta = delta;
+            writeValue((uint16_t)previous.temperatureCenti, (uint16_t)sample.temperatureCenti);
+            writeValue(previous.humidityPermille, sample.humidityPermille);
+            writeValue(previous.photoresisterValue, sample.photoresisterValue);
+            if (sample.flags == previous.flags) {
+                bits.write(0, 1);
+            } else {
+                bits.write(1, 1);
+                bits.write(sample.flags, 8);
+            }
+        }
+        previous = sample;
+        count++;
+        writeCount();
+        return true;
+    }
+
+    uint16_t getCount() const { return count; }
+
+    // Bytes of the buffer in use, header included
+    size_t getSize() const { return gorilla::HEADER_BYTES + (bits.getBits() + 7) / 8; }
+
+    size_t getBits() const { return gorilla::HEADER_BYTES * 8 + bits.getBits(); }
+
+private:
+    uint8_t* header;
+    BitWriter bits;
+    uint16_t count;
+    uint32_t lastDelta;
+    SensorData previous;
+
+    void writeCount() {
+        header[0] = (uint8_t)(count & 0xFF);
+        header[1] = (uint8_t)(count >> 8);
+    }
+
+    void writeTimestamp(int32_t deltaOfDelta) {
+        uint32_t encoded = gorilla::zigzag(deltaOfDelta);
+        if (encoded == 0) {
+            bits.write(0, 1);
+        } else if (encoded < (1u << 4)) {
+            bits.write(0x2, 2);
+            bits.write(encoded, 4);
+        } else if (encoded < (1u << 9)) {
+            bits.write(0x6, 3);
+            bits.write(encoded, 9);
+        } else if (encoded < (1u << 12)) {
+            bits.write(0xE, 4);
+            bits.write(encoded, 12);
+        } else {
+            bits.write(0xF, 4);
+            bits.write(encoded, 32);
+        }
+    }
+
+    void writeValue(uint16_t before, uint16_t value) {
+        uint32_t encoded = gorilla::zigzag((int32_t)value - (int32_t)before);
+        if (encoded == 0) {
+            bits.write(0, 1);
+        } else if (encoded < (1u << 4)) {
+            bits.write(0x2, 2);
+            bits.write(encoded, 4);
+        } else if (encoded < (1u << 8)) {
+            bits.write(0x6, 3);
+            bits.write(encoded, 8);
+        } else {
+            bits.write(0x7, 3);
+            bits.write(value, 16);
+        }
+    }
+};
+
+class GorillaBlockDecoder {
+public:
+    GorillaBlockDecoder(const uint8_t* block, size_t sizeBytes)
+        : bits(block + (sizeBytes >= gorilla::HEADER_BYTES ? gorilla::HEADER_BYTES : 0),
+               sizeBytes >= gorilla::HEADER_BYTES ? sizeBytes - gorilla::HEADER_BYTES : 0),
+          count(sizeBytes >= gorilla::HEADER_BYTES ? (uint16_t)(block[0] | (block[1] << 8)) : 0),
+          decoded(0), lastDelta(0) {}
+
+    uint16_t getCount() const { return count; }
+
+    // False after the last sample, or if the block is cut short
+    bool next(SensorData& sample) {
+        if (decoded >= count) return false;
+        if (decoded == 0) {
+            current.timestamp = bits.read(32);
+            current.temperatureCenti = (int16_t)bits.read(16);
+            current.humidityPermille = (uint16_t)bits.read(16);
+            current.photoresisterValue = (uint16_t)bits.read(16);
+            current.flags = (uint8_t)bits.read(8);
+        } else {
+            lastDelta += (uint32_t)readTimestamp();
+            current.timestamp += lastDelta;
+            current.temperatureCenti = (int16_t)readValue((uint16_t)current.temperatureCenti);
+            current.humidityPermille = readValue(current.humidityPermille);
+            current.photoresisterValue = readValue(current.photoresisterValue);
+            if (bits.readBit()) {
+                current.flags = (uint8_t)bits.read(8);
+            }
+        }
+        if (bits.hasOverrun()) {
+            decoded = count;
+            return false;
+        }
+        decoded++;
+        sample = current;
+        return true;
+    }
+
+private:
+    BitReader bits;
+    uint16_t count;
+    uint16_t decoded;
+    uint32_t lastDelta;
+    SensorData current;
+
+    int32_t readTimestamp() {
+        if (!bits.readBit()) return 0;
+        if (!bits.readBit()) return gorilla::unzigzag(bits.read(4));
+        if (!bits.readBit()) return gorilla::unzigzag(bits.read(9));
+        if (!bits.readBit()) return gorilla::unzigzag(bits.read(12));
+        return gorilla::unzigzag(bits.read(32));
+    }
+
+    uint16_t readValue(uint16_t before) {
+        if (!bits.readBit()) return before;
+        if (!bits.readBit()) return (uint16_t)(before + gorilla::unzigzag(bits.read(4)));
+        if (!bits.readBit()) return (uint16_t)(before + gorilla::unzigzag(bits.read(8)));
+        return (uint16_t)bits.read(16);
+    }
+};
+
+#endif
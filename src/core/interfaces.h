@@ -3,25 +3,48 @@
 
 #include <functional>
 #include <memory>
+#include <math.h>
+#include <stdint.h>
+#include <type_traits>
 #include <Arduino.h>
 
+// One sample in 12 bytes of fixed point, trivially copyable, so it can be
+// stored by the thousand and passed around without touching the heap.
+// Convert with the accessors only at the edges (JSON, display, logs).
 struct SensorData {
-    float temperture;
-    float humidity;
-    int photoresisterValue;
-    bool ledOn;
-    String ledState;
-    unsigned long freeMemory;
-    unsigned long lowestMemory;
+    static const uint8_t FLAG_LED_ON = 0x01;
     
-    SensorData() : temperture(0), humidity(0), photoresisterValue(0), 
-                   ledOn(false), ledState("off"), freeMemory(0), lowestMemory(0) {}
+    int16_t temperatureCenti;     // 0.01 °C
+    uint16_t humidityPermille;    // 0.1 %RH
+    uint16_t photoresisterValue;  // Raw ADC, 0-4095
+    uint8_t flags;
+    uint8_t reserved;
+    uint32_t timestamp;           // millis() when read
     
-    SensorData(float temp, float hum, int photo, bool led, String state, unsigned long free, unsigned long lowest)
-        : temperture(temp), humidity(hum), photoresisterValue(photo), 
-          ledOn(led), ledState(state), freeMemory(free), lowestMemory(lowest) {}
+    SensorData() : temperatureCenti(0), humidityPermille(0), photoresisterValue(0), 
+                   flags(0), reserved(0), timestamp(0) {}
+    
+    SensorData(float temp, float hum, int photo, bool led, uint32_t readAt)
+        : temperatureCenti(toFixed(temp, 100.0f, -32768, 32767)),
+          humidityPermille((uint16_t)toFixed(hum, 10.0f, 0, 1000)),
+          photoresisterValue((uint16_t)(photo < 0 ? 0 : photo > 65535 ? 65535 : photo)),
+          flags(led ? FLAG_LED_ON : 0), reserved(0), timestamp(readAt) {}
+    
+    float temperature() const { return temperatureCenti / 100.0f; }
+    float humidity() const { return humidityPermille / 10.0f; }
+    bool ledOn() const { return (flags & FLAG_LED_ON) != 0; }
+    const char* ledState() const { return ledOn() ? "on" : "off"; }
+    
+private:
+    static int32_t toFixed(float value, float scale, int32_t low, int32_t high) {
+        long scaled = lroundf(value * scale);
+        return scaled < low ? low : scaled > high ? high : (int32_t)scaled;
+    }
 };
 
+static_assert(sizeof(SensorData) == 12, "SensorData is meant to stay 12 bytes");
+static_assert(std::is_trivially_copyable<SensorData>::value, "SensorData must copy without the heap");
+
 struct DisplayData {
     SensorData sensorData;
     bool showLedStatus;
@@ -43,7 +66,9 @@ enum class ErrorCode {
     MQTT_CONNECTION_FAILED,
     MQTT_PUBLISH_FAILED,
     FILE_READ_FAILED,
-    MEMORY_ALLOCATION_FAILED
+    MEMORY_ALLOCATION_FAILED,
+    FILE_WRITE_FAILED,
+    CONFIG_INVALID
 };
 
 template<typename T>
@@ -64,6 +89,10 @@ public:
     virtual ~ISensorReader() = default;
     virtual Result<SensorData> read() = 0;
     virtual bool isReady() = 0;
+    // Reads closer together than this may return the previous reading
+    virtual void setReadInterval(unsigned long /* intervalMs */) {}
+    // Shortest interval that yields fresh readings; 0 if there is none
+    virtual unsigned long minReadInterval() const { return 0; }
 };
 
 class IDisplayDriver {
@@ -0,0 +1,119 @@
+#ifndef CORE_LATENCY_HISTOGRAM_H
+#define CORE_LATENCY_HISTOGRAM_H
+
+#include <Arduino.h>
+#include <stdint.h>
+
+// Fixed-bucket, log-scale histogram of durations in microseconds. Each power
+// of two is split into 4 buckets, so percentiles are within 25% of the true
+// value from 1 us up to about 4 s; anything longer lands in the last bucket
+// (max is still exact). Recording is O(1) and never allocates.
+//
+// Counters are plain words: a reader on another core may see a sample half
+// recorded, which is fine for diagnostics.
+class LatencyHistogram {
+public:
+    static const int SUB_BUCKETS = 4;
+    static const int OCTAVES = 21;
+    static const int BUCKET_COUNT = OCTAVES * SUB_BUCKETS;
+
+    LatencyHistogram() {
+        reset();
+    }
+
+    void record(uint32_t micros) {
+        buckets[bucketFor(micros)]++;
+        count++;
+        totalMicros += micros;
+        if (micros > maxMicros) {
+            maxMicros = micros;
+        }
+    }
+
+    // Upper bound of the bucket holding the given percentile (0-100),
+    // capped at the largest value seen
+    uint32_t percentile(float percent) const {
+        if (count == 0) {
+            return 0;
+        }
+        uint32_t rank = (uint32_t)(count * percent / 100.0f + 0.5f);
+        if (rank < 1) rank = 1;
+        uint32_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += buckets[i];
+            if (seen >= rank) {
+                uint32_t bound = upperBound(i);
+                return bound < maxMicros ? bound : maxMicros;
+            }
+        }
+        return maxMicros;
+    }
+
+    uint32_t getCount() const {
+        return count;
+    }
+
+    uint32_t getMax() const {
+        return maxMicros;
+    }
+
+    uint64_t getTotal() const {
+        return totalMicros;
+    }
+
+    void reset() {
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            buckets[i] = 0;
+        }
+        count = 0;
+        maxMicros = 0;
+        totalMicros = 0;
+    }
+
+private:
+    uint32_t buckets[BUCKET_COUNT];
+    uint32_t count;
+    uint32_t maxMicros;
+    uint64_t totalMicros;
+
+    // 0-3 us map linearly; above that the top three bits select the bucket
+    static int bucketFor(uint32_t micros) {
+        if (micros < SUB_BUCKETS) {
+            return (int)micros;
+        }
+        int msb = 31 - __builtin_clz(micros);
+        int sub = (int)(micros >> (msb - 2)) - SUB_BUCKETS;
+        int bucket = (msb - 1) * SUB_BUCKETS + sub;
+        return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+    }
+
+    static uint32_t upperBound(int bucket) {
+        if (bucket < SUB_BUCKETS) {
+            return (uint32_t)bucket;
+        }
+        int msb = bucket / SUB_BUCKETS + 1;
+        int sub = bucket % SUB_BUCKETS;
+        return ((uint32_t)(SUB_BUCKETS + sub + 1) << (msb - 2)) - 1;
+    }
+};
+
+// Times one stage with the CPU cycle counter. The counter wraps after about
+// 17 s at 240 MHz, so anything slower is measured with millis() instead.
+class StageTimer {
+public:
+    StageTimer() : startCycles(ESP.getCycleCount()), startMs(millis()) {}
+
+    uint32_t elapsedMicros() const {
+        unsigned long elapsedMs = millis() - startMs;
+        if (elapsedMs >= 10000) {
+            return (uint32_t)(elapsedMs * 1000);
+        }
+        return (ESP.getCycleCount() - startCycles) / ESP.getCpuFreqMHz();
+    }
+
+private:
+    uint32_t startCycles;
+    unsigned long startMs;
+};
+
+#endif
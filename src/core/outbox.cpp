@@ -0,0 +1,403 @@
+#include "outbox.h"
+#include <stdio.h>
+#include <string.h>
+#include "logger.h"
+
+namespace {
+
+const uint32_t SEGMENT_MAGIC = 0x3158424F;  // "OBX1"
+const uint8_t RECORD_MARKER = 0xA5;
+const size_t PAYLOAD_BYTES = 12;
+const size_t CURSOR_BYTES = 12;
+
+// CRC-16/CCITT-FALSE
+uint16_t crc16(const uint8_t* data, size_t length) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < length; i++) {
+        crc ^= (uint16_t)data[i] << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+        }
+    }
+    return crc;
+}
+
+void put16(uint8_t* out, uint16_t value) {
+    out[0] = (uint8_t)value;
+    out[1] = (uint8_t)(value >> 8);
+}
+
+void put32(uint8_t* out, uint32_t value) {
+    put16(out, (uint16_t)value);
+    put16(out + 2, (uint16_t)(value >> 16));
+}
+
+uint16_t get16(const uint8_t* in) {
+    return (uint16_t)(in[0] | (in[1] << 8));
+}
+
+uint32_t get32(const uint8_t* in) {
+    return get16(in) | ((uint32_t)get16(in + 2) << 16);
+}
+
+// Header and cursor share a layout: two words, then a CRC over them
+void encodeWords(uint8_t* out, uint32_t first, uint32_t second) {
+    put32(out, first);
+    put32(out + 4, second);
+    put16(out + 8, crc16(out, 8));
+    put16(out + 10, 0);
+}
+
+bool decodeWords(const uint8_t* in, uint32_t& first, uint32_t& second) {
+    if (get16(in + 8) != crc16(in, 8)) return false;
+    first = get32(in);
+    second = get32(in + 4);
+    return true;
+}
+
+void encodeRecord(uint8_t* out, const SensorData& sample) {
+    out[0] = RECORD_MARKER;
+    out[1] = PAYLOAD_BYTES;
+    put16(out + 2, (uint16_t)sample.temperatureCenti);
+    put16(out + 4, sample.humidityPermille);
+    put16(out + 6, sample.photoresisterValue);
+    out[8] = sample.flags;
+    out[9] = 0;
+    put32(out + 10, sample.timestamp);
+    put16(out + 14, crc16(out + 1, 1 + PAYLOAD_BYTES));
+}
+
+bool decodeRecord(const uint8_t* in, SensorData& sample) {
+    if (in[0] != RECORD_MARKER || in[1] != PAYLOAD_BYTES || get16(in + 14) != crc16(in + 1, 1 + PAYLOAD_BYTES)) {
+        return false;
+    }
+    sample.temperatureCenti = (int16_t)get16(in + 2);
+    sample.humidityPermille = get16(in + 4);
+    sample.photoresisterValue = get16(in + 6);
+    sample.flags = in[8];
+    sample.timestamp = get32(in + 10);
+    return true;
+}
+
+}  // namespace
+
+Outbox::Outbox(fs::FS& fs, const char* directory, size_t maxBytes)
+    : fs(fs), directory(directory), hasSegments(false), oldestSeq(0), newestSeq(0), nextSeq(0),
+      firstLiveSeq(0), newestWritable(false), readOffset(0), pendingCount(0), peeked(false), aheadSeq(0),
+      aheadOffset(0), aheadCount(0), generation(0), commitsSinceCheckpoint(0), stats() {
+    size_t segments = maxBytes / SEGMENT_BYTES;
+    slotCount = segments < MIN_SEGMENTS ? MIN_SEGMENTS : segments > MAX_SEGMENTS ? MAX_SEGMENTS : segments;
+    memset(recordCounts, 0, sizeof(recordCounts));
+}
+
+void Outbox::segmentPath(size_t slot, char* path, size_t size) const {
+    snprintf(path, size, "%s/%u.seg", directory, (unsigned)slot);
+}
+
+void Outbox::cursorPath(char* path, size_t size) const {
+    snprintf(path, size, "%s/cursor", directory);
+}
+
+ErrorCode Outbox::begin() {
+    char path[48];
+    uint32_t seqs[MAX_SEGMENTS];
+    bool present[MAX_SEGMENTS] = {};
+    hasSegments = false;
+    pendingCount = 0;
+    peeked = false;
+    aheadCount = 0;
+    generation++;
+    memset(recordCounts, 0, sizeof(recordCounts));
+
+    for (size_t slot = 0; slot < MAX_SEGMENTS; slot++) {
+        segmentPath(slot, path, sizeof(path));
+        if (!fs.exists(path)) continue;
+
+        uint8_t header[HEADER_BYTES];
+        File file = fs.open(path, "r");
+        size_t headerRead = file ? file.read(header, HEADER_BYTES) : 0;
+        size_t size = file ? file.size() : 0;
+        file.close();
+
+        uint32_t magic;
+        uint32_t seq;
+        if (headerRead != HEADER_BYTES || !decodeWords(header, magic, seq) || magic != SEGMENT_MAGIC) {
+            LOG_WARNF("[Outbox] Discarding %s: torn or invalid header", path);
+            fs.remove(path);
+            continue;
+        }
+        // A smaller outboxMaxBytes than last boot leaves segments whose
+        // sequence no longer maps to their slot
+        if (slot >= slotCount || slotOf(seq) != slot) {
+            LOG_WARNF("[Outbox] Discarding %s: outside the configured ring", path);
+            fs.remove(path);
+            continue;
+        }
+
+        size_t records = (size - HEADER_BYTES) / RECORD_BYTES;  // A torn last record is left out
+        recordCounts[slot] = (uint16_t)(records < RECORDS_PER_SEGMENT ? records : RECORDS_PER_SEGMENT);
+        seqs[slot] = seq;
+        present[slot] = true;
+        if (!hasSegments || seq > newestSeq) newestSeq = seq;
+        hasSegments = true;
+    }
+
+    // Live segments span at most one lap of the ring; anything older was
+    // about to be evicted when power went
+    oldestSeq = newestSeq;
+    for (size_t slot = 0; slot < slotCount; slot++) {
+        if (!present[slot]) continue;
+        if (newestSeq - seqs[slot] >= slotCount) {
+            segmentPath(slot, path, sizeof(path));
+            fs.remove(path);
+            recordCounts[slot] = 0;
+            continue;
+        }
+        if (seqs[slot] < oldestSeq) oldestSeq = seqs[slot];
+        pendingCount += recordCounts[slot];
+    }
+
+    readOffset = 0;
+    uint32_t cursorSeq;
+    uint32_t cursorOffset;
+    if (hasSegments && readCursor(cursorSeq, cursorOffset) && cursorSeq == oldestSeq &&
+        cursorOffset <= recordCounts[slotOf(oldestSeq)]) {
+        readOffset = cursorOffset;
+        pendingCount -= cursorOffset;
+    } else {
+        // Stale: it refers to a segment that no longer exists
+        cursorPath(path, sizeof(path));
+        fs.remove(path);
+    }
+
+    nextSeq = hasSegments ? newestSeq + 1 : 0;
+    firstLiveSeq = nextSeq;
+    newestWritable = false;
+    commitsSinceCheckpoint = 0;
+    stats = Stats();
+    stats.recovered = pendingCount;
+
+    if (pendingCount > 0) {
+        LOG_INFOF("[Outbox] Recovered %u unsent samples in %u segments", (unsigned)pendingCount,
+                  (unsigned)(newestSeq - oldestSeq + 1));
+    }
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode Outbox::append(const SensorData& sample) {
+    if (!hasSegments || !newestWritable || recordCounts[slotOf(newestSeq)] >= RECORDS_PER_SEGMENT) {
+        ErrorCode result = startSegment();
+        if (result != ErrorCode::SUCCESS) {
+            return result;
+        }
+    }
+
+    uint8_t record[RECORD_BYTES];
+    encodeRecord(record, sample);
+
+    char path[48];
+    segmentPath(slotOf(newestSeq), path, sizeof(path));
+    File file = fs.open(path, "a");
+    size_t written = file ? file.write(record, RECORD_BYTES) : 0;
+    file.close();
+    if (written != RECORD_BYTES) {
+        // Whatever part of the record reached flash is ignored as a torn
+        // tail; never append after it
+        newestWritable = false;
+        return ErrorCode::FILE_WRITE_FAILED;
+    }
+
+    recordCounts[slotOf(newestSeq)]++;
+    pendingCount++;
+    stats.appended++;
+    return ErrorCode::SUCCESS;
+}
+
+ErrorCode Outbox::startSegment() {
+    uint32_t seq = hasSegments ? newestSeq + 1 : nextSeq;
+    if (hasSegments && seq - oldestSeq >= slotCount) {
+        evictOldest();
+    }
+
+    uint8_t header[HEADER_BYTES];
+    encodeWords(header, SEGMENT_MAGIC, seq);
+
+    char path[48];
+    segmentPath(slotOf(seq), path, sizeof(path));
+    File file = fs.open(path, "w");
+    size_t written = file ? file.write(header, HEADER_BYTES) : 0;
+    file.close();
+    if (written != HEADER_BYTES) {
+        fs.remove(path);
+        return ErrorCode::FILE_WRITE_FAILED;
+    }
+
+    recordCounts[slotOf(seq)] = 0;
+    if (!hasSegments) {
+        oldestSeq = seq;
+        readOffset = 0;
+        hasSegments = true;
+    }
+    newestSeq = seq;
+    newestWritable = true;
+    return ErrorCode::SUCCESS;
+}
+
+// Deletes the oldest segment; its samples must already be accounted for
+void Outbox::dropOldest() {
+    char path[48];
+    segmentPath(slotOf(oldestSeq), path, sizeof(path));
+    fs.remove(path);
+    recordCounts[slotOf(oldestSeq)] = 0;
+    peeked = false;
+    readOffset = 0;
+
+    if (oldestSeq == newestSeq) {
+        hasSegments = false;
+        nextSeq = newestSeq + 1;
+    } else {
+        oldestSeq++;
+    }
+}
+
+void Outbox::evictOldest() {
+    size_t unsent = recordCounts[slotOf(oldestSeq)] - readOffset;
+    if (unsent > 0) {
+        LOG_WARNF("[Outbox] Full, evicting %u unsent samples", (unsigned)unsent);
+    }
+    stats.evicted += unsent;
+    pendingCount -= unsent;
+    // The first sample out from readNext() is always in this segment
+    if (aheadCount > 0) rewind();
+    dropOldest();
+}
+
+bool Outbox::peek(SensorData& sample, bool& fromEarlierBoot) {
+    while (!peeked && hasSegments) {
+        size_t slot = slotOf(oldestSeq);
+        if (readOffset >= recordCounts[slot]) {
+            if (oldestSeq == newestSeq && newestWritable) {
+                // Caught up with the segment still being written
+                if (commitsSinceCheckpoint > 0) writeCursor();
+                return false;
+            }
+            dropOldest();
+            continue;
+        }
+
+        uint8_t record[RECORD_BYTES];
+        if (!readRecord(slot, readOffset, record)) {
+            // Segment shorter than counted (removed or truncated underneath us)
+            LOG_WARNF("[Outbox] Segment %u ended early, skipping the rest of it", (unsigned)slot);
+            pendingCount -= recordCounts[slot] - readOffset;
+            stats.corrupt += recordCounts[slot] - readOffset;
+            recordCounts[slot] = (uint16_t)readOffset;
+            continue;
+        }
+        if (!decodeRecord(record, peekedSample)) {
+            stats.corrupt++;
+            readOffset++;
+            pendingCount--;
+            continue;
+        }
+        peeked = true;
+    }
+
+    if (!peeked) {
+        return false;
+    }
+    sample = peekedSample;
+    fromEarlierBoot = oldestSeq < firstLiveSeq;
+    return true;
+}
+
+bool Outbox::readRecord(size_t slot, size_t offset, uint8_t* record) {
+    char path[48];
+    segmentPath(slot, path, sizeof(path));
+    File file = fs.open(path, "r");
+    bool read = file && file.seek(HEADER_BYTES + offset * RECORD_BYTES) && file.read(record, RECORD_BYTES) == RECORD_BYTES;
+    file.close();
+    return read;
+}
+
+// Skips unreadable records the same way peek() does, so the n-th sample
+// read here is the one the n-th commit() drops
+bool Outbox::readNext(SensorData& sample, bool& fromEarlierBoot) {
+    if (aheadCount == 0) {
+        if (!peek(sample, fromEarlierBoot)) return false;
+        aheadSeq = oldestSeq;
+        aheadOffset = readOffset + 1;
+        aheadCount = 1;
+        return true;
+    }
+
+    for (;;) {
+        size_t slot = slotOf(aheadSeq);
+        if (aheadOffset >= recordCounts[slot]) {
+            if (aheadSeq == newestSeq) return false;
+            aheadSeq++;
+            aheadOffset = 0;
+            continue;
+        }
+
+        uint8_t record[RECORD_BYTES];
+        if (!readRecord(slot, aheadOffset, record)) {
+            aheadOffset = recordCounts[slot];  // peek() accounts for it once it gets there
+            continue;
+        }
+        aheadOffset++;
+        if (decodeRecord(record, sample)) {
+            aheadCount++;
+            fromEarlierBoot = aheadSeq < firstLiveSeq;
+            return true;
+        }
+    }
+}
+
+void Outbox::rewind() {
+    aheadCount = 0;
+    generation++;
+}
+
+void Outbox::commit() {
+    if (!peeked && aheadCount > 0) {
+        SensorData sample;
+        bool fromEarlierBoot;
+        peek(sample, fromEarlierBoot);
+    }
+    if (!peeked) return;
+    peeked = false;
+    if (aheadCount > 0) aheadCount--;
+    readOffset++;
+    pendingCount--;
+    stats.sent++;
+    if (++commitsSinceCheckpoint >= CHECKPOINT_EVERY || pendingCount == 0) {
+        writeCursor();
+    }
+}
+
+void Outbox::writeCursor() {
+    uint8_t cursor[CURSOR_BYTES];
+    encodeWords(cursor, oldestSeq, (uint32_t)readOffset);
+
+    char path[48];
+    cursorPath(path, sizeof(path));
+    File file = fs.open(path, "w");
+    if (file) {
+        file.write(cursor, CURSOR_BYTES);
+        file.close();
+    }
+    commitsSinceCheckpoint = 0;
+}
+
+bool Outbox::readCursor(uint32_t& seq, uint32_t& offset) {
+    char path[48];
+    cursorPath(path, sizeof(path));
+    if (!fs.exists(path)) return false;
+
+    uint8_t cursor[CURSOR_BYTES];
+    File file = fs.open(path, "r");
+    bool read = file && file.read(cursor, CURSOR_BYTES) == CURSOR_BYTES;
+    file.close();
+    return read && decodeWords(cursor, seq, offset);
+}
@@ -0,0 +1,142 @@
+#ifndef CORE_OUTBOX_H
+#define CORE_OUTBOX_H
+
+#include <FS.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "interfaces.h"
+
+// Store-and-forward queue, kept in flash, for samples that could not be
+// published. A broker outage, or a reset during one, then loses nothing.
+//
+// The log is a ring of segment files <directory>/<slot>.seg. Each one starts
+// with a 12-byte header (magic, sequence number, CRC-16) and holds fixed
+// 16-byte records: 0xA5, payload length, the 12-byte SensorData and a CRC-16.
+// Appends go to the newest segment and reads come from the oldest. A segment
+// is deleted once it has been drained, and when the ring is full the oldest
+// segment is evicted, unsent samples and all.
+//
+// Power loss:
+// - Each append closes its file before returning.
+// - At boot, a segment with a torn header is discarded. A torn record at the
+//   end of a segment is ignored, and a record failing its CRC is skipped and
+//   counted.
+// - New samples always start a fresh segment, so a torn tail never shifts
+//   the records that follow it.
+// - Drain progress in the oldest segment is checkpointed every
+//   CHECKPOINT_EVERY samples, so a reset re-sends at most that many.
+//
+// A sender that keeps several samples in flight reads them with readNext()
+// and commits each one as it is acknowledged, oldest first.
+//
+// Not thread-safe; only the networking side touches it.
+class Outbox {
+public:
+    static const size_t SEGMENT_BYTES = 4096;
+    static const size_t HEADER_BYTES = 12;
+    static const size_t RECORD_BYTES = 16;
+    static const size_t RECORDS_PER_SEGMENT = (SEGMENT_BYTES - HEADER_BYTES) / RECORD_BYTES;
+    static const size_t MIN_SEGMENTS = 2;
+    static const size_t MAX_SEGMENTS = 64;
+    static const unsigned long CHECKPOINT_EVERY = 32;
+
+    struct Stats {
+        unsigned long appended;
+        unsigned long sent;
+        unsigned long evicted;    // Dropped unsent because the ring was full
+        unsigned long corrupt;    // Records that failed the CRC check
+        unsigned long recovered;  // Pending samples found at boot
+    };
+
+    // maxBytes is rounded down to whole segments (2 to 64 of them)
+    Outbox(fs::FS& fs, const char* directory, size_t maxBytes);
+
+    // Scans the segments left by the previous boot. Call once before use.
+    ErrorCode begin();
+
+    ErrorCode append(const SensorData& sample);
+
+    // Oldest unsent sample. fromEarlierBoot is set when it was stored before
+    // the last reset, so its timestamp is from another millis() epoch.
+    // Returns the same sample until commit().
+    bool peek(SensorData& sample, bool& fromEarlierBoot);
+
+    // Drops the oldest unsent sample: the one last returned by peek(), or
+    // the first one still out from readNext()
+    void commit();
+
+    // The sample after those already handed out by readNext(), starting at
+    // the oldest unsent one. Nothing is removed until commit().
+    bool readNext(SensorData& sample, bool& fromEarlierBoot);
+
+    // Makes readNext() start over at the oldest unsent sample, e.g. once the
+    // connection that carried the samples read so far is gone
+    void rewind();
+
+    // Samples handed out by readNext() and not committed yet
+    size_t readAhead() const {
+        return aheadCount;
+    }
+
+    // Changes whenever samples out from readNext() are rewound or evicted.
+    // A commit for a sample read in an earlier generation would drop the
+    // wrong one, so senders compare this before committing.
+    uint32_t getGeneration() const {
+        return generation;
+    }
+
+    size_t pending() const {
+        return pendingCount;
+    }
+
+    bool empty() const {
+        return pendingCount == 0;
+    }
+
+    size_t getCapacity() const {
+        return slotCount * RECORDS_PER_SEGMENT;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+private:
+    fs::FS& fs;
+    const char* directory;
+    size_t slotCount;
+    uint16_t recordCounts[MAX_SEGMENTS];  // Records in each slot's segment
+
+    bool hasSegments;
+    uint32_t oldestSeq;
+    uint32_t newestSeq;
+    uint32_t nextSeq;        // Used when the ring is empty
+    uint32_t firstLiveSeq;   // Segments before this were written by an earlier boot
+    bool newestWritable;     // Recovered segments are never appended to
+    size_t readOffset;       // Records already sent from the oldest segment
+    size_t pendingCount;
+
+    bool peeked;
+    SensorData peekedSample;
+    uint32_t aheadSeq;       // Where readNext() continues
+    size_t aheadOffset;
+    size_t aheadCount;
+    uint32_t generation;
+    unsigned long commitsSinceCheckpoint;
+    Stats stats;
+
+    size_t slotOf(uint32_t seq) const {
+        return seq % slotCount;
+    }
+
+    void segmentPath(size_t slot, char* path, size_t size) const;
+    void cursorPath(char* path, size_t size) const;
+    ErrorCode startSegment();
+    void dropOldest();
+    void evictOldest();
+    void writeCursor();
+    bool readCursor(uint32_t& seq, uint32_t& offset);
+    bool readRecord(size_t slot, size_t offset, uint8_t* record);
+};
+
+#endif
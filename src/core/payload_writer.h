@@ -0,0 +1,80 @@
+#ifndef CORE_PAYLOAD_WRITER_H
+#define CORE_PAYLOAD_WRITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Builds a message in a caller-owned buffer without touching the heap, for
+// payloads that go out every few seconds for weeks. Output that doesn't
+// fit is cut off and flagged; check ok() and drop the message rather than
+// send broken JSON.
+class PayloadWriter {
+public:
+    PayloadWriter(char* buffer, size_t capacity) : buffer(buffer), capacity(capacity), length(0), overflow(false) {
+        if (capacity > 0) buffer[0] = '\0';
+    }
+
+    PayloadWriter& raw(const char* text) {
+        return append(text, strlen(text));
+    }
+
+    PayloadWriter& number(unsigned long value) {
+        char digits[12];
+        int written = snprintf(digits, sizeof(digits), "%lu", value);
+        return append(digits, (size_t)written);
+    }
+
+    // value / 10^decimals with trailing zeros dropped: (2450, 2) -> "24.5"
+    PayloadWriter& fixed(long value, int decimals) {
+        long scale = 1;
+        for (int i = 0; i < decimals; i++) scale *= 10;
+        unsigned long magnitude = value < 0 ? (unsigned long)(-value) : (unsigned long)value;
+        unsigned long fraction = magnitude % scale;
+
+        if (value < 0) raw("-");
+        number(magnitude / scale);
+        if (fraction == 0) return *this;
+
+        char digits[12];
+        int width = decimals;
+        while (fraction % 10 == 0) {
+            fraction /= 10;
+            width--;
+        }
+        int written = snprintf(digits, sizeof(digits), ".%0*lu", width, fraction);
+        return append(digits, (size_t)written);
+    }
+
+    const char* c_str() const {
+        return buffer;
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool ok() const {
+        return !overflow;
+    }
+
+private:
+    char* buffer;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    PayloadWriter& append(const char* text, size_t count) {
+        if (overflow || length + count >= capacity) {
+            overflow = true;
+            return *this;
+        }
+        memcpy(buffer + length, text, count);
+        length += count;
+        buffer[length] = '\0';
+        return *this;
+    }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef CORE_SAMPLE_CODEC_H
+#define CORE_SAMPLE_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "config.h"
+#include "interfaces.h"
+#include "payload_writer.h"
+
+// Appends CBOR (RFC 8949) items to a caller-owned buffer. Like
+// PayloadWriter it never allocates, and stops and flags overflow when the
+// buffer is full.
+class CborWriter {
+public:
+    CborWriter(char* buffer, size_t capacity) : buffer((uint8_t*)buffer), capacity(capacity), length(0), overflow(false) {}
+
+    CborWriter& array(size_t count) {
+        return head(4, count);
+    }
+
+    CborWriter& integer(long value) {
+        return value < 0 ? head(1, (uint32_t)(-1 - value)) : head(0, (uint32_t)value);
+    }
+
+    CborWriter& boolean(bool value) {
+        return byte(value ? 0xf5 : 0xf4);
+    }
+
+    CborWriter& null() {
+        return byte(0xf6);
+    }
+
+    size_t size() const {
+        return length;
+    }
+
+    bool ok() const {
+        return !overflow;
+    }
+
+private:
+    uint8_t* buffer;
+    size_t capacity;
+    size_t length;
+    bool overflow;
+
+    // Shortest head for the value, as deterministic encoding requires
+    CborWriter& head(uint8_t majorType, uint32_t value) {
+        uint8_t major = majorType << 5;
+        if (value < 24) return byte(major | value);
+        if (value <= 0xff) return byte(major | 24).byte(value);
+        if (value <= 0xffff) return byte(major | 25).byte(value >> 8).byte(value);
+        return byte(major | 26).byte(value >> 24).byte(value >> 16).byte(value >> 8).byte(value);
+    }
+
+    CborWriter& byte(uint8_t value) {
+        if (overflow || length >= capacity) {
+            overflow = true;
+            return *this;
+        }
+        buffer[length++] = value;
+        return *this;
+    }
+};
+
+// Encodes the data, batch and backlog messages in either format. Each
+// call writes one message at the start of the buffer and returns its size,
+// or 0 if it didn't fit.
+//
+// JSON is what Home Assistant and existing consumers read. CBOR messages
+// are fixed-position arrays led by a schema version, with temperature in
+// hundredths of a degree and humidity in tenths of a percent:
+//   data     [1, temp_centi, humi_permille, light, led, free_heap, min_free_heap]
+//   batch    [1, [[age_ms, temp_centi, humi_permille, light, led], ...]]
+//   backlog  [1, temp_centi, humi_permille, light, led, age_s or null]
+// New fields are only ever appended, and a different layout bumps the version.
+class SampleEncoder {
+public:
+    static const long CBOR_SCHEMA = 1;
+
+    SampleEncoder(PayloadFormat format, char* buffer, size_t capacity)
+        : format(format), buffer(buffer), capacity(capacity) {}
+
+    size_t data(const SensorData& sample, uint32_t freeHeap, uint32_t minFreeHeap) {
+        if (format == PayloadFormat::CBOR) {
+            CborWriter cbor(buffer, capacity);
+            cbor.array(7).integer(CBOR_SCHEMA);
+            writeReading(cbor, sample);
+            cbor.integer(freeHeap).integer(minFreeHeap);
+            return cbor.ok() ? cbor.size() : 0;
+        }
+        PayloadWriter json(buffer, capacity);
+        writeReading(json, sample);
+        json.raw(",\"freeMemory\":").number(freeHeap);
+        json.raw(",\"lowestMemory\":").number(minFreeHeap);
+        json.raw("}");
+        return json.ok() ? json.size() : 0;
+    }
+
+    // Oldest first; ages are relative to now, as there is no wall clock
+    size_t batch(const SensorData* samples, size_t count, uint32_t now) {
+        if (format == PayloadFormat::CBOR) {
+            CborWriter cbor(buffer, capacity);
+            cbor.array(2).integer(CBOR_SCHEMA).array(count);
+            for (size_t i = 0; i < count; i++) {
+                const SensorData& sample = samples[i];
+                cbor.array(5).integer(now - sample.timestamp);
+                writeReading(cbor, sample);
+            }
+            return cbor.ok() ? cbor.size() : 0;
+        }
+        PayloadWriter json(buffer, capacity);
+        json.raw("{\"samples\":[");
+        for (size_t i = 0; i < count; i++) {
+            const SensorData& sample = samples[i];
+            json.raw(i > 0 ? ",[" : "[").number(now - sample.timestamp);
+            json.raw(",").fixed(sample.temperatureCenti, 2);
+            json.raw(",").fixed(sample.humidityPermille, 1);
+            json.raw(",").number(sample.photoresisterValue);
+            json.raw(sample.ledOn() ? ",1]" : ",0]");
+        }
+        json.raw("]}");
+        return json.ok() ? json.size() : 0;
+    }
+
+    // A sample from before the last reset has no usable age and says so
+    size_t backlog(const SensorData& sample, bool fromEarlierBoot, uint32_t ageSeconds) {
+        if (format == PayloadFormat::CBOR) {
+            CborWriter cbor(buffer, capacity);
+            cbor.array(6).integer(CBOR_SCHEMA);
+            writeReading(cbor, sample);
+            if (fromEarlierBoot) {
+                cbor.null();
+            } else {
+                cbor.integer(ageSeconds);
+            }
+            return cbor.ok() ? cbor.size() : 0;
+        }
+        PayloadWriter json(buffer, capacity);
+        writeReading(json, sample);
+        if (fromEarlierBoot) {
+            json.raw(",\"earlierBoot\":true}");
+        } else {
+            json.raw(",\"age\":").number(ageSeconds).raw("}");
+        }
+        return json.ok() ? json.size() : 0;
+    }
+
+private:
+    PayloadFormat format;
+    char* buffer;
+    size_t capacity;
+
+    static void writeReading(CborWriter& cbor, const SensorData& sample) {
+        cbor.integer(sample.temperatureCenti).integer(sample.humidityPermille);
+        cbor.integer(sample.photoresisterValue).boolean(sample.ledOn());
+    }
+
+    // Opens the object shared by /data and /backlog; the caller closes it
+    static void writeReading(PayloadWriter& json, const SensorData& sample) {
+        json.raw("{\"temp\":").fixed(sample.temperatureCenti, 2);
+        json.raw(",\"humi\":").fixed(sample.humidityPermille, 1);
+        json.raw(",\"photoresister\":").number(sample.photoresisterValue);
+        json.raw(",\"ledState\":\"").raw(sample.ledState()).raw("\"");
+    }
+};
+
+#endif
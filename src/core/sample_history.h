@@ -0,0 +1,184 @@
+#ifndef CORE_SAMPLE_HISTORY_H
+#define CORE_SAMPLE_HISTORY_H
+
+#include <new>
+#include <stddef.h>
+#include <stdint.h>
+#include "gorilla_codec.h"
+#include "interfaces.h"
+
+// Store of the most recent samples, Gorilla-compressed (see gorilla_codec.h)
+// and oldest overwritten first. The buffer is allocated once in allocate()
+// and split into BLOCK_BYTES blocks used as a ring: samples are appended to
+// the newest block until it is full, and once every block is in use the
+// oldest one is dropped whole. A DHT sample takes 10 to 19 bits instead of
+// 96, so the same RAM holds five to ten times the history.
+//
+// Appending is O(1) and allocation-free for the life of the app. Readers
+// decode into a visitor, skipping blocks older than they need.
+//
+// Not thread-safe: App serialises the sensing-side append and any reader on
+// the networking side with a mutex.
+class SampleHistory {
+public:
+    static const size_t BLOCK_BYTES = 256;
+    static const size_t MIN_BLOCKS = 4;
+    // For sizing only: about the worst the bench sees, a noisy light sensor
+    static const size_t ESTIMATED_BITS_PER_SAMPLE = 24;
+
+    SampleHistory()
+        : arena(nullptr), blocks(nullptr), blockCount(0), oldestBlock(0), usedBlocks(0), count(0),
+          encoder(idle, sizeof(idle)) {}
+
+    ~SampleHistory() {
+        release();
+    }
+
+    SampleHistory(const SampleHistory&) = delete;
+    SampleHistory& operator=(const SampleHistory&) = delete;
+
+    // Bytes needed to cover retentionMs at one sample per intervalMs,
+    // limited to maxBytes
+    static size_t bytesFor(unsigned long retentionMs, unsigned long intervalMs, size_t maxBytes) {
+        size_t samples = intervalMs > 0 ? retentionMs / intervalMs : retentionMs;
+        size_t wanted = samples / 8 * ESTIMATED_BITS_PER_SAMPLE;
+        size_t chosen = wanted < maxBytes ? wanted : maxBytes;
+        size_t least = MIN_BLOCKS * (BLOCK_BYTES + sizeof(BlockInfo));
+        return chosen > least ? chosen : least;
+    }
+
+    // Halves the request until the heap can satisfy it; fails only if not
+    // even MIN_BLOCKS blocks fit
+    ErrorCode allocate(size_t requestedBytes) {
+        release();
+        for (size_t size = requestedBytes / (BLOCK_BYTES + sizeof(BlockInfo)); size >= MIN_BLOCKS; size /= 2) {
+            arena = new (std::nothrow) uint8_t[size * BLOCK_BYTES];
+            blocks = new (std::nothrow) BlockInfo[size];
+            if (arena && blocks) {
+                blockCount = size;
+                return ErrorCode::SUCCESS;
+            }
+            release();
+        }
+        return ErrorCode::MEMORY_ALLOCATION_FAILED;
+    }
+
+    void append(const SensorData& sample) {
+        if (blockCount == 0) return;
+        if (usedBlocks == 0 || !encoder.append(sample)) {
+            startBlock();
+            encoder.append(sample);  // Always fits an empty block
+        }
+        BlockInfo& info = blocks[newestBlock()];
+        if (encoder.getCount() == 1) info.firstTimestamp = sample.timestamp;
+        info.lastTimestamp = sample.timestamp;
+        count++;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Samples the buffer holds at the compression reached so far
+    size_t getCapacity() const {
+        size_t totalBytes = blockCount * BLOCK_BYTES;
+        size_t usedBytes = usedBlocks > 0 ? (usedBlocks - 1) * BLOCK_BYTES + encoder.getSize() : 0;
+        if (count == 0 || usedBytes == 0) {
+            return totalBytes * 8 / ESTIMATED_BITS_PER_SAMPLE;
+        }
+        return (size_t)((uint64_t)count * totalBytes / usedBytes);
+    }
+
+    size_t getFootprint() const {
+        return blockCount * (BLOCK_BYTES + sizeof(BlockInfo));
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    // Milliseconds between the oldest and newest sample
+    uint32_t span() const {
+        return count < 2 ? 0 : blocks[newestBlock()].lastTimestamp - blocks[oldestBlock].firstTimestamp;
+    }
+
+    // Visits every sample, oldest first; returns how many
+    template <typename Visitor>
+    size_t forEach(Visitor visit) const {
+        return visitFrom(0, false, visit);
+    }
+
+    // Visits every sample taken at or after sinceMs, oldest first; returns
+    // how many. Timestamps only ever grow (modulo millis() wrap), so blocks
+    // that end before sinceMs aren't decoded.
+    template <typename Visitor>
+    size_t forEachSince(uint32_t sinceMs, Visitor visit) const {
+        return visitFrom(sinceMs, true, visit);
+    }
+
+    void clear() {
+        usedBlocks = count = 0;
+    }
+
+private:
+    struct BlockInfo {
+        uint32_t firstTimestamp;
+        uint32_t lastTimestamp;
+    };
+
+    uint8_t* arena;
+    BlockInfo* blocks;
+    size_t blockCount;
+    size_t oldestBlock;
+    size_t usedBlocks;
+    size_t count;
+    uint8_t idle[gorilla::HEADER_BYTES];  // Where the encoder points before the first block
+    GorillaBlockEncoder encoder;          // Appends to the newest block
+
+    void release() {
+        delete[] arena;
+        delete[] blocks;
+        arena = nullptr;
+        blocks = nullptr;
+        blockCount = oldestBlock = usedBlocks = count = 0;
+        encoder = GorillaBlockEncoder(idle, sizeof(idle));
+    }
+
+    size_t newestBlock() const {
+        size_t block = oldestBlock + usedBlocks - 1;
+        return block >= blockCount ? block - blockCount : block;
+    }
+
+    uint8_t* blockData(size_t block) const {
+        return arena + block * BLOCK_BYTES;
+    }
+
+    void startBlock() {
+        if (usedBlocks == blockCount) {
+            count -= GorillaBlockDecoder(blockData(oldestBlock), BLOCK_BYTES).getCount();
+            oldestBlock = oldestBlock + 1 == blockCount ? 0 : oldestBlock + 1;
+            usedBlocks--;
+        }
+        usedBlocks++;
+        encoder = GorillaBlockEncoder(blockData(newestBlock()), BLOCK_BYTES);
+    }
+
+    template <typename Visitor>
+    size_t visitFrom(uint32_t sinceMs, bool filtered, Visitor& visit) const {
+        size_t visited = 0;
+        for (size_t i = 0; i < usedBlocks; i++) {
+            size_t block = oldestBlock + i < blockCount ? oldestBlock + i : oldestBlock + i - blockCount;
+            if (filtered && (int32_t)(blocks[block].lastTimestamp - sinceMs) < 0) continue;
+            GorillaBlockDecoder decoder(blockData(block), BLOCK_BYTES);
+            SensorData sample;
+            while (decoder.next(sample)) {
+                if (filtered && (int32_t)(sample.timestamp - sinceMs) < 0) continue;
+                visit(sample);
+                visited++;
+            }
+        }
+        return visited;
+    }
+};
+
+#endif
@@ -0,0 +1,184 @@
+#ifndef CORE_SCHEDULER_H
+#define CORE_SCHEDULER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <memory>
+#include "latency_histogram.h"
+
+// Deadline-driven task scheduler for the main loop. Each subsystem registers
+// a period; runDue() runs whatever is due (earliest deadline first, kept in
+// a fixed-size binary min-heap) and returns how long the loop may sleep
+// before the next deadline. Tasks can also be pulled forward with runAt()
+// or wake() when an event makes them due early. Every run is timed into a
+// per-task latency histogram.
+class Scheduler {
+public:
+    typedef int TaskId;
+    static const int MAX_TASKS = 12;
+    static const TaskId INVALID_TASK = -1;
+
+    Scheduler() : taskCount(0), heapSize(0), wakeups(0), runs(0) {}
+
+    // First run happens on the next runDue(); periods of 0 are treated as 1 ms
+    TaskId addTask(const char* name, unsigned long periodMs, std::function<void()> callback) {
+        if (taskCount >= MAX_TASKS) {
+            return INVALID_TASK;
+        }
+        TaskId id = taskCount++;
+        tasks[id].name = name;
+        tasks[id].period = periodMs > 0 ? periodMs : 1;
+        tasks[id].due = millis();
+        tasks[id].callback = callback;
+        tasks[id].latency.reset(new LatencyHistogram());
+        heap[heapSize] = id;
+        position[id] = heapSize++;
+        siftUp(position[id]);
+        return id;
+    }
+
+    // New period applies from the next run, or sooner if that is earlier
+    void setPeriod(TaskId id, unsigned long periodMs) {
+        if (!isValid(id)) return;
+        unsigned long lastRun = tasks[id].due - tasks[id].period;
+        tasks[id].period = periodMs > 0 ? periodMs : 1;
+        runAt(id, lastRun + tasks[id].period);
+    }
+
+    // Pull a task's next run forward to dueMs (never pushes it back)
+    void runAt(TaskId id, unsigned long dueMs) {
+        if (!isValid(id)) return;
+        if (isBefore(dueMs, tasks[id].due)) {
+            tasks[id].due = dueMs;
+            siftUp(position[id]);
+        }
+    }
+
+    void wake(TaskId id) {
+        runAt(id, millis());
+    }
+
+    // Runs every task whose deadline has passed and returns the number of
+    // milliseconds until the earliest remaining deadline
+    unsigned long runDue() {
+        if (heapSize == 0) {
+            return 1000;
+        }
+
+        wakeups++;
+        unsigned long now = millis();
+        // Bounded so a task that keeps re-waking itself cannot starve the caller
+        for (int budget = 2 * taskCount; budget > 0 && !isBefore(now, tasks[heap[0]].due); budget--) {
+            TaskId id = heap[0];
+            Task& task = tasks[id];
+
+            // Stay on the period grid unless we overran a whole period
+            task.due += task.period;
+            if (isBefore(task.due, now)) {
+                task.due = now + task.period;
+            }
+            siftDown(0);
+
+            StageTimer timer;
+            task.callback();
+            task.latency->record(timer.elapsedMicros());
+            runs++;
+            now = millis();
+        }
+
+        return timeUntilNext();
+    }
+
+    // Milliseconds until the earliest deadline, 0 if something is already due
+    unsigned long timeUntilNext() const {
+        if (heapSize == 0) {
+            return 1000;
+        }
+        unsigned long now = millis();
+        unsigned long next = tasks[heap[0]].due;
+        return isBefore(now, next) ? next - now : 0;
+    }
+
+    const char* getTaskName(TaskId id) const {
+        return isValid(id) ? tasks[id].name : "";
+    }
+    
+    // Task ids are 0..getTaskCount()-1 in registration order
+    int getTaskCount() const {
+        return taskCount;
+    }
+    
+    const LatencyHistogram* getLatency(TaskId id) const {
+        return isValid(id) ? tasks[id].latency.get() : nullptr;
+    }
+
+    unsigned long getWakeups() const {
+        return wakeups;
+    }
+
+    unsigned long getRuns() const {
+        return runs;
+    }
+
+private:
+    struct Task {
+        const char* name;
+        unsigned long period;
+        unsigned long due;
+        std::function<void()> callback;
+        std::unique_ptr<LatencyHistogram> latency;  // Allocated in addTask so unused slots stay small
+    };
+
+    Task tasks[MAX_TASKS];
+    TaskId heap[MAX_TASKS];   // Task ids ordered by due time
+    int position[MAX_TASKS];  // Index of each task inside heap
+    int taskCount;
+    int heapSize;
+    unsigned long wakeups;
+    unsigned long runs;
+
+    bool isValid(TaskId id) const {
+        return id >= 0 && id < taskCount;
+    }
+
+    // Wrap-safe ordering of millis() timestamps
+    static bool isBefore(unsigned long a, unsigned long b) {
+        return (long)(a - b) < 0;
+    }
+
+    bool earlier(int i, int j) const {
+        return isBefore(tasks[heap[i]].due, tasks[heap[j]].due);
+    }
+
+    void swapEntries(int i, int j) {
+        TaskId tmp = heap[i];
+        heap[i] = heap[j];
+        heap[j] = tmp;
+        position[heap[i]] = i;
+        position[heap[j]] = j;
+    }
+
+    void siftUp(int i) {
+        while (i > 0) {
+            int parent = (i - 1) / 2;
+            if (!earlier(i, parent)) break;
+            swapEntries(i, parent);
+            i = parent;
+        }
+    }
+
+    void siftDown(int i) {
+        while (true) {
+            int smallest = i;
+            int left = 2 * i + 1;
+            int right = left + 1;
+            if (left < heapSize && earlier(left, smallest)) smallest = left;
+            if (right < heapSize && earlier(right, smallest)) smallest = right;
+            if (smallest == i) break;
+            swapEntries(i, smallest);
+            i = smallest;
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef CORE_SPSC_QUEUE_H
+#define CORE_SPSC_QUEUE_H
+
+#include <atomic>
+#include <stddef.h>
+
+// Bounded single-producer/single-consumer queue. One task pushes, one task
+// pops, and neither ever blocks or takes a lock, so the sensing core keeps
+// its timing while the networking core is stuck in a connect(). When the
+// queue is full push() fails and the drop is counted.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    SpscQueue() : head(0), tail(0), dropped(0) {}
+
+    // Producer side
+    bool push(const T& item) {
+        size_t currentTail = tail.load(std::memory_order_relaxed);
+        if (currentTail - head.load(std::memory_order_acquire) >= Capacity) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        slots[currentTail & (Capacity - 1)] = item;
+        tail.store(currentTail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool pop(T& item) {
+        size_t currentHead = head.load(std::memory_order_relaxed);
+        if (currentHead == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = slots[currentHead & (Capacity - 1)];
+        head.store(currentHead + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Either side; only a snapshot while the other side is running
+    bool empty() const {
+        return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+    }
+
+    size_t size() const {
+        return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+    }
+
+    unsigned long getDropped() const {
+        return dropped.load(std::memory_order_relaxed);
+    }
+
+private:
+    T slots[Capacity];
+    std::atomic<size_t> head;  // Next slot to pop, written by the consumer
+    std::atomic<size_t> tail;  // Next slot to push, written by the producer
+    std::atomic<unsigned long> dropped;
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef CORE_STATIC_EVENT_BUS_H
+#define CORE_STATIC_EVENT_BUS_H
+
+#include <stdint.h>
+#include "event_bus.h"
+#include "event_queue.h"
+
+// Drop-in replacement for EventBus with the same dispatch semantics
+// (synchronous, in subscription order, per-type latency histograms) but
+// fixed storage: handlers live in an array indexed by EventType, each one
+// a plain function pointer plus context. subscribe() never allocates and
+// publish() is an array index and direct calls. Subscribing past
+// MaxHandlers fails instead of growing.
+//
+// post() is the deferred alternative to publish(): the event goes into a
+// fixed ring (safe from ISRs and the other core) and handlers run when the
+// owner calls dispatchQueued() at a defined point in its loop.
+template <size_t MaxHandlers, size_t QueueCapacity = 16>
+class StaticEventBus {
+    static_assert(MaxHandlers > 0 && MaxHandlers <= 255, "Handler counts are stored in a byte");
+
+public:
+    typedef void (*HandlerFunction)(void* context, const Event& event);
+    typedef void (*LatencyVisitor)(void* context, EventType type, const LatencyHistogram& latency);
+
+    StaticEventBus() {
+        clear();
+    }
+
+    bool subscribe(EventType type, HandlerFunction function, void* context) {
+        size_t index = (size_t)type;
+        if (index >= EVENT_TYPE_COUNT || counts[index] >= MaxHandlers) {
+            return false;
+        }
+        handlers[index][counts[index]++] = Handler{function, context};
+        return true;
+    }
+
+    // Binds a member function at compile time: subscribe<App, &App::onFoo>(type, this)
+    template <typename T, void (T::*Method)(const Event&)>
+    bool subscribe(EventType type, T* object) {
+        return subscribe(type, &invokeMember<T, Method>, object);
+    }
+
+    void publish(const Event& event) {
+        size_t index = (size_t)event.type;
+        if (index >= EVENT_TYPE_COUNT || counts[index] == 0) {
+            return;
+        }
+        StageTimer timer;
+        const Handler* typeHandlers = handlers[index];
+        for (uint8_t i = 0, n = counts[index]; i < n; i++) {
+            typeHandlers[i].function(typeHandlers[i].context, event);
+        }
+        latency[index].record(timer.elapsedMicros());
+    }
+
+    bool post(const Event& event) {
+        return queue.post(event);
+    }
+
+    void setCoalescing(EventType type, bool enabled) {
+        queue.setCoalescing(type, enabled);
+    }
+
+    // Runs handlers for up to maxEvents queued events, oldest first, including
+    // ones posted by those handlers. Returns how many were dispatched.
+    size_t dispatchQueued(size_t maxEvents) {
+        Event batch[DISPATCH_CHUNK];
+        size_t dispatched = 0;
+        while (dispatched < maxEvents) {
+            size_t wanted = maxEvents - dispatched < DISPATCH_CHUNK ? maxEvents - dispatched : DISPATCH_CHUNK;
+            size_t taken = queue.take(batch, wanted);
+            for (size_t i = 0; i < taken; i++) {
+                publish(batch[i]);
+            }
+            dispatched += taken;
+            if (taken < wanted) break;
+        }
+        return dispatched;
+    }
+
+    bool hasQueued() {
+        return !queue.empty();
+    }
+
+    typename DeferredEventQueue<QueueCapacity>::Stats getQueueStats() {
+        return queue.getStats();
+    }
+
+    // Visits every type that has at least one subscriber
+    void forEachLatency(LatencyVisitor visitor, void* context) const {
+        for (size_t i = 0; i < EVENT_TYPE_COUNT; i++) {
+            if (counts[i] > 0) {
+                visitor(context, (EventType)i, latency[i]);
+            }
+        }
+    }
+
+    void clear() {
+        for (size_t i = 0; i < EVENT_TYPE_COUNT; i++) {
+            counts[i] = 0;
+        }
+    }
+
+private:
+    struct Handler {
+        HandlerFunction function;
+        void* context;
+    };
+
+    static const size_t DISPATCH_CHUNK = 4;  // Events copied out per critical section
+
+    Handler handlers[EVENT_TYPE_COUNT][MaxHandlers];
+    uint8_t counts[EVENT_TYPE_COUNT];
+    LatencyHistogram latency[EVENT_TYPE_COUNT];
+    DeferredEventQueue<QueueCapacity> queue;
+
+    template <typename T, void (T::*Method)(const Event&)>
+    static void invokeMember(void* object, const Event& event) {
+        (static_cast<T*>(object)->*Method)(event);
+    }
+};
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef CORE_TOPIC_ROUTER_H
+#define CORE_TOPIC_ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// MQTT filter match with '+' and '#' wildcards. "a/#" also matches "a".
+inline bool topicMatches(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') return true;
+        if (*filter == '+') {
+            while (*topic && *topic != '/') topic++;
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) {
+            return *topic == '\0' && filter[0] == '/' && filter[1] == '#' && filter[2] == '\0';
+        }
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+// An inbound message as the client received it: the payload points into
+// the client's receive buffer, is not NUL-terminated and is only valid
+// for the duration of the handler call.
+struct MqttMessage {
+    const char* topic;
+    const uint8_t* payload;
+    size_t length;
+
+    bool equals(const char* text) const {
+        size_t textLength = strlen(text);
+        return textLength == length && memcmp(payload, text, length) == 0;
+    }
+
+    // The whole payload as a decimal number; false if empty, anything but
+    // digits, or too large
+    bool toUnsigned(unsigned long& value) const {
+        if (length == 0 || length > 9) return false;
+        unsigned long result = 0;
+        for (size_t i = 0; i < length; i++) {
+            if (payload[i] < '0' || payload[i] > '9') return false;
+            result = result * 10 + (payload[i] - '0');
+        }
+        value = result;
+        return true;
+    }
+};
+
+// Dispatches inbound messages to handlers by topic filter, without copying
+// the topic or payload. Filters live in fixed slots along with the length
+// of their literal prefix (everything before the first wildcard), so a
+// route is ruled out with one length check and one memcmp; wildcard
+// matching only runs on what is left. Every matching route is called, in
+// the order they were added. Adding past MaxRoutes fails instead of
+// growing.
+template <size_t MaxRoutes>
+class TopicRouter {
+    static_assert(MaxRoutes > 0 && MaxRoutes <= 255, "Route counts are stored in a byte");
+
+public:
+    static const size_t FILTER_BYTES = 64;
+    typedef void (*HandlerFunction)(void* context, const MqttMessage& message);
+
+    TopicRouter() : count(0) {}
+
+    bool add(const char* filter, HandlerFunction function, void* context) {
+        size_t length = strlen(filter);
+        if (count >= MaxRoutes || length == 0 || length >= FILTER_BYTES) {
+            return false;
+        }
+        Route& route = routes[count++];
+        memcpy(route.filter, filter, length + 1);
+        route.length = (uint8_t)length;
+        route.literalLength = (uint8_t)strcspn(filter, "+#");
+        route.function = function;
+        route.context = context;
+        return true;
+    }
+
+    // Binds a member function at compile time: add<App, &App::onFoo>(filter, this)
+    template <typename T, void (T::*Method)(const MqttMessage&)>
+    bool add(const char* filter, T* object) {
+        return add(filter, &invokeMember<T, Method>, object);
+    }
+
+    // Returns how many handlers ran
+    size_t dispatch(const char* topic, const uint8_t* payload, size_t length) const {
+        MqttMessage message = {topic, payload, length};
+        size_t topicLength = strlen(topic);
+        size_t handled = 0;
+        for (uint8_t i = 0; i < count; i++) {
+            const Route& route = routes[i];
+            if (matches(route, topic, topicLength)) {
+                route.function(route.context, message);
+                handled++;
+            }
+        }
+        return handled;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // For subscribing to every route on (re)connect
+    const char* filter(size_t index) const {
+        return routes[index].filter;
+    }
+
+    void clear() {
+        count = 0;
+    }
+
+private:
+    struct Route {
+        char filter[FILTER_BYTES];
+        uint8_t length;
+        uint8_t literalLength;
+        HandlerFunction function;
+        void* context;
+    };
+
+    Route routes[MaxRoutes];
+    uint8_t count;
+
+    static bool matches(const Route& route, const char* topic, size_t topicLength) {
+        if (route.literalLength == route.length) {
+            return topicLength == route.length && memcmp(topic, route.filter, topicLength) == 0;
+        }
+        // "a/#" matches "a" too, which is one byte short of its literal prefix
+        size_t literal = route.literalLength;
+        if (topicLength < literal) {
+            return topicLength + 1 == literal && route.filter[literal] == '#' &&
+                   memcmp(topic, route.filter, topicLength) == 0;
+        }
+        return memcmp(topic, route.filter, literal) == 0 && topicMatches(route.filter + literal, topic + literal);
+    }
+
+    template <typename T, void (T::*Method)(const MqttMessage&)>
+    static void invokeMember(void* context, const MqttMessage& message) {
+        (static_cast<T*>(context)->*Method)(message);
+    }
+};
+
+#endif
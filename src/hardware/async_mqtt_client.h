@@ -0,0 +1,632 @@
+#ifndef HARDWARE_ASYNC_MQTT_CLIENT_H
+#define HARDWARE_ASYNC_MQTT_CLIENT_H
+
+#include <Arduino.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <functional>
+#include <memory>
+#include "../core/interfaces.h"
+#include "../core/latency_histogram.h"
+#include "../core/logger.h"
+#include "../core/topic_router.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// MQTT 3.1.1 client on a non-blocking socket, as an alternative to
+// PubSubClient. connect() only starts the TCP handshake and update() does
+// whatever the socket allows without waiting: finish connecting, send what
+// is queued, parse what has arrived, keep the session alive. A slow or
+// unreachable broker therefore never stalls the caller.
+//
+// QoS1 publishes are pipelined: up to `window` of them can wait for their
+// PUBACK at once. Every one is reported exactly once to the delivery
+// callback, as acknowledged or as dropped with the connection. Sessions
+// are clean, so nothing is retransmitted here; the caller keeps its copy
+// until the ack and sends it again if it was dropped (see SampleUplink).
+// Inbound messages are delivered at QoS0, with the payload handed out in
+// place from the receive buffer.
+//
+// Talks to lwIP's BSD socket API on the device and to the host's on the
+// native build. Not thread-safe; only the networking side touches it.
+class AsyncMqttClient : public IMqttClient {
+public:
+    static const size_t MAX_WINDOW = 32;
+    static const size_t MAX_SUBSCRIPTIONS = 8;
+    static const size_t TOPIC_BYTES = 64;
+    static const size_t CREDENTIAL_BYTES = 64;
+    static const unsigned long CONNECT_TIMEOUT = 10000;  // TCP handshake plus CONNACK
+
+    enum class State : uint8_t { DISCONNECTED, CONNECTING, AWAITING_CONNACK, CONNECTED };
+
+    struct Stats {
+        unsigned long connects;
+        unsigned long published;  // QoS0 and QoS1
+        unsigned long acked;
+        unsigned long dropped;    // QoS1 publishes lost with their connection
+        unsigned long received;
+        size_t maxInFlight;
+    };
+
+    typedef std::function<void(uint16_t packetId, bool acked)> DeliveryCallback;
+
+    // bufferBytes bounds one packet either way; window is capped at MAX_WINDOW
+    AsyncMqttClient(size_t bufferBytes = 2048, size_t window = 8)
+        : port(1883), keepAliveSeconds(30), sock(-1), sendFailed(false), state(State::DISCONNECTED), stateSince(0),
+          lastSendAt(0), lastReceiveAt(0), txCapacity(bufferBytes), txStart(0), txEnd(0),
+          rxCapacity(bufferBytes), rxLength(0), window(window < 1 ? 1 : window > MAX_WINDOW ? MAX_WINDOW : window),
+          inFlightHead(0), inFlightCount(0), nextPacketId(1), subscriptionCount(0), stats() {
+        txBuffer.reset(new uint8_t[txCapacity]);
+        rxBuffer.reset(new uint8_t[rxCapacity + 1]);  // Room to terminate a payload in place
+        strcpy(clientId, "esp32");
+        host[0] = username[0] = password[0] = '\0';
+    }
+
+    ~AsyncMqttClient() override {
+        closeSocket();
+    }
+
+    void setPort(uint16_t brokerPort) {
+        port = brokerPort;
+    }
+
+    void setClientId(const char* id) {
+        copy(clientId, id, sizeof(clientId));
+    }
+
+    void setKeepAlive(uint16_t seconds) {
+        keepAliveSeconds = seconds;
+    }
+
+    void setDeliveryCallback(DeliveryCallback callback) {
+        deliveryCallback = callback;
+    }
+
+    // Starts connecting and returns PENDING; update() finishes the job.
+    // broker is an IPv4 address, or a host name resolved here (blocking).
+    ErrorCode connect(const char* broker, const char* user, const char* pass) override {
+        if (state == State::CONNECTED) return ErrorCode::SUCCESS;
+        if (state != State::DISCONNECTED) return ErrorCode::PENDING;
+        copy(host, broker, sizeof(host));
+        copy(username, user, sizeof(username));
+        copy(password, pass, sizeof(password));
+
+        struct sockaddr_in address;
+        if (!resolve(address)) {
+            LOG_ERRORF("[AsyncMQTT] Cannot resolve %s", host);
+            return ErrorCode::MQTT_CONNECTION_FAILED;
+        }
+
+        sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) {
+            LOG_ERRORF("[AsyncMQTT] socket() failed: %d", errno);
+            return ErrorCode::MQTT_CONNECTION_FAILED;
+        }
+        fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+        // Pipelined publishes are small; don't let Nagle hold them back for an ack
+        int noDelay = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+
+        txStart = txEnd = rxLength = 0;
+        stateSince = millis();
+        if (::connect(sock, (struct sockaddr*)&address, sizeof(address)) == 0) {
+            sendConnect();
+            return ErrorCode::PENDING;
+        }
+        if (errno != EINPROGRESS) {
+            LOG_ERRORF("[AsyncMQTT] connect to %s:%u failed: %d", host, (unsigned)port, errno);
+            closeSocket();
+            return ErrorCode::MQTT_CONNECTION_FAILED;
+        }
+        state = State::CONNECTING;
+        return ErrorCode::PENDING;
+    }
+
+    // Never blocks. Call often; packets only move from here.
+    void update() {
+        if (state == State::DISCONNECTED) return;
+        unsigned long now = millis();
+
+        if (state == State::CONNECTING) {
+            if (!socketReady(false)) {
+                if (now - stateSince > CONNECT_TIMEOUT) drop("TCP connect timed out");
+                return;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) {
+                LOG_WARNF("[AsyncMQTT] connect to %s:%u failed: %d", host, (unsigned)port, error);
+                drop(nullptr);
+                return;
+            }
+            sendConnect();
+        }
+
+        if (!flushOrDrop()) return;
+        receive();
+        if (state == State::DISCONNECTED) return;
+        if (!flushOrDrop()) return;  // PUBACKs for what just arrived
+
+        if (state == State::AWAITING_CONNACK) {
+            if (now - stateSince > CONNECT_TIMEOUT) drop("no CONNACK");
+            return;
+        }
+        if (keepAliveSeconds > 0) {
+            now = millis();
+            unsigned long keepAliveMs = keepAliveSeconds * 1000UL;
+            if (now - lastReceiveAt > keepAliveMs * 3 / 2) {
+                drop("broker silent past the keep-alive");
+                return;
+            }
+            if (now - lastSendAt >= keepAliveMs) {
+                const uint8_t ping[] = {0xC0, 0x00};
+                queue(ping, sizeof(ping));
+                flushOrDrop();
+            }
+        }
+    }
+
+    ErrorCode publish(const char* topic, const char* payload) override {
+        return publish(topic, (const uint8_t*)payload, strlen(payload), 0, false);
+    }
+
+    // QoS 0 or 1. PENDING means not now: the window or the send buffer is
+    // full. packetId is set for QoS1 and matches the delivery callback.
+    ErrorCode publish(const char* topic, const uint8_t* payload, size_t length, uint8_t qos, bool retained,
+                      uint16_t* packetId = nullptr) {
+        if (state != State::CONNECTED || qos > 1) return ErrorCode::MQTT_PUBLISH_FAILED;
+        size_t topicLength = strlen(topic);
+        size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+        size_t packetBytes = 1 + lengthBytes(remaining) + remaining;
+        if (packetBytes > txCapacity) return ErrorCode::MQTT_PUBLISH_FAILED;
+        if (qos > 0 && inFlightCount >= window) return ErrorCode::PENDING;
+        if (txRoom() < packetBytes) {
+            flush();
+            if (txRoom() < packetBytes) return ErrorCode::PENDING;
+        }
+
+        compactTx(packetBytes);
+        uint8_t* out = txBuffer.get() + txEnd;
+        *out++ = 0x30 | (qos << 1) | (retained ? 1 : 0);
+        out = writeLength(out, remaining);
+        out = writeString(out, topic, topicLength);
+        uint16_t id = 0;
+        if (qos > 0) {
+            id = takePacketId();
+            *out++ = id >> 8;
+            *out++ = id & 0xFF;
+            InFlight& slot = inFlight[(inFlightHead + inFlightCount) % window];
+            slot.packetId = id;
+            slot.sentAt = micros();
+            inFlightCount++;
+            if (inFlightCount > stats.maxInFlight) stats.maxInFlight = inFlightCount;
+        }
+        memcpy(out, payload, length);
+        txEnd += packetBytes;
+        stats.published++;
+        if (packetId) *packetId = id;
+        flush();
+        return ErrorCode::SUCCESS;
+    }
+
+    // Whether publish() of this size would be accepted right now
+    bool canPublish(size_t topicLength, size_t length, uint8_t qos) const {
+        size_t remaining = 2 + topicLength + (qos > 0 ? 2 : 0) + length;
+        return state == State::CONNECTED && (qos == 0 || inFlightCount < window) &&
+               txRoom() >= 1 + lengthBytes(remaining) + remaining;
+    }
+
+    // Kept across reconnects; the callback gets the payload NUL-terminated
+    ErrorCode subscribe(const char* topic, std::function<void(const char*)> callback) override {
+        if (subscriptionCount >= MAX_SUBSCRIPTIONS || strlen(topic) >= TOPIC_BYTES) {
+            return ErrorCode::MEMORY_ALLOCATION_FAILED;
+        }
+        Subscription& subscription = subscriptions[subscriptionCount++];
+        copy(subscription.topic, topic, sizeof(subscription.topic));
+        subscription.callback = callback;
+        if (state == State::CONNECTED) sendSubscribe(subscription);
+        return ErrorCode::SUCCESS;
+    }
+
+    bool isConnected() override {
+        return state == State::CONNECTED;
+    }
+
+    // Sends DISCONNECT if it can, then closes; in-flight publishes are dropped
+    void disconnect() {
+        if (state == State::CONNECTED) {
+            const uint8_t packet[] = {0xE0, 0x00};
+            queue(packet, sizeof(packet));
+            flush();
+        }
+        drop(nullptr);
+    }
+
+    State getState() const {
+        return state;
+    }
+
+    size_t getInFlight() const {
+        return inFlightCount;
+    }
+
+    size_t getWindow() const {
+        return window;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    // Publish to PUBACK
+    const LatencyHistogram& getAckLatency() const {
+        return ackLatency;
+    }
+
+    // Socket to select() on while idle; -1 when there is none
+    int fd() const {
+        return sock;
+    }
+
+private:
+    struct InFlight {
+        uint16_t packetId;
+        uint32_t sentAt;  // micros()
+    };
+
+    struct Subscription {
+        char topic[TOPIC_BYTES];
+        std::function<void(const char*)> callback;
+    };
+
+    char host[CREDENTIAL_BYTES];
+    char clientId[CREDENTIAL_BYTES];
+    char username[CREDENTIAL_BYTES];
+    char password[CREDENTIAL_BYTES];
+    uint16_t port;
+    uint16_t keepAliveSeconds;
+    int sock;
+    bool sendFailed;
+    State state;
+    unsigned long stateSince;
+    unsigned long lastSendAt;
+    unsigned long lastReceiveAt;
+
+    std::unique_ptr<uint8_t[]> txBuffer;
+    size_t txCapacity;
+    size_t txStart;  // Queued bytes are [txStart, txEnd)
+    size_t txEnd;
+    std::unique_ptr<uint8_t[]> rxBuffer;
+    size_t rxCapacity;
+    size_t rxLength;
+
+    InFlight inFlight[MAX_WINDOW];  // Ring, oldest at inFlightHead
+    size_t window;
+    size_t inFlightHead;
+    size_t inFlightCount;
+    uint16_t nextPacketId;
+
+    Subscription subscriptions[MAX_SUBSCRIPTIONS];
+    size_t subscriptionCount;
+    DeliveryCallback deliveryCallback;
+    Stats stats;
+    LatencyHistogram ackLatency;
+
+    static void copy(char* destination, const char* source, size_t size) {
+        strncpy(destination, source ? source : "", size - 1);
+        destination[size - 1] = '\0';
+    }
+
+    bool resolve(struct sockaddr_in& address) {
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        if (inet_pton(AF_INET, host, &address.sin_addr) == 1) return true;
+
+        struct addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        struct addrinfo* result = nullptr;
+        if (getaddrinfo(host, nullptr, &hints, &result) != 0 || !result) return false;
+        address.sin_addr = ((struct sockaddr_in*)result->ai_addr)->sin_addr;
+        freeaddrinfo(result);
+        return true;
+    }
+
+    bool socketReady(bool forReading) const {
+        fd_set set;
+        FD_ZERO(&set);
+        FD_SET(sock, &set);
+        struct timeval timeout = {0, 0};
+        return select(sock + 1, forReading ? &set : nullptr, forReading ? nullptr : &set, nullptr, &timeout) > 0;
+    }
+
+    static size_t lengthBytes(size_t remaining) {
+        return remaining < 128 ? 1 : remaining < 16384 ? 2 : remaining < 2097152 ? 3 : 4;
+    }
+
+    static uint8_t* writeLength(uint8_t* out, size_t remaining) {
+        do {
+            uint8_t digit = remaining % 128;
+            remaining /= 128;
+            *out++ = remaining > 0 ? (digit | 0x80) : digit;
+        } while (remaining > 0);
+        return out;
+    }
+
+    static uint8_t* writeString(uint8_t* out, const char* text, size_t length) {
+        *out++ = length >> 8;
+        *out++ = length & 0xFF;
+        memcpy(out, text, length);
+        return out + length;
+    }
+
+    uint16_t takePacketId() {
+        uint16_t id = nextPacketId++;
+        if (nextPacketId == 0) nextPacketId = 1;
+        return id;
+    }
+
+    size_t txRoom() const {
+        return txCapacity - (txEnd - txStart);
+    }
+
+    // Makes `bytes` contiguous at txEnd, moving what is still queued to the front
+    void compactTx(size_t bytes) {
+        if (txEnd + bytes <= txCapacity) return;
+        memmove(txBuffer.get(), txBuffer.get() + txStart, txEnd - txStart);
+        txEnd -= txStart;
+        txStart = 0;
+    }
+
+    bool queue(const uint8_t* packet, size_t length) {
+        if (txRoom() < length) return false;
+        compactTx(length);
+        memcpy(txBuffer.get() + txEnd, packet, length);
+        txEnd += length;
+        return true;
+    }
+
+    void sendConnect() {
+        size_t idLength = strlen(clientId);
+        size_t userLength = strlen(username);
+        size_t passLength = strlen(password);
+        size_t remaining = 10 + 2 + idLength;
+        uint8_t flags = 0x02;  // Clean session
+        if (userLength > 0) {
+            flags |= 0x80;
+            remaining += 2 + userLength;
+            if (passLength > 0) {
+                flags |= 0x40;
+                remaining += 2 + passLength;
+            }
+        }
+
+        uint8_t packet[16 + 3 * CREDENTIAL_BYTES];
+        uint8_t* out = packet;
+        *out++ = 0x10;
+        out = writeLength(out, remaining);
+        out = writeString(out, "MQTT", 4);
+        *out++ = 4;  // Protocol level 3.1.1
+        *out++ = flags;
+        *out++ = keepAliveSeconds >> 8;
+        *out++ = keepAliveSeconds & 0xFF;
+        out = writeString(out, clientId, idLength);
+        if (flags & 0x80) out = writeString(out, username, userLength);
+        if (flags & 0x40) out = writeString(out, password, passLength);
+        queue(packet, out - packet);
+
+        state = State::AWAITING_CONNACK;
+        stateSince = lastReceiveAt = millis();
+        flush();
+    }
+
+    void sendSubscribe(const Subscription& subscription) {
+        size_t topicLength = strlen(subscription.topic);
+        uint8_t packet[8 + TOPIC_BYTES];
+        uint8_t* out = packet;
+        *out++ = 0x82;
+        out = writeLength(out, 2 + 2 + topicLength + 1);
+        uint16_t id = takePacketId();
+        *out++ = id >> 8;
+        *out++ = id & 0xFF;
+        out = writeString(out, subscription.topic, topicLength);
+        *out++ = 0;  // Requested QoS
+        if (!queue(packet, out - packet)) {
+            LOG_WARNF("[AsyncMQTT] No room to subscribe to %s", subscription.topic);
+            return;
+        }
+        flush();
+    }
+
+    // A failed send is only noted here; update() drops the connection, so
+    // delivery callbacks never run from inside publish()
+    void flush() {
+        while (sock >= 0 && !sendFailed && txEnd > txStart) {
+            ssize_t sent = send(sock, txBuffer.get() + txStart, txEnd - txStart, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) sendFailed = true;
+                return;
+            }
+            txStart += sent;
+            lastSendAt = millis();
+        }
+        if (txStart == txEnd) txStart = txEnd = 0;
+    }
+
+    bool flushOrDrop() {
+        flush();
+        if (sendFailed) {
+            drop("send failed");
+            return false;
+        }
+        return true;
+    }
+
+    void receive() {
+        while (sock >= 0) {
+            if (rxLength == rxCapacity) {
+                drop("packet larger than the receive buffer");
+                return;
+            }
+            ssize_t received = recv(sock, rxBuffer.get() + rxLength, rxCapacity - rxLength, MSG_DONTWAIT);
+            if (received == 0) {
+                drop("closed by the broker");
+                return;
+            }
+            if (received < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) return;
+                drop("receive failed");
+                return;
+            }
+            rxLength += received;
+            lastReceiveAt = millis();
+            parsePackets();
+        }
+    }
+
+    void parsePackets() {
+        size_t offset = 0;
+        while (sock >= 0 && rxLength - offset >= 2) {
+            // Remaining length: 1-4 bytes, 7 bits each
+            size_t remaining = 0;
+            size_t headerBytes = 1;
+            bool complete = false;
+            while (headerBytes <= 4 && offset + headerBytes < rxLength) {
+                uint8_t digit = rxBuffer[offset + headerBytes];
+                remaining |= (size_t)(digit & 0x7F) << (7 * (headerBytes - 1));
+                headerBytes++;
+                if ((digit & 0x80) == 0) {
+                    complete = true;
+                    break;
+                }
+            }
+            if (!complete) {
+                if (headerBytes > 4) drop("malformed packet length");
+                break;
+            }
+            if (headerBytes + remaining > rxCapacity) {
+                drop("packet larger than the receive buffer");
+                return;
+            }
+            if (offset + headerBytes + remaining > rxLength) break;
+
+            handlePacket(rxBuffer.get() + offset, rxBuffer.get() + offset + headerBytes, remaining);
+            offset += headerBytes + remaining;
+        }
+        if (sock < 0) return;
+        memmove(rxBuffer.get(), rxBuffer.get() + offset, rxLength - offset);
+        rxLength -= offset;
+    }
+
+    void handlePacket(uint8_t* header, uint8_t* body, size_t length) {
+        switch (header[0] >> 4) {
+        case 2:  // CONNACK
+            if (length < 2 || body[1] != 0) {
+                LOG_ERRORF("[AsyncMQTT] Broker refused the connection, code %d", length < 2 ? -1 : body[1]);
+                drop(nullptr);
+                return;
+            }
+            state = State::CONNECTED;
+            stats.connects++;
+            LOG_INFOF("[AsyncMQTT] Connected to %s:%u as %s", host, (unsigned)port, clientId);
+            for (size_t i = 0; i < subscriptionCount; i++) {
+                sendSubscribe(subscriptions[i]);
+            }
+            break;
+        case 3:  // PUBLISH
+            onPublish(header[0], body, length);
+            break;
+        case 4:  // PUBACK
+            if (length >= 2) onPuback((body[0] << 8) | body[1]);
+            break;
+        case 9:  // SUBACK
+            if (length >= 3 && body[2] == 0x80) LOG_WARN("[AsyncMQTT] Broker rejected a subscription");
+            break;
+        default:  // PINGRESP; the timestamp is all that mattered
+            break;
+        }
+    }
+
+    void onPublish(uint8_t flags, uint8_t* body, size_t length) {
+        uint8_t qos = (flags >> 1) & 0x03;
+        if (length < 2) return;
+        size_t topicLength = (body[0] << 8) | body[1];
+        size_t headerLength = 2 + topicLength + (qos > 0 ? 2 : 0);
+        if (headerLength > length || topicLength >= TOPIC_BYTES) return;
+
+        char topic[TOPIC_BYTES];
+        memcpy(topic, body + 2, topicLength);
+        topic[topicLength] = '\0';
+        if (qos == 1) {
+            const uint8_t ack[] = {0x40, 0x02, body[2 + topicLength], body[3 + topicLength]};
+            queue(ack, sizeof(ack));
+        }
+
+        // Terminate the payload in place; the byte after it is restored below
+        char* payload = (char*)body + headerLength;
+        char* end = (char*)body + length;
+        char saved = *end;
+        *end = '\0';
+        stats.received++;
+        for (size_t i = 0; i < subscriptionCount; i++) {
+            if (topicMatches(subscriptions[i].topic, topic) && subscriptions[i].callback) {
+                subscriptions[i].callback(payload);
+            }
+        }
+        *end = saved;
+    }
+
+    void onPuback(uint16_t packetId) {
+        // The broker acknowledges in publish order, so this is nearly always the oldest
+        for (size_t i = 0; i < inFlightCount; i++) {
+            InFlight& slot = inFlight[(inFlightHead + i) % window];
+            if (slot.packetId != packetId) continue;
+            ackLatency.record(micros() - slot.sentAt);
+            for (size_t j = i; j > 0; j--) {
+                inFlight[(inFlightHead + j) % window] = inFlight[(inFlightHead + j - 1) % window];
+            }
+            inFlightHead = (inFlightHead + 1) % window;
+            inFlightCount--;
+            stats.acked++;
+            if (deliveryCallback) deliveryCallback(packetId, true);
+            return;
+        }
+    }
+
+    void closeSocket() {
+        if (sock >= 0) {
+            ::close(sock);
+            sock = -1;
+        }
+        state = State::DISCONNECTED;
+        sendFailed = false;
+        txStart = txEnd = rxLength = 0;
+    }
+
+    // Closes the connection and reports every unacknowledged publish, oldest first
+    void drop(const char* reason) {
+        if (reason) LOG_WARNF("[AsyncMQTT] Disconnected: %s", reason);
+        closeSocket();
+        while (inFlightCount > 0) {
+            uint16_t packetId = inFlight[inFlightHead].packetId;
+            inFlightHead = (inFlightHead + 1) % window;
+            inFlightCount--;
+            stats.dropped++;
+            if (deliveryCallback) deliveryCallback(packetId, false);
+        }
+    }
+};
+
+#endif
@@ -7,9 +7,11 @@
 
 class DHTSensor : public ISensorReader {
 public:
+    static const unsigned long MIN_READ_INTERVAL = 1000;  // The DHT11 can't be read more often
+    
     DHTSensor(int pin, int type, int photoresisterPin, int ledPin)
         : dht(pin, type), photoPin(photoresisterPin), ledPin(ledPin), 
-          lastReadTime(0), readInterval(1000) {
+          lastReadTime(0), readInterval(MIN_READ_INTERVAL) {
         pinMode(ledPin, OUTPUT);
         pinMode(photoresisterPin, INPUT);
     }
@@ -30,11 +32,8 @@ public:
         
         int photoValue = analogRead(photoPin);
         bool ledOn = digitalRead(ledPin);
-        String ledState = ledOn ? "on" : "off";
-        unsigned long freeHeap = ESP.getFreeHeap();
-        unsigned long minFreeHeap = ESP.getMinFreeHeap();
         
-        lastData = SensorData(temperature, humidity, photoValue, ledOn, ledState, freeHeap, minFreeHeap);
+        lastData = SensorData(temperature, humidity, photoValue, ledOn, now);
         lastReadTime = now;
         
         LOG_DEBUGF("Sensor read - Temp: %.1f°C, Humidity: %.1f%%, Light: %d", 
@@ -47,8 +46,12 @@ public:
         return millis() - lastReadTime >= readInterval;
     }
     
-    void setReadInterval(unsigned long interval) {
-        readInterval = interval;
+    void setReadInterval(unsigned long interval) override {
+        readInterval = interval > MIN_READ_INTERVAL ? interval : MIN_READ_INTERVAL;
+    }
+    
+    unsigned long minReadInterval() const override {
+        return MIN_READ_INTERVAL;
     }
     
 private:
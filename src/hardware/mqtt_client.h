@@ -1,277 +1,806 @@
 #ifndef HARDWARE_MQTT_CLIENT_H
 #define HARDWARE_MQTT_CLIENT_H
 
+#include <sys/select.h>
+#include <atomic>
+#include <memory>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
 #include <WiFiClient.h>
 #include <PubSubClient.h>
-#include <ArduinoJson.h>
+#include "../core/backoff.h"
 #include "../core/interfaces.h"
 #include "../core/logger.h"
 #include "../core/config.h"
+#include "../core/outbox.h"
+#include "../core/sample_codec.h"
+#include "../core/topic_router.h"
+#include "tls_client.h"
 
 class MQTTClient {
 public:
+    static const size_t MAX_BATCH_SAMPLES = 120;
+    static const size_t BATCH_ROW_BYTES = 40;  // Longest "[age,temp,humi,light,led]," row
+    static const size_t MIN_PAYLOAD_BYTES = 512;  // Longest discovery message, with room to spare
+    static const size_t TOPIC_BYTES = 64;
+    static const unsigned long RECONNECT_MIN_DELAY = 1000;
+    static const unsigned long RECONNECT_MAX_DELAY = 60000;
+    static const unsigned long FAILOVER_DELAY = 250;  // From a failed broker to the next one in the same round
+    static const unsigned long FAILURE_MEMORY = 600000;  // How long failed connects count against a broker's turn
+    static const uint32_t CONNECT_TASK_STACK_SIZE = 4096;
+    static const uint32_t TLS_CONNECT_TASK_STACK_SIZE = 12288;  // The mbedTLS handshake runs on this stack
+    static const size_t MAX_ROUTES = 8;
+    typedef TopicRouter<MAX_ROUTES>::HandlerFunction CommandHandler;
+    
+    struct BrokerHealth {
+        unsigned long attempts;
+        unsigned long failures;
+        unsigned long consecutiveFailures;  // Since its last successful connect
+        unsigned long connectMs;            // Smoothed time to connect, over successes; 0 = none yet
+        unsigned long lastFailureAt;
+    };
+    
     MQTTClient(const MQTTConfig& config) 
-        : config(config), client(wifiClient), connected(false), 
-          lastReconnectAttempt(0), manualLedControl(false) {}
+        : config(config), tlsClient(wifiClient),
+          client(config.tls ? static_cast<Client&>(tlsClient) : static_cast<Client&>(wifiClient)), connected(false), 
+          connectState(CONNECT_IDLE), connectTask(nullptr), nextConnectAt(0), connectAttempts(0),
+          reconnectBackoff(RECONNECT_MIN_DELAY, RECONNECT_MAX_DELAY), currentBroker(0), connectedBroker(0),
+          triedBrokers(0), brokerSwitches(0), failbacks(0), lastConnectMs(0), probeState(CONNECT_IDLE),
+          nextProbeAt(0), commandsReceived(0),
+          commandsUnrouted(0), outbox(nullptr), drainTokens(0), lastDrainRefill(0), payloadCapacity(0),
+          discoveryFs(nullptr), discoveryPath(nullptr), publishedDiscoveryHash(0) {
+        dataTopic[0] = batchTopic[0] = backlogTopic[0] = diagnosticsTopic[0] = ledTopic[0] = '\0';
+        configStatusTopic[0] = '\0';
+        memset(brokerHealth, 0, sizeof(brokerHealth));
+    }
     
     ErrorCode initialize() {
         client.setServer(config.broker, config.port);
+        if (config.brokerCount() > 1) {
+            LOG_INFOF("MQTT broker %s:%d with %u fallbacks", config.broker, config.port,
+                      (unsigned)config.fallbackBrokerCount);
+        }
         client.setCallback([this](char* topic, byte* payload, unsigned int length) {
             this->onMessage(topic, payload, length);
         });
-        client.setBufferSize(512);
+        // Room for the diagnostics report, or a full batch if that is larger
+        size_t batchBytes = 64 + BATCH_ROW_BYTES * batchLimit();
+        client.setBufferSize(batchBytes > 1024 ? batchBytes : 1024);
+        
+        // Every steady-state message is built here, so publishing never
+        // touches the heap
+        payloadCapacity = batchBytes > MIN_PAYLOAD_BYTES ? batchBytes : MIN_PAYLOAD_BYTES;
+        payloadBuffer.reset(new char[payloadCapacity]);
+        
+        buildTopics();
+        // Home Assistant's value templates can only read the JSON payloads
+        if (config.payloadFormat == PayloadFormat::JSON) {
+            router.add<MQTTClient, &MQTTClient::onHomeAssistantStatus>(homeAssistantStatusTopic(), this);
+        }
+        
+        // Connects run here so a broker that is down (a TCP timeout of
+        // several seconds) never stalls the loop calling update(). Core 0,
+        // alongside the WiFi stack.
+        uint32_t stackSize = config.tls ? TLS_CONNECT_TASK_STACK_SIZE : CONNECT_TASK_STACK_SIZE;
+        if (xTaskCreatePinnedToCore(connectTaskEntry, "mqtt-connect", stackSize, this, 1, &connectTask, 0) !=
+            pdPASS) {
+            LOG_ERROR("Failed to start the MQTT connect task");
+            return ErrorCode::MQTT_CONNECTION_FAILED;
+        }
         
         LOG_INFO("MQTT client initialized");
         return ErrorCode::SUCCESS;
     }
     
+    // The CA that brokers' certificates must chain to, as PEM. Only read
+    // with config.tls; until it loads, no connect is attempted in the clear.
+    ErrorCode loadCaCertificate(fs::FS& fs, const char* path) {
+        File file = fs.open(path, "r");
+        if (!file) {
+            LOG_ERRORF("MQTT over TLS needs a CA certificate at %s", path);
+            return ErrorCode::FILE_READ_FAILED;
+        }
+        size_t size = file.size();
+        std::unique_ptr<char[]> pem(new char[size + 1]);
+        size_t length = file.read((uint8_t*)pem.get(), size);
+        file.close();
+        pem[length] = '\0';
+        // Parsed once; the PEM text isn't needed afterwards
+        return tlsClient.begin(pem.get(), length + 1) ? ErrorCode::SUCCESS : ErrorCode::CONFIG_INVALID;
+    }
+    
+    bool usesTls() const {
+        return config.tls;
+    }
+    
+    const TlsClient::Stats& getTlsStats() const {
+        return tlsClient.getStats();
+    }
+    
+    // Least free stack the connect task has had, in bytes; handshakes are
+    // its deepest calls
+    size_t getConnectStackHeadroom() const {
+        return connectTask ? uxTaskGetStackHighWaterMark(connectTask) : 0;
+    }
+    
+    // Blocks until a broker answers or every one has been tried. The app
+    // goes through update() instead, which connects in the background.
     ErrorCode connect() {
         if (connected) {
             return ErrorCode::SUCCESS;
         }
+        if (connectState.load() != CONNECT_IDLE || probeState.load() != CONNECT_IDLE) {
+            return ErrorCode::MQTT_CONNECTION_FAILED;
+        }
         
-        LOG_INFOF("Connecting to MQTT broker: %s:%d", config.broker, config.port);
-        LOG_INFOF("Using edgeId: %s, username: %s", config.edgeId, config.username);
-        
-        if (client.connect(config.edgeId, config.username, config.password)) {
-            connected = true;
-            LOG_INFO("MQTT connected successfully");
-            
-            // Subscribe to LED control topic
-            String ledTopic = String("Advantech/") + config.edgeId + "/led";
-            if (client.subscribe(ledTopic.c_str())) {
-                LOG_INFOF("Subscribed to: %s", ledTopic.c_str());
+        triedBrokers = 0;
+        for (size_t broker = nextBroker(); broker < config.brokerCount(); broker = nextBroker()) {
+            beginAttempt(broker);
+            unsigned long startedAt = millis();
+            bool ok = client.connect(config.edgeId, config.username, config.password);
+            lastConnectMs = millis() - startedAt;
+            if (ok) {
+                recordAttempt(true);
+                onConnected();
+                return ErrorCode::SUCCESS;
             }
-            
-            // Publish Home Assistant discovery
-            publishHomeAssistantDiscovery();
-            
-            return ErrorCode::SUCCESS;
-        } else {
-            LOG_ERRORF("MQTT connection failed, rc=%d", client.state());
-            return ErrorCode::MQTT_CONNECTION_FAILED;
+            recordAttempt(false);
+            LOG_ERRORF("MQTT connection to %s failed, rc=%d", config.brokerHost(broker), client.state());
         }
+        triedBrokers = 0;
+        return ErrorCode::MQTT_CONNECTION_FAILED;
     }
     
     void update() {
+        checkProbe();
         if (connected) {
             if (!client.connected()) {
                 connected = false;
                 LOG_WARN("MQTT connection lost");
+                // The whole fleet lost the same broker; spread the retries
+                scheduleReconnect();
             } else {
                 client.loop();
+                drainOutbox();
+                probePreferredBroker();
             }
-        } else {
-            // Try to reconnect every 5 seconds
-            unsigned long now = millis();
-            if (now - lastReconnectAttempt > 5000) {
-                lastReconnectAttempt = now;
-                connect();
+            return;
+        }
+        
+        switch (connectState.load(std::memory_order_acquire)) {
+        case CONNECT_IDLE:
+            // A probe still running has the connect task busy
+            if ((long)(millis() - nextConnectAt) >= 0 && probeState.load() == CONNECT_IDLE) {
+                beginAttempt(nextBroker());
+                connectState.store(CONNECT_RUNNING, std::memory_order_release);
+                xTaskNotifyGive(connectTask);
             }
+            break;
+        case CONNECT_RUNNING:
+            break;  // The connect task owns the client until it reports back
+        case CONNECT_SUCCEEDED:
+            connectState.store(CONNECT_IDLE);
+            recordAttempt(true);
+            onConnected();
+            break;
+        case CONNECT_FAILED:
+            connectState.store(CONNECT_IDLE);
+            recordAttempt(false);
+            failOver();
+            break;
         }
     }
     
+    // True while the connect task holds the client
+    bool isConnecting() const {
+        return connectState.load() != CONNECT_IDLE;
+    }
+    
+    unsigned long getConnectAttempts() const {
+        return connectAttempts;
+    }
+    
+    // Index into config.brokerHost(): the broker connected to, or the last one
+    size_t getActiveBroker() const {
+        return connectedBroker;
+    }
+    
+    // Connections made to a different broker than the one before
+    unsigned long getBrokerSwitches() const {
+        return brokerSwitches;
+    }
+    
+    // Switches back to the preferred broker after a probe found it up
+    unsigned long getFailbacks() const {
+        return failbacks;
+    }
+    
+    const BrokerHealth& getBrokerHealth(size_t index) const {
+        return brokerHealth[index];
+    }
+    
+    // ms until the next attempt; 0 if connected, connecting or already due
+    unsigned long getReconnectDelay() const {
+        if (connected || isConnecting()) return 0;
+        long remaining = (long)(nextConnectAt - millis());
+        return remaining > 0 ? (unsigned long)remaining : 0;
+    }
+    
     ErrorCode publishSensorData(const SensorData& data) {
         if (!connected || !client.connected()) {
             return ErrorCode::MQTT_PUBLISH_FAILED;
         }
         
-        // Create JSON payload
-        DynamicJsonDocument doc(256);
-        doc["temp"] = data.temperture;
-        doc["humi"] = data.humidity;
-        doc["photoresister"] = data.photoresisterValue;
-        doc["ledState"] = data.ledState;
-        doc["freeMemory"] = data.freeMemory;
-        doc["lowestMemory"] = data.lowestMemory;
-        
-        String payload;
-        serializeJson(doc, payload);
-        
-        String topic = String("Advantech/") + config.edgeId + "/data";
-        
-        if (client.publish(topic.c_str(), payload.c_str())) {
-            LOG_INFOF("[publish success] topic: %s, payload: %s", topic.c_str(), payload.c_str());
+        size_t length = encoder().data(data, ESP.getFreeHeap(), ESP.getMinFreeHeap());
+        if (length > 0 && send(dataTopic, length)) {
+            LOG_DEBUGF("[publish success] topic: %s, %u bytes", dataTopic, (unsigned)length);
             return ErrorCode::SUCCESS;
-        } else {
-            LOG_ERRORF("Failed to publish to topic: %s", topic.c_str());
+        }
+        LOG_ERRORF("Failed to publish to topic: %s", dataTopic);
+        return ErrorCode::MQTT_PUBLISH_FAILED;
+    }
+    
+    // Readings per batch publish; 0 when batching is off
+    size_t batchLimit() const {
+        return config.batchMaxSamples < MAX_BATCH_SAMPLES ? config.batchMaxSamples : MAX_BATCH_SAMPLES;
+    }
+    
+    // {"samples":[[age_ms,temp,humi,light,led],...]}, oldest first, or the
+    // CBOR equivalent (see sample_codec.h)
+    ErrorCode publishBatch(const SensorData* samples, size_t count) {
+        if (!connected || !client.connected()) {
             return ErrorCode::MQTT_PUBLISH_FAILED;
         }
+        
+        size_t length = encoder().batch(samples, count, millis());
+        if (length > 0 && send(batchTopic, length)) {
+            LOG_INFOF("[publish success] topic: %s, %u samples, %u bytes", batchTopic, (unsigned)count,
+                      (unsigned)length);
+            return ErrorCode::SUCCESS;
+        }
+        LOG_ERRORF("Failed to publish batch (%u samples)", (unsigned)count);
+        return ErrorCode::MQTT_PUBLISH_FAILED;
+    }
+    
+    // Where the hash of the last published discovery set is kept, so a
+    // reconnect or reboot with nothing changed publishes no discovery at all
+    void setDiscoveryCache(fs::FS& fs, const char* path) {
+        discoveryFs = &fs;
+        discoveryPath = path;
+        loadDiscoveryHash();
+    }
+    
+    // Samples the app could not publish are drained from here at
+    // config.outboxDrainRate once the broker is back
+    void setOutbox(Outbox* pendingSamples) {
+        outbox = pendingSamples;
     }
     
     bool isConnected() {
         return connected && client.connected();
     }
     
-    void setLedCallback(std::function<void(bool)> callback) {
-        ledCallback = callback;
+    ErrorCode publishDiagnostics(const String& payload) {
+        if (!connected || !client.connected()) {
+            return ErrorCode::MQTT_PUBLISH_FAILED;
+        }
+        
+        if (client.publish(diagnosticsTopic, payload.c_str())) {
+            return ErrorCode::SUCCESS;
+        }
+        LOG_ERRORF("Failed to publish diagnostics (%u bytes)", payload.length());
+        return ErrorCode::MQTT_PUBLISH_FAILED;
+    }
+    
+    // Retained, so each device's last config result stays readable
+    ErrorCode publishConfigStatus(const char* payload) {
+        if (!connected || !client.connected()) {
+            return ErrorCode::MQTT_PUBLISH_FAILED;
+        }
+        if (client.publish(configStatusTopic, payload, true)) {
+            return ErrorCode::SUCCESS;
+        }
+        LOG_ERRORF("Failed to publish to topic: %s", configStatusTopic);
+        return ErrorCode::MQTT_PUBLISH_FAILED;
+    }
+    
+    // An empty retained message deletes whatever the broker kept on topic
+    ErrorCode clearRetained(const char* topic) {
+        if (!connected || !client.connected()) {
+            return ErrorCode::MQTT_PUBLISH_FAILED;
+        }
+        if (client.publish(topic, (const uint8_t*)"", 0, true)) {
+            return ErrorCode::SUCCESS;
+        }
+        LOG_ERRORF("Failed to clear retained message on %s", topic);
+        return ErrorCode::MQTT_PUBLISH_FAILED;
+    }
+    
+    // Sends DISCONNECT and closes the socket, flushing anything written
+    // before it; the connect task reconnects on the next update()
+    void disconnect() {
+        if (connected) {
+            client.disconnect();
+            connected = false;
+        }
+    }
+    
+    // Sleep for up to timeoutMs, returning true early if the broker has sent
+    // something. Lets the main loop idle without polling client.loop().
+    bool waitForTraffic(unsigned long timeoutMs) {
+        if (connected && transport().available() > 0) {
+            return true;
+        }
+        
+        int fd = connected ? wifiClient.fd() : -1;
+        if (fd < 0) {
+            delay(timeoutMs);
+            return false;
+        }
+        
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(fd, &readSet);
+        struct timeval timeout;
+        timeout.tv_sec = timeoutMs / 1000;
+        timeout.tv_usec = (timeoutMs % 1000) * 1000;
+        
+        int result = select(fd + 1, &readSet, nullptr, nullptr, &timeout);
+        if (result < 0) {
+            delay(timeoutMs);
+            return false;
+        }
+        return result > 0;
+    }
+    
+    // Calls handler for messages on Advantech/<edgeId>/<suffix>, where the
+    // suffix may hold '+' and '#'. Routes are subscribed on every connect,
+    // so add them before the first one. Handlers run on the thread calling
+    // update() and get the payload in place, without a copy.
+    bool route(const char* suffix, CommandHandler handler, void* context) {
+        char filter[TOPIC_BYTES];
+        return deviceFilter(suffix, filter) && checkRoute(suffix, router.add(filter, handler, context));
+    }
+    
+    template <typename T, void (T::*Method)(const MqttMessage&)>
+    bool route(const char* suffix, T* object) {
+        char filter[TOPIC_BYTES];
+        return deviceFilter(suffix, filter) && checkRoute(suffix, router.add<T, Method>(filter, object));
+    }
+    
+    unsigned long getCommandsReceived() const {
+        return commandsReceived;
+    }
+    
+    unsigned long getCommandsUnrouted() const {
+        return commandsUnrouted;
     }
     
 private:
     const MQTTConfig& config;
     WiFiClient wifiClient;
+    TlsClient tlsClient;  // On top of wifiClient when config.tls
     PubSubClient client;
     bool connected;
-    unsigned long lastReconnectAttempt;
-    bool manualLedControl;
-    std::function<void(bool)> ledCallback;
     
-    void onMessage(char* topic, byte* payload, unsigned int length) {
-        // Convert payload to string
-        char message[length + 1];
-        memcpy(message, payload, length);
-        message[length] = '\0';
-        
-        String topicStr = String(topic);
-        String expectedTopic = String("Advantech/") + config.edgeId + "/led";
-        
-        if (topicStr == expectedTopic) {
-            bool ledOn = (strcmp(message, "on") == 0);
-            LOG_INFOF("*** MANUAL LED CONTROL from Home Assistant: %s ***", ledOn ? "ON" : "OFF");
-            
-            if (ledCallback) {
-                ledCallback(ledOn);
+    // Background connects: update() hands the client to connectTask by
+    // setting CONNECT_RUNNING and takes it back once the task reports a
+    // result, so the two never use it at the same time
+    enum : uint8_t { CONNECT_IDLE, CONNECT_RUNNING, CONNECT_SUCCEEDED, CONNECT_FAILED };
+    std::atomic<uint8_t> connectState;
+    TaskHandle_t connectTask;
+    unsigned long nextConnectAt;
+    unsigned long connectAttempts;
+    Backoff reconnectBackoff;
+    
+    // Failover across config's brokers. A round tries each broker once, in
+    // nextBroker() order, FAILOVER_DELAY apart; the jittered backoff only
+    // comes in once the whole round has failed. While on a fallback the
+    // connect task also probes the preferred broker with a bare TCP
+    // connect, through probeState as connectState above, and a reachable
+    // one is switched back to.
+    BrokerHealth brokerHealth[MQTTConfig::MAX_BROKERS];
+    size_t currentBroker;    // Being connected to
+    size_t connectedBroker;  // Last connected to
+    uint8_t triedBrokers;    // Bit per broker already tried this round
+    unsigned long brokerSwitches;
+    unsigned long failbacks;
+    unsigned long lastConnectMs;  // Written by whoever ran the connect, before its result is stored
+    std::atomic<uint8_t> probeState;
+    unsigned long nextProbeAt;
+    WiFiClient probeClient;
+    TopicRouter<MAX_ROUTES> router;
+    unsigned long commandsReceived;
+    unsigned long commandsUnrouted;  // Subscribed but no longer routed, e.g. a stale retained message
+    Outbox* outbox;
+    float drainTokens;
+    unsigned long lastDrainRefill;
+    std::unique_ptr<char[]> payloadBuffer;
+    size_t payloadCapacity;
+    char dataTopic[TOPIC_BYTES];
+    char batchTopic[TOPIC_BYTES];
+    char backlogTopic[TOPIC_BYTES];
+    char diagnosticsTopic[TOPIC_BYTES];
+    char ledTopic[TOPIC_BYTES];
+    char configStatusTopic[TOPIC_BYTES];
+    fs::FS* discoveryFs;
+    const char* discoveryPath;
+    uint32_t publishedDiscoveryHash;  // 0 = unknown, publish on connect
+    
+    Client& transport() {
+        return config.tls ? static_cast<Client&>(tlsClient) : static_cast<Client&>(wifiClient);
+    }
+    
+    // Home Assistant publishes "online" here whenever it starts
+    static const char* homeAssistantStatusTopic() {
+        return "homeassistant/status";
+    }
+    
+    static void connectTaskEntry(void* param) {
+        MQTTClient* self = static_cast<MQTTClient*>(param);
+        for (;;) {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+            if (self->probeState.load(std::memory_order_acquire) == CONNECT_RUNNING) {
+                bool reachable = self->probeClient.connect(self->config.brokerHost(0), self->config.brokerPort(0));
+                self->probeClient.stop();
+                self->probeState.store(reachable ? CONNECT_SUCCEEDED : CONNECT_FAILED, std::memory_order_release);
+            }
+            if (self->connectState.load(std::memory_order_acquire) == CONNECT_RUNNING) {
+                unsigned long startedAt = millis();
+                bool ok = self->client.connect(self->config.edgeId, self->config.username, self->config.password);
+                self->lastConnectMs = millis() - startedAt;
+                self->connectState.store(ok ? CONNECT_SUCCEEDED : CONNECT_FAILED, std::memory_order_release);
             }
         }
     }
     
-    void publishHomeAssistantDiscovery() {
-        publishTemperatureDiscovery();
-        publishHumidityDiscovery();
-        publishLightDiscovery();
-        publishMemoryDiscovery();
-        publishLedDiscovery();
+    // Untried brokers with the fewest recent consecutive failures first;
+    // among those the preferred broker, then the fastest to connect, then
+    // config order. A broker that just failed is thereby tried after the
+    // others rather than costing a timeout every round, until it answers,
+    // a probe finds it up, or FAILURE_MEMORY passes.
+    // config.brokerCount() once every broker has been tried.
+    size_t nextBroker() const {
+        size_t best = config.brokerCount();
+        for (size_t i = 0; i < config.brokerCount(); i++) {
+            if (triedBrokers & (1u << i)) continue;
+            if (best == config.brokerCount() || healthier(i, best)) best = i;
+        }
+        return best;
     }
     
-    void publishTemperatureDiscovery() {
-        DynamicJsonDocument doc(512);
-        doc["name"] = String(config.edgeId) + " Temperature";
-        doc["device_class"] = "temperature";
-        doc["state_topic"] = String("Advantech/") + config.edgeId + "/data";
-        doc["unit_of_measurement"] = "°C";
-        doc["value_template"] = "{{ value_json.temp }}";
-        doc["unique_id"] = String(config.edgeId) + "_temperature";
-        
-        JsonObject device = doc.createNestedObject("device");
-        device["identifiers"] = config.edgeId;
-        device["name"] = String("ESP32 Sensor ") + config.edgeId;
-        device["model"] = "ESP32 Environmental Monitor";
-        device["manufacturer"] = "DIY";
-        
-        String payload;
-        serializeJson(doc, payload);
-        
-        String topic = String("homeassistant/sensor/") + config.edgeId + "/temperature/config";
-        client.publish(topic.c_str(), payload.c_str(), true);
-    }
-    
-    void publishHumidityDiscovery() {
-        DynamicJsonDocument doc(512);
-        doc["name"] = String(config.edgeId) + " Humidity";
-        doc["device_class"] = "humidity";
-        doc["state_topic"] = String("Advantech/") + config.edgeId + "/data";
-        doc["unit_of_measurement"] = "%";
-        doc["value_template"] = "{{ value_json.humi }}";
-        doc["unique_id"] = String(config.edgeId) + "_humidity";
-        
-        JsonObject device = doc.createNestedObject("device");
-        device["identifiers"] = config.edgeId;
-        device["name"] = String("ESP32 Sensor ") + config.edgeId;
-        device["model"] = "ESP32 Environmental Monitor";
-        device["manufacturer"] = "DIY";
-        
-        String payload;
-        serializeJson(doc, payload);
-        
-        String topic = String("homeassistant/sensor/") + config.edgeId + "/humidity/config";
-        client.publish(topic.c_str(), payload.c_str(), true);
-    }
-    
-    void publishLightDiscovery() {
-        DynamicJsonDocument doc(512);
-        doc["name"] = String(config.edgeId) + " Light";
-        doc["device_class"] = "illuminance";
-        doc["state_topic"] = String("Advantech/") + config.edgeId + "/data";
-        doc["unit_of_measurement"] = "lx";
-        doc["value_template"] = "{{ value_json.photoresister }}";
-        doc["unique_id"] = String(config.edgeId) + "_photoresister";
-        
-        JsonObject device = doc.createNestedObject("device");
-        device["identifiers"] = config.edgeId;
-        device["name"] = String("ESP32 Sensor ") + config.edgeId;
-        device["model"] = "ESP32 Environmental Monitor";
-        device["manufacturer"] = "DIY";
-        
-        String payload;
-        serializeJson(doc, payload);
-        
-        String topic = String("homeassistant/sensor/") + config.edgeId + "/photoresister/config";
-        client.publish(topic.c_str(), payload.c_str(), true);
-    }
-    
-    void publishMemoryDiscovery() {
-        // Free Memory
-        DynamicJsonDocument doc1(512);
-        doc1["name"] = String(config.edgeId) + " Free Memory";
-        doc1["state_topic"] = String("Advantech/") + config.edgeId + "/data";
-        doc1["unit_of_measurement"] = "bytes";
-        doc1["value_template"] = "{{ value_json.freeMemory }}";
-        doc1["unique_id"] = String(config.edgeId) + "_free_memory";
+    bool healthier(size_t candidate, size_t than) const {
+        unsigned long candidateFailures = recentFailures(candidate);
+        unsigned long thanFailures = recentFailures(than);
+        if (candidateFailures != thanFailures) return candidateFailures < thanFailures;
+        if (than == 0) return false;
+        if (candidate == 0) return true;
+        const BrokerHealth& a = brokerHealth[candidate];
+        const BrokerHealth& b = brokerHealth[than];
+        return a.connectMs > 0 && b.connectMs > 0 && a.connectMs < b.connectMs;
+    }
+    
+    unsigned long recentFailures(size_t broker) const {
+        const BrokerHealth& health = brokerHealth[broker];
+        return health.consecutiveFailures > 0 && millis() - health.lastFailureAt < FAILURE_MEMORY
+                   ? health.consecutiveFailures
+                   : 0;
+    }
+    
+    void beginAttempt(size_t broker) {
+        currentBroker = broker;
+        triedBrokers |= 1u << broker;
+        client.setServer(config.brokerHost(broker), config.brokerPort(broker));
+        LOG_INFOF("Connecting to MQTT broker: %s:%d%s", config.brokerHost(broker), config.brokerPort(broker),
+                  config.tls ? " over TLS" : "");
+        connectAttempts++;
+        brokerHealth[broker].attempts++;
+    }
+    
+    void recordAttempt(bool ok) {
+        BrokerHealth& health = brokerHealth[currentBroker];
+        if (!ok) {
+            health.failures++;
+            health.consecutiveFailures++;
+            health.lastFailureAt = millis();
+            return;
+        }
+        health.consecutiveFailures = 0;
+        // EWMA with a weight of 1/4, so one slow handshake doesn't reorder the list
+        unsigned long ms = lastConnectMs > 0 ? lastConnectMs : 1;
+        health.connectMs = health.connectMs == 0 ? ms : (health.connectMs * 3 + ms) / 4;
+    }
+    
+    // The next broker after a short pause, or the backoff once all have failed
+    void failOver() {
+        size_t next = nextBroker();
+        if (next < config.brokerCount()) {
+            nextConnectAt = millis() + FAILOVER_DELAY;
+            LOG_WARNF("MQTT broker %s failed (rc=%d), trying %s", config.brokerHost(currentBroker), client.state(),
+                      config.brokerHost(next));
+            return;
+        }
+        triedBrokers = 0;
+        scheduleReconnect();
+    }
+    
+    void probePreferredBroker() {
+        if (connectedBroker == 0 || config.brokerProbeInterval == 0 || probeState.load() != CONNECT_IDLE ||
+            (long)(millis() - nextProbeAt) < 0) {
+            return;
+        }
+        nextProbeAt = millis() + config.brokerProbeInterval;
+        probeState.store(CONNECT_RUNNING, std::memory_order_release);
+        xTaskNotifyGive(connectTask);
+    }
+    
+    void checkProbe() {
+        uint8_t state = probeState.load(std::memory_order_acquire);
+        if (state == CONNECT_IDLE || state == CONNECT_RUNNING) return;
+        probeState.store(CONNECT_IDLE);
+        if (state != CONNECT_SUCCEEDED || !connected || connectedBroker == 0) return;
         
-        JsonObject device1 = doc1.createNestedObject("device");
-        device1["identifiers"] = config.edgeId;
-        device1["name"] = String("ESP32 Sensor ") + config.edgeId;
-        device1["model"] = "ESP32 Environmental Monitor";
-        device1["manufacturer"] = "DIY";
+        LOG_INFOF("Preferred MQTT broker %s is reachable again, switching back", config.broker);
+        failbacks++;
+        brokerHealth[0].consecutiveFailures = 0;
+        client.disconnect();
+        connected = false;
+        triedBrokers = 0;
+        nextConnectAt = millis();
+    }
+    
+    void scheduleReconnect() {
+        unsigned long delayMs = reconnectBackoff.next();
+        nextConnectAt = millis() + delayMs;
+        LOG_WARNF("MQTT not connected (rc=%d), retry %lu in %lu ms", client.state(), reconnectBackoff.getFailures(),
+                  delayMs);
+    }
+    
+    void onConnected() {
+        connected = true;
+        reconnectBackoff.reset();
+        triedBrokers = 0;
+        if (currentBroker != connectedBroker) {
+            brokerSwitches++;
+            connectedBroker = currentBroker;
+        }
+        nextProbeAt = millis() + config.brokerProbeInterval;
+        LOG_INFOF("MQTT connected successfully as %s to %s", config.edgeId, config.brokerHost(connectedBroker));
         
-        String payload1;
-        serializeJson(doc1, payload1);
+        for (size_t i = 0; i < router.size(); i++) {
+            if (client.subscribe(router.filter(i))) {
+                LOG_INFOF("Subscribed to: %s", router.filter(i));
+            }
+        }
         
-        String topic1 = String("homeassistant/sensor/") + config.edgeId + "/freeMemory/config";
-        client.publish(topic1.c_str(), payload1.c_str(), true);
+        if (config.payloadFormat == PayloadFormat::JSON) {
+            publishHomeAssistantDiscovery(false);
+        } else if (publishedDiscoveryHash != 0) {
+            clearHomeAssistantDiscovery();
+        }
+    }
+    
+    void buildTopics() {
+        snprintf(dataTopic, sizeof(dataTopic), "Advantech/%s/data", config.edgeId);
+        snprintf(batchTopic, sizeof(batchTopic), "Advantech/%s/batch", config.edgeId);
+        snprintf(backlogTopic, sizeof(backlogTopic), "Advantech/%s/backlog", config.edgeId);
+        snprintf(diagnosticsTopic, sizeof(diagnosticsTopic), "Advantech/%s/diagnostics", config.edgeId);
+        snprintf(ledTopic, sizeof(ledTopic), "Advantech/%s/led", config.edgeId);
+        snprintf(configStatusTopic, sizeof(configStatusTopic), "Advantech/%s/config/status", config.edgeId);
+    }
+    
+    SampleEncoder encoder() {
+        return SampleEncoder(config.payloadFormat, payloadBuffer.get(), payloadCapacity);
+    }
+    
+    bool send(const char* topic, size_t length) {
+        return client.publish(topic, (const uint8_t*)payloadBuffer.get(), length);
+    }
+    
+    // Sends backlog at a steady rate (bursting at most one second's worth)
+    // so a long outage doesn't flood the link or crowd out live publishes.
+    // Backlog goes to <edgeId>/backlog rather than /data, so Home Assistant
+    // never shows an old reading as the current one.
+    void drainOutbox() {
+        unsigned long now = millis();
+        float rate = (float)config.outboxDrainRate;
+        drainTokens += (now - lastDrainRefill) * rate / 1000.0f;
+        if (drainTokens > rate) drainTokens = rate;
+        lastDrainRefill = now;
         
-        // Lowest Memory
-        DynamicJsonDocument doc2(512);
-        doc2["name"] = String(config.edgeId) + " Lowest Memory";
-        doc2["state_topic"] = String("Advantech/") + config.edgeId + "/data";
-        doc2["unit_of_measurement"] = "bytes";
-        doc2["value_template"] = "{{ value_json.lowestMemory }}";
-        doc2["unique_id"] = String(config.edgeId) + "_lowest_memory";
+        if (!outbox || outbox->empty()) return;
         
-        JsonObject device2 = doc2.createNestedObject("device");
-        device2["identifiers"] = config.edgeId;
-        device2["name"] = String("ESP32 Sensor ") + config.edgeId;
-        device2["model"] = "ESP32 Environmental Monitor";
-        device2["manufacturer"] = "DIY";
+        SensorData sample;
+        bool fromEarlierBoot;
+        while (drainTokens >= 1.0f && outbox->peek(sample, fromEarlierBoot)) {
+            if (publishBacklogSample(sample, fromEarlierBoot) != ErrorCode::SUCCESS) {
+                break;
+            }
+            outbox->commit();
+            drainTokens -= 1.0f;
+        }
+    }
+    
+    // Same fields as /data plus how old the reading is
+    ErrorCode publishBacklogSample(const SensorData& data, bool fromEarlierBoot) {
+        size_t length = encoder().backlog(data, fromEarlierBoot, (millis() - data.timestamp) / 1000);
+        if (length > 0 && send(backlogTopic, length)) {
+            return ErrorCode::SUCCESS;
+        }
+        LOG_ERRORF("Failed to publish to topic: %s", backlogTopic);
+        return ErrorCode::MQTT_PUBLISH_FAILED;
+    }
+    
+    // The topic and payload stay in PubSubClient's buffer
+    void onMessage(char* topic, byte* payload, unsigned int length) {
+        if (router.dispatch(topic, payload, length) > 0) {
+            commandsReceived++;
+        } else {
+            commandsUnrouted++;
+            LOG_DEBUGF("No route for %s", topic);
+        }
+    }
+    
+    // Home Assistant restarted; its entities come from our retained discovery
+    void onHomeAssistantStatus(const MqttMessage& message) {
+        if (message.equals("online")) {
+            publishHomeAssistantDiscovery(true);
+        }
+    }
+    
+    bool deviceFilter(const char* suffix, char (&filter)[TOPIC_BYTES]) {
+        int length = snprintf(filter, sizeof(filter), "Advantech/%s/%s", config.edgeId, suffix);
+        return checkRoute(suffix, length > 0 && (size_t)length < sizeof(filter));
+    }
+    
+    static bool checkRoute(const char* suffix, bool ok) {
+        if (!ok) {
+            LOG_ERRORF("No room to route %s", suffix);
+        }
+        return ok;
+    }
+    
+    // Home Assistant MQTT discovery: one retained config message per entity.
+    // Every entity reads its state from the /data JSON.
+    struct DiscoveryEntity {
+        const char* component;    // "sensor" or "light"
+        const char* objectId;     // Topic segment: homeassistant/<component>/<edgeId>/<objectId>/config
+        const char* name;         // Appended to the edgeId
+        const char* uniqueSuffix;
+        const char* deviceClass;  // Optional
+        const char* unit;         // Optional
+        const char* valueKey;     // Field of the /data JSON
+    };
+    
+    static const DiscoveryEntity* discoveryEntities(size_t& count) {
+        static const DiscoveryEntity entities[] = {
+            {"sensor", "temperature", "Temperature", "temperature", "temperature", "°C", "temp"},
+            {"sensor", "humidity", "Humidity", "humidity", "humidity", "%", "humi"},
+            {"sensor", "photoresister", "Light", "photoresister", "illuminance", "lx", "photoresister"},
+            {"sensor", "freeMemory", "Free Memory", "free_memory", nullptr, "bytes", "freeMemory"},
+            {"sensor", "lowestMemory", "Lowest Memory", "lowest_memory", nullptr, "bytes", "lowestMemory"},
+            {"light", "led", "LED", "led", nullptr, nullptr, "ledState"},
+        };
+        count = sizeof(entities) / sizeof(entities[0]);
+        return entities;
+    }
+    
+    size_t renderDiscovery(const DiscoveryEntity& entity, char* topic, size_t topicSize) {
+        snprintf(topic, topicSize, "homeassistant/%s/%s/%s/config", entity.component, config.edgeId, entity.objectId);
         
-        String payload2;
-        serializeJson(doc2, payload2);
+        PayloadWriter json(payloadBuffer.get(), payloadCapacity);
+        json.raw("{\"name\":\"").raw(config.edgeId).raw(" ").raw(entity.name).raw("\"");
+        if (entity.deviceClass) json.raw(",\"device_class\":\"").raw(entity.deviceClass).raw("\"");
+        json.raw(",\"state_topic\":\"").raw(dataTopic).raw("\"");
+        if (entity.unit) json.raw(",\"unit_of_measurement\":\"").raw(entity.unit).raw("\"");
+        if (strcmp(entity.component, "light") == 0) {
+            json.raw(",\"command_topic\":\"").raw(ledTopic).raw("\"");
+            json.raw(",\"payload_on\":\"on\",\"payload_off\":\"off\"");
+            json.raw(",\"state_value_template\":\"{{ value_json.").raw(entity.valueKey).raw(" }}\"");
+        } else {
+            json.raw(",\"value_template\":\"{{ value_json.").raw(entity.valueKey).raw(" }}\"");
+        }
+        json.raw(",\"unique_id\":\"").raw(config.edgeId).raw("_").raw(entity.uniqueSuffix).raw("\"");
+        json.raw(",\"device\":{\"identifiers\":\"").raw(config.edgeId);
+        json.raw("\",\"name\":\"ESP32 Sensor ").raw(config.edgeId);
+        json.raw("\",\"model\":\"ESP32 Environmental Monitor\",\"manufacturer\":\"DIY\"}}");
+        return json.ok() ? json.size() : 0;
+    }
+    
+    // FNV-1a over the broker and every rendered topic and payload: changes
+    // whenever any retained message would, or they would go to a new broker
+    uint32_t discoveryHash() {
+        const char* broker = config.brokerHost(connectedBroker);
+        int port = config.brokerPort(connectedBroker);
+        uint32_t hash = fnv1a(2166136261u, broker, strlen(broker));
+        hash = fnv1a(hash, &port, sizeof(port));
         
-        String topic2 = String("homeassistant/sensor/") + config.edgeId + "/lowestMemory/config";
-        client.publish(topic2.c_str(), payload2.c_str(), true);
-    }
-    
-    void publishLedDiscovery() {
-        DynamicJsonDocument doc(512);
-        doc["name"] = String(config.edgeId) + " LED";
-        doc["state_topic"] = String("Advantech/") + config.edgeId + "/data";
-        doc["command_topic"] = String("Advantech/") + config.edgeId + "/led";
-        doc["payload_on"] = "on";
-        doc["payload_off"] = "off";
-        doc["state_value_template"] = "{{ value_json.ledState }}";
-        doc["unique_id"] = String(config.edgeId) + "_led";
+        size_t count;
+        const DiscoveryEntity* entities = discoveryEntities(count);
+        char topic[96];
+        for (size_t i = 0; i < count; i++) {
+            size_t length = renderDiscovery(entities[i], topic, sizeof(topic));
+            hash = fnv1a(hash, topic, strlen(topic) + 1);
+            hash = fnv1a(hash, payloadBuffer.get(), length);
+        }
+        return hash;
+    }
+    
+    static uint32_t fnv1a(uint32_t hash, const void* data, size_t length) {
+        const uint8_t* bytes = (const uint8_t*)data;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+    
+    // The retained messages outlive both the connection and a reboot, so
+    // they are only sent when they changed, or when Home Assistant comes
+    // back online and asks for them (force).
+    void publishHomeAssistantDiscovery(bool force) {
+        uint32_t hash = discoveryHash();
+        if (!force && hash == publishedDiscoveryHash) {
+            LOG_INFO("Home Assistant discovery unchanged, not republished");
+            return;
+        }
         
-        JsonObject device = doc.createNestedObject("device");
-        device["identifiers"] = config.edgeId;
-        device["name"] = String("ESP32 Sensor ") + config.edgeId;
-        device["model"] = "ESP32 Environmental Monitor";
-        device["manufacturer"] = "DIY";
+        size_t count;
+        const DiscoveryEntity* entities = discoveryEntities(count);
+        char topic[96];
+        size_t bytes = 0;
+        for (size_t i = 0; i < count; i++) {
+            size_t length = renderDiscovery(entities[i], topic, sizeof(topic));
+            if (length == 0 || !client.publish(topic, (const uint8_t*)payloadBuffer.get(), length, true)) {
+                LOG_ERRORF("Failed to publish discovery to %s", topic);
+                return;
+            }
+            bytes += length;
+        }
+        LOG_INFOF("Published Home Assistant discovery: %u entities, %u bytes", (unsigned)count, (unsigned)bytes);
         
-        String payload;
-        serializeJson(doc, payload);
+        publishedDiscoveryHash = hash;
+        if (discoveryFs) {
+            File file = discoveryFs->open(discoveryPath, "w");
+            if (file) {
+                file.write((const uint8_t*)&hash, sizeof(hash));
+                file.close();
+            }
+        }
+    }
+    
+    // A JSON boot left retained configs whose templates can't read CBOR:
+    // empty retained messages delete them, and the hash is forgotten so a
+    // later switch back to JSON publishes them again
+    void clearHomeAssistantDiscovery() {
+        size_t count;
+        const DiscoveryEntity* entities = discoveryEntities(count);
+        char topic[96];
+        for (size_t i = 0; i < count; i++) {
+            snprintf(topic, sizeof(topic), "homeassistant/%s/%s/%s/config", entities[i].component, config.edgeId,
+                     entities[i].objectId);
+            if (!client.publish(topic, (const uint8_t*)"", 0, true)) {
+                LOG_ERRORF("Failed to clear discovery at %s", topic);
+                return;
+            }
+        }
+        LOG_INFOF("Cleared Home Assistant discovery for CBOR payloads: %u entities", (unsigned)count);
         
-        String topic = String("homeassistant/light/") + config.edgeId + "/led/config";
-        client.publish(topic.c_str(), payload.c_str(), true);
+        publishedDiscoveryHash = 0;
+        if (discoveryFs && discoveryFs->exists(discoveryPath)) {
+            discoveryFs->remove(discoveryPath);
+        }
+    }
+    
+    void loadDiscoveryHash() {
+        publishedDiscoveryHash = 0;
+        if (!discoveryFs || !discoveryFs->exists(discoveryPath)) return;
+        File file = discoveryFs->open(discoveryPath, "r");
+        if (!file) return;
+        uint32_t hash;
+        if (file.read((uint8_t*)&hash, sizeof(hash)) == sizeof(hash)) {
+            publishedDiscoveryHash = hash;
+        }
+        file.close();
     }
 };
 
@@ -71,11 +71,11 @@ private:
     void showSensorData(const SensorData& data) {
         // Temperature
         display.setCursor(0, 0);
-        display.printf("Temp: %.1fC", data.temperture);
+        display.printf("Temp: %.1fC", data.temperature());
         
         // Humidity
         display.setCursor(0, 16);
-        display.printf("Humidity: %.1f%%", data.humidity);
+        display.printf("Humidity: %.1f%%", data.humidity());
         
         // Light level bar
         display.setCursor(0, 32);
@@ -0,0 +1,165 @@
+#ifndef HARDWARE_SAMPLE_UPLINK_H
+#define HARDWARE_SAMPLE_UPLINK_H
+
+#include <Arduino.h>
+#include <string.h>
+#include "../core/config.h"
+#include "../core/interfaces.h"
+#include "../core/logger.h"
+#include "../core/outbox.h"
+#include "../core/sample_codec.h"
+#include "async_mqtt_client.h"
+
+// Publishes readings at QoS1 through AsyncMqttClient and holds on to each
+// one until the broker has acknowledged it:
+// - A live reading goes to the data topic. If it can't go out, or its
+//   connection drops before the PUBACK, it is appended to the outbox.
+// - The outbox drains to the backlog topic through the same in-flight
+//   window, and a stored reading is only committed (removed from flash)
+//   once its PUBACK arrives. A dropped connection rewinds the outbox, so
+//   those readings are sent again.
+// With a window of two or more, one slot is left to live readings while
+// the backlog drains.
+//
+// MQTT 3.1.1 has the broker acknowledge QoS1 publishes in the order it got
+// them (section 4.6), so each ack for the backlog commits the oldest
+// reading still out. Delivery is at least once: a reading whose ack was
+// lost with the connection arrives twice.
+//
+// Takes over the client's delivery callback. Not thread-safe; only the
+// networking side touches it.
+class SampleUplink {
+public:
+    static const size_t PAYLOAD_BYTES = 160;  // Longest data or backlog message, JSON or CBOR
+
+    struct Stats {
+        unsigned long live;       // Readings published on the data topic
+        unsigned long backlog;    // Stored readings published on the backlog topic
+        unsigned long acked;
+        unsigned long requeued;   // Live readings stored after their connection dropped
+        unsigned long stored;     // Live readings stored because they couldn't go out
+    };
+
+    SampleUplink(AsyncMqttClient& client, Outbox& outbox, PayloadFormat format)
+        : client(client), outbox(outbox), format(format), pendingHead(0), pendingCount(0), stats() {
+        dataTopic[0] = backlogTopic[0] = '\0';
+        client.setDeliveryCallback([this](uint16_t packetId, bool acked) { onDelivery(packetId, acked); });
+    }
+
+    void setTopics(const char* data, const char* backlog) {
+        strncpy(dataTopic, data, sizeof(dataTopic) - 1);
+        dataTopic[sizeof(dataTopic) - 1] = '\0';
+        strncpy(backlogTopic, backlog, sizeof(backlogTopic) - 1);
+        backlogTopic[sizeof(backlogTopic) - 1] = '\0';
+    }
+
+    // SUCCESS once the reading is in flight or stored; FILE_WRITE_FAILED if
+    // it could be neither
+    ErrorCode send(const SensorData& sample) {
+        size_t length = encoder().data(sample, ESP.getFreeHeap(), ESP.getMinFreeHeap());
+        if (length > 0 && publish(dataTopic, length, sample, false)) {
+            stats.live++;
+            return ErrorCode::SUCCESS;
+        }
+        stats.stored++;
+        return outbox.append(sample);
+    }
+
+    // Tops up the window from the outbox; call after client.update()
+    void update() {
+        SensorData sample;
+        bool fromEarlierBoot;
+        size_t reserved = client.getWindow() > 1 ? 1 : 0;
+        while (client.getInFlight() + reserved < client.getWindow() &&
+               client.canPublish(strlen(backlogTopic), PAYLOAD_BYTES, 1) && outbox.readNext(sample, fromEarlierBoot)) {
+            size_t length = encoder().backlog(sample, fromEarlierBoot, (millis() - sample.timestamp) / 1000);
+            if (length == 0 || !publish(backlogTopic, length, sample, true)) {
+                outbox.rewind();
+                return;
+            }
+            stats.backlog++;
+        }
+    }
+
+    size_t getInFlight() const {
+        return pendingCount;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+private:
+    // A reading waiting for its PUBACK
+    struct Pending {
+        uint16_t packetId;
+        bool fromOutbox;
+        uint32_t generation;  // Outbox generation it was read in
+        SensorData sample;
+    };
+
+    AsyncMqttClient& client;
+    Outbox& outbox;
+    PayloadFormat format;
+    char dataTopic[AsyncMqttClient::TOPIC_BYTES];
+    char backlogTopic[AsyncMqttClient::TOPIC_BYTES];
+    char payload[PAYLOAD_BYTES];
+    Pending pending[AsyncMqttClient::MAX_WINDOW];  // Ring in publish order
+    size_t pendingHead;
+    size_t pendingCount;
+    Stats stats;
+
+    SampleEncoder encoder() {
+        return SampleEncoder(format, payload, sizeof(payload));
+    }
+
+    bool publish(const char* topic, size_t length, const SensorData& sample, bool fromOutbox) {
+        uint16_t packetId;
+        if (client.publish(topic, (const uint8_t*)payload, length, 1, false, &packetId) != ErrorCode::SUCCESS) {
+            return false;
+        }
+        Pending& entry = pending[(pendingHead + pendingCount) % AsyncMqttClient::MAX_WINDOW];
+        entry.packetId = packetId;
+        entry.fromOutbox = fromOutbox;
+        entry.generation = outbox.getGeneration();
+        entry.sample = sample;
+        pendingCount++;
+        return true;
+    }
+
+    void onDelivery(uint16_t packetId, bool acked) {
+        size_t index = 0;
+        while (index < pendingCount && pending[(pendingHead + index) % AsyncMqttClient::MAX_WINDOW].packetId != packetId) {
+            index++;
+        }
+        if (index == pendingCount) return;  // Someone else's publish
+
+        Pending entry = pending[(pendingHead + index) % AsyncMqttClient::MAX_WINDOW];
+        for (size_t i = index; i > 0; i--) {
+            pending[(pendingHead + i) % AsyncMqttClient::MAX_WINDOW] =
+                pending[(pendingHead + i - 1) % AsyncMqttClient::MAX_WINDOW];
+        }
+        pendingHead = (pendingHead + 1) % AsyncMqttClient::MAX_WINDOW;
+        pendingCount--;
+
+        if (acked) {
+            stats.acked++;
+            // A rewind or eviction since then means the outbox no longer
+            // holds this reading at its head
+            if (entry.fromOutbox && entry.generation == outbox.getGeneration()) {
+                outbox.commit();
+            }
+            return;
+        }
+        if (entry.fromOutbox) {
+            if (entry.generation == outbox.getGeneration()) outbox.rewind();
+            return;
+        }
+        stats.requeued++;
+        if (outbox.append(entry.sample) != ErrorCode::SUCCESS) {
+            LOG_ERROR("[Uplink] Could not store a reading whose publish was dropped");
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,373 @@
+#ifndef HARDWARE_TLS_CLIENT_H
+#define HARDWARE_TLS_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <string.h>
+#include <mbedtls/ctr_drbg.h>
+#include <mbedtls/entropy.h>
+#include <mbedtls/error.h>
+#include <mbedtls/net_sockets.h>
+#include <mbedtls/ssl.h>
+#include <mbedtls/x509_crt.h>
+#include "../core/logger.h"
+
+// mbedTLS 3 hides the handshake state behind MBEDTLS_PRIVATE(); 2.x has
+// it as a plain field
+#ifndef MBEDTLS_PRIVATE
+#define MBEDTLS_PRIVATE(member) member
+#endif
+
+// TLS over a WiFiClient, for PubSubClient. Unlike WiFiClientSecure it
+// keeps what a reconnect can reuse:
+// - The CA chain, RNG and TLS config are set up once in begin().
+// - The SSL context, with its record buffers, is reset rather than freed
+//   between connections.
+// - The session of the last handshake is cached and offered to the same
+//   host:port next time (a session ID or ticket), so the broker can skip
+//   the certificate exchange and key agreement: a resumed handshake.
+// The broker's certificate must chain to the CA and name the host
+// connected to: a DNS name SAN, or an IP address SAN when the host is an
+// IPv4 address. mbedTLS 2.x (Arduino-ESP32 2.x) only matches DNS names,
+// so IP hosts are checked in verifyCertificate(). Each handshake is timed
+// and the heap it took on top of what was free before it is recorded.
+//
+// Used from one thread at a time; MQTTClient hands it to its connect task
+// together with the PubSubClient on top.
+class TlsClient : public Client {
+public:
+    static const unsigned long HANDSHAKE_TIMEOUT = 10000;
+    static const size_t HOST_BYTES = 128;
+
+    struct Stats {
+        unsigned long fullHandshakes;
+        unsigned long resumedHandshakes;
+        unsigned long failedHandshakes;
+        unsigned long lastHandshakeMs;
+        size_t lastHandshakeHeap;  // Free heap before the handshake minus the lowest during it
+        size_t maxHandshakeHeap;
+        int lastError;             // mbedTLS error of the last failed handshake
+    };
+
+    explicit TlsClient(WiFiClient& transport)
+        : transport(transport), ready(false), contextReady(false), open(false), sessionCached(false),
+          sessionPort(0), hostIsIp(false), hostIp(), peeked(-1), stats() {
+        mbedtls_ssl_init(&ssl);
+        mbedtls_ssl_config_init(&conf);
+        mbedtls_x509_crt_init(&caChain);
+        mbedtls_ctr_drbg_init(&drbg);
+        mbedtls_entropy_init(&entropy);
+        mbedtls_ssl_session_init(&session);
+        sessionHost[0] = '\0';
+    }
+
+    ~TlsClient() override {
+        stop();
+        mbedtls_ssl_session_free(&session);
+        mbedtls_ssl_free(&ssl);
+        mbedtls_ssl_config_free(&conf);
+        mbedtls_ctr_drbg_free(&drbg);
+        mbedtls_entropy_free(&entropy);
+        mbedtls_x509_crt_free(&caChain);
+    }
+
+    // pem must be NUL-terminated, with length counting the NUL. Until this
+    // succeeds every connect fails; there is no unverified fallback.
+    bool begin(const char* pem, size_t length) {
+        int ret = mbedtls_x509_crt_parse(&caChain, (const unsigned char*)pem, length);
+        if (ret != 0) {
+            logError("Could not parse the MQTT CA certificate", ret);
+            return false;
+        }
+        const char* personalization = "mqtt-tls";
+        ret = mbedtls_ctr_drbg_seed(&drbg, mbedtls_entropy_func, &entropy, (const unsigned char*)personalization,
+                                    strlen(personalization));
+        if (ret == 0) {
+            ret = mbedtls_ssl_config_defaults(&conf, MBEDTLS_SSL_IS_CLIENT, MBEDTLS_SSL_TRANSPORT_STREAM,
+                                              MBEDTLS_SSL_PRESET_DEFAULT);
+        }
+        if (ret != 0) {
+            logError("Could not set up TLS", ret);
+            return false;
+        }
+        mbedtls_ssl_conf_authmode(&conf, MBEDTLS_SSL_VERIFY_REQUIRED);
+        mbedtls_ssl_conf_ca_chain(&conf, &caChain, nullptr);
+        mbedtls_ssl_conf_rng(&conf, mbedtls_ctr_drbg_random, &drbg);
+        mbedtls_ssl_conf_verify(&conf, verifyCertificate, this);
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+        mbedtls_ssl_conf_session_tickets(&conf, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
+#endif
+        ready = true;
+        return true;
+    }
+
+    bool isReady() const {
+        return ready;
+    }
+
+    const Stats& getStats() const {
+        return stats;
+    }
+
+    int connect(IPAddress ip, uint16_t port) override {
+        return connect(ip.toString().c_str(), port);
+    }
+
+    int connect(const char* host, uint16_t port) override {
+        stop();
+        if (!ready) {
+            LOG_ERROR("No MQTT CA certificate loaded; not connecting without TLS");
+            return 0;
+        }
+        if (!transport.connect(host, port)) {
+            return 0;
+        }
+
+        IPAddress address;
+        hostIsIp = address.fromString(host);
+        for (int i = 0; i < 4; i++) {
+            hostIp[i] = hostIsIp ? address[i] : 0;
+        }
+        
+        uint32_t freeBefore = ESP.getFreeHeap();
+        int ret = contextReady ? mbedtls_ssl_session_reset(&ssl) : mbedtls_ssl_setup(&ssl, &conf);
+        if (ret == 0) {
+            contextReady = true;
+            ret = mbedtls_ssl_set_hostname(&ssl, host);
+        }
+        bool offered = ret == 0 && sessionCached && port == sessionPort && strcmp(host, sessionHost) == 0;
+        if (offered) {
+            ret = mbedtls_ssl_set_session(&ssl, &session);
+        }
+        if (ret != 0) {
+            logError("Could not prepare the TLS connection", ret);
+            transport.stop();
+            return 0;
+        }
+        mbedtls_ssl_set_bio(&ssl, this, sendCallback, receiveCallback, nullptr);
+
+        bool resumed;
+        ret = handshake(freeBefore, resumed);
+        if (ret != 0) {
+            stats.failedHandshakes++;
+            stats.lastError = ret;
+            LOG_WARNF("TLS handshake with %s:%u failed: -0x%04x after %lu ms", host, port, (unsigned)-ret,
+                      stats.lastHandshakeMs);
+            // A rejected or stale session is not offered again
+            forgetSession();
+            transport.stop();
+            return 0;
+        }
+        open = true;
+        if (resumed) {
+            stats.resumedHandshakes++;
+        } else {
+            stats.fullHandshakes++;
+        }
+        LOG_INFOF("TLS %s handshake with %s:%u in %lu ms, %u bytes of heap", resumed ? "resumed" : "full", host,
+                  port, stats.lastHandshakeMs, (unsigned)stats.lastHandshakeHeap);
+        cacheSession(host, port);
+        return 1;
+    }
+
+    uint8_t connected() override {
+        if (open && !transport.connected()) {
+            open = false;
+        }
+        return open ? 1 : 0;
+    }
+
+    void stop() override {
+        if (open) {
+            mbedtls_ssl_close_notify(&ssl);
+            open = false;
+        }
+        peeked = -1;
+        transport.stop();
+    }
+
+    size_t write(uint8_t c) override {
+        return write(&c, 1);
+    }
+
+    size_t write(const uint8_t* buffer, size_t size) override {
+        size_t written = 0;
+        while (open && written < size) {
+            int ret = mbedtls_ssl_write(&ssl, buffer + written, size - written);
+            if (ret > 0) {
+                written += ret;
+            } else if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                open = false;
+            }
+        }
+        return written;
+    }
+    using Print::write;
+
+    // Decrypted bytes ready to read, pulling in a record if one has arrived
+    int available() override {
+        if (!open) return 0;
+        if (peeked >= 0) return 1 + (int)mbedtls_ssl_get_bytes_avail(&ssl);
+        size_t pending = mbedtls_ssl_get_bytes_avail(&ssl);
+        if (pending == 0 && transport.available() > 0) {
+            int ret = mbedtls_ssl_read(&ssl, nullptr, 0);
+            if (ret < 0 && ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+                open = false;
+                return 0;
+            }
+            pending = mbedtls_ssl_get_bytes_avail(&ssl);
+        }
+        return (int)pending;
+    }
+
+    int read() override {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    int read(uint8_t* buffer, size_t size) override {
+        if (!open || size == 0) return -1;
+        size_t count = 0;
+        if (peeked >= 0) {
+            buffer[count++] = (uint8_t)peeked;
+            peeked = -1;
+            if (count == size) return (int)count;
+        }
+        int ret = mbedtls_ssl_read(&ssl, buffer + count, size - count);
+        if (ret > 0) return (int)count + ret;
+        if (ret != MBEDTLS_ERR_SSL_WANT_READ && ret != MBEDTLS_ERR_SSL_WANT_WRITE) {
+            open = false;
+        }
+        return count > 0 ? (int)count : -1;
+    }
+
+    int peek() override {
+        if (peeked < 0) {
+            uint8_t c;
+            if (open && mbedtls_ssl_read(&ssl, &c, 1) == 1) {
+                peeked = c;
+            }
+        }
+        return peeked;
+    }
+
+    operator bool() override {
+        return connected();
+    }
+
+private:
+    WiFiClient& transport;
+    mbedtls_ssl_context ssl;
+    mbedtls_ssl_config conf;
+    mbedtls_x509_crt caChain;
+    mbedtls_ctr_drbg_context drbg;
+    mbedtls_entropy_context entropy;
+    mbedtls_ssl_session session;
+    bool ready;
+    bool contextReady;
+    bool open;
+    bool sessionCached;
+    char sessionHost[HOST_BYTES];
+    uint16_t sessionPort;
+    bool hostIsIp;
+    uint8_t hostIp[4];
+    int peeked;
+    Stats stats;
+
+    // Steps through the handshake so the heap can be sampled in between. A
+    // resumed handshake goes from ServerHello straight to the server's
+    // ChangeCipherSpec, without ever reaching the certificate state.
+    int handshake(uint32_t freeBefore, bool& resumed) {
+        unsigned long startedAt = millis();
+        uint32_t lowest = ESP.getFreeHeap();
+        resumed = true;
+        int ret = 0;
+        while (ssl.MBEDTLS_PRIVATE(state) != MBEDTLS_SSL_HANDSHAKE_OVER) {
+            if (ssl.MBEDTLS_PRIVATE(state) == MBEDTLS_SSL_SERVER_CERTIFICATE) {
+                resumed = false;
+            }
+            ret = mbedtls_ssl_handshake_step(&ssl);
+            uint32_t freeNow = ESP.getFreeHeap();
+            if (freeNow < lowest) lowest = freeNow;
+            if (ret == MBEDTLS_ERR_SSL_WANT_READ || ret == MBEDTLS_ERR_SSL_WANT_WRITE) {
+                if (millis() - startedAt >= HANDSHAKE_TIMEOUT) {
+                    ret = MBEDTLS_ERR_SSL_TIMEOUT;
+                    break;
+                }
+                delay(1);
+                ret = 0;
+                continue;
+            }
+            if (ret != 0) break;
+        }
+        stats.lastHandshakeMs = millis() - startedAt;
+        stats.lastHandshakeHeap = freeBefore > lowest ? freeBefore - lowest : 0;
+        if (stats.lastHandshakeHeap > stats.maxHandshakeHeap) {
+            stats.maxHandshakeHeap = stats.lastHandshakeHeap;
+        }
+        return ret;
+    }
+
+    void cacheSession(const char* host, uint16_t port) {
+        forgetSession();
+        if (strlen(host) >= sizeof(sessionHost) || mbedtls_ssl_get_session(&ssl, &session) != 0) {
+            return;
+        }
+        strcpy(sessionHost, host);
+        sessionPort = port;
+        sessionCached = true;
+    }
+
+    void forgetSession() {
+        mbedtls_ssl_session_free(&session);
+        mbedtls_ssl_session_init(&session);
+        sessionCached = false;
+    }
+
+    // Called for each certificate of the chain after mbedTLS has checked
+    // it. When the host is an IP address that mbedTLS found no name for,
+    // an iPAddress SAN of the end-entity certificate counts as the match;
+    // anything else it rejected stays rejected.
+    static int verifyCertificate(void* context, mbedtls_x509_crt* crt, int depth, uint32_t* flags) {
+        TlsClient* self = static_cast<TlsClient*>(context);
+        if (depth == 0 && self->hostIsIp && (*flags & MBEDTLS_X509_BADCERT_CN_MISMATCH) &&
+            hasIpAddress(crt, self->hostIp)) {
+            *flags &= ~(uint32_t)MBEDTLS_X509_BADCERT_CN_MISMATCH;
+        }
+        return 0;
+    }
+
+    static bool hasIpAddress(const mbedtls_x509_crt* crt, const uint8_t (&ip)[4]) {
+        const int IP_ADDRESS_TAG = MBEDTLS_ASN1_CONTEXT_SPECIFIC | 7;  // GeneralName [7] iPAddress
+        for (const mbedtls_x509_sequence* name = &crt->subject_alt_names; name; name = name->next) {
+            if (name->buf.tag == IP_ADDRESS_TAG && name->buf.len == sizeof(ip) && name->buf.p &&
+                memcmp(name->buf.p, ip, sizeof(ip)) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static int sendCallback(void* context, const unsigned char* buffer, size_t length) {
+        WiFiClient& transport = static_cast<TlsClient*>(context)->transport;
+        size_t written = transport.write(buffer, length);
+        return written > 0 ? (int)written : MBEDTLS_ERR_NET_SEND_FAILED;
+    }
+
+    static int receiveCallback(void* context, unsigned char* buffer, size_t length) {
+        WiFiClient& transport = static_cast<TlsClient*>(context)->transport;
+        if (transport.available() <= 0) {
+            return transport.connected() ? MBEDTLS_ERR_SSL_WANT_READ : MBEDTLS_ERR_NET_CONN_RESET;
+        }
+        int count = transport.read(buffer, length);
+        return count > 0 ? count : MBEDTLS_ERR_SSL_WANT_READ;
+    }
+
+    static void logError(const char* what, int ret) {
+        char text[96];
+        mbedtls_strerror(ret, text, sizeof(text));
+        LOG_ERRORF("%s: -0x%04x %s", what, (unsigned)-ret, text);
+    }
+};
+
+#endif
@@ -1,7 +1,10 @@
 #ifndef HARDWARE_WIFI_MANAGER_H
 #define HARDWARE_WIFI_MANAGER_H
 
+#include <Preferences.h>
 #include <WiFi.h>
+#include <atomic>
+#include "../core/backoff.h"
 #include "../core/interfaces.h"
 #include "../core/logger.h"
 #include "../core/config.h"
@@ -14,14 +17,121 @@ enum class WiFiState {
     AP_MODE
 };
 
+// Why the link was lost, from the reason in the disconnected event
+enum class DisconnectCause {
+    BEACON_TIMEOUT,  // Signal lost: no beacons from the access point
+    AUTH,            // Key exchange failed or the authentication expired
+    AP_LEFT,         // The access point dropped or deauthenticated the station
+    NO_AP,           // The access point disappeared
+    OTHER
+};
+
+// The access point and lease of the last connection. With BSSID and
+// channel the next connect probes one channel instead of scanning all of
+// them, and with the leased address it skips DHCP.
+struct WiFiLink {
+    static const uint32_t MAGIC = 0x57464C32;  // "WFL2"
+
+    uint32_t magic;
+    char ssid[sizeof(WiFiConfig::ssid)];
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t checksum;
+
+    bool isValid() const {
+        return magic == MAGIC && checksum == computeChecksum() && channel > 0 && ssid[sizeof(ssid) - 1] == '\0';
+    }
+
+    bool isFor(const char* network) const {
+        return isValid() && strcmp(ssid, network) == 0;
+    }
+
+    void seal() {
+        magic = MAGIC;
+        checksum = computeChecksum();
+    }
+
+    // FNV-1a over everything before the checksum; callers zero the struct
+    // first so the padding is deterministic
+    uint32_t computeChecksum() const {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(this);
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < offsetof(WiFiLink, checksum); i++) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+};
+
 class WiFiManager {
 public:
-    WiFiManager(const WiFiConfig& config) 
-        : config(config), state(WiFiState::DISCONNECTED), 
-          lastConnectionAttempt(0), connectionTimeout(30000) {}
+    // A cached connect that hasn't joined by then falls back to a full scan
+    static const unsigned long CACHED_CONNECT_TIMEOUT = 2000;
+    static const unsigned long RETRY_MIN_DELAY = 1000;
+    static const unsigned long RETRY_MAX_DELAY = 30000;
+    static const unsigned long RSSI_SAMPLE_INTERVAL = 2000;
+    // Roaming: a candidate must beat the current signal by ROAM_MIN_GAIN dB,
+    // and a weak link is rescanned at most once per ROAM_HOLDOFF
+    static const int ROAM_MIN_GAIN = 8;
+    static const unsigned long ROAM_HOLDOFF = 60000;
+    static const unsigned long ROAM_SCAN_TIMEOUT = 10000;
+    static const size_t WIFI_STATES = 5;
+    static const size_t DISCONNECT_CAUSES = 5;
+    
+    struct ConnectStats {
+        unsigned long cachedConnects;  // Joined straight from the cached BSSID/channel
+        unsigned long scanConnects;    // Joined after a scan of every channel
+        unsigned long cachedMisses;    // Cached connects that had to fall back to a scan
+        unsigned long failures;        // Scans that found nothing or timed out
+        unsigned long lastConnectMs;   // From starting to connect until connected, the last time
+        bool lastCached;
+        unsigned long linkWrites;      // Times the cached link was written to NVS
+    };
+    
+    struct LinkStats {
+        int32_t rssi;                  // Last sample in dBm, 0 before the first
+        float rssiAverage;             // Moving average on the current access point, about 8 samples
+        int32_t rssiMin;               // Weakest sample on the current access point
+        unsigned long rssiSamples;
+        unsigned long reconnects;      // Connections made again after the link was lost
+        unsigned long disconnects[DISCONNECT_CAUSES];  // Links lost, by DisconnectCause
+        uint8_t lastDisconnectReason;  // wifi_err_reason_t of the last link lost
+        unsigned long roamScans;       // Scans for a stronger access point
+        unsigned long roams;           // Moves to one
+        uint64_t stateMs[WIFI_STATES]; // Time spent in each WiFiState
+    };
+    
+    WiFiManager(const WiFiConfig& config)
+        : config(config), state(WiFiState::DISCONNECTED),
+          lastConnectionAttempt(0), connectionTimeout(30000), connectStartedAt(0), retryAt(0),
+          cachedAttempt(false), retryBackoff(RETRY_MIN_DELAY, RETRY_MAX_DELAY), stats{},
+          linkStats{}, stateSince(millis()), eventId(0), disconnectReason(0), linkLost(false), firstSample(true),
+          nextSampleAt(0), weak(false), weakSince(0), roamScanning(false), roamScanned(false), roamScanAt(0),
+          roaming(false) {
+        memset(&link, 0, sizeof(link));
+    }
+    
+    ~WiFiManager() {
+        if (eventId != 0) {
+            WiFi.removeEvent(eventId);
+        }
+    }
     
     ErrorCode initialize() {
         WiFi.mode(WIFI_STA);
+        // Reconnects are driven from update(), and begin() need not rewrite
+        // the credentials to flash every time
+        WiFi.persistent(false);
+        WiFi.setAutoReconnect(false);
+        // Runs on the event task; update() picks the reason up when it sees the link gone
+        eventId = WiFi.onEvent([this](arduino_event_id_t /* event */, arduino_event_info_t info) {
+            disconnectReason = info.wifi_sta_disconnected.reason;
+        }, ARDUINO_EVENT_WIFI_STA_DISCONNECTED);
+        loadLink();
         LOG_INFO("WiFi manager initialized");
         return ErrorCode::SUCCESS;
     }
@@ -36,12 +146,6 @@ public:
         }
         
         if (state == WiFiState::CONNECTING) {
-            // Check if connection timed out
-            if (millis() - lastConnectionAttempt > connectionTimeout) {
-                LOG_WARN("WiFi connection timeout");
-                state = WiFiState::FAILED;
-                return ErrorCode::WIFI_CONNECTION_FAILED;
-            }
             return ErrorCode::PENDING;
         }
         
@@ -51,55 +155,76 @@ public:
             return startAccessPointMode();
         }
         
-        LOG_INFOF("Connecting to WiFi: %s", config.ssid);
-        
-        if (strlen(config.password) > 0) {
-            WiFi.begin(config.ssid, config.password);
+        connectStartedAt = millis();
+        if (link.isFor(config.ssid)) {
+            beginCached();
         } else {
-            WiFi.begin(config.ssid);
+            beginScan();
         }
-        
-        state = WiFiState::CONNECTING;
-        lastConnectionAttempt = millis();
-        
         return ErrorCode::PENDING;
     }
     
     void update() {
         switch (state) {
-            case WiFiState::CONNECTING:
-                if (WiFi.status() == WL_CONNECTED) {
-                    state = WiFiState::CONNECTED;
-                    LOG_INFOF("[wifi connected] ip: %s", WiFi.localIP().toString().c_str());
-                } else if (millis() - lastConnectionAttempt > connectionTimeout) {
-                    state = WiFiState::FAILED;
-                    LOG_WARN("WiFi connection failed - timeout");
+            case WiFiState::DISCONNECTED:
+                connect();
+                break;
+            
+            case WiFiState::CONNECTING: {
+                wl_status_t status = WiFi.status();
+                if (status == WL_CONNECTED) {
+                    onConnected();
+                    break;
+                }
+                unsigned long timeout = cachedAttempt ? CACHED_CONNECT_TIMEOUT : connectionTimeout;
+                bool notFound = status == WL_NO_SSID_AVAIL || status == WL_CONNECT_FAILED;
+                if (!notFound && millis() - lastConnectionAttempt <= timeout) {
+                    break;
+                }
+                if (roaming) {
+                    roaming = false;
+                    LOG_WARN("WiFi: could not join the stronger access point, scanning");
+                    beginScan();
+                } else if (cachedAttempt) {
+                    // The access point moved channel or was replaced
+                    stats.cachedMisses++;
+                    LOG_WARNF("WiFi: cached access point not found on channel %d, scanning", (int)link.channel);
+                    beginScan();
+                } else {
+                    stats.failures++;
+                    setState(WiFiState::FAILED);
+                    retryAt = millis() + retryBackoff.next();
+                    LOG_WARNF("WiFi connection failed (status %d), retrying in %lu ms", (int)status,
+                              retryAt - millis());
                 }
                 break;
-                
+            }
+            
             case WiFiState::CONNECTED:
                 if (WiFi.status() != WL_CONNECTED) {
-                    state = WiFiState::DISCONNECTED;
-                    LOG_WARN("WiFi connection lost");
+                    // Reconnected on the next update, straight to the same access point
+                    onLinkLost();
+                    break;
                 }
+                sampleLink();
+                updateRoaming();
                 break;
-                
+            
             case WiFiState::FAILED:
-                // Retry after 10 seconds, but only if we have credentials
-                if (millis() - lastConnectionAttempt > 10000) {
+                if ((long)(millis() - retryAt) >= 0) {
                     if (strlen(config.ssid) > 0) {
-                        state = WiFiState::DISCONNECTED;
+                        setState(WiFiState::DISCONNECTED);
                     } else {
                         // No credentials, go to AP mode
                         startAccessPointMode();
                     }
                 }
                 break;
-                
+            
             case WiFiState::AP_MODE:
                 // AP mode is stable, nothing to update
                 break;
-                
+            
             default:
                 break;
         }
@@ -114,6 +239,11 @@ public:
         return state == WiFiState::CONNECTING;
     }
     
+    // Connecting or scanning for a stronger access point; other scans wait
+    bool isRadioBusy() const {
+        return state == WiFiState::CONNECTING || roamScanning;
+    }
+    
     bool isInAPMode() const {
         return state == WiFiState::AP_MODE;
     }
@@ -125,11 +255,331 @@ public:
         return WiFi.localIP().toString();
     }
     
+    const ConnectStats& getConnectStats() const {
+        return stats;
+    }
+    
+    // Time in the current state is counted up to now
+    LinkStats getLinkStats() const {
+        LinkStats current = linkStats;
+        current.stateMs[(size_t)state] += millis() - stateSince;
+        return current;
+    }
+    
+    static const char* stateName(WiFiState state) {
+        switch (state) {
+            case WiFiState::DISCONNECTED: return "disconnected";
+            case WiFiState::CONNECTING: return "connecting";
+            case WiFiState::CONNECTED: return "connected";
+            case WiFiState::FAILED: return "failed";
+            case WiFiState::AP_MODE: return "ap_mode";
+        }
+        return "unknown";
+    }
+    
+    static const char* causeName(DisconnectCause cause) {
+        switch (cause) {
+            case DisconnectCause::BEACON_TIMEOUT: return "beacon_timeout";
+            case DisconnectCause::AUTH: return "auth";
+            case DisconnectCause::AP_LEFT: return "ap_left";
+            case DisconnectCause::NO_AP: return "no_ap";
+            case DisconnectCause::OTHER: return "other";
+        }
+        return "other";
+    }
+    
+    static DisconnectCause causeOf(uint8_t reason) {
+        switch (reason) {
+            case WIFI_REASON_BEACON_TIMEOUT:
+                return DisconnectCause::BEACON_TIMEOUT;
+            case WIFI_REASON_AUTH_EXPIRE:
+            case WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT:
+            case WIFI_REASON_AUTH_FAIL:
+            case WIFI_REASON_HANDSHAKE_TIMEOUT:
+                return DisconnectCause::AUTH;
+            case WIFI_REASON_AUTH_LEAVE:
+            case WIFI_REASON_ASSOC_EXPIRE:
+            case WIFI_REASON_ASSOC_TOOMANY:
+            case WIFI_REASON_ASSOC_LEAVE:
+                return DisconnectCause::AP_LEFT;
+            case WIFI_REASON_NO_AP_FOUND:
+                return DisconnectCause::NO_AP;
+            default:
+                return DisconnectCause::OTHER;
+        }
+    }
+
 private:
     const WiFiConfig& config;
     WiFiState state;
     unsigned long lastConnectionAttempt;
     unsigned long connectionTimeout;
+    unsigned long connectStartedAt;
+    unsigned long retryAt;
+    bool cachedAttempt;
+    Backoff retryBackoff;
+    WiFiLink link;
+    ConnectStats stats;
+    LinkStats linkStats;
+    unsigned long stateSince;
+    wifi_event_id_t eventId;
+    std::atomic<uint8_t> disconnectReason;  // From the event task; 0 until a disconnect
+    bool linkLost;         // The next connect is a reconnect
+    bool firstSample;      // Of the current access point
+    unsigned long nextSampleAt;
+    bool weak;             // Every sample since weakSince below config.roamRssi
+    unsigned long weakSince;
+    bool roamScanning;
+    bool roamScanned;      // roamScanAt is set
+    unsigned long roamScanAt;
+    bool roaming;          // Joining the access point a roam scan found
+    
+    void setState(WiFiState next) {
+        unsigned long now = millis();
+        linkStats.stateMs[(size_t)state] += now - stateSince;
+        stateSince = now;
+        state = next;
+    }
+    
+    // NVS namespace and key of the cached link
+    static const char* prefsNamespace() {
+        return "wifi";
+    }
+    
+    static const char* prefsLinkKey() {
+        return "link";
+    }
+    
+    // Survives a software reset, panic, watchdog or deep sleep, but not a
+    // power cycle, which leaves it holding whatever the RAM powered up with
+    static WiFiLink& warmLink() {
+        static RTC_NOINIT_ATTR WiFiLink saved;
+        return saved;
+    }
+    
+    static bool keepsRtcMemory(esp_reset_reason_t reason) {
+        return reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT && reason != ESP_RST_UNKNOWN;
+    }
+    
+    // RTC memory after a warm reset, NVS otherwise
+    void loadLink() {
+        if (keepsRtcMemory(esp_reset_reason()) && warmLink().isValid()) {
+            link = warmLink();
+            LOG_INFOF("WiFi: cached access point for %s from RTC memory", link.ssid);
+            return;
+        }
+        Preferences prefs;
+        if (prefs.begin(prefsNamespace(), true)) {
+            WiFiLink stored;
+            if (prefs.getBytes(prefsLinkKey(), &stored, sizeof(stored)) == sizeof(stored) && stored.isValid()) {
+                link = stored;
+                LOG_INFOF("WiFi: cached access point for %s from NVS", link.ssid);
+            }
+            prefs.end();
+        }
+    }
+    
+    // NVS is only written when the access point or lease changed
+    void saveLink() {
+        WiFiLink current;
+        memset(&current, 0, sizeof(current));
+        strncpy(current.ssid, config.ssid, sizeof(current.ssid) - 1);
+        const uint8_t* bssid = WiFi.BSSID();
+        if (bssid) {
+            memcpy(current.bssid, bssid, sizeof(current.bssid));
+        }
+        current.channel = WiFi.channel();
+        current.ip = (uint32_t)WiFi.localIP();
+        current.gateway = (uint32_t)WiFi.gatewayIP();
+        current.subnet = (uint32_t)WiFi.subnetMask();
+        current.dns = (uint32_t)WiFi.dnsIP();
+        current.seal();
+        if (!bssid || !current.isValid()) {
+            return;
+        }
+        
+        warmLink() = current;
+        if (memcmp(&current, &link, sizeof(current)) != 0) {
+            Preferences prefs;
+            if (prefs.begin(prefsNamespace(), false)) {
+                if (prefs.putBytes(prefsLinkKey(), &current, sizeof(current)) == sizeof(current)) {
+                    stats.linkWrites++;
+                }
+                prefs.end();
+            }
+        }
+        link = current;
+    }
+    
+    // The cached lease as a static address, or DHCP without reuseIp
+    void useCachedAddress() {
+        if (config.reuseIp && link.ip != 0) {
+            WiFi.config(IPAddress(link.ip), IPAddress(link.gateway), IPAddress(link.subnet), IPAddress(link.dns));
+        } else {
+            WiFi.config(IPAddress(), IPAddress(), IPAddress());
+        }
+    }
+    
+    void beginCached() {
+        useCachedAddress();
+        LOG_INFOF("Connecting to WiFi: %s on channel %d (cached)", config.ssid, (int)link.channel);
+        begin(link.channel, link.bssid);
+        cachedAttempt = true;
+    }
+    
+    void beginScan() {
+        // Back to DHCP: a cached address may not suit whatever the scan finds
+        WiFi.config(IPAddress(), IPAddress(), IPAddress());
+        LOG_INFOF("Connecting to WiFi: %s", config.ssid);
+        begin(0, nullptr);
+        cachedAttempt = false;
+    }
+    
+    void begin(int32_t channel, const uint8_t* bssid) {
+        disconnectReason = 0;
+        WiFi.begin(config.ssid, strlen(config.password) > 0 ? config.password : nullptr, channel, bssid);
+        setState(WiFiState::CONNECTING);
+        lastConnectionAttempt = millis();
+    }
+    
+    void onConnected() {
+        setState(WiFiState::CONNECTED);
+        retryBackoff.reset();
+        if (roaming) {
+            linkStats.roams++;
+        } else if (linkLost) {
+            linkStats.reconnects++;
+        }
+        roaming = false;
+        linkLost = false;
+        firstSample = true;
+        nextSampleAt = millis();
+        weak = false;
+        stats.lastConnectMs = millis() - connectStartedAt;
+        stats.lastCached = cachedAttempt;
+        if (cachedAttempt) {
+            stats.cachedConnects++;
+        } else {
+            stats.scanConnects++;
+        }
+        LOG_INFOF("[wifi connected] ip: %s in %lu ms (%s)", WiFi.localIP().toString().c_str(), stats.lastConnectMs,
+                  cachedAttempt ? "cached access point" : "full scan");
+        saveLink();
+    }
+    
+    void onLinkLost() {
+        uint8_t reason = disconnectReason;
+        DisconnectCause cause = causeOf(reason);
+        linkStats.lastDisconnectReason = reason;
+        linkStats.disconnects[(size_t)cause]++;
+        linkLost = true;
+        if (roamScanning) {
+            WiFi.scanDelete();
+            roamScanning = false;
+        }
+        setState(WiFiState::DISCONNECTED);
+        LOG_WARNF("WiFi connection lost (reason %u, %s)", (unsigned)reason, causeName(cause));
+    }
+    
+    // One RSSI sample per RSSI_SAMPLE_INTERVAL while connected
+    void sampleLink() {
+        if ((long)(millis() - nextSampleAt) < 0) {
+            return;
+        }
+        nextSampleAt = millis() + RSSI_SAMPLE_INTERVAL;
+        int32_t rssi = WiFi.RSSI();
+        if (rssi >= 0) {
+            return;  // No reading
+        }
+        linkStats.rssi = rssi;
+        linkStats.rssiSamples++;
+        if (firstSample) {
+            linkStats.rssiAverage = rssi;
+            linkStats.rssiMin = rssi;
+            firstSample = false;
+        } else {
+            linkStats.rssiAverage += (rssi - linkStats.rssiAverage) / 8;
+            linkStats.rssiMin = rssi < linkStats.rssiMin ? rssi : linkStats.rssiMin;
+        }
+        // Any sample at or above the threshold restarts the window
+        if (config.roamRssi != 0 && rssi < config.roamRssi) {
+            if (!weak) {
+                weak = true;
+                weakSince = millis();
+            }
+        } else {
+            weak = false;
+        }
+    }
+    
+    void updateRoaming() {
+        if (roamScanning) {
+            finishRoamScan();
+            return;
+        }
+        if (!weak || millis() - weakSince < config.roamWindow) {
+            return;
+        }
+        if (roamScanned && millis() - roamScanAt < ROAM_HOLDOFF) {
+            return;
+        }
+        if (WiFi.scanComplete() == WIFI_SCAN_RUNNING) {
+            return;  // Someone else's scan has the radio
+        }
+        roamScanned = true;
+        roamScanAt = millis();
+        if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED) {
+            LOG_WARN("WiFi: roam scan could not be started");
+            return;
+        }
+        roamScanning = true;
+        linkStats.roamScans++;
+        LOG_INFOF("WiFi: signal below %d dBm for %lu ms, scanning for a stronger access point", config.roamRssi,
+                  millis() - weakSince);
+    }
+    
+    // Picks the strongest other access point of the same SSID that beats
+    // the current average by ROAM_MIN_GAIN, and joins it directly
+    void finishRoamScan() {
+        int16_t found = WiFi.scanComplete();
+        if (found == WIFI_SCAN_RUNNING && millis() - roamScanAt < ROAM_SCAN_TIMEOUT) {
+            return;
+        }
+        roamScanning = false;
+        const uint8_t* current = WiFi.BSSID();
+        int32_t threshold = (int32_t)linkStats.rssiAverage + ROAM_MIN_GAIN;
+        int32_t bestRssi = 0;
+        int32_t bestChannel = 0;
+        uint8_t bestBssid[6];
+        bool candidate = false;
+        for (int16_t i = 0; i < found; i++) {
+            const uint8_t* bssid = WiFi.BSSID(i);
+            int32_t rssi = WiFi.RSSI(i);
+            if (!bssid || (current && memcmp(bssid, current, sizeof(bestBssid)) == 0) || rssi < threshold ||
+                (candidate && rssi <= bestRssi) || WiFi.SSID(i) != config.ssid) {
+                continue;
+            }
+            memcpy(bestBssid, bssid, sizeof(bestBssid));
+            bestRssi = rssi;
+            bestChannel = WiFi.channel(i);
+            candidate = true;
+        }
+        WiFi.scanDelete();
+        if (!candidate) {
+            LOG_INFOF("WiFi: no access point of %s at least %d dBm", config.ssid, (int)threshold);
+            return;
+        }
+        
+        LOG_INFOF("WiFi: roaming from %d dBm to %02X:%02X:%02X:%02X:%02X:%02X on channel %d (%d dBm)",
+                  (int)linkStats.rssiAverage, bestBssid[0], bestBssid[1], bestBssid[2], bestBssid[3], bestBssid[4],
+                  bestBssid[5], (int)bestChannel, (int)bestRssi);
+        WiFi.disconnect();
+        useCachedAddress();  // Same network, same lease
+        connectStartedAt = millis();
+        begin(bestChannel, bestBssid);
+        cachedAttempt = true;
+        roaming = true;
+    }
     
     ErrorCode startAccessPointMode() {
         WiFi.mode(WIFI_AP);
@@ -139,7 +589,7 @@ private:
         apName.replace(":", "");
         
         if (WiFi.softAP(apName.c_str())) {
-            state = WiFiState::AP_MODE;
+            setState(WiFiState::AP_MODE);
             LOG_INFOF("[AP Mode] Started access point: %s", apName.c_str());
             LOG_INFOF("[AP Mode] IP address: %s", WiFi.softAPIP().toString().c_str());
             LOG_INFO("[AP Mode] Connect to configure WiFi credentials");
@@ -151,4 +601,4 @@ private:
     }
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,250 @@
+#ifndef HARDWARE_WIFI_SCANNER_H
+#define HARDWARE_WIFI_SCANNER_H
+
+#include <WiFi.h>
+#include <atomic>
+#include <mutex>
+#include "../core/logger.h"
+
+// Background Wi-Fi scans for the provisioning page. Web handlers never
+// scan themselves: they take a snapshot of the last results, and if those
+// are stale they ask update(), on the network loop, to start an async scan.
+// Scans therefore run at most once per RESCAN_INTERVAL however often the
+// page is loaded, and never while the station is connecting.
+class WiFiScanner {
+public:
+    static const size_t MAX_NETWORKS = 20;
+    static const unsigned long RESCAN_INTERVAL = 15000;  // Younger results are served as they are
+    static const unsigned long SCAN_TIMEOUT = 10000;
+
+    struct Network {
+        char ssid[33];
+        int8_t rssi;
+        uint8_t encryption;
+    };
+
+    // A copy of the results, detached from later scans, that renders itself
+    // as {"age":s,"scanning":bool,"networks":[{"ssid":..,"rssi":..,"encryption":..}]}
+    // a piece at a time; age is null before the first scan finishes
+    struct Snapshot {
+        Network networks[MAX_NETWORKS];
+        size_t count;
+        bool hasResults;
+        bool scanning;
+        unsigned long ageMs;
+
+        // Writes the bytes of the JSON from offset index on, up to maxLength;
+        // returns how many, 0 once it is all out
+        size_t render(uint8_t* buffer, size_t maxLength, size_t index) const {
+            Window out(buffer, maxLength, index);
+            out.text("{\"age\":");
+            if (hasResults) {
+                out.number(ageMs / 1000);
+            } else {
+                out.text("null");
+            }
+            out.text(scanning ? ",\"scanning\":true,\"networks\":[" : ",\"scanning\":false,\"networks\":[");
+            for (size_t i = 0; i < count && !out.full(); i++) {
+                out.text(i > 0 ? ",{\"ssid\":\"" : "{\"ssid\":\"");
+                out.escaped(networks[i].ssid);
+                out.text("\",\"rssi\":");
+                out.number(networks[i].rssi);
+                out.text(",\"encryption\":");
+                out.number(networks[i].encryption);
+                out.text("}");
+            }
+            out.text("]}");
+            return out.written();
+        }
+
+    private:
+        // Keeps only the bytes of the output that fall in [index, index + capacity)
+        class Window {
+        public:
+            Window(uint8_t* buffer, size_t capacity, size_t index)
+                : buffer(buffer), capacity(capacity), skip(index), length(0) {}
+
+            void text(const char* value) {
+                while (*value) put(*value++);
+            }
+
+            void number(long value) {
+                char digits[21];  // Any 64-bit long, sign included
+                snprintf(digits, sizeof(digits), "%ld", value);
+                text(digits);
+            }
+
+            // JSON string contents: quotes, backslashes and control characters escaped
+            void escaped(const char* value) {
+                for (; *value; value++) {
+                    unsigned char c = (unsigned char)*value;
+                    if (c == '"' || c == '\\') {
+                        put('\\');
+                        put((char)c);
+                    } else if (c < 0x20) {
+                        char code[7];
+                        snprintf(code, sizeof(code), "\\u%04x", c);
+                        text(code);
+                    } else {
+                        put((char)c);
+                    }
+                }
+            }
+
+            bool full() const {
+                return length >= capacity;
+            }
+
+            size_t written() const {
+                return length;
+            }
+
+        private:
+            uint8_t* buffer;
+            size_t capacity;
+            size_t skip;
+            size_t length;
+
+            void put(char c) {
+                if (skip > 0) {
+                    skip--;
+                } else if (length < capacity) {
+                    buffer[length++] = (uint8_t)c;
+                }
+            }
+        };
+    };
+
+    struct Stats {
+        unsigned long started;
+        unsigned long completed;
+        unsigned long failed;
+        unsigned long served;  // Snapshots handed to requests
+    };
+
+    WiFiScanner()
+        : scanRequested(false), scanning(false), hasResults(false), count(0), completedAt(0), startedAt(0),
+          stats{} {}
+
+    // Any task. A scan is asked for when the results are older than
+    // RESCAN_INTERVAL or there are none yet.
+    void snapshot(Snapshot& out) {
+        std::lock_guard<std::mutex> lock(mutex);
+        memcpy(out.networks, networks, count * sizeof(Network));
+        out.count = count;
+        out.hasResults = hasResults;
+        out.ageMs = hasResults ? millis() - completedAt : 0;
+        bool stale = !hasResults || out.ageMs >= RESCAN_INTERVAL;
+        if (stale && !scanning) {
+            scanRequested = true;
+        }
+        out.scanning = scanning || scanRequested;
+        stats.served++;
+    }
+
+    // Any task: scan soon, e.g. when the provisioning AP comes up so the
+    // page has results by the time someone opens it
+    void requestScan() {
+        scanRequested = true;
+    }
+
+    // Network loop. radioBusy holds scans back while the station connects.
+    void update(bool radioBusy) {
+        if (scanning) {
+            collect();
+            return;
+        }
+        if (!scanRequested || radioBusy) {
+            return;
+        }
+        // Only this task writes stats.started, so reading it needs no lock
+        if (stats.started > 0 && millis() - startedAt < RESCAN_INTERVAL) {
+            return;
+        }
+        scanRequested = false;
+        startedAt = millis();
+        if (WiFi.scanNetworks(true) == WIFI_SCAN_FAILED) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.failed++;
+            LOG_WARN("WiFi scan could not be started");
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        stats.started++;
+        scanning = true;
+    }
+
+    Stats getStats() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+private:
+    std::mutex mutex;  // Guards the results and stats; snapshot() runs on the web server's task
+    std::atomic<bool> scanRequested;
+    std::atomic<bool> scanning;
+    bool hasResults;
+    Network networks[MAX_NETWORKS];
+    size_t count;
+    unsigned long completedAt;
+    unsigned long startedAt;
+    Stats stats;
+
+    void collect() {
+        int16_t found = WiFi.scanComplete();
+        if (found == WIFI_SCAN_RUNNING && millis() - startedAt < SCAN_TIMEOUT) {
+            return;
+        }
+        if (found < 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            stats.failed++;
+            LOG_WARNF("WiFi scan failed (%d)", (int)found);
+        } else {
+            store(found);
+        }
+        WiFi.scanDelete();
+        scanning = false;
+    }
+
+    // Strongest first, one entry per SSID, hidden networks left out
+    void store(int16_t found) {
+        Network fresh[MAX_NETWORKS];
+        size_t freshCount = 0;
+        for (int16_t i = 0; i < found; i++) {
+            String ssid = WiFi.SSID(i);
+            if (ssid.length() == 0) continue;
+            int32_t rssi = WiFi.RSSI(i);
+            size_t at = 0;
+            while (at < freshCount && strcmp(fresh[at].ssid, ssid.c_str()) != 0) at++;
+            if (at < freshCount) {
+                if (rssi <= fresh[at].rssi) continue;
+            } else if (freshCount < MAX_NETWORKS) {
+                at = freshCount++;
+            } else if (rssi > fresh[freshCount - 1].rssi) {
+                at = freshCount - 1;  // Push out the weakest
+            } else {
+                continue;
+            }
+            strncpy(fresh[at].ssid, ssid.c_str(), sizeof(fresh[at].ssid) - 1);
+            fresh[at].ssid[sizeof(fresh[at].ssid) - 1] = '\0';
+            fresh[at].rssi = (int8_t)rssi;
+            fresh[at].encryption = (uint8_t)WiFi.encryptionType(i);
+            // Keep the list sorted so the weakest is last
+            while (at > 0 && fresh[at].rssi > fresh[at - 1].rssi) {
+                Network swap = fresh[at - 1];
+                fresh[at - 1] = fresh[at];
+                fresh[at] = swap;
+                at--;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        memcpy(networks, fresh, freshCount * sizeof(Network));
+        count = freshCount;
+        hasResults = true;
+        completedAt = millis();
+        stats.completed++;
+    }
+};
+
+#endif
@@ -16,7 +16,9 @@ void setup() {
     Serial.println("MAC Address: " + WiFi.macAddress());
     Serial.println("========================================");
     
-    App app;
+    // Static rather than on the loop task's stack: App holds fixed-size
+    // tables (event handlers, latency histograms, queues)
+    static App app;
     ErrorCode result = app.initialize();
     
     if (result != ErrorCode::SUCCESS) {
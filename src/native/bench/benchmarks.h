@@ -0,0 +1,60 @@
+#ifndef NATIVE_BENCH_BENCHMARKS_H
+#define NATIVE_BENCH_BENCHMARKS_H
+
+// Host micro-benchmarks, run as `program bench <name>`. Each prints its
+// results and returns a process exit code.
+
+// EventBus (std::map + std::function) against StaticEventBus: dispatch
+// cost, heap allocations and object size
+int runEventBusBench(unsigned long iterations);
+
+// Gorilla block codec on a sensor trace (the day/night profile, or a
+// recorded CSV as used by `program sim --profile`): bits per sample,
+// compression ratio and encode/decode speed. Fails if a round trip differs.
+int runGorillaBench(const char* profilePath, unsigned long samples, unsigned long intervalMs);
+
+// Payload encodings of the data and batch topics on a sensor trace:
+// serializeJson (the original /data path) against the JSON and CBOR
+// SampleEncoder, in ns and bytes per sample. Fails if CBOR doesn't decode
+// back to the same readings.
+int runCodecBench(const char* profilePath, unsigned long samples);
+
+// MQTTClient's /data and /batch publishes against the native broker:
+// ns per publish and heap allocations, which must be zero once connected.
+// Also checks the hand-built JSON against the expected text, and that
+// discovery is only republished when the entity set changed and is
+// cleared once after a switch to CBOR.
+int runPublishBench(unsigned long iterations);
+
+// AsyncMqttClient and SampleUplink end to end over real sockets, against
+// the in-process LoopbackBroker (PUBACKs held ackDelayMs) or a broker at
+// host:port such as a local mosquitto. Compares draining a stored backlog
+// one publish at a time with a window of 8, checks live QoS1 publishes
+// don't allocate, and with the loopback broker drops the connection every
+// few publishes: no reading may go missing.
+int runMqttBench(unsigned long samples, unsigned long ackDelayMs, const char* broker);
+
+// Inbound MQTT commands: TopicRouter against the original onMessage
+// (payload copy plus String topic compares), in ns and heap allocations
+// per message, which must be zero for the router. Also checks '+'/'#'
+// matching and that MQTTClient subscribes its routes and dispatches to them.
+int runRouterBench(unsigned long iterations);
+
+// MQTTClient over TlsClient against the mbedTLS stand-in's simulated
+// broker, on the virtual clock: handshake time and peak heap of the first
+// connect, a full handshake and a resumed one. Fails if a reconnect with a
+// cached session isn't resumed, the heap grows over `reconnects` of them,
+// a session is offered to another broker, or anything connects without a
+// valid CA, to an untrusted certificate or to one naming another host;
+// also fails if an IP SAN doesn't match a broker addressed by IP.
+int runTlsBench(unsigned long reconnects);
+
+// The /scan endpoint of an App in AP mode, on the virtual clock: the
+// original handler (a blocking scan and String concatenation) against the
+// cached, streamed one, in handler time and heap allocations. Fails if the
+// handler blocks, the results are wrong or badly escaped, the page being
+// reloaded every second for `requests` seconds scans more than once per
+// WiFiScanner::RESCAN_INTERVAL, or stale results aren't flagged.
+int runScanBench(unsigned long requests);
+
+#endif
@@ -0,0 +1,221 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "../../core/sample_codec.h"
+#include "../sim/sensor_profile.h"
+
+namespace {
+
+const int ROUNDS = 5;
+const size_t BATCH_SIZE = 60;
+const uint32_t FREE_HEAP = 183456;
+const uint32_t MIN_FREE_HEAP = 162340;
+
+// Readings as a DHT22 reports them (0.1 degree / 0.1 %RH) every intervalMs
+std::vector<SensorData> makeTrace(const SensorProfile& profile, unsigned long samples, unsigned long intervalMs) {
+    std::vector<SensorData> trace;
+    trace.reserve(samples);
+    for (unsigned long i = 0; i < samples; i++) {
+        ProfileSample sample = profile.at(i * intervalMs);
+        trace.push_back(SensorData(roundf(sample.temperature * 10) / 10, roundf(sample.humidity * 10) / 10,
+                                   sample.light, sample.light < 800, 5000 + i * intervalMs));
+    }
+    return trace;
+}
+
+// The /data message as MQTTClient built it with ArduinoJson before the
+// hand-written encoders
+size_t serializeWithArduinoJson(const SensorData& data, String& payload) {
+    JsonDocument doc;
+    doc["temp"] = data.temperature();
+    doc["humi"] = data.humidity();
+    doc["photoresister"] = data.photoresisterValue;
+    doc["ledState"] = data.ledState();
+    doc["freeMemory"] = FREE_HEAP;
+    doc["lowestMemory"] = MIN_FREE_HEAP;
+    payload = "";
+    return serializeJson(doc, payload);
+}
+
+struct Measurement {
+    double nsPerSample;
+    double bytesPerSample;
+};
+
+template <typename Encode>
+Measurement measure(size_t samples, Encode encode) {
+    double bestNs = 0;
+    size_t bytes = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        bytes = encode();
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (round == 0 || ns < bestNs) bestNs = ns;
+    }
+    return Measurement{bestNs / samples, (double)bytes / samples};
+}
+
+void print(const char* name, const Measurement& result, const Measurement& baseline) {
+    Serial.printf("[bench] %-26s %7.1f ns/sample, %6.1f bytes/sample (%3.0f%% of serializeJson)\n", name,
+                  result.nsPerSample, result.bytesPerSample, 100.0 * result.bytesPerSample / baseline.bytesPerSample);
+}
+
+// Just enough of a CBOR reader to check the encoder: unsigned and negative
+// integers, arrays and booleans
+class CborReader {
+public:
+    CborReader(const char* data, size_t size) : data((const uint8_t*)data), size(size), position(0), failed(false) {}
+
+    bool array(size_t expected) {
+        uint32_t count;
+        return head(4, count) && count == expected;
+    }
+
+    size_t array() {
+        uint32_t count = 0;
+        head(4, count);
+        return count;
+    }
+
+    long integer() {
+        if (position >= size) return fail();
+        uint32_t value = 0;
+        if ((data[position] >> 5) == 1) {
+            head(1, value);
+            return -1 - (long)value;
+        }
+        head(0, value);
+        return (long)value;
+    }
+
+    int boolean() {
+        if (position >= size || (data[position] != 0xf4 && data[position] != 0xf5)) return fail();
+        return data[position++] == 0xf5;
+    }
+
+    bool atEnd() const {
+        return !failed && position == size;
+    }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+    bool failed;
+
+    long fail() {
+        failed = true;
+        return -1;
+    }
+
+    bool head(uint8_t majorType, uint32_t& value) {
+        if (position >= size || (data[position] >> 5) != majorType) return fail(), false;
+        uint8_t info = data[position++] & 0x1f;
+        size_t extra = info < 24 ? 0 : info == 24 ? 1 : info == 25 ? 2 : info == 26 ? 4 : 8;
+        if (extra == 8 || position + extra > size) return fail(), false;
+        value = info < 24 ? info : 0;
+        for (size_t i = 0; i < extra; i++) value = (value << 8) | data[position++];
+        return true;
+    }
+};
+
+bool sameReading(CborReader& reader, const SensorData& sample) {
+    return reader.integer() == sample.temperatureCenti && reader.integer() == sample.humidityPermille &&
+           reader.integer() == sample.photoresisterValue && reader.boolean() == (sample.ledOn() ? 1 : 0);
+}
+
+bool checkCbor(const std::vector<SensorData>& trace, char* buffer, size_t capacity) {
+    SampleEncoder cbor(PayloadFormat::CBOR, buffer, capacity);
+    for (const SensorData& sample : trace) {
+        CborReader reader(buffer, cbor.data(sample, FREE_HEAP, MIN_FREE_HEAP));
+        if (!reader.array(7) || reader.integer() != SampleEncoder::CBOR_SCHEMA || !sameReading(reader, sample) ||
+            reader.integer() != (long)FREE_HEAP || reader.integer() != (long)MIN_FREE_HEAP || !reader.atEnd()) {
+            return false;
+        }
+    }
+
+    size_t count = trace.size() < BATCH_SIZE ? trace.size() : BATCH_SIZE;
+    uint32_t now = trace[count - 1].timestamp + 250;
+    CborReader reader(buffer, cbor.batch(&trace[0], count, now));
+    if (!reader.array(2) || reader.integer() != SampleEncoder::CBOR_SCHEMA || reader.array() != count) return false;
+    for (size_t i = 0; i < count; i++) {
+        if (!reader.array(5) || reader.integer() != (long)(now - trace[i].timestamp) || !sameReading(reader, trace[i])) {
+            return false;
+        }
+    }
+    return reader.atEnd();
+}
+
+}  // namespace
+
+int runCodecBench(const char* profilePath, unsigned long samples) {
+    std::unique_ptr<SensorProfile> profile;
+    if (profilePath) {
+        CsvProfile* csv = new CsvProfile();
+        profile.reset(csv);
+        if (!csv->load(profilePath)) {
+            Serial.printf("[bench] Could not load profile '%s'\n", profilePath);
+            return 2;
+        }
+    } else {
+        profile.reset(new DayNightProfile());
+    }
+    if (samples < BATCH_SIZE) samples = BATCH_SIZE;
+    std::vector<SensorData> trace = makeTrace(*profile, samples, 1000);
+    const size_t capacity = 64 + 40 * BATCH_SIZE;
+    std::unique_ptr<char[]> buffer(new char[capacity]);
+
+    String payload;
+    Measurement baseline = measure(samples, [&]() {
+        size_t bytes = 0;
+        for (const SensorData& sample : trace) bytes += serializeWithArduinoJson(sample, payload);
+        return bytes;
+    });
+    Serial.printf("[bench] %lu samples; /data as serializeJson: %7.1f ns/sample, %6.1f bytes/sample\n", samples,
+                  baseline.nsPerSample, baseline.bytesPerSample);
+
+    SampleEncoder json(PayloadFormat::JSON, buffer.get(), capacity);
+    SampleEncoder cbor(PayloadFormat::CBOR, buffer.get(), capacity);
+    print("/data JSON", measure(samples, [&]() {
+              size_t bytes = 0;
+              for (const SensorData& sample : trace) bytes += json.data(sample, FREE_HEAP, MIN_FREE_HEAP);
+              return bytes;
+          }),
+          baseline);
+    print("/data CBOR", measure(samples, [&]() {
+              size_t bytes = 0;
+              for (const SensorData& sample : trace) bytes += cbor.data(sample, FREE_HEAP, MIN_FREE_HEAP);
+              return bytes;
+          }),
+          baseline);
+
+    size_t batches = samples / BATCH_SIZE;
+    char name[32];
+    snprintf(name, sizeof(name), "/batch of %zu JSON", BATCH_SIZE);
+    print(name, measure(batches * BATCH_SIZE, [&]() {
+              size_t bytes = 0;
+              for (size_t i = 0; i < batches; i++) {
+                  const SensorData* first = &trace[i * BATCH_SIZE];
+                  bytes += json.batch(first, BATCH_SIZE, first[BATCH_SIZE - 1].timestamp);
+              }
+              return bytes;
+          }),
+          baseline);
+    snprintf(name, sizeof(name), "/batch of %zu CBOR", BATCH_SIZE);
+    print(name, measure(batches * BATCH_SIZE, [&]() {
+              size_t bytes = 0;
+              for (size_t i = 0; i < batches; i++) {
+                  const SensorData* first = &trace[i * BATCH_SIZE];
+                  bytes += cbor.batch(first, BATCH_SIZE, first[BATCH_SIZE - 1].timestamp);
+              }
+              return bytes;
+          }),
+          baseline);
+
+    bool decoded = checkCbor(trace, buffer.get(), capacity);
+    Serial.printf("[bench] CBOR round trip: %s\n", decoded ? "exact" : "MISMATCH");
+    return decoded ? 0 : 1;
+}
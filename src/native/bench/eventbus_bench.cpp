@@ -0,0 +1,114 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <chrono>
+#include "../../core/event_bus.h"
+#include "../../core/static_event_bus.h"
+#include "../hal/native_hal.h"
+
+namespace {
+
+struct Counter {
+    volatile unsigned long calls = 0;
+
+    void onEvent(const Event& /* event */) {
+        calls = calls + 1;
+    }
+};
+
+// Best of several rounds, to keep scheduler noise out of the comparison
+const int ROUNDS = 5;
+
+struct Result {
+    unsigned long subscribeAllocations;
+    unsigned long publishAllocations;
+    double nsPerPublish;
+};
+
+template <typename Subscribe, typename Publish>
+Result measure(unsigned long iterations, Subscribe subscribe, Publish publish) {
+    unsigned long before = native_hal::heapStats().allocations;
+    subscribe();
+    unsigned long afterSubscribe = native_hal::heapStats().allocations;
+
+    Event event(EventType::SENSOR_DATA_UPDATED, SensorData(24.0f, 55.0f, 900, false, 0));
+    double bestNs = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; i++) {
+            publish(event);
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (round == 0 || ns < bestNs) bestNs = ns;
+    }
+    unsigned long afterPublish = native_hal::heapStats().allocations;
+
+    return Result{afterSubscribe - before, afterPublish - afterSubscribe, bestNs / iterations};
+}
+
+double timingShareNs = 0;
+
+void print(const char* name, size_t handlers, size_t objectSize, const Result& result) {
+    Serial.printf("[bench] %-17s %zu handler(s): %6.1f ns/publish (%5.1f ns dispatch), %lu allocs on subscribe, "
+                  "%lu on publish, sizeof %zu\n",
+                  name, handlers, result.nsPerPublish, result.nsPerPublish - timingShareNs,
+                  result.subscribeAllocations, result.publishAllocations, objectSize);
+}
+
+void runWith(unsigned long iterations, size_t handlers) {
+    Counter counter;
+
+    EventBus dynamicBus;
+    Result dynamicResult = measure(
+        iterations,
+        [&]() {
+            for (size_t i = 0; i < handlers; i++) {
+                dynamicBus.subscribe(EventType::SENSOR_DATA_UPDATED, [&counter](const Event& e) { counter.onEvent(e); });
+            }
+            dynamicBus.subscribe(EventType::LED_STATUS_CHANGED, [&counter](const Event& e) { counter.onEvent(e); });
+        },
+        [&](const Event& event) { dynamicBus.publish(event); });
+    print("EventBus", handlers, sizeof(dynamicBus), dynamicResult);
+
+    StaticEventBus<4> staticBus;
+    Result staticResult = measure(
+        iterations,
+        [&]() {
+            for (size_t i = 0; i < handlers; i++) {
+                staticBus.subscribe<Counter, &Counter::onEvent>(EventType::SENSOR_DATA_UPDATED, &counter);
+            }
+            staticBus.subscribe<Counter, &Counter::onEvent>(EventType::LED_STATUS_CHANGED, &counter);
+        },
+        [&](const Event& event) { staticBus.publish(event); });
+    print("StaticEventBus<4>", handlers, sizeof(staticBus), staticResult);
+}
+
+// Both buses time each dispatch into a latency histogram; measure that
+// share so the dispatch mechanism itself can be compared
+double timerOverheadNs(unsigned long iterations) {
+    LatencyHistogram histogram;
+    double bestNs = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; i++) {
+            StageTimer timer;
+            histogram.record(timer.elapsedMicros());
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (round == 0 || ns < bestNs) bestNs = ns;
+    }
+    return bestNs / iterations;
+}
+
+}  // namespace
+
+int runEventBusBench(unsigned long iterations) {
+    // Reading the virtual clock is a memory load, so the per-dispatch latency
+    // timing both buses do costs next to nothing and dispatch dominates
+    native_hal::useVirtualClock(true);
+    Serial.printf("[bench] %lu publishes of SENSOR_DATA_UPDATED per run\n", iterations);
+    timingShareNs = timerOverheadNs(iterations);
+    Serial.printf("[bench] latency timing share (in both): %.1f ns/publish\n", timingShareNs);
+    runWith(iterations, 1);
+    runWith(iterations, 3);
+    return 0;
+}
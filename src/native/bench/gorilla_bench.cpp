@@ -0,0 +1,181 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include "../../core/gorilla_codec.h"
+#include "../../core/sample_history.h"
+#include "../sim/sensor_profile.h"
+
+namespace {
+
+const int ROUNDS = 5;
+const size_t BLOCK_BYTES = 256;  // One SPIFFS page
+const size_t HISTORY_BYTES = 32768;  // The default sensor.historyMaxBytes
+
+struct Encoded {
+    std::vector<uint8_t> storage;  // Blocks back to back, BLOCK_BYTES apart
+    std::vector<size_t> sizes;     // Bytes used in each block
+    size_t bits = 0;
+};
+
+// Samples as the device records them: one fresh DHT11 reading per interval,
+// quantised to 1 degree / 1 %RH, light optionally with ADC noise. Timing
+// jitter of a millisecond either way mimics the scheduler.
+std::vector<SensorData> makeTrace(const SensorProfile& profile, unsigned long samples, unsigned long intervalMs,
+                                  int lightNoise) {
+    std::vector<SensorData> trace;
+    trace.reserve(samples);
+    uint32_t seed = 12345;
+    uint32_t timestamp = 5000;
+    for (unsigned long i = 0; i < samples; i++) {
+        seed = seed * 1103515245 + 12345;
+        ProfileSample sample = profile.at(i * intervalMs);
+        int light = sample.light;
+        if (lightNoise > 0) {
+            light += (int)((seed >> 16) % (2 * lightNoise + 1)) - lightNoise;
+        }
+        int jitter = (int)((seed >> 8) % 3) - 1;
+        trace.push_back(SensorData(roundf(sample.temperature), roundf(sample.humidity), light, light < 800,
+                                   timestamp + jitter));
+        timestamp += intervalMs;
+    }
+    return trace;
+}
+
+void encode(const std::vector<SensorData>& trace, Encoded& out) {
+    size_t blocks = 0;
+    out.sizes.clear();
+    out.bits = 0;
+    std::unique_ptr<GorillaBlockEncoder> encoder;
+    for (const SensorData& sample : trace) {
+        if (!encoder || !encoder->append(sample)) {
+            if (encoder) {
+                out.sizes.push_back(encoder->getSize());
+                out.bits += encoder->getBits();
+            }
+            if ((blocks + 1) * BLOCK_BYTES > out.storage.size()) {
+                out.storage.resize((blocks + 1) * BLOCK_BYTES * 2);
+            }
+            encoder.reset(new GorillaBlockEncoder(&out.storage[blocks * BLOCK_BYTES], BLOCK_BYTES));
+            blocks++;
+            encoder->append(sample);
+        }
+    }
+    if (encoder) {
+        out.sizes.push_back(encoder->getSize());
+        out.bits += encoder->getBits();
+    }
+}
+
+size_t decode(const Encoded& encoded, std::vector<SensorData>& out) {
+    size_t decoded = 0;
+    for (size_t block = 0; block < encoded.sizes.size(); block++) {
+        GorillaBlockDecoder decoder(&encoded.storage[block * BLOCK_BYTES], encoded.sizes[block]);
+        SensorData sample;
+        while (decoder.next(sample)) {
+            out[decoded++] = sample;
+        }
+    }
+    return decoded;
+}
+
+bool sameSample(const SensorData& a, const SensorData& b) {
+    return a.timestamp == b.timestamp && a.temperatureCenti == b.temperatureCenti &&
+           a.humidityPermille == b.humidityPermille && a.photoresisterValue == b.photoresisterValue &&
+           a.flags == b.flags;
+}
+
+// The trace through the app's SampleHistory: what it keeps must be exactly
+// the newest samples of the trace, whole or from a given time on
+bool checkHistory(const std::vector<SensorData>& trace, unsigned long intervalMs) {
+    SampleHistory history;
+    if (history.allocate(HISTORY_BYTES) != ErrorCode::SUCCESS) return false;
+    for (const SensorData& sample : trace) {
+        history.append(sample);
+    }
+    size_t held = history.size();
+    size_t first = trace.size() - held;
+    size_t index = first;
+    bool intact = held > 0 && held <= trace.size();
+    history.forEach([&](const SensorData& sample) {
+        intact = intact && index < trace.size() && sameSample(sample, trace[index]);
+        index++;
+    });
+    intact = intact && index == trace.size();
+
+    size_t from = first + held / 2;
+    index = from;
+    size_t since = history.forEachSince(trace[from].timestamp, [&](const SensorData& sample) {
+        intact = intact && index < trace.size() && sameSample(sample, trace[index]);
+        index++;
+    });
+    intact = intact && since == trace.size() - from;
+
+    Serial.printf("[bench]   SampleHistory in %zu bytes: %zu samples, %.1f h (raw would hold %.1f h), %s\n",
+                  history.getFootprint(), held, held * (double)intervalMs / 3600000.0,
+                  history.getFootprint() / sizeof(SensorData) * (double)intervalMs / 3600000.0,
+                  intact ? "newest samples intact" : "MISMATCH");
+    return intact;
+}
+
+bool runTrace(const char* name, const std::vector<SensorData>& trace) {
+    Encoded encoded;
+    std::vector<SensorData> decoded(trace.size());
+    double bestEncodeNs = 0;
+    double bestDecodeNs = 0;
+    size_t decodedCount = 0;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        encode(trace, encoded);
+        auto middle = std::chrono::steady_clock::now();
+        decodedCount = decode(encoded, decoded);
+        auto end = std::chrono::steady_clock::now();
+
+        double encodeNs = std::chrono::duration<double, std::nano>(middle - start).count();
+        double decodeNs = std::chrono::duration<double, std::nano>(end - middle).count();
+        if (round == 0 || encodeNs < bestEncodeNs) bestEncodeNs = encodeNs;
+        if (round == 0 || decodeNs < bestDecodeNs) bestDecodeNs = decodeNs;
+    }
+
+    bool lossless = decodedCount == trace.size();
+    for (size_t i = 0; lossless && i < trace.size(); i++) {
+        lossless = sameSample(trace[i], decoded[i]);
+    }
+
+    size_t stored = encoded.sizes.size() * BLOCK_BYTES;
+    double rawBytes = (double)trace.size() * sizeof(SensorData);
+    Serial.printf("[bench] %-22s %7zu samples: %5.2f bits/sample, %5.1fx (%5.1fx in %zu-byte blocks), "
+                  "encode %6.1f ns/sample (%5.0f MB/s), decode %6.1f ns/sample (%5.0f MB/s), %s\n",
+                  name, trace.size(), (double)encoded.bits / trace.size(), rawBytes * 8 / encoded.bits,
+                  rawBytes / stored, BLOCK_BYTES, bestEncodeNs / trace.size(), rawBytes * 1000 / bestEncodeNs,
+                  bestDecodeNs / trace.size(), rawBytes * 1000 / bestDecodeNs, lossless ? "lossless" : "MISMATCH");
+    return lossless;
+}
+
+}  // namespace
+
+int runGorillaBench(const char* profilePath, unsigned long samples, unsigned long intervalMs) {
+    std::unique_ptr<SensorProfile> profile;
+    if (profilePath) {
+        CsvProfile* csv = new CsvProfile();
+        profile.reset(csv);
+        if (!csv->load(profilePath)) {
+            Serial.printf("[bench] Could not load profile '%s'\n", profilePath);
+            return 2;
+        }
+    } else {
+        profile.reset(new DayNightProfile());
+    }
+
+    Serial.printf("[bench] %lu samples every %lu ms, raw %zu bytes/sample\n", samples, intervalMs,
+                  sizeof(SensorData));
+    std::vector<SensorData> trace = makeTrace(*profile, samples, intervalMs, 0);
+    bool ok = runTrace(profilePath ? "recorded trace" : "day/night trace", trace) && checkHistory(trace, intervalMs);
+    trace = makeTrace(*profile, samples, intervalMs, 4);
+    ok = runTrace("+ light noise +-4", trace) && checkHistory(trace, intervalMs) && ok;
+    trace = makeTrace(*profile, samples, intervalMs, 32);
+    ok = runTrace("+ light noise +-32", trace) && checkHistory(trace, intervalMs) && ok;
+    return ok ? 0 : 1;
+}
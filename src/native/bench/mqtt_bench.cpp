@@ -0,0 +1,300 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <algorithm>
+#include <chrono>
+#include <string.h>
+#include <thread>
+#include <vector>
+#include "../../core/outbox.h"
+#include "../../hardware/async_mqtt_client.h"
+#include "../../hardware/sample_uplink.h"
+#include "../hal/native_hal.h"
+#include "../sim/loopback_broker.h"
+
+namespace {
+
+const char* DATA_TOPIC = "Advantech/bench/data";
+const char* BACKLOG_TOPIC = "Advantech/bench/backlog";
+const unsigned long TIMEOUT_MS = 60000;
+
+struct Broker {
+    char host[64];
+    uint16_t port;
+};
+
+// Counts how often each reading arrives; readings are told apart by their
+// light value
+class Receiver {
+public:
+    explicit Receiver(size_t readings) : counts(readings, 0), received(0) {}
+
+    void attach(AsyncMqttClient& client) {
+        client.subscribe("Advantech/bench/#", [this](const char* payload) {
+            const char* light = strstr(payload, "\"photoresister\":");
+            if (!light) return;
+            unsigned long reading = strtoul(light + 16, nullptr, 10);
+            if (reading < counts.size()) counts[reading]++;
+            received++;
+        });
+    }
+
+    void reset() {
+        std::fill(counts.begin(), counts.end(), 0);
+        received = 0;
+    }
+
+    // Readings in [from, to) that never arrived, and extra copies of those that did
+    void tally(size_t from, size_t to, unsigned long& missing, unsigned long& duplicates) const {
+        missing = duplicates = 0;
+        for (size_t i = from; i < to; i++) {
+            if (counts[i] == 0) missing++;
+            if (counts[i] > 1) duplicates += counts[i] - 1;
+        }
+    }
+
+    unsigned long getReceived() const {
+        return received;
+    }
+
+private:
+    std::vector<uint16_t> counts;
+    unsigned long received;
+};
+
+// Runs both clients until done() or the timeout, reconnecting the
+// publisher whenever it drops. Returns false on timeout.
+template <typename Done>
+bool drive(const Broker& broker, AsyncMqttClient& publisher, SampleUplink* uplink, AsyncMqttClient& subscriber,
+           uint32_t& slowestUpdateUs, Done done) {
+    unsigned long start = millis();
+    while (!done()) {
+        if (millis() - start > TIMEOUT_MS) return false;
+        if (publisher.getState() == AsyncMqttClient::State::DISCONNECTED) {
+            publisher.connect(broker.host, "bench", "bench");
+        }
+        uint32_t before = micros();
+        publisher.update();
+        if (uplink) uplink->update();
+        uint32_t elapsed = micros() - before;
+        if (elapsed > slowestUpdateUs) slowestUpdateUs = elapsed;
+        subscriber.update();
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    return true;
+}
+
+// Lets messages already routed by the broker reach the subscriber
+void settle(AsyncMqttClient& subscriber, unsigned long ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        subscriber.update();
+        std::this_thread::sleep_for(std::chrono::microseconds(200));
+    }
+}
+
+void fillOutbox(Outbox& outbox, size_t from, size_t to) {
+    for (size_t i = from; i < to; i++) {
+        outbox.append(SensorData(20.0f + (i % 100) * 0.01f, 50.0f, (int)i, false, millis()));
+    }
+}
+
+Outbox* freshOutbox() {
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    Outbox* outbox = new Outbox(SPIFFS, "/mqtt_outbox", 256 * 1024);
+    outbox->begin();
+    return outbox;
+}
+
+struct DrainResult {
+    double ms;
+    unsigned long missing;
+    unsigned long duplicates;
+    uint32_t slowestUpdateUs;
+    bool finished;
+};
+
+// Drains `samples` stored readings through a window of the given size
+DrainResult drainBacklog(const Broker& broker, AsyncMqttClient& subscriber, Receiver& receiver, size_t window,
+                         size_t samples) {
+    Outbox* outbox = freshOutbox();
+    fillOutbox(*outbox, 0, samples);
+    receiver.reset();
+
+    AsyncMqttClient publisher(2048, window);
+    publisher.setPort(broker.port);
+    publisher.setClientId("bench-publisher");
+    SampleUplink uplink(publisher, *outbox, PayloadFormat::JSON);
+    uplink.setTopics(DATA_TOPIC, BACKLOG_TOPIC);
+
+    DrainResult result = {0, 0, 0, 0, false};
+    auto start = std::chrono::steady_clock::now();
+    result.finished = drive(broker, publisher, &uplink, subscriber, result.slowestUpdateUs,
+                            [&]() { return outbox->empty() && uplink.getInFlight() == 0; });
+    result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    settle(subscriber, 100);
+    receiver.tally(0, samples, result.missing, result.duplicates);
+
+    const LatencyHistogram& ackLatency = publisher.getAckLatency();
+    Serial.printf("[bench] window %2u: %u stored readings in %7.1f ms (%6.0f/s), ack p50 %u us p99 %u us, "
+                  "max in flight %u, slowest update %u us\n",
+                  (unsigned)window, (unsigned)samples, result.ms, samples * 1000.0 / (result.ms > 0 ? result.ms : 1),
+                  ackLatency.percentile(50), ackLatency.percentile(99), (unsigned)publisher.getStats().maxInFlight,
+                  result.slowestUpdateUs);
+    publisher.disconnect();
+    delete outbox;
+    return result;
+}
+
+bool check(const char* name, bool passed) {
+    if (!passed) Serial.printf("[bench] FAIL: %s\n", name);
+    return passed;
+}
+
+// Live readings while connected: no heap once the client is set up
+bool checkLiveAllocations(const Broker& broker, AsyncMqttClient& subscriber, Receiver& receiver, size_t samples) {
+    Outbox* outbox = freshOutbox();
+    receiver.reset();
+    AsyncMqttClient publisher(2048, 8);
+    publisher.setPort(broker.port);
+    publisher.setClientId("bench-live");
+    SampleUplink uplink(publisher, *outbox, PayloadFormat::JSON);
+    uplink.setTopics(DATA_TOPIC, BACKLOG_TOPIC);
+
+    uint32_t slowest = 0;
+    bool connected = drive(broker, publisher, &uplink, subscriber, slowest, [&]() { return publisher.isConnected(); });
+    unsigned long before = native_hal::heapStats().allocations;
+    size_t sent = 0;
+    bool finished = connected && drive(broker, publisher, &uplink, subscriber, slowest, [&]() {
+        if (sent < samples && publisher.canPublish(strlen(DATA_TOPIC), SampleUplink::PAYLOAD_BYTES, 1)) {
+            uplink.send(SensorData(21.0f, 50.0f, (int)sent, sent % 2 == 0, millis()));
+            sent++;
+        }
+        return sent == samples && uplink.getInFlight() == 0;
+    });
+    unsigned long allocations = native_hal::heapStats().allocations - before;
+    settle(subscriber, 100);
+    unsigned long missing;
+    unsigned long duplicates;
+    receiver.tally(0, samples, missing, duplicates);
+
+    Serial.printf("[bench] live: %u readings, %lu allocs, %lu stored, %lu missing\n", (unsigned)samples, allocations,
+                  uplink.getStats().stored, missing);
+    publisher.disconnect();
+    delete outbox;
+    return check("live readings all arrive", finished && missing == 0 && uplink.getStats().stored == 0) &&
+           check("live QoS1 publishes are allocation-free", allocations == 0);
+}
+
+// Broker drops the connection every few publishes while a backlog drains
+// and live readings keep coming: every reading must still arrive
+bool checkFlakyLink(const Broker& broker, LoopbackBroker& loopback, AsyncMqttClient& subscriber, Receiver& receiver,
+                    size_t stored, size_t live) {
+    const size_t window = 8;
+    Outbox* outbox = freshOutbox();
+    fillOutbox(*outbox, 0, stored);
+    receiver.reset();
+    loopback.dropEvery(37);
+    unsigned long dropsBefore = loopback.getDropCount();
+
+    AsyncMqttClient publisher(2048, window);
+    publisher.setPort(broker.port);
+    publisher.setClientId("bench-flaky");
+    SampleUplink uplink(publisher, *outbox, PayloadFormat::JSON);
+    uplink.setTopics(DATA_TOPIC, BACKLOG_TOPIC);
+
+    uint32_t slowest = 0;
+    size_t sent = 0;
+    unsigned long lastLive = millis();
+    bool finished = drive(broker, publisher, &uplink, subscriber, slowest, [&]() {
+        if (sent < live && millis() - lastLive >= 2) {
+            uplink.send(SensorData(22.0f, 50.0f, (int)(stored + sent), false, millis()));
+            sent++;
+            lastLive = millis();
+        }
+        return sent == live && outbox->empty() && uplink.getInFlight() == 0;
+    });
+    loopback.dropEvery(0);
+    settle(subscriber, 100);
+
+    unsigned long drops = loopback.getDropCount() - dropsBefore;
+    unsigned long missing;
+    unsigned long duplicates;
+    receiver.tally(0, stored + live, missing, duplicates);
+    Serial.printf("[bench] flaky link: %lu drops, %u stored + %u live readings, %lu missing, %lu duplicates, "
+                  "%lu requeued, slowest update %u us\n",
+                  drops, (unsigned)stored, (unsigned)live, missing, duplicates, uplink.getStats().requeued, slowest);
+    publisher.disconnect();
+    delete outbox;
+    return check("flaky link finishes", finished) && check("connection drops were injected", drops > 0) &&
+           check("no reading lost across drops", missing == 0) &&
+           check("duplicates only from unacknowledged windows", duplicates <= drops * window);
+}
+
+}  // namespace
+
+int runMqttBench(unsigned long samples, unsigned long ackDelayMs, const char* brokerAddress) {
+    native_hal::env().spiffsRoot = ".native_bench_spiffs";
+    Logger::setLevel(LogLevel::ERROR);
+    if (samples > 2000) samples = 2000;  // Readings are told apart by a 12-bit light value
+
+    LoopbackBroker loopback;
+    Broker broker;
+    if (brokerAddress) {
+        const char* colon = strchr(brokerAddress, ':');
+        size_t hostLength = colon ? (size_t)(colon - brokerAddress) : strlen(brokerAddress);
+        snprintf(broker.host, sizeof(broker.host), "%.*s", (int)hostLength, brokerAddress);
+        broker.port = colon ? (uint16_t)atoi(colon + 1) : 1883;
+        Serial.printf("[bench] broker %s:%u\n", broker.host, (unsigned)broker.port);
+    } else {
+        if (!loopback.start()) {
+            Serial.println("[bench] FAIL: could not start the loopback broker");
+            return 1;
+        }
+        loopback.setAckDelay(ackDelayMs);
+        strcpy(broker.host, "127.0.0.1");
+        broker.port = loopback.getPort();
+        Serial.printf("[bench] loopback broker on port %u, PUBACKs held %lu ms\n", (unsigned)broker.port, ackDelayMs);
+    }
+
+    Receiver receiver(4096);
+    AsyncMqttClient subscriber(4096, 1);
+    subscriber.setPort(broker.port);
+    subscriber.setClientId("bench-subscriber");
+    receiver.attach(subscriber);
+    subscriber.connect(broker.host, "bench", "bench");
+    unsigned long start = millis();
+    while (!subscriber.isConnected() && millis() - start < 5000) {
+        subscriber.update();
+        delay(1);
+    }
+    if (!subscriber.isConnected()) {
+        Serial.println("[bench] FAIL: subscriber could not connect");
+        return 1;
+    }
+    settle(subscriber, 50);  // SUBACK
+
+    bool passed = true;
+    DrainResult stopAndWait = drainBacklog(broker, subscriber, receiver, 1, samples);
+    DrainResult pipelined = drainBacklog(broker, subscriber, receiver, 8, samples);
+    passed = check("stored readings all arrive", stopAndWait.finished && pipelined.finished &&
+                                                     stopAndWait.missing == 0 && pipelined.missing == 0) &&
+             passed;
+    Serial.printf("[bench] pipelining: %.1fx the stop-and-wait rate\n",
+                  stopAndWait.ms / (pipelined.ms > 0 ? pipelined.ms : 1));
+    if (!brokerAddress && ackDelayMs > 0) {
+        passed = check("a window of 8 drains at least 3x faster than one in flight", pipelined.ms * 3 < stopAndWait.ms) &&
+                 passed;
+    }
+    passed = checkLiveAllocations(broker, subscriber, receiver, samples) && passed;
+    if (!brokerAddress) {
+        passed = checkFlakyLink(broker, loopback, subscriber, receiver, samples, samples / 2) && passed;
+    }
+
+    subscriber.disconnect();
+    loopback.stop();
+    Logger::setLevel(LogLevel::INFO);
+    Serial.printf("[bench] %s\n", passed ? "PASS: QoS1 readings arrive through drops, pipelined" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,187 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <chrono>
+#include <string.h>
+#include "../../hardware/mqtt_client.h"
+#include "../hal/native_hal.h"
+
+namespace {
+
+const int ROUNDS = 5;
+const size_t BATCH_SIZE = 60;
+
+struct Captured {
+    char topic[MQTTClient::TOPIC_BYTES];
+    char payload[64 + MQTTClient::BATCH_ROW_BYTES * MQTTClient::MAX_BATCH_SAMPLES];
+};
+
+Captured last;
+unsigned long emptyRetained = 0;
+
+struct Timing {
+    unsigned long allocations;
+    double nsPerPublish;
+    bool allSent;
+};
+
+template <typename Publish>
+Timing measure(unsigned long iterations, Publish publish) {
+    // One untimed call first, so lazy setup doesn't count as steady state
+    bool allSent = publish(0) == ErrorCode::SUCCESS;
+
+    unsigned long before = native_hal::heapStats().allocations;
+    double bestNs = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; i++) {
+            if (publish(i) != ErrorCode::SUCCESS) allSent = false;
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (round == 0 || ns < bestNs) bestNs = ns;
+    }
+    unsigned long after = native_hal::heapStats().allocations;
+    return Timing{after - before, bestNs / iterations, allSent};
+}
+
+bool report(const char* name, unsigned long iterations, const Timing& result) {
+    Serial.printf("[bench] %-6s %8.1f ns/publish, %lu allocs over %lu publishes, last %zu bytes on %s\n", name,
+                  result.nsPerPublish, result.allocations, iterations * ROUNDS + 1, strlen(last.payload), last.topic);
+    if (!result.allSent) {
+        Serial.printf("[bench] FAIL: %s publish returned an error\n", name);
+    }
+    if (result.allocations != 0) {
+        Serial.printf("[bench] FAIL: %s publish allocated on the heap\n", name);
+    }
+    return result.allSent && result.allocations == 0;
+}
+
+// Discovery bytes a connect publishes. The client is disconnected first by
+// taking the broker away for one update().
+unsigned long discoveryBytesOnConnect(MQTTClient& client) {
+    if (client.isConnected()) {
+        native_hal::env().brokerAvailable = false;
+        client.update();
+        native_hal::env().brokerAvailable = true;
+    }
+    unsigned long before = native_hal::env().publishBytes;
+    client.connect();
+    return native_hal::env().publishBytes - before;
+}
+
+bool checkDiscovery(MQTTConfig& config) {
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    MQTTClient client(config);
+    client.initialize();
+    client.setDiscoveryCache(SPIFFS, "/discovery.hash");
+    unsigned long firstConnect = discoveryBytesOnConnect(client);
+    unsigned long reconnect = discoveryBytesOnConnect(client);
+
+    MQTTClient rebooted(config);
+    rebooted.initialize();
+    rebooted.setDiscoveryCache(SPIFFS, "/discovery.hash");
+    unsigned long afterReboot = discoveryBytesOnConnect(rebooted);
+
+    strcpy(config.edgeId, "bench2");
+    unsigned long renamed = discoveryBytesOnConnect(rebooted);
+    strcpy(config.edgeId, "bench");
+
+    // Rebooted into CBOR: the retained JSON configs are deleted once
+    config.payloadFormat = PayloadFormat::CBOR;
+    MQTTClient cbor(config);
+    cbor.initialize();
+    cbor.setDiscoveryCache(SPIFFS, "/discovery.hash");
+    unsigned long before = emptyRetained;
+    discoveryBytesOnConnect(cbor);
+    unsigned long cleared = emptyRetained - before;
+    bool hashRemoved = !SPIFFS.exists("/discovery.hash");
+    before = emptyRetained;
+    discoveryBytesOnConnect(cbor);
+    unsigned long clearedAgain = emptyRetained - before;
+    config.payloadFormat = PayloadFormat::JSON;
+
+    Serial.printf("[bench] discovery bytes: first connect %lu, reconnect %lu, after reboot %lu, after an edgeId "
+                  "change %lu\n",
+                  firstConnect, reconnect, afterReboot, renamed);
+    Serial.printf("[bench] switched to CBOR: %lu retained configs cleared, %lu on reconnect\n", cleared, clearedAgain);
+    bool passed = firstConnect > 0 && reconnect == 0 && afterReboot == 0 && renamed > 0;
+    if (!passed) {
+        Serial.println("[bench] FAIL: discovery should only be published when it changed");
+    }
+    if (cleared == 0 || clearedAgain != 0 || !hashRemoved) {
+        Serial.println("[bench] FAIL: switching to CBOR should clear the retained discovery once");
+        passed = false;
+    }
+    return passed;
+}
+
+bool expectPayload(const char* expected) {
+    if (strcmp(last.payload, expected) == 0) return true;
+    Serial.printf("[bench] FAIL: payload\n  got      %s\n  expected %s\n", last.payload, expected);
+    return false;
+}
+
+}  // namespace
+
+int runPublishBench(unsigned long iterations) {
+    // Frozen clock, so batch ages in the expected payload are exact
+    native_hal::useVirtualClock(true);
+    native_hal::env().brokerAvailable = true;
+    native_hal::env().spiffsRoot = ".native_bench_spiffs";
+    WiFi.begin("bench", "");
+    native_hal::env().publishHook = [](const char* topic, const uint8_t* payload, unsigned int length,
+                                       bool retained) {
+        if (retained && length == 0) emptyRetained++;
+        strncpy(last.topic, topic, sizeof(last.topic) - 1);
+        size_t copied = length < sizeof(last.payload) - 1 ? length : sizeof(last.payload) - 1;
+        memcpy(last.payload, payload, copied);
+        last.payload[copied] = '\0';
+    };
+
+    MQTTConfig config;
+    strcpy(config.broker, "localhost");
+    strcpy(config.edgeId, "bench");
+    config.batchMaxSamples = BATCH_SIZE;
+    MQTTClient client(config);
+    client.initialize();
+    if (client.connect() != ErrorCode::SUCCESS) {
+        Serial.println("[bench] FAIL: could not connect to the native broker");
+        return 1;
+    }
+
+    SensorData batch[BATCH_SIZE];
+    for (size_t i = 0; i < BATCH_SIZE; i++) {
+        batch[i] = SensorData(-5.25f + i, 40.0f + i * 0.5f, 4095 - (int)i, i % 2 == 0, millis());
+    }
+
+    // Keep console output out of the timings
+    Logger::setLevel(LogLevel::WARN);
+    bool passed = true;
+    Timing data = measure(iterations, [&](unsigned long i) {
+        return client.publishSensorData(SensorData(24.5f + (i % 50) * 0.01f, 55.3f, 900, true, millis()));
+    });
+    passed = report("data", iterations, data) && passed;
+    char expectedData[128];
+    snprintf(expectedData, sizeof(expectedData),
+             "{\"temp\":24.5,\"humi\":55.3,\"photoresister\":900,\"ledState\":\"on\",\"freeMemory\":%u,"
+             "\"lowestMemory\":%u}",
+             (unsigned)ESP.getFreeHeap(), (unsigned)ESP.getMinFreeHeap());
+    client.publishSensorData(SensorData(24.5f, 55.3f, 900, true, millis()));
+    passed = expectPayload(expectedData) && passed;
+
+    Timing batched = measure(iterations / BATCH_SIZE + 1,
+                             [&](unsigned long) { return client.publishBatch(batch, BATCH_SIZE); });
+    passed = report("batch", iterations / BATCH_SIZE + 1, batched) && passed;
+    client.publishBatch(batch, 2);
+    passed = expectPayload("{\"samples\":[[0,-5.25,40,4095,1],[0,-4.25,40.5,4094,0]]}") && passed;
+
+    passed = checkDiscovery(config) && passed;
+
+    native_hal::env().publishHook = nullptr;
+    Logger::setLevel(LogLevel::INFO);
+    native_hal::useVirtualClock(false);
+    Serial.printf("[bench] %s\n", passed ? "PASS: steady-state publishes are allocation-free" : "FAILED");
+    return passed ? 0 : 1;
+}
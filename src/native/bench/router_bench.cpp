@@ -0,0 +1,236 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <chrono>
+#include <string.h>
+#include "../../core/topic_router.h"
+#include "../../hardware/mqtt_client.h"
+#include "../hal/native_hal.h"
+
+namespace {
+
+const int ROUNDS = 5;
+
+// What the device routes, plus a message nothing routes
+struct Inbound {
+    const char* topic;
+    const char* payload;
+};
+
+const Inbound MESSAGES[] = {
+    {"Advantech/bench/led", "on"},
+    {"Advantech/bench/cmd/interval", "2000"},
+    {"Advantech/bench/cmd/threshold", "750"},
+    {"Advantech/bench/cmd/publish", ""},
+    {"homeassistant/status", "online"},
+    {"Advantech/bench/led", "off"},
+    {"Advantech/other/led", "on"},
+};
+const size_t MESSAGE_COUNT = sizeof(MESSAGES) / sizeof(MESSAGES[0]);
+
+struct Handled {
+    volatile unsigned long led = 0;
+    volatile unsigned long interval = 0;
+    volatile unsigned long threshold = 0;
+    volatile unsigned long publish = 0;
+    volatile unsigned long status = 0;
+
+    void onLed(const MqttMessage& message) {
+        if (message.equals("on") || message.equals("off")) led = led + 1;
+    }
+    void onInterval(const MqttMessage& message) {
+        unsigned long value;
+        if (message.toUnsigned(value) && value == 2000) interval = interval + 1;
+    }
+    void onThreshold(const MqttMessage& message) {
+        unsigned long value;
+        if (message.toUnsigned(value) && value == 750) threshold = threshold + 1;
+    }
+    void onPublish(const MqttMessage& /* message */) {
+        publish = publish + 1;
+    }
+    void onStatus(const MqttMessage& message) {
+        if (message.equals("online")) status = status + 1;
+    }
+
+    unsigned long total() const {
+        return led + interval + threshold + publish + status;
+    }
+};
+
+// The original onMessage: the payload copied into a VLA, then the topic
+// and each expected topic built as Strings, one command after another
+void legacyDispatch(Handled& handled, char* topic, const uint8_t* payload, unsigned int length) {
+    char message[length + 1];
+    memcpy(message, payload, length);
+    message[length] = '\0';
+
+    String topicStr = String(topic);
+    if (topicStr == String("homeassistant/status")) {
+        if (strcmp(message, "online") == 0) handled.status = handled.status + 1;
+        return;
+    }
+    if (topicStr == String("Advantech/") + "bench" + "/led") {
+        if (strcmp(message, "on") == 0 || strcmp(message, "off") == 0) handled.led = handled.led + 1;
+        return;
+    }
+    if (topicStr == String("Advantech/") + "bench" + "/cmd/interval") {
+        if (atol(message) == 2000) handled.interval = handled.interval + 1;
+        return;
+    }
+    if (topicStr == String("Advantech/") + "bench" + "/cmd/threshold") {
+        if (atol(message) == 750) handled.threshold = handled.threshold + 1;
+        return;
+    }
+    if (topicStr == String("Advantech/") + "bench" + "/cmd/publish") {
+        handled.publish = handled.publish + 1;
+    }
+}
+
+struct Timing {
+    unsigned long allocations;
+    double nsPerMessage;
+};
+
+template <typename Dispatch>
+Timing measure(unsigned long iterations, Dispatch dispatch) {
+    char topics[MESSAGE_COUNT][MQTTClient::TOPIC_BYTES];
+    for (size_t i = 0; i < MESSAGE_COUNT; i++) {
+        strcpy(topics[i], MESSAGES[i].topic);
+    }
+    unsigned long before = native_hal::heapStats().allocations;
+    double bestNs = 0;
+    for (int round = 0; round < ROUNDS; round++) {
+        auto start = std::chrono::steady_clock::now();
+        for (unsigned long i = 0; i < iterations; i++) {
+            const Inbound& message = MESSAGES[i % MESSAGE_COUNT];
+            dispatch(topics[i % MESSAGE_COUNT], (const uint8_t*)message.payload, strlen(message.payload));
+        }
+        double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (round == 0 || ns < bestNs) bestNs = ns;
+    }
+    unsigned long after = native_hal::heapStats().allocations;
+    return Timing{after - before, bestNs / iterations};
+}
+
+template <size_t N>
+void addRoutes(TopicRouter<N>& router, Handled& handled) {
+    router.template add<Handled, &Handled::onLed>("Advantech/bench/led", &handled);
+    router.template add<Handled, &Handled::onInterval>("Advantech/bench/cmd/interval", &handled);
+    router.template add<Handled, &Handled::onThreshold>("Advantech/bench/cmd/threshold", &handled);
+    router.template add<Handled, &Handled::onPublish>("Advantech/bench/cmd/publish", &handled);
+    router.template add<Handled, &Handled::onStatus>("homeassistant/status", &handled);
+}
+
+bool checkMatching() {
+    struct Case {
+        const char* filter;
+        const char* topic;
+        bool matches;
+    };
+    const Case cases[] = {
+        {"a/b", "a/b", true},
+        {"a/b", "a/bc", false},
+        {"a/b", "a", false},
+        {"a/+", "a/b", true},
+        {"a/+", "a/b/c", false},
+        {"a/+/c", "a/b/c", true},
+        {"a/+/c", "a//c", true},
+        {"a/#", "a/b/c", true},
+        {"a/#", "a", true},
+        {"a/#", "ab", false},
+        {"+/#", "a", true},
+        {"#", "a/b", true},
+        {"+", "a/b", false},
+    };
+    bool passed = true;
+    for (const Case& test : cases) {
+        TopicRouter<1> router;
+        Handled handled;
+        router.add<Handled, &Handled::onPublish>(test.filter, &handled);
+        bool matched = router.dispatch(test.topic, nullptr, 0) == 1;
+        if (matched != test.matches || topicMatches(test.filter, test.topic) != test.matches) {
+            Serial.printf("[bench] FAIL: filter %s %s topic %s\n", test.filter, test.matches ? "should match" : "matched",
+                          test.topic);
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+// Through MQTTClient and the native broker: routes are subscribed on
+// connect and handlers see each command's payload
+bool checkClient() {
+    native_hal::env().brokerAvailable = true;
+    WiFi.begin("bench", "");
+    MQTTConfig config;
+    strcpy(config.broker, "localhost");
+    strcpy(config.edgeId, "bench");
+    MQTTClient client(config);
+    client.initialize();
+
+    Handled handled;
+    bool routed = client.route<Handled, &Handled::onLed>("led", &handled) &&
+                  client.route<Handled, &Handled::onInterval>("cmd/interval", &handled) &&
+                  client.route<Handled, &Handled::onThreshold>("cmd/+", &handled);
+    if (!routed || client.connect() != ErrorCode::SUCCESS) {
+        Serial.println("[bench] FAIL: could not route or connect to the native broker");
+        return false;
+    }
+    native_hal::deliver("Advantech/bench/led", "on");
+    native_hal::deliver("Advantech/bench/cmd/interval", "2000");
+    native_hal::deliver("Advantech/bench/cmd/threshold", "750");
+    native_hal::deliver("Advantech/other/led", "on");
+    client.update();
+
+    // cmd/interval also matches cmd/+, whose handler only counts 750
+    bool passed = handled.led == 1 && handled.interval == 1 && handled.threshold == 1 &&
+                  client.getCommandsReceived() == 3 && client.getCommandsUnrouted() == 0;
+    Serial.printf("[bench] client: led %lu, interval %lu, threshold %lu, routed %lu, unrouted %lu\n",
+                  (unsigned long)handled.led, (unsigned long)handled.interval, (unsigned long)handled.threshold,
+                  client.getCommandsReceived(), client.getCommandsUnrouted());
+    if (!passed) {
+        Serial.println("[bench] FAIL: commands sent through MQTTClient did not reach their handlers");
+    }
+    return passed;
+}
+
+}  // namespace
+
+int runRouterBench(unsigned long iterations) {
+    Logger::setLevel(LogLevel::WARN);
+    bool passed = checkMatching();
+
+    Handled legacy;
+    Timing legacyTiming = measure(iterations, [&](char* topic, const uint8_t* payload, size_t length) {
+        legacyDispatch(legacy, topic, payload, length);
+    });
+
+    Handled routed;
+    TopicRouter<MQTTClient::MAX_ROUTES> router;
+    addRoutes(router, routed);
+    Timing routerTiming = measure(iterations, [&](char* topic, const uint8_t* payload, size_t length) {
+        router.dispatch(topic, payload, length);
+    });
+
+    unsigned long messages = iterations * ROUNDS;
+    Serial.printf("[bench] %lu messages over %zu topics (one unrouted) per run\n", iterations, MESSAGE_COUNT);
+    Serial.printf("[bench] String compare %7.1f ns/message, %5.2f allocs/message\n", legacyTiming.nsPerMessage,
+                  (double)legacyTiming.allocations / messages);
+    Serial.printf("[bench] TopicRouter    %7.1f ns/message, %5.2f allocs/message, sizeof %zu\n",
+                  routerTiming.nsPerMessage, (double)routerTiming.allocations / messages, sizeof(router));
+
+    if (routed.total() != legacy.total() || routed.led != legacy.led || routed.status != legacy.status) {
+        Serial.printf("[bench] FAIL: router handled %lu messages, String compare %lu\n", routed.total(),
+                      legacy.total());
+        passed = false;
+    }
+    if (routerTiming.allocations != 0) {
+        Serial.println("[bench] FAIL: router dispatch allocated on the heap");
+        passed = false;
+    }
+    passed = checkClient() && passed;
+
+    Serial.println(passed ? "[bench] PASS" : "[bench] FAIL");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,209 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <memory>
+#include <string.h>
+#include "../../core/app.h"
+#include "../hal/native_hal.h"
+#include "../sim/sensor_profile.h"
+#include "../sim/sim_hardware.h"
+
+namespace {
+
+const unsigned long SCAN_MS = 2500;  // An ESP32 active scan of 13 channels, give or take
+
+// What the radio hears: one network on three access points, a hidden one,
+// and SSIDs that need escaping in JSON
+const native_hal::ScanResult NEARBY[] = {
+    {"office", -71, 3},       {"Home \"5G\"", -48, 3}, {"office", -52, 3},     {"", -40, 3},
+    {"guest", -80, 0},        {"back\\slash", -66, 4}, {"office", -90, 3},     {"printer-7F2A", -58, 3},
+    {"neighbour", -85, 3},    {"Kitchen", -61, 3},     {"Hall\tAP", -77, 3},   {"IoT", -55, 3},
+    {"garage", -88, 3},       {"lab", -63, 3},         {"mesh-node", -69, 3},
+};
+const size_t NEARBY_COUNT = sizeof(NEARBY) / sizeof(NEARBY[0]);
+const size_t VISIBLE_NETWORKS = 12;  // Less the hidden one and two more "office"
+
+// The original handler: a blocking scan inside the request, and the
+// JSON concatenated into a String
+String legacyScan() {
+    String json = "{\"networks\":[";
+
+    int n = WiFi.scanNetworks();
+    for (int i = 0; i < n; i++) {
+        if (i > 0) json += ",";
+        json += "{";
+        json += "\"ssid\":\"" + WiFi.SSID(i) + "\",";
+        json += "\"rssi\":" + String(WiFi.RSSI(i)) + ",";
+        json += "\"encryption\":" + String(WiFi.encryptionType(i));
+        json += "}";
+    }
+
+    json += "]}";
+    WiFi.scanDelete();
+    return json;
+}
+
+struct Served {
+    unsigned long handlerMs;
+    unsigned long allocations;
+    unsigned long chunks;
+    String body;
+};
+
+Served serve(AsyncWebServer& server) {
+    AsyncWebServerRequest request(HTTP_GET, "/scan");
+    unsigned long allocationsBefore = native_hal::heapStats().allocations;
+    unsigned long startedAt = millis();
+    server.handle(request);
+    return Served{millis() - startedAt, native_hal::heapStats().allocations - allocationsBefore, request.chunks,
+                  request.responseBody};
+}
+
+void runFor(App& app, unsigned long ms) {
+    unsigned long until = millis() + ms;
+    while ((long)(until - millis()) > 0) {
+        unsigned long idleMs = app.runOnce();
+        unsigned long left = until - millis();
+        app.idle(idleMs < left ? idleMs : left);
+    }
+}
+
+bool check(bool passed, const char* failure) {
+    if (!passed) {
+        Serial.printf("[bench] FAIL: %s\n", failure);
+    }
+    return passed;
+}
+
+// Strongest first, hidden networks left out, one entry per SSID with its
+// strongest access point, and every SSID back intact through a JSON parser
+bool checkResults(const String& body) {
+    JsonDocument doc;
+    if (deserializeJson(doc, body)) {
+        Serial.printf("[bench] /scan is not valid JSON: %s\n", body.c_str());
+        return false;
+    }
+    JsonArray networks = doc["networks"];
+    size_t count = 0;
+    long lastRssi = 0;
+    bool sorted = true;
+    bool office = false;
+    bool quoted = false;
+    bool backslash = false;
+    bool tab = false;
+    bool hidden = false;
+    for (JsonVariant network : networks) {
+        const char* ssid = network["ssid"];
+        long rssi = network["rssi"];
+        if (count > 0 && rssi > lastRssi) sorted = false;
+        lastRssi = rssi;
+        office = office || (strcmp(ssid, "office") == 0 && rssi == -52);
+        quoted = quoted || strcmp(ssid, "Home \"5G\"") == 0;
+        backslash = backslash || strcmp(ssid, "back\\slash") == 0;
+        tab = tab || strcmp(ssid, "Hall\tAP") == 0;
+        hidden = hidden || ssid[0] == '\0';
+        count++;
+    }
+    return count == VISIBLE_NETWORKS && sorted && office && quoted && backslash && tab && !hidden &&
+           !doc["age"].isNull();
+}
+
+}  // namespace
+
+int runScanBench(unsigned long requests) {
+    Logger::setLevel(LogLevel::ERROR);
+    native_hal::useVirtualClock(true);
+    native_hal::Environment& env = native_hal::env();
+    env.spiffsRoot = ".native_bench_spiffs";
+    env.wifiScanMs = SCAN_MS;
+    env.scanResults.assign(NEARBY, NEARBY + NEARBY_COUNT);
+    bool passed = true;
+
+    // The original handler blocks the web server's task for the whole scan
+    unsigned long allocationsBefore = native_hal::heapStats().allocations;
+    unsigned long startedAt = millis();
+    String legacy = legacyScan();
+    unsigned long legacyMs = millis() - startedAt;
+    unsigned long legacyAllocations = native_hal::heapStats().allocations - allocationsBefore;
+    JsonDocument legacyDoc;
+    bool legacyValid = !deserializeJson(legacyDoc, legacy);
+    unsigned long scansBeforeBoot = env.wifiScans;
+
+    // An unconfigured device: the app comes up as an access point
+    Config seeded;
+    seeded.setDefaults();
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    seeded.saveToFile("/config.json");
+    DayNightProfile profile;
+    RecordingLed* led = new RecordingLed();
+    App app;
+    app.useHardware(std::unique_ptr<ISensorReader>(new ScriptedSensor(profile, led, millis())),
+                    std::unique_ptr<IDisplayDriver>(new RecordingDisplay()), std::unique_ptr<ILedController>(led));
+    if (app.initialize() != ErrorCode::SUCCESS) {
+        Serial.println("[bench] FAIL: App failed to initialize");
+        return 2;
+    }
+    Logger::setLevel(LogLevel::ERROR);
+    app.start();
+    runFor(app, 100);
+    AsyncWebServer* server = AsyncWebServer::current();
+    if (!server) {
+        Serial.println("[bench] FAIL: web server did not start in AP mode");
+        return 2;
+    }
+
+    // The AP coming up starts a scan, so the page has results when opened
+    runFor(app, SCAN_MS + 1000);
+    unsigned long scansAtBoot = env.wifiScans - scansBeforeBoot;
+    Served first = serve(*server);
+    passed = check(scansAtBoot == 1 && checkResults(first.body), "no scan results, or wrong ones, after boot") &&
+             passed;
+    passed = check(first.handlerMs == 0, "the /scan handler blocked") && passed;
+    passed = check(first.chunks > 1, "the response was not streamed in chunks") && passed;
+
+    // The page reloaded once a second: answers stay instant, scans stay rare
+    unsigned long scansBefore = env.wifiScans;
+    unsigned long slowest = 0;
+    unsigned long allocations = 0;
+    bool allValid = true;
+    Served last = first;
+    for (unsigned long i = 0; i < requests; i++) {
+        runFor(app, 1000);
+        last = serve(*server);
+        if (last.handlerMs > slowest) slowest = last.handlerMs;
+        allocations += last.allocations;
+        allValid = allValid && checkResults(last.body);
+    }
+    unsigned long scans = env.wifiScans - scansBefore;
+    unsigned long maxScans = requests * 1000 / WiFiScanner::RESCAN_INTERVAL + 1;
+    passed = check(allValid && slowest == 0, "a cached answer was wrong or blocked") && passed;
+    passed = check(scans > 0 && scans <= maxScans, "rescans were not rate-limited") && passed;
+
+    // No requests for a while: nothing is scanned, and the next answer says how old it is
+    unsigned long idleScans = env.wifiScans;
+    runFor(app, 5 * 60000);
+    Served stale = serve(*server);
+    JsonDocument staleDoc;
+    deserializeJson(staleDoc, stale.body);
+    unsigned long age = staleDoc["age"];
+    bool scanning = staleDoc["scanning"];
+    passed = check(env.wifiScans == idleScans && age >= 300 && scanning, "stale results were not flagged") && passed;
+
+    double perRequest = requests > 0 ? (double)allocations / requests : 0;
+    Serial.printf("[bench] %zu access points, %zu networks shown, %u ms scans\n", NEARBY_COUNT, VISIBLE_NETWORKS,
+                  (unsigned)SCAN_MS);
+    Serial.printf("[bench] blocking scan in handler %5lu ms, %3lu allocations, %u bytes%s\n", legacyMs,
+                  legacyAllocations, legacy.length(), legacyValid ? "" : " (invalid JSON)");
+    Serial.printf("[bench] cached, streamed         %5lu ms, %5.1f allocations, %u bytes in %lu chunks\n", slowest,
+                  perRequest, last.body.length(), last.chunks);
+    Serial.printf("[bench] %lu requests, 1/s: %lu scans (at most %lu); stale answer %lu s old, rescan requested\n",
+                  requests, scans, maxScans, age);
+
+    native_hal::useVirtualClock(false);
+    Serial.println(passed ? "[bench] PASS" : "[bench] FAIL");
+    return passed ? 0 : 1;
+}
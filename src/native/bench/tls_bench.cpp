@@ -0,0 +1,178 @@
+#include "benchmarks.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <WiFi.h>
+#include <string.h>
+#include "../../hardware/mqtt_client.h"
+#include "../hal/native_hal.h"
+
+namespace {
+
+const char* CA_FILE = "/mqtt_ca.pem";
+const char* CA_PEM =
+    "-----BEGIN CERTIFICATE-----\n"
+    "MIIBszCCAVmgAwIBAgIUbench0000000000000000000000000wCgYIKoZIzj0EAwIw\n"
+    "-----END CERTIFICATE-----\n";
+
+struct Handshake {
+    bool connected;
+    unsigned long ms;
+    size_t heap;
+    bool resumed;
+};
+
+// Takes the broker away for one update() so the client sees the drop;
+// update() while disconnected would start a background connect instead
+void dropConnection(MQTTClient& client) {
+    if (!client.isConnected()) return;
+    native_hal::env().brokerAvailable = false;
+    client.update();
+    native_hal::env().brokerAvailable = true;
+}
+
+Handshake connectAgain(MQTTClient& client) {
+    unsigned long resumedBefore = client.getTlsStats().resumedHandshakes;
+    bool connected = client.connect() == ErrorCode::SUCCESS;
+    const TlsClient::Stats& stats = client.getTlsStats();
+    return Handshake{connected, stats.lastHandshakeMs, stats.lastHandshakeHeap,
+                     stats.resumedHandshakes > resumedBefore};
+}
+
+Handshake reconnect(MQTTClient& client) {
+    dropConnection(client);
+    return connectAgain(client);
+}
+
+void writeFile(const char* path, const char* text) {
+    File file = SPIFFS.open(path, "w");
+    file.write((const uint8_t*)text, strlen(text));
+    file.close();
+}
+
+// A fresh TLS connection to host, which the broker's certificate must name
+bool connectsTo(const char* host) {
+    WiFiClient transport;
+    TlsClient tls(transport);
+    bool connected = tls.begin(CA_PEM, strlen(CA_PEM) + 1) && tls.connect(host, 8883);
+    tls.stop();
+    return connected;
+}
+
+bool check(bool passed, const char* failure) {
+    if (!passed) {
+        Serial.printf("[bench] FAIL: %s\n", failure);
+    }
+    return passed;
+}
+
+}  // namespace
+
+int runTlsBench(unsigned long reconnects) {
+    Logger::setLevel(LogLevel::ERROR);
+    native_hal::useVirtualClock(true);
+    native_hal::env().spiffsRoot = ".native_bench_spiffs";
+    native_hal::env().brokerAvailable = true;
+    native_hal::env().brokersDown.clear();
+    native_hal::TlsBroker& broker = native_hal::env().tls;
+    broker.subjectAltNames = {"DNS:broker-a", "DNS:broker-b"};
+    WiFi.begin("bench", "");
+    SPIFFS.format();
+    SPIFFS.begin(true);
+
+    MQTTConfig config;
+    strcpy(config.broker, "broker-a");
+    strcpy(config.edgeId, "bench");
+    config.port = 8883;
+    config.tls = true;
+    config.addFallbackBroker("broker-b", 8883);
+    MQTTClient client(config);
+    client.initialize();
+    bool passed = true;
+
+    // No CA, or one that doesn't parse: nothing goes out in the clear
+    bool refused = client.connect() != ErrorCode::SUCCESS;
+    writeFile(CA_FILE, "not a certificate");
+    bool rejectedCa = client.loadCaCertificate(SPIFFS, CA_FILE) == ErrorCode::CONFIG_INVALID;
+    refused = refused && client.connect() != ErrorCode::SUCCESS && native_hal::env().publishCount == 0;
+    passed = check(refused && rejectedCa, "connected without a valid CA") && passed;
+
+    writeFile(CA_FILE, CA_PEM);
+    passed = check(client.loadCaCertificate(SPIFFS, CA_FILE) == ErrorCode::SUCCESS, "CA did not load") && passed;
+    Handshake first = reconnect(client);
+    SensorData sample = {};
+    bool published = client.publishSensorData(sample) == ErrorCode::SUCCESS;
+    passed = check(first.connected && !first.resumed && published, "first TLS connect or publish failed") && passed;
+
+    // A later full handshake, for comparison: the broker restarted and forgot its sessions
+    Handshake warm = reconnect(client);
+    broker.sessionEpoch++;
+    Handshake full = reconnect(client);
+    passed = check(warm.resumed && full.connected && !full.resumed,
+                   "a session was not resumed, or was resumed after the broker restarted") && passed;
+
+    // Reconnects with a cached session; the heap must not creep
+    Handshake resumed = reconnect(client);
+    size_t heapBefore = native_hal::heapStats().currentBytes;
+    unsigned long resumedCount = 0;
+    unsigned long totalMs = 0;
+    for (unsigned long i = 0; i < reconnects; i++) {
+        Handshake again = reconnect(client);
+        if (again.connected && again.resumed) resumedCount++;
+        totalMs += again.ms;
+    }
+    size_t heapAfter = native_hal::heapStats().currentBytes;
+    passed = check(resumed.resumed && resumedCount == reconnects, "reconnects did not all resume") && passed;
+    passed = check(heapAfter <= heapBefore, "heap grew over the resumed reconnects") && passed;
+
+    // The broker turns resumption off: full handshakes, still connected
+    broker.resumption = false;
+    Handshake noTickets = reconnect(client);
+    broker.resumption = true;
+    passed = check(noTickets.connected && !noTickets.resumed, "no fallback to a full handshake") && passed;
+
+    // Another broker never gets the first one's session
+    Handshake settle = reconnect(client);
+    dropConnection(client);
+    native_hal::env().brokersDown.insert("broker-a");
+    Handshake other = connectAgain(client);
+    bool onFallback = client.getActiveBroker() == 1;
+    native_hal::env().brokersDown.clear();
+    passed = check(settle.resumed && other.connected && !other.resumed && onFallback,
+                   "the fallback broker was offered the preferred broker's session") && passed;
+
+    // A broker redeployed with a certificate that doesn't chain to the CA is refused
+    unsigned long failedBefore = client.getTlsStats().failedHandshakes;
+    broker.sessionEpoch++;
+    broker.certificateTrusted = false;
+    Handshake untrusted = reconnect(client);
+    broker.certificateTrusted = true;
+    passed = check(!untrusted.connected && client.getTlsStats().failedHandshakes > failedBefore,
+                   "connected to a broker with an untrusted certificate") && passed;
+
+    // The certificate must name the host: by DNS name, or by IP address as
+    // BUILD_GUIDE issues it for a broker addressed by IP
+    bool otherName = connectsTo("broker-c");
+    broker.subjectAltNames = {"IP:192.168.31.21"};
+    bool byIp = connectsTo("192.168.31.21");
+    bool otherIp = connectsTo("192.168.31.22");
+    bool ipForName = connectsTo("broker-a");
+    broker.subjectAltNames = {"DNS:broker-a", "IP:192.168.31.21"};
+    bool both = connectsTo("broker-a") && connectsTo("192.168.31.21");
+    broker.subjectAltNames = {"DNS:broker-a", "DNS:broker-b"};
+    passed = check(byIp && both, "an IP SAN did not match the broker's address") && passed;
+    passed = check(!otherName && !otherIp && !ipForName, "connected to a broker whose certificate names another host") &&
+             passed;
+
+    double averageMs = reconnects > 0 ? (double)totalMs / reconnects : 0;
+    Serial.printf("[bench] first TLS connect   %5lu ms, %6zu bytes of heap (record buffers allocated)\n", first.ms,
+                  first.heap);
+    Serial.printf("[bench] full handshake      %5lu ms, %6zu bytes of heap\n", full.ms, full.heap);
+    Serial.printf("[bench] resumed handshake   %5lu ms, %6zu bytes of heap, %lu/%lu reconnects resumed (avg %.0f ms)\n",
+                  resumed.ms, resumed.heap, resumedCount, reconnects, averageMs);
+    Serial.printf("[bench] broker saw %lu full and %lu resumed handshakes; heap %zu -> %zu bytes over the reconnects\n",
+                  broker.fullHandshakes, broker.resumedHandshakes, heapBefore, heapAfter);
+
+    native_hal::useVirtualClock(false);
+    Serial.println(passed ? "[bench] PASS" : "[bench] FAIL");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,51 @@
+#ifndef NATIVE_HAL_ADAFRUIT_SSD1306_H
+#define NATIVE_HAL_ADAFRUIT_SSD1306_H
+
+#include <Arduino.h>
+#include "Wire.h"
+
+#define SSD1306_SWITCHCAPVCC 0x02
+#define SSD1306_BLACK 0
+#define SSD1306_WHITE 1
+
+// Headless SSD1306 stand-in: accepts all drawing calls and discards them,
+// so OLEDDisplay keeps its real code path (formatting included) on the host.
+class Adafruit_SSD1306 : public Print {
+public:
+    Adafruit_SSD1306(uint8_t w, uint8_t h, TwoWire* twi = &Wire, int8_t rstPin = -1)
+        : displayWidth(w), displayHeight(h), textSize(1) {}
+
+    bool begin(uint8_t switchVcc = SSD1306_SWITCHCAPVCC, uint8_t address = 0, bool reset = true,
+               bool periphBegin = true) {
+        return true;
+    }
+
+    void clearDisplay() {}
+    void display() {}
+    void setTextSize(uint8_t size) { textSize = size; }
+    void setTextColor(uint16_t color) {}
+    void setCursor(int16_t x, int16_t y) {}
+    void drawRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {}
+    void fillRect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {}
+
+    void getTextBounds(const char* str, int16_t x, int16_t y, int16_t* x1, int16_t* y1, uint16_t* w, uint16_t* h) {
+        *x1 = x;
+        *y1 = y;
+        *w = strlen(str) * 6 * textSize;
+        *h = 8 * textSize;
+    }
+
+    int16_t width() const { return displayWidth; }
+    int16_t height() const { return displayHeight; }
+
+    size_t write(uint8_t c) override { return 1; }
+    size_t write(const uint8_t* buffer, size_t size) override { return size; }
+    using Print::write;
+
+private:
+    int16_t displayWidth;
+    int16_t displayHeight;
+    uint8_t textSize;
+};
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef NATIVE_HAL_ARDUINO_H
+#define NATIVE_HAL_ARDUINO_H
+
+// Host stand-in for the ESP32 Arduino core. Only what src/core and
+// src/hardware use is provided; behaviour is driven by native_hal::env().
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "WString.h"
+#include "Print.h"
+#include "IPAddress.h"
+#include "HardwareSerial.h"
+#include "Esp.h"
+
+typedef uint8_t byte;
+
+// RTC memory is ordinary memory here: it keeps its contents for as long as
+// the process runs, and esp_reset_reason() says whether a reset kept it
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+
+#define HIGH 0x1
+#define LOW 0x0
+
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef NATIVE_HAL_CLIENT_H
+#define NATIVE_HAL_CLIENT_H
+
+#include "IPAddress.h"
+#include "Print.h"
+
+class Client : public Stream {
+public:
+    virtual int connect(IPAddress ip, uint16_t port) = 0;
+    virtual int connect(const char* host, uint16_t port) = 0;
+    virtual uint8_t connected() = 0;
+    virtual void stop() = 0;
+    virtual int read(uint8_t* buffer, size_t size) = 0;
+    using Stream::read;
+    virtual operator bool() = 0;
+};
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef NATIVE_HAL_DHT_H
+#define NATIVE_HAL_DHT_H
+
+#include <Arduino.h>
+
+#define DHT11 11
+#define DHT22 22
+
+// DHT stand-in returning the readings in native_hal::env().
+class DHT {
+public:
+    DHT(uint8_t pin, uint8_t type, uint8_t count = 6) : pin(pin), type(type) {}
+
+    void begin(uint8_t usec = 55) {}
+    float readTemperature(bool fahrenheit = false, bool force = false);
+    float readHumidity(bool force = false);
+
+private:
+    uint8_t pin;
+    uint8_t type;
+};
+
+#endif
@@ -0,0 +1,166 @@
+#ifndef NATIVE_HAL_ESP_ASYNC_WEB_SERVER_H
+#define NATIVE_HAL_ESP_ASYNC_WEB_SERVER_H
+
+#include <Arduino.h>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+typedef enum {
+    HTTP_GET = 0b00000001,
+    HTTP_POST = 0b00000010,
+    HTTP_DELETE = 0b00000100,
+    HTTP_PUT = 0b00001000,
+    HTTP_ANY = 0b01111111
+} WebRequestMethod;
+
+typedef uint8_t WebRequestMethodComposite;
+
+class AsyncWebParameter {
+public:
+    AsyncWebParameter(const String& name, const String& value, bool form) : paramName(name), paramValue(value), form(form) {}
+
+    const String& name() const { return paramName; }
+    const String& value() const { return paramValue; }
+    bool isPost() const { return form; }
+
+private:
+    String paramName;
+    String paramValue;
+    bool form;
+};
+
+// Writes up to maxLength bytes of the body from offset index on; 0 ends it
+typedef std::function<size_t(uint8_t* buffer, size_t maxLength, size_t index)> AwsResponseFiller;
+
+class AsyncWebServerResponse {
+public:
+    AsyncWebServerResponse(const String& contentType, AwsResponseFiller filler)
+        : contentType(contentType), filler(filler) {}
+
+    String contentType;
+    AwsResponseFiller filler;
+};
+
+// Request stand-in: host code builds one, hands it to
+// AsyncWebServer::handle(), and inspects the recorded response.
+class AsyncWebServerRequest {
+public:
+    AsyncWebServerRequest(WebRequestMethodComposite method, const char* url) : requestMethod(method), requestUrl(url) {}
+
+    void addParam(const String& name, const String& value, bool post = false) {
+        params.emplace_back(name, value, post);
+    }
+
+    WebRequestMethodComposite method() const { return requestMethod; }
+    const String& url() const { return requestUrl; }
+
+    bool hasParam(const char* name, bool post = false) const {
+        return getParam(name, post) != nullptr;
+    }
+    const AsyncWebParameter* getParam(const char* name, bool post = false) const {
+        for (const auto& param : params) {
+            if (param.name() == name && param.isPost() == post) {
+                return &param;
+            }
+        }
+        return nullptr;
+    }
+
+    void send(int code, const char* contentType = "", const String& content = String()) {
+        responseCode = code;
+        responseType = contentType;
+        responseBody = content;
+    }
+    void send(int code, const String& contentType, const String& content = String()) {
+        send(code, contentType.c_str(), content);
+    }
+
+    // The filler is drained at once, in TCP-segment-sized pieces, as the
+    // async TCP task would over several callbacks
+    AsyncWebServerResponse* beginChunkedResponse(const String& contentType, AwsResponseFiller filler) {
+        response.reset(new AsyncWebServerResponse(contentType, filler));
+        return response.get();
+    }
+    void send(AsyncWebServerResponse* chunked) {
+        uint8_t segment[CHUNK_BYTES];
+        std::string body;
+        size_t index = 0;
+        size_t length;
+        while ((length = chunked->filler(segment, sizeof(segment), index)) > 0) {
+            body.append((const char*)segment, length);
+            index += length;
+            chunks++;
+        }
+        send(200, chunked->contentType, String(body.c_str()));
+    }
+
+    static const size_t CHUNK_BYTES = 536;
+    unsigned long chunks = 0;
+
+    int responseCode = 0;
+    String responseType;
+    String responseBody;
+
+private:
+    WebRequestMethodComposite requestMethod;
+    String requestUrl;
+    std::vector<AsyncWebParameter> params;
+    std::unique_ptr<AsyncWebServerResponse> response;
+};
+
+typedef std::function<void(AsyncWebServerRequest* request)> ArRequestHandlerFunction;
+
+class AsyncWebServer {
+public:
+    explicit AsyncWebServer(uint16_t port) : port(port) {}
+    ~AsyncWebServer() {
+        if (current() == this) current() = nullptr;
+    }
+
+    void begin() {
+        running = true;
+        current() = this;
+    }
+    void end() { running = false; }
+    bool isRunning() const { return running; }
+
+    // Host-only: the most recently started server, so host programs can
+    // issue requests against an App they do not own the server of
+    static AsyncWebServer*& current() {
+        static AsyncWebServer* server = nullptr;
+        return server;
+    }
+
+    void on(const char* uri, WebRequestMethodComposite method, ArRequestHandlerFunction onRequest) {
+        routes.push_back(Route{uri, method, onRequest});
+    }
+
+    // Host-only: dispatch a request to the first matching handler, as the
+    // async TCP task would. Returns false (and answers 404) if none matches.
+    bool handle(AsyncWebServerRequest& request) {
+        for (auto& route : routes) {
+            if ((route.method & request.method()) && request.url() == route.uri.c_str()) {
+                route.handler(&request);
+                return true;
+            }
+        }
+        request.send(404, "text/plain", "Not found");
+        return false;
+    }
+
+private:
+    struct Route {
+        std::string uri;
+        WebRequestMethodComposite method;
+        ArRequestHandlerFunction handler;
+    };
+
+    uint16_t port;
+    bool running = false;
+    std::vector<Route> routes;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef NATIVE_HAL_ESP_H
+#define NATIVE_HAL_ESP_H
+
+#include <cstdint>
+
+class EspClass {
+public:
+    uint32_t getHeapSize();
+    uint32_t getFreeHeap();
+    uint32_t getMinFreeHeap();
+    uint32_t getCpuFreqMHz() { return 240; }
+    uint32_t getCycleCount();  // Derived from micros(), so it follows the virtual clock
+    void restart();
+};
+
+extern EspClass ESP;
+
+typedef enum {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_EXT,
+    ESP_RST_SW,
+    ESP_RST_PANIC,
+    ESP_RST_INT_WDT,
+    ESP_RST_TASK_WDT,
+    ESP_RST_WDT,
+    ESP_RST_DEEPSLEEP,
+    ESP_RST_BROWNOUT,
+    ESP_RST_SDIO
+} esp_reset_reason_t;
+
+// Reports native_hal::env().resetReason
+esp_reset_reason_t esp_reset_reason();
+
+#endif
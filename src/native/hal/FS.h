@@ -0,0 +1,109 @@
+#ifndef NATIVE_HAL_FS_H
+#define NATIVE_HAL_FS_H
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "Print.h"
+
+// Host stand-in for the ESP32 fs::FS/fs::File API. Paths are mapped onto a
+// directory on the host so configuration and logs survive between runs.
+namespace fs {
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2
+};
+
+class File : public Stream {
+public:
+    File() {}
+    File(std::shared_ptr<FILE> handle, const char* path) : handle(handle), path(path) {}
+
+    size_t write(uint8_t c) override {
+        return handle && fputc(c, handle.get()) != EOF ? 1 : 0;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return handle ? fwrite(buffer, 1, size, handle.get()) : 0;
+    }
+    using Print::write;
+
+    int available() override {
+        if (!handle) return 0;
+        long remaining = (long)size() - (long)position();
+        return remaining > 0 ? (int)remaining : 0;
+    }
+    int read() override {
+        return handle ? fgetc(handle.get()) : -1;
+    }
+    size_t read(uint8_t* buffer, size_t size) {
+        return handle ? fread(buffer, 1, size, handle.get()) : 0;
+    }
+    int peek() override {
+        if (!handle) return -1;
+        int c = fgetc(handle.get());
+        if (c != EOF) ungetc(c, handle.get());
+        return c;
+    }
+    void flush() override {
+        if (handle) fflush(handle.get());
+    }
+
+    bool seek(uint32_t pos, SeekMode mode = SeekSet) {
+        int whence = mode == SeekSet ? SEEK_SET : (mode == SeekCur ? SEEK_CUR : SEEK_END);
+        return handle && fseek(handle.get(), (long)pos, whence) == 0;
+    }
+    size_t position() const {
+        return handle ? (size_t)ftell(handle.get()) : 0;
+    }
+    size_t size() const {
+        if (!handle) return 0;
+        long current = ftell(handle.get());
+        fseek(handle.get(), 0, SEEK_END);
+        long end = ftell(handle.get());
+        fseek(handle.get(), current, SEEK_SET);
+        return (size_t)end;
+    }
+
+    void close() {
+        handle.reset();
+    }
+    bool isDirectory() const {
+        return false;
+    }
+    const char* name() const {
+        return path.c_str();
+    }
+    operator bool() const {
+        return (bool)handle;
+    }
+
+private:
+    std::shared_ptr<FILE> handle;
+    std::string path;
+};
+
+class FS {
+public:
+    File open(const char* path, const char* mode = "r");
+    File open(const String& path, const char* mode = "r") { return open(path.c_str(), mode); }
+    bool exists(const char* path);
+    bool exists(const String& path) { return exists(path.c_str()); }
+    bool remove(const char* path);
+    bool remove(const String& path) { return remove(path.c_str()); }
+    bool rename(const char* from, const char* to);
+
+protected:
+    std::string hostPath(const char* path) const;
+};
+
+}  // namespace fs
+
+using fs::File;
+using fs::FS;
+using fs::SeekCur;
+using fs::SeekEnd;
+using fs::SeekSet;
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef NATIVE_HAL_HARDWARE_SERIAL_H
+#define NATIVE_HAL_HARDWARE_SERIAL_H
+
+#include <cstdio>
+#include "Print.h"
+
+// Serial writes straight to stdout on the host.
+class HardwareSerial : public Stream {
+public:
+    void begin(unsigned long baud) {
+        (void)baud;
+    }
+    void end() {}
+
+    size_t write(uint8_t c) override {
+        return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        return fwrite(buffer, 1, size, stdout);
+    }
+    using Print::write;
+
+    int available() override { return 0; }
+    int read() override { return -1; }
+    int peek() override { return -1; }
+    void flush() override { fflush(stdout); }
+
+    operator bool() const { return true; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef NATIVE_HAL_IPADDRESS_H
+#define NATIVE_HAL_IPADDRESS_H
+
+#include <cstdint>
+#include <cstdio>
+#include "WString.h"
+
+class IPAddress {
+public:
+    IPAddress() : address{0, 0, 0, 0} {}
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) : address{a, b, c, d} {}
+    IPAddress(uint32_t value) {
+        for (int i = 0; i < 4; i++) {
+            address[i] = (value >> (8 * i)) & 0xFF;
+        }
+    }
+
+    operator uint32_t() const {
+        return (uint32_t)address[0] | ((uint32_t)address[1] << 8) | ((uint32_t)address[2] << 16) |
+               ((uint32_t)address[3] << 24);
+    }
+
+    uint8_t operator[](int index) const { return address[index]; }
+    uint8_t& operator[](int index) { return address[index]; }
+
+    bool fromString(const char* str) {
+        unsigned int a, b, c, d;
+        if (sscanf(str, "%u.%u.%u.%u", &a, &b, &c, &d) != 4 || a > 255 || b > 255 || c > 255 || d > 255) {
+            return false;
+        }
+        address[0] = a;
+        address[1] = b;
+        address[2] = c;
+        address[3] = d;
+        return true;
+    }
+
+    String toString() const {
+        char buffer[16];
+        snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u", address[0], address[1], address[2], address[3]);
+        return String(buffer);
+    }
+
+private:
+    uint8_t address[4];
+};
+
+#endif
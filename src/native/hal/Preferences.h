@@ -0,0 +1,28 @@
+#ifndef NATIVE_HAL_PREFERENCES_H
+#define NATIVE_HAL_PREFERENCES_H
+
+#include <cstddef>
+#include <string>
+
+// NVS stand-in: namespaced key/value blobs in native_hal::env().nvs, which
+// outlive any App or WiFiManager the way flash outlives a reset
+class Preferences {
+public:
+    bool begin(const char* name, bool readOnly = false);
+    void end();
+
+    size_t putBytes(const char* key, const void* value, size_t length);
+    size_t getBytes(const char* key, void* buffer, size_t maxLength);
+    size_t getBytesLength(const char* key);
+    bool remove(const char* key);
+    bool clear();
+
+private:
+    std::string space;
+    bool started = false;
+    bool readOnly = false;
+
+    std::string entry(const char* key) const;
+};
+
+#endif
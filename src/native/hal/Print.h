@@ -0,0 +1,89 @@
+#ifndef NATIVE_HAL_PRINT_H
+#define NATIVE_HAL_PRINT_H
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include "WString.h"
+
+// Host stand-in for Arduino's Print/Stream hierarchy.
+class Print {
+public:
+    virtual ~Print() = default;
+
+    virtual size_t write(uint8_t c) = 0;
+    virtual size_t write(const uint8_t* buffer, size_t size) {
+        size_t n = 0;
+        while (size--) {
+            n += write(*buffer++);
+        }
+        return n;
+    }
+    size_t write(const char* str) {
+        return str ? write((const uint8_t*)str, strlen(str)) : 0;
+    }
+
+    size_t print(const char* str) { return write(str); }
+    size_t print(const String& str) { return write((const uint8_t*)str.c_str(), str.length()); }
+    size_t print(char c) { return write((uint8_t)c); }
+    size_t print(int value) { return printf("%d", value); }
+    size_t print(unsigned int value) { return printf("%u", value); }
+    size_t print(long value) { return printf("%ld", value); }
+    size_t print(unsigned long value) { return printf("%lu", value); }
+    size_t print(double value, int decimals = 2) { return printf("%.*f", decimals, value); }
+
+    size_t println() { return write("\n"); }
+    template <typename T>
+    size_t println(const T& value) {
+        size_t n = print(value);
+        return n + println();
+    }
+
+    size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3))) {
+        char buffer[256];
+        va_list args;
+        va_start(args, format);
+        int len = vsnprintf(buffer, sizeof(buffer), format, args);
+        va_end(args);
+        if (len < 0) return 0;
+        if ((size_t)len < sizeof(buffer)) {
+            return write((const uint8_t*)buffer, len);
+        }
+        // Rare long line: format again into a right-sized heap buffer
+        std::string longBuffer(len + 1, '\0');
+        va_start(args, format);
+        vsnprintf(&longBuffer[0], longBuffer.size(), format, args);
+        va_end(args);
+        return write((const uint8_t*)longBuffer.data(), len);
+    }
+
+    virtual void flush() {}
+};
+
+class Stream : public Print {
+public:
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+
+    size_t readBytes(char* buffer, size_t length) {
+        size_t count = 0;
+        while (count < length) {
+            int c = read();
+            if (c < 0) break;
+            *buffer++ = (char)c;
+            count++;
+        }
+        return count;
+    }
+    size_t readBytes(uint8_t* buffer, size_t length) {
+        return readBytes((char*)buffer, length);
+    }
+
+    void setTimeout(unsigned long timeout) {
+        (void)timeout;
+    }
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef NATIVE_HAL_PUBSUBCLIENT_H
+#define NATIVE_HAL_PUBSUBCLIENT_H
+
+#include <Arduino.h>
+#include <functional>
+#include <string>
+#include <vector>
+#include "Client.h"
+
+#define MQTT_CONNECTION_TIMEOUT -4
+#define MQTT_CONNECTION_LOST -3
+#define MQTT_CONNECT_FAILED -2
+#define MQTT_DISCONNECTED -1
+#define MQTT_CONNECTED 0
+
+#define MQTT_CALLBACK_SIGNATURE std::function<void(char*, uint8_t*, unsigned int)> callback
+
+// PubSubClient stand-in. Instead of speaking MQTT over the Client it talks
+// to the simulated broker in native_hal::env(): connect() succeeds while the
+// broker is up, publishes are counted there, and messages queued with
+// native_hal::deliver() are handed to the callback from loop().
+class PubSubClient {
+public:
+    explicit PubSubClient(Client& client) : client(&client) {}
+
+    PubSubClient& setServer(const char* domain, uint16_t port);
+    PubSubClient& setCallback(MQTT_CALLBACK_SIGNATURE);
+    bool setBufferSize(uint16_t size);
+    uint16_t getBufferSize() { return bufferSize; }
+    PubSubClient& setSocketTimeout(uint16_t timeout) { return *this; }
+    PubSubClient& setKeepAlive(uint16_t keepAlive) { return *this; }
+
+    bool connect(const char* id);
+    bool connect(const char* id, const char* user, const char* pass);
+    void disconnect();
+    bool connected();
+    int state() { return currentState; }
+    bool loop();
+
+    bool publish(const char* topic, const char* payload);
+    bool publish(const char* topic, const char* payload, bool retained);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length);
+    bool publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained);
+
+    bool subscribe(const char* topic);
+    bool unsubscribe(const char* topic);
+
+private:
+    Client* client;
+    const char* domain = nullptr;  // Kept, not copied, like the real one
+    uint16_t port = 1883;
+    std::function<void(char*, uint8_t*, unsigned int)> callback;
+    std::vector<std::string> subscriptions;
+    uint16_t bufferSize = 256;
+    int currentState = MQTT_DISCONNECTED;
+    bool isOpen = false;
+};
+
+#endif
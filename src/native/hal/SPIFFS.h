@@ -0,0 +1,22 @@
+#ifndef NATIVE_HAL_SPIFFS_H
+#define NATIVE_HAL_SPIFFS_H
+
+#include "FS.h"
+
+namespace fs {
+
+class SPIFFSFS : public FS {
+public:
+    bool begin(bool formatOnFail = false, const char* basePath = "/spiffs", uint8_t maxOpenFiles = 10,
+               const char* partitionLabel = nullptr);
+    void end() {}
+    bool format();
+    size_t totalBytes() { return 1024 * 1024; }
+    size_t usedBytes();
+};
+
+}  // namespace fs
+
+extern fs::SPIFFSFS SPIFFS;
+
+#endif
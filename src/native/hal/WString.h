@@ -0,0 +1,156 @@
+#ifndef NATIVE_HAL_WSTRING_H
+#define NATIVE_HAL_WSTRING_H
+
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+// Host stand-in for the Arduino String class, backed by std::string.
+// Only the subset used by the firmware (and by ArduinoJson's Arduino
+// string adapter) is provided.
+class String {
+public:
+    String() {}
+    String(const char* s) : str(s ? s : "") {}
+    String(const String& other) = default;
+    String(String&& other) = default;
+    explicit String(char c) : str(1, c) {}
+    explicit String(int value) : str(std::to_string(value)) {}
+    explicit String(unsigned int value) : str(std::to_string(value)) {}
+    explicit String(long value) : str(std::to_string(value)) {}
+    explicit String(unsigned long value) : str(std::to_string(value)) {}
+    explicit String(float value, unsigned int decimals = 2) : str(formatDouble(value, decimals)) {}
+    explicit String(double value, unsigned int decimals = 2) : str(formatDouble(value, decimals)) {}
+
+    String& operator=(const String& other) = default;
+    String& operator=(String&& other) = default;
+    String& operator=(const char* s) {
+        str = s ? s : "";
+        return *this;
+    }
+
+    const char* c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.size(); }
+    bool isEmpty() const { return str.empty(); }
+    bool reserve(unsigned int size) {
+        str.reserve(size);
+        return true;
+    }
+
+    bool concat(const String& s) {
+        str += s.str;
+        return true;
+    }
+    bool concat(const char* s) {
+        if (s) str += s;
+        return true;
+    }
+    bool concat(const char* s, unsigned int len) {
+        if (s) str.append(s, len);
+        return true;
+    }
+    bool concat(char c) {
+        str += c;
+        return true;
+    }
+
+    String& operator+=(const String& s) { concat(s); return *this; }
+    String& operator+=(const char* s) { concat(s); return *this; }
+    String& operator+=(char c) { concat(c); return *this; }
+    String& operator+=(int value) { str += std::to_string(value); return *this; }
+    String& operator+=(unsigned int value) { str += std::to_string(value); return *this; }
+    String& operator+=(long value) { str += std::to_string(value); return *this; }
+    String& operator+=(unsigned long value) { str += std::to_string(value); return *this; }
+
+    bool operator==(const String& other) const { return str == other.str; }
+    bool operator==(const char* s) const { return str == (s ? s : ""); }
+    bool operator!=(const String& other) const { return str != other.str; }
+    bool operator!=(const char* s) const { return !(*this == s); }
+    bool operator<(const String& other) const { return str < other.str; }
+
+    char operator[](unsigned int index) const { return index < str.size() ? str[index] : '\0'; }
+    char charAt(unsigned int index) const { return (*this)[index]; }
+
+    String substring(unsigned int from) const {
+        return from < str.size() ? String(str.substr(from).c_str()) : String();
+    }
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) std::swap(from, to);
+        if (from >= str.size()) return String();
+        return String(str.substr(from, to - from).c_str());
+    }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        size_t pos = str.find(c, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    int indexOf(const char* s, unsigned int from = 0) const {
+        size_t pos = str.find(s, from);
+        return pos == std::string::npos ? -1 : (int)pos;
+    }
+    bool startsWith(const char* s) const { return str.compare(0, strlen(s), s) == 0; }
+    bool endsWith(const char* s) const {
+        size_t n = strlen(s);
+        return str.size() >= n && str.compare(str.size() - n, n, s) == 0;
+    }
+
+    void replace(const char* find, const char* with) {
+        size_t findLen = strlen(find);
+        if (findLen == 0) return;
+        size_t withLen = strlen(with);
+        size_t pos = 0;
+        while ((pos = str.find(find, pos)) != std::string::npos) {
+            str.replace(pos, findLen, with);
+            pos += withLen;
+        }
+    }
+    void toLowerCase() {
+        for (auto& c : str) c = (char)tolower((unsigned char)c);
+    }
+    void toUpperCase() {
+        for (auto& c : str) c = (char)toupper((unsigned char)c);
+    }
+    void trim() {
+        size_t begin = str.find_first_not_of(" \t\r\n");
+        size_t end = str.find_last_not_of(" \t\r\n");
+        str = begin == std::string::npos ? std::string() : str.substr(begin, end - begin + 1);
+    }
+
+    long toInt() const { return strtol(str.c_str(), nullptr, 10); }
+    float toFloat() const { return strtof(str.c_str(), nullptr); }
+
+private:
+    std::string str;
+
+    static std::string formatDouble(double value, unsigned int decimals) {
+        char buffer[48];
+        snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, value);
+        return buffer;
+    }
+};
+
+inline String operator+(const String& lhs, const String& rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+}
+
+inline String operator+(const String& lhs, const char* rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+}
+
+inline String operator+(const char* lhs, const String& rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+}
+
+inline String operator+(const String& lhs, char rhs) {
+    String result(lhs);
+    result += rhs;
+    return result;
+}
+
+#endif
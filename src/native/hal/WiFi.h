@@ -0,0 +1,158 @@
+#ifndef NATIVE_HAL_WIFI_H
+#define NATIVE_HAL_WIFI_H
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+#include "WiFiClient.h"
+
+typedef enum {
+    WL_NO_SHIELD = 255,
+    WL_IDLE_STATUS = 0,
+    WL_NO_SSID_AVAIL = 1,
+    WL_SCAN_COMPLETED = 2,
+    WL_CONNECTED = 3,
+    WL_CONNECT_FAILED = 4,
+    WL_CONNECTION_LOST = 5,
+    WL_DISCONNECTED = 6
+} wl_status_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+
+typedef enum {
+    WIFI_OFF = 0,
+    WIFI_STA = 1,
+    WIFI_AP = 2,
+    WIFI_AP_STA = 3
+} wifi_mode_t;
+
+typedef enum {
+    WIFI_AUTH_OPEN = 0,
+    WIFI_AUTH_WEP,
+    WIFI_AUTH_WPA_PSK,
+    WIFI_AUTH_WPA2_PSK,
+    WIFI_AUTH_WPA_WPA2_PSK,
+    WIFI_AUTH_WPA2_ENTERPRISE
+} wifi_auth_mode_t;
+
+typedef enum {
+    ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+    ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+    ARDUINO_EVENT_MAX = 41
+} arduino_event_id_t;
+
+// The subset of esp_wifi_types.h reasons the firmware tells apart
+typedef enum {
+    WIFI_REASON_UNSPECIFIED = 1,
+    WIFI_REASON_AUTH_EXPIRE = 2,
+    WIFI_REASON_AUTH_LEAVE = 3,
+    WIFI_REASON_ASSOC_EXPIRE = 4,
+    WIFI_REASON_ASSOC_TOOMANY = 5,
+    WIFI_REASON_ASSOC_LEAVE = 8,
+    WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT = 15,
+    WIFI_REASON_BEACON_TIMEOUT = 200,
+    WIFI_REASON_NO_AP_FOUND = 201,
+    WIFI_REASON_AUTH_FAIL = 202,
+    WIFI_REASON_ASSOC_FAIL = 203,
+    WIFI_REASON_HANDSHAKE_TIMEOUT = 204,
+    WIFI_REASON_CONNECTION_FAIL = 205
+} wifi_err_reason_t;
+
+typedef struct {
+    uint8_t ssid[32];
+    uint8_t ssid_len;
+    uint8_t bssid[6];
+    uint8_t reason;
+} wifi_event_sta_disconnected_t;
+
+typedef union {
+    wifi_event_sta_disconnected_t wifi_sta_disconnected;
+} arduino_event_info_t;
+
+typedef size_t wifi_event_id_t;
+typedef std::function<void(arduino_event_id_t event, arduino_event_info_t info)> WiFiEventFuncCb;
+
+// Station/AP stand-in driven by native_hal::env(): begin() joins the access
+// point after the scan/probe, association and DHCP times there, as long as
+// env().wifiAvailable is set. The link drops when it is cleared and, as
+// with auto-reconnect off on the device, stays down until the next begin().
+// A directed begin() may also join any access point in env().scanResults.
+// Event handlers run inside the call that notices the change.
+class WiFiClass {
+public:
+    wifi_event_id_t onEvent(WiFiEventFuncCb callback, arduino_event_id_t event = ARDUINO_EVENT_MAX);
+    void removeEvent(wifi_event_id_t id);
+
+    bool mode(wifi_mode_t mode);
+    wifi_mode_t getMode() { return currentMode; }
+    void persistent(bool persistent) {}
+    bool setAutoReconnect(bool autoReconnect) { return true; }
+
+    wl_status_t begin(const char* ssid, const char* password = nullptr, int32_t channel = 0,
+                      const uint8_t* bssid = nullptr, bool connect = true);
+    // A zero localIP goes back to DHCP
+    bool config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress(),
+                IPAddress dns2 = IPAddress());
+    bool disconnect(bool wifiOff = false);
+    wl_status_t status();
+
+    IPAddress localIP();
+    IPAddress gatewayIP();
+    IPAddress subnetMask();
+    IPAddress dnsIP(uint8_t index = 0);
+    String macAddress();
+    String SSID();
+    int32_t RSSI();
+    uint8_t* BSSID();
+    String BSSIDstr();
+    int32_t channel();
+
+    bool softAP(const char* ssid, const char* password = nullptr);
+    IPAddress softAPIP();
+    uint8_t softAPgetStationNum() { return 0; }
+
+    // Takes env().wifiScanMs: blocking, or in the background with async,
+    // polled through scanComplete()
+    int16_t scanNetworks(bool async = false);
+    int16_t scanComplete();
+    String SSID(uint8_t index);
+    int32_t RSSI(uint8_t index);
+    wifi_auth_mode_t encryptionType(uint8_t index);
+    uint8_t* BSSID(uint8_t index);
+    int32_t channel(uint8_t index);
+    void scanDelete();
+
+private:
+    wifi_mode_t currentMode = WIFI_OFF;
+    bool started = false;
+    String ssid;
+    unsigned long beganAt = 0;
+    unsigned long joinMs = 0;
+    bool apFound = false;  // Set by begin(); a directed probe may miss
+    bool joined = false;
+    bool lost = false;
+    int joinedAp = -1;  // Index into env().scanResults, or -1 for the env().wifiBssid one
+    uint8_t joinedBssid[6] = {};
+    IPAddress staticIP;
+    IPAddress staticGateway;
+    IPAddress staticSubnet;
+    IPAddress staticDns;
+    bool scanRunning = false;
+    unsigned long scanStartedAt = 0;
+
+    struct Handler {
+        wifi_event_id_t id;
+        arduino_event_id_t event;
+        WiFiEventFuncCb callback;
+    };
+    std::vector<Handler> handlers;
+    wifi_event_id_t nextHandlerId = 1;
+
+    int findAccessPoint(int32_t channel, const uint8_t* bssid) const;
+    void disconnected(uint8_t reason);
+};
+
+extern WiFiClass WiFi;
+
+#endif
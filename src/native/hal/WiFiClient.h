@@ -0,0 +1,35 @@
+#ifndef NATIVE_HAL_WIFI_CLIENT_H
+#define NATIVE_HAL_WIFI_CLIENT_H
+
+#include <string>
+#include "Client.h"
+
+// TCP stand-in: a connection succeeds while the simulated broker is up
+// and its host is not in native_hal::env().brokersDown.
+// No bytes flow; PubSubClient's stand-in talks to the broker directly, and
+// available() reports queued inbound messages so waits end early.
+class WiFiClient : public Client {
+public:
+    int connect(IPAddress ip, uint16_t port) override;
+    int connect(const char* host, uint16_t port) override;
+    uint8_t connected() override;
+    void stop() override { open = false; }
+
+    size_t write(uint8_t c) override { return open ? 1 : 0; }
+    size_t write(const uint8_t* buffer, size_t size) override { return open ? size : 0; }
+    using Print::write;
+
+    int available() override;
+    int read() override { return -1; }
+    int read(uint8_t* buffer, size_t size) override { return -1; }
+    int peek() override { return -1; }
+
+    operator bool() override { return connected(); }
+    int fd() const { return -1; }  // No real socket to select() on
+
+private:
+    bool open = false;
+    std::string host;
+};
+
+#endif
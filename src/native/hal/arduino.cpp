@@ -0,0 +1,141 @@
+#include <Arduino.h>
+#include <chrono>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include "native_hal.h"
+
+HardwareSerial Serial;
+EspClass ESP;
+
+namespace native_hal {
+
+Environment& env() {
+    static Environment environment;
+    return environment;
+}
+
+}  // namespace native_hal
+
+using native_hal::env;
+
+namespace {
+
+const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+std::mt19937 rng(0x5EED);
+
+bool virtualClock = false;
+uint64_t virtualMicros = 0;
+
+uint64_t realMicros() {
+    auto elapsed = std::chrono::steady_clock::now() - bootTime;
+    return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+int clampPin(uint8_t pin) {
+    return pin < 40 ? pin : 39;
+}
+
+}  // namespace
+
+namespace native_hal {
+
+void useVirtualClock(bool enabled) {
+    if (enabled && !virtualClock) {
+        virtualMicros = realMicros();
+    }
+    virtualClock = enabled;
+}
+
+bool isVirtualClock() {
+    return virtualClock;
+}
+
+void advanceClock(unsigned long ms) {
+    virtualMicros += (uint64_t)ms * 1000;
+}
+
+}  // namespace native_hal
+
+// Both clocks wrap at 32 bits like the ESP32 core
+unsigned long millis() {
+    uint64_t now = virtualClock ? virtualMicros : realMicros();
+    return (uint32_t)(now / 1000);
+}
+
+unsigned long micros() {
+    return (uint32_t)(virtualClock ? virtualMicros : realMicros());
+}
+
+void delay(uint32_t ms) {
+    if (virtualClock) {
+        native_hal::advanceClock(ms);
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    }
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    env().digitalPins[clampPin(pin)] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) {
+    return env().digitalPins[clampPin(pin)];
+}
+
+uint16_t analogRead(uint8_t pin) {
+    return (uint16_t)env().analogPins[clampPin(pin)];
+}
+
+long random(long max) {
+    return max > 0 ? random(0, max) : 0;
+}
+
+long random(long min, long max) {
+    if (max <= min) return min;
+    return min + (long)(rng() % (unsigned long)(max - min));
+}
+
+void randomSeed(unsigned long seed) {
+    rng.seed(seed);
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+uint32_t EspClass::getHeapSize() {
+    return env().heapSize;
+}
+
+uint32_t EspClass::getFreeHeap() {
+    size_t used = native_hal::heapStats().currentBytes;
+    return used < env().heapSize ? env().heapSize - used : 0;
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+    size_t peak = native_hal::heapStats().peakBytes;
+    return peak < env().heapSize ? env().heapSize - peak : 0;
+}
+
+uint32_t EspClass::getCycleCount() {
+    uint64_t now = virtualClock ? virtualMicros : realMicros();
+    return (uint32_t)(now * getCpuFreqMHz());
+}
+
+void EspClass::restart() {
+    Serial.println("[native] ESP.restart() requested, exiting");
+    Serial.flush();
+    exit(0);
+}
+
+esp_reset_reason_t esp_reset_reason() {
+    return (esp_reset_reason_t)env().resetReason;
+}
@@ -0,0 +1,91 @@
+#include <Arduino.h>
+#include <freertos/task.h>
+#include "native_hal.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+struct NativeTask {
+    std::string name;
+    uint32_t stackDepth = 0;
+    std::mutex mutex;
+    std::condition_variable notified;
+    std::condition_variable parked;  // Signalled when the task blocks in ulTaskNotifyTake
+    uint32_t notifyCount = 0;
+    bool waiting = false;
+};
+
+namespace {
+
+// Tasks live for the whole process, like firmware tasks that never return
+thread_local NativeTask* currentTask = nullptr;
+
+}  // namespace
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* createdTask,
+                                   BaseType_t coreId) {
+    NativeTask* task = new NativeTask();
+    task->name = name ? name : "";
+    task->stackDepth = stackDepth;
+    if (createdTask) {
+        *createdTask = task;
+    }
+    std::thread([task, function, parameters]() {
+        currentTask = task;
+        function(parameters);
+    }).detach();
+    return pdPASS;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+    // Threads not started through xTaskCreatePinnedToCore (main) get one lazily
+    if (!currentTask) {
+        currentTask = new NativeTask();
+        currentTask->name = "main";
+    }
+    return currentTask;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    delay(ticks);
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+    return (task ? task : xTaskGetCurrentTaskHandle())->stackDepth;
+}
+
+// On the virtual clock the notified task runs until it blocks again before
+// this returns, as a higher-priority task would on the device. Simulated
+// runs then don't depend on how the host schedules threads.
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    std::unique_lock<std::mutex> lock(task->mutex);
+    task->notifyCount++;
+    task->notified.notify_one();
+    if (native_hal::isVirtualClock() && task != currentTask) {
+        task->parked.wait(lock, [task]() { return task->waiting && task->notifyCount == 0; });
+    }
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait) {
+    NativeTask* task = xTaskGetCurrentTaskHandle();
+    std::unique_lock<std::mutex> lock(task->mutex);
+    auto hasNotification = [task]() { return task->notifyCount > 0; };
+    task->waiting = true;
+    task->parked.notify_all();
+    if (ticksToWait == portMAX_DELAY) {
+        task->notified.wait(lock, hasNotification);
+    } else {
+        task->notified.wait_for(lock, std::chrono::milliseconds(ticksToWait), hasNotification);
+    }
+
+    task->waiting = false;
+    uint32_t count = task->notifyCount;
+    if (count > 0) {
+        task->notifyCount = clearCountOnExit ? 0 : count - 1;
+    }
+    return count;
+}
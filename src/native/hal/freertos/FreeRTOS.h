@@ -0,0 +1,46 @@
+#ifndef NATIVE_HAL_FREERTOS_FREERTOS_H
+#define NATIVE_HAL_FREERTOS_FREERTOS_H
+
+// FreeRTOS types and macros used by src/core; one tick is one millisecond.
+
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY ((TickType_t)0xffffffffUL)
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+// ESP32 critical sections are spinlocks shared by both cores and ISRs; a
+// host spinlock gives the same exclusion between threads
+struct portMUX_TYPE {
+    std::atomic<bool> locked{false};
+};
+
+inline void nativeEnterCritical(portMUX_TYPE* mux) {
+    // Threads can be preempted while holding it (the device masks
+    // interrupts instead), so give the holder a chance to finish
+    while (mux->locked.exchange(true, std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+}
+
+inline void nativeExitCritical(portMUX_TYPE* mux) {
+    mux->locked.store(false, std::memory_order_release);
+}
+
+#define portMUX_INITIALIZE(mux) ((mux)->locked.store(false))
+#define portENTER_CRITICAL(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) nativeExitCritical(mux)
+#define portENTER_CRITICAL_SAFE(mux) nativeEnterCritical(mux)
+#define portEXIT_CRITICAL_SAFE(mux) nativeExitCritical(mux)
+
+#endif
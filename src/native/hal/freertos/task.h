@@ -0,0 +1,28 @@
+#ifndef NATIVE_HAL_FREERTOS_TASK_H
+#define NATIVE_HAL_FREERTOS_TASK_H
+
+// Task API stand-in: each task is a detached std::thread and core affinity
+// is ignored. Waits use the real clock, so dual-core runs are not meant for
+// the virtual clock. Helper tasks that block in ulTaskNotifyTake between
+// jobs do work there, see xTaskNotifyGive.
+
+#include "FreeRTOS.h"
+
+typedef void (*TaskFunction_t)(void*);
+typedef struct NativeTask* TaskHandle_t;
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stackDepth,
+                                   void* parameters, UBaseType_t priority, TaskHandle_t* createdTask,
+                                   BaseType_t coreId);
+TaskHandle_t xTaskGetCurrentTaskHandle();
+void vTaskDelay(TickType_t ticks);
+
+// Host threads have host-sized stacks that aren't measured: reports the
+// whole depth the task was created with
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task);
+
+// Direct-to-task notifications used as a counting semaphore
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearCountOnExit, TickType_t ticksToWait);
+
+#endif
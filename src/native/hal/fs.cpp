@@ -0,0 +1,88 @@
+#include <SPIFFS.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstdio>
+#include <string>
+#include "native_hal.h"
+
+fs::SPIFFSFS SPIFFS;
+
+namespace {
+
+bool makeDirectories(const std::string& path) {
+    size_t pos = 0;
+    while ((pos = path.find('/', pos + 1)) != std::string::npos) {
+        std::string dir = path.substr(0, pos);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            return false;
+        }
+    }
+    return mkdir(path.c_str(), 0755) == 0 || errno == EEXIST;
+}
+
+std::string parentOf(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+}
+
+}  // namespace
+
+namespace fs {
+
+std::string FS::hostPath(const char* path) const {
+    std::string result = native_hal::env().spiffsRoot;
+    if (path[0] != '/') result += '/';
+    result += path;
+    return result;
+}
+
+File FS::open(const char* path, const char* mode) {
+    std::string host = hostPath(path);
+    const char* hostMode = "rb";
+    if (mode[0] == 'w') {
+        hostMode = mode[1] == '+' ? "w+b" : "wb";
+    } else if (mode[0] == 'a') {
+        hostMode = mode[1] == '+' ? "a+b" : "ab";
+    } else if (mode[1] == '+') {
+        hostMode = "r+b";
+    }
+    if (mode[0] != 'r') {
+        makeDirectories(parentOf(host));
+    }
+    FILE* handle = fopen(host.c_str(), hostMode);
+    if (!handle) {
+        return File();
+    }
+    return File(std::shared_ptr<FILE>(handle, fclose), path);
+}
+
+bool FS::exists(const char* path) {
+    struct stat info;
+    return stat(hostPath(path).c_str(), &info) == 0;
+}
+
+bool FS::remove(const char* path) {
+    return ::remove(hostPath(path).c_str()) == 0;
+}
+
+bool FS::rename(const char* from, const char* to) {
+    return ::rename(hostPath(from).c_str(), hostPath(to).c_str()) == 0;
+}
+
+bool SPIFFSFS::begin(bool formatOnFail, const char* basePath, uint8_t maxOpenFiles, const char* partitionLabel) {
+    return makeDirectories(native_hal::env().spiffsRoot);
+}
+
+bool SPIFFSFS::format() {
+    std::string command = "rm -rf '" + native_hal::env().spiffsRoot + "'";
+    if (system(command.c_str()) != 0) {
+        return false;
+    }
+    return makeDirectories(native_hal::env().spiffsRoot);
+}
+
+size_t SPIFFSFS::usedBytes() {
+    return 0;
+}
+
+}  // namespace fs
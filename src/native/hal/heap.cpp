@@ -0,0 +1,92 @@
+// Replaces the global operator new/delete so host runs can report heap use
+// the way ESP.getFreeHeap()/getMinFreeHeap() would on the device. Each block
+// carries a small header holding its size.
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "native_hal.h"
+
+namespace {
+
+constexpr size_t HEADER_SIZE = alignof(std::max_align_t);
+
+std::atomic<size_t> currentBytes(0);
+std::atomic<size_t> peakBytes(0);
+std::atomic<unsigned long> allocations(0);
+std::atomic<unsigned long> frees(0);
+
+void* allocate(size_t size) {
+    void* block = malloc(size + HEADER_SIZE);
+    if (!block) {
+        return nullptr;
+    }
+    *static_cast<size_t*>(block) = size;
+
+    size_t now = currentBytes.fetch_add(size) + size;
+    size_t peak = peakBytes.load();
+    while (now > peak && !peakBytes.compare_exchange_weak(peak, now)) {
+    }
+    allocations++;
+    return static_cast<char*>(block) + HEADER_SIZE;
+}
+
+void release(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    void* block = static_cast<char*>(ptr) - HEADER_SIZE;
+    currentBytes.fetch_sub(*static_cast<size_t*>(block));
+    frees++;
+    free(block);
+}
+
+}  // namespace
+
+namespace native_hal {
+
+HeapStats heapStats() {
+    return HeapStats{currentBytes.load(), peakBytes.load(), allocations.load(), frees.load()};
+}
+
+void resetHeapPeak() {
+    peakBytes.store(currentBytes.load());
+}
+
+}  // namespace native_hal
+
+void* operator new(size_t size) {
+    void* ptr = allocate(size);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    release(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    release(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    release(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    release(ptr);
+}
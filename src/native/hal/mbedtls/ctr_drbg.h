@@ -0,0 +1,7 @@
+#ifndef NATIVE_HAL_MBEDTLS_CTR_DRBG_H
+#define NATIVE_HAL_MBEDTLS_CTR_DRBG_H
+
+// Declared together with the rest of the stand-in
+#include "ssl.h"
+
+#endif
@@ -0,0 +1,160 @@
+#ifndef NATIVE_HAL_MBEDTLS_SSL_H
+#define NATIVE_HAL_MBEDTLS_SSL_H
+
+// mbedTLS stand-in: the subset TlsClient uses. No bytes are encrypted; a
+// handshake walks the client states of a TLS 1.2 handshake against the
+// simulated broker in native_hal::env().tls, taking its time (delay(), so
+// the virtual clock follows) and heap (operator new, so heapStats() sees
+// it). A session offered with mbedtls_ssl_set_session() resumes if the
+// broker still knows it, skipping the certificate and key exchange states.
+// The first record goes through the send callback, so a transport that
+// is down fails the handshake. The broker's certificate is checked against
+// the host name as mbedTLS 2.28 does (dNSName SANs only, or the CN when it
+// has no SANs), then handed to the verify callback.
+
+#include <cstddef>
+#include <cstdint>
+
+#define MBEDTLS_SSL_SESSION_TICKETS
+
+#define MBEDTLS_SSL_IS_CLIENT 0
+#define MBEDTLS_SSL_TRANSPORT_STREAM 0
+#define MBEDTLS_SSL_PRESET_DEFAULT 0
+#define MBEDTLS_SSL_VERIFY_REQUIRED 2
+#define MBEDTLS_SSL_SESSION_TICKETS_ENABLED 1
+
+#define MBEDTLS_ERR_SSL_WANT_READ -0x6900
+#define MBEDTLS_ERR_SSL_WANT_WRITE -0x6880
+#define MBEDTLS_ERR_SSL_TIMEOUT -0x6800
+#define MBEDTLS_ERR_SSL_BAD_INPUT_DATA -0x7100
+#define MBEDTLS_ERR_X509_CERT_VERIFY_FAILED -0x2700
+#define MBEDTLS_ERR_X509_INVALID_FORMAT -0x2180
+#define MBEDTLS_ERR_NET_SEND_FAILED -0x004E
+#define MBEDTLS_ERR_NET_CONN_RESET -0x0050
+
+#define MBEDTLS_ASN1_CONTEXT_SPECIFIC 0x80
+#define MBEDTLS_X509_BADCERT_CN_MISMATCH 0x04
+#define MBEDTLS_X509_BADCERT_NOT_TRUSTED 0x08
+
+typedef enum {
+    MBEDTLS_SSL_HELLO_REQUEST,
+    MBEDTLS_SSL_CLIENT_HELLO,
+    MBEDTLS_SSL_SERVER_HELLO,
+    MBEDTLS_SSL_SERVER_CERTIFICATE,
+    MBEDTLS_SSL_SERVER_KEY_EXCHANGE,
+    MBEDTLS_SSL_CERTIFICATE_REQUEST,
+    MBEDTLS_SSL_SERVER_HELLO_DONE,
+    MBEDTLS_SSL_CLIENT_CERTIFICATE,
+    MBEDTLS_SSL_CLIENT_KEY_EXCHANGE,
+    MBEDTLS_SSL_CERTIFICATE_VERIFY,
+    MBEDTLS_SSL_CLIENT_CHANGE_CIPHER_SPEC,
+    MBEDTLS_SSL_CLIENT_FINISHED,
+    MBEDTLS_SSL_SERVER_CHANGE_CIPHER_SPEC,
+    MBEDTLS_SSL_SERVER_FINISHED,
+    MBEDTLS_SSL_FLUSH_BUFFERS,
+    MBEDTLS_SSL_HANDSHAKE_WRAPUP,
+    MBEDTLS_SSL_HANDSHAKE_OVER,
+} mbedtls_ssl_states;
+
+typedef int mbedtls_ssl_send_t(void* ctx, const unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_t(void* ctx, unsigned char* buf, size_t len);
+typedef int mbedtls_ssl_recv_timeout_t(void* ctx, unsigned char* buf, size_t len, uint32_t timeout);
+
+struct mbedtls_x509_buf {
+    int tag;
+    size_t len;
+    unsigned char* p;
+};
+
+// Subject alternative names: tag is MBEDTLS_ASN1_CONTEXT_SPECIFIC | the
+// GeneralName type, p the raw value
+struct mbedtls_x509_sequence {
+    mbedtls_x509_buf buf;
+    mbedtls_x509_sequence* next;
+};
+
+struct mbedtls_x509_crt {
+    bool parsed;
+    mbedtls_x509_sequence subject_alt_names;
+};
+
+struct mbedtls_entropy_context {
+    int unused;
+};
+
+struct mbedtls_ctr_drbg_context {
+    bool seeded;
+};
+
+struct mbedtls_ssl_session {
+    bool valid;
+    unsigned long epoch;  // The broker's session epoch it was issued in
+};
+
+struct mbedtls_ssl_config {
+    const mbedtls_x509_crt* ca;
+    int authmode;
+    bool tickets;
+    int (*f_vrfy)(void*, mbedtls_x509_crt*, int, uint32_t*);
+    void* p_vrfy;
+};
+
+struct mbedtls_ssl_context {
+    int state;
+    const mbedtls_ssl_config* conf;
+    void* bio;
+    mbedtls_ssl_send_t* send;
+    mbedtls_ssl_recv_t* recv;
+    char* recordBuffers;     // In and out record buffers, held from setup to free
+    char* handshakeScratch;  // Peer certificate and key exchange, held during the handshake
+    bool offered;
+    unsigned long offeredEpoch;
+    char hostname[128];
+    bool established;
+};
+
+int mbedtls_entropy_func(void* data, unsigned char* output, size_t len);
+void mbedtls_entropy_init(mbedtls_entropy_context* ctx);
+void mbedtls_entropy_free(mbedtls_entropy_context* ctx);
+
+void mbedtls_ctr_drbg_init(mbedtls_ctr_drbg_context* ctx);
+void mbedtls_ctr_drbg_free(mbedtls_ctr_drbg_context* ctx);
+int mbedtls_ctr_drbg_seed(mbedtls_ctr_drbg_context* ctx, int (*f_entropy)(void*, unsigned char*, size_t),
+                          void* p_entropy, const unsigned char* custom, size_t len);
+int mbedtls_ctr_drbg_random(void* p_rng, unsigned char* output, size_t output_len);
+
+void mbedtls_x509_crt_init(mbedtls_x509_crt* crt);
+void mbedtls_x509_crt_free(mbedtls_x509_crt* crt);
+int mbedtls_x509_crt_parse(mbedtls_x509_crt* chain, const unsigned char* buf, size_t buflen);
+
+void mbedtls_ssl_config_init(mbedtls_ssl_config* conf);
+void mbedtls_ssl_config_free(mbedtls_ssl_config* conf);
+int mbedtls_ssl_config_defaults(mbedtls_ssl_config* conf, int endpoint, int transport, int preset);
+void mbedtls_ssl_conf_authmode(mbedtls_ssl_config* conf, int authmode);
+void mbedtls_ssl_conf_ca_chain(mbedtls_ssl_config* conf, mbedtls_x509_crt* ca_chain, void* ca_crl);
+void mbedtls_ssl_conf_rng(mbedtls_ssl_config* conf, int (*f_rng)(void*, unsigned char*, size_t), void* p_rng);
+void mbedtls_ssl_conf_session_tickets(mbedtls_ssl_config* conf, int use_tickets);
+void mbedtls_ssl_conf_verify(mbedtls_ssl_config* conf, int (*f_vrfy)(void*, mbedtls_x509_crt*, int, uint32_t*),
+                             void* p_vrfy);
+
+void mbedtls_ssl_session_init(mbedtls_ssl_session* session);
+void mbedtls_ssl_session_free(mbedtls_ssl_session* session);
+
+void mbedtls_ssl_init(mbedtls_ssl_context* ssl);
+void mbedtls_ssl_free(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_setup(mbedtls_ssl_context* ssl, const mbedtls_ssl_config* conf);
+int mbedtls_ssl_session_reset(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_set_hostname(mbedtls_ssl_context* ssl, const char* hostname);
+void mbedtls_ssl_set_bio(mbedtls_ssl_context* ssl, void* p_bio, mbedtls_ssl_send_t* f_send,
+                         mbedtls_ssl_recv_t* f_recv, mbedtls_ssl_recv_timeout_t* f_recv_timeout);
+int mbedtls_ssl_set_session(mbedtls_ssl_context* ssl, const mbedtls_ssl_session* session);
+int mbedtls_ssl_get_session(const mbedtls_ssl_context* ssl, mbedtls_ssl_session* session);
+int mbedtls_ssl_handshake_step(mbedtls_ssl_context* ssl);
+int mbedtls_ssl_read(mbedtls_ssl_context* ssl, unsigned char* buf, size_t len);
+int mbedtls_ssl_write(mbedtls_ssl_context* ssl, const unsigned char* buf, size_t len);
+size_t mbedtls_ssl_get_bytes_avail(const mbedtls_ssl_context* ssl);
+int mbedtls_ssl_close_notify(mbedtls_ssl_context* ssl);
+
+void mbedtls_strerror(int errnum, char* buffer, size_t buflen);
+
+#endif
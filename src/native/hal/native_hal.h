@@ -0,0 +1,136 @@
+#ifndef NATIVE_HAL_NATIVE_HAL_H
+#define NATIVE_HAL_NATIVE_HAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+// Host-side state behind the Arduino/ESP stand-ins. Host programs poke
+// these fields to play the role of the physical world (sensor values,
+// access point, MQTT broker) while the firmware runs unmodified.
+namespace native_hal {
+
+struct ScanResult {
+    std::string ssid;
+    int32_t rssi;
+    int encryption;
+    // Other access points of the station's SSID can be joined through a
+    // directed begin() with these
+    uint8_t bssid[6] = {};
+    int32_t channel = 0;
+};
+
+// The broker side of MQTT over TLS, for the mbedTLS stand-in. Rough
+// ESP32 figures: a full ECDHE handshake costs seconds of CPU and tens of KB
+// on top of the record buffers; a resumed one neither.
+struct TlsBroker {
+    bool certificateTrusted = true;  // Its certificate chains to the CA the device loaded
+    // Names in its certificate, as in openssl's subjectAltName: "DNS:host"
+    // or "IP:a.b.c.d". With none, the commonName is the only name.
+    std::vector<std::string> subjectAltNames;
+    std::string commonName;
+    bool resumption = true;          // Accepts session IDs and tickets
+    unsigned long sessionEpoch = 1;  // Bump to forget every session, as a broker restart does
+    unsigned long fullHandshakeMs = 1800;
+    unsigned long resumedHandshakeMs = 120;
+    size_t recordBufferBytes = 2 * 16717;
+    size_t fullHandshakeBytes = 11000;
+    size_t resumedHandshakeBytes = 1500;
+    unsigned long fullHandshakes = 0;
+    unsigned long resumedHandshakes = 0;
+};
+
+struct Environment {
+    // DHT readings; NAN simulates a failed read
+    float temperature = 24.0f;
+    float humidity = 55.0f;
+
+    // Pin levels seen by analogRead()/digitalRead()
+    int analogPins[40] = {};
+    int digitalPins[40] = {};
+
+    // Wi-Fi access point
+    bool wifiAvailable = true;
+    int32_t wifiRssi = -55;
+    uint8_t wifiBssid[6] = {0x9C, 0x9D, 0x7E, 0x41, 0x20, 0x0A};
+    int32_t wifiChannel = 6;
+    // Reason handed to the disconnected event when the link drops
+    uint8_t wifiDisconnectReason = 200;  // WIFI_REASON_BEACON_TIMEOUT
+    std::vector<ScanResult> scanResults;
+    // How long WiFi.begin() takes to reach WL_CONNECTED: a scan of every
+    // channel, or a probe of one channel when given a BSSID and channel,
+    // then association and, without a static IP, DHCP. A probe that finds
+    // no such BSSID on that channel ends in WL_NO_SSID_AVAIL.
+    unsigned long wifiScanMs = 0;
+    unsigned long wifiProbeMs = 0;
+    unsigned long wifiAssociateMs = 0;
+    unsigned long dhcpMs = 0;
+    unsigned long wifiBegins = 0;
+    unsigned long wifiScans = 0;  // scanNetworks() calls, blocking or async
+
+    // esp_reset_reason(); only resets other than power-on and brown-out
+    // keep RTC memory
+    int resetReason = 1;  // ESP_RST_POWERON
+    // NVS through Preferences, "namespace/key" -> bytes
+    std::map<std::string, std::vector<uint8_t>> nvs;
+    unsigned long nvsWrites = 0;
+
+    // MQTT broker reachable through PubSubClient
+    bool brokerAvailable = true;
+    // How long a connect to an unreachable broker blocks before failing,
+    // like the TCP timeout on the device (real time unless the clock is virtual)
+    unsigned long connectDelayMs = 0;
+    // Broker hosts that are down even while brokerAvailable is set, and how
+    // long a successful connect to a host takes (0 if not listed)
+    std::set<std::string> brokersDown;
+    std::map<std::string, unsigned long> brokerConnectMs;
+    unsigned long publishCount = 0;
+    unsigned long publishBytes = 0;
+    // Optional observer for every accepted publish (topic, payload, length, retained)
+    std::function<void(const char*, const uint8_t*, unsigned int, bool)> publishHook;
+    std::vector<std::pair<std::string, std::string>> pendingMessages;
+    // Retained messages by topic, handed to each matching subscribe
+    std::map<std::string, std::string> retainedMessages;
+    TlsBroker tls;
+
+    // Heap size of the simulated part; free/min-free figures are derived from
+    // the live operator new/delete accounting in heapStats()
+    uint32_t heapSize = 320 * 1024;
+
+    // Directory that backs SPIFFS
+    std::string spiffsRoot = ".native_spiffs";
+};
+
+Environment& env();
+
+// Virtual time: once enabled, millis()/micros() only move when delay() or
+// advanceClock() is called, so hours of firmware time replay in seconds.
+void useVirtualClock(bool enabled);
+bool isVirtualClock();
+void advanceClock(unsigned long ms);
+
+struct HeapStats {
+    size_t currentBytes;
+    size_t peakBytes;
+    unsigned long allocations;
+    unsigned long frees;
+};
+
+// Process-wide operator new/delete accounting
+HeapStats heapStats();
+void resetHeapPeak();
+
+// Queue an inbound MQTT message; subscribed clients receive it from loop()
+void deliver(const char* topic, const char* payload);
+
+// Publish a retained message: delivered now and to every later subscriber.
+// An empty payload clears it, as on a real broker.
+void retain(const char* topic, const char* payload);
+
+}  // namespace native_hal
+
+#endif
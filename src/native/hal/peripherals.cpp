@@ -0,0 +1,16 @@
+#include <DHT.h>
+#include <Wire.h>
+#include "native_hal.h"
+
+TwoWire Wire;
+
+using native_hal::env;
+
+float DHT::readTemperature(bool fahrenheit, bool force) {
+    float celsius = env().temperature;
+    return fahrenheit ? celsius * 1.8f + 32.0f : celsius;
+}
+
+float DHT::readHumidity(bool force) {
+    return env().humidity;
+}
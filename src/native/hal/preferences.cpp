@@ -0,0 +1,63 @@
+#include <Preferences.h>
+#include <cstring>
+#include <iterator>
+#include "native_hal.h"
+
+using native_hal::env;
+
+bool Preferences::begin(const char* name, bool readOnly) {
+    space = name;
+    started = true;
+    this->readOnly = readOnly;
+    return true;
+}
+
+void Preferences::end() {
+    started = false;
+}
+
+std::string Preferences::entry(const char* key) const {
+    return space + "/" + key;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length) {
+    if (!started || readOnly) {
+        return 0;
+    }
+    const uint8_t* bytes = static_cast<const uint8_t*>(value);
+    env().nvs[entry(key)].assign(bytes, bytes + length);
+    env().nvsWrites++;
+    return length;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength) {
+    auto found = env().nvs.find(entry(key));
+    if (!started || found == env().nvs.end() || found->second.size() > maxLength) {
+        return 0;
+    }
+    memcpy(buffer, found->second.data(), found->second.size());
+    return found->second.size();
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+    auto found = env().nvs.find(entry(key));
+    return started && found != env().nvs.end() ? found->second.size() : 0;
+}
+
+bool Preferences::remove(const char* key) {
+    if (!started || readOnly) {
+        return false;
+    }
+    return env().nvs.erase(entry(key)) > 0;
+}
+
+bool Preferences::clear() {
+    if (!started || readOnly) {
+        return false;
+    }
+    std::string prefix = space + "/";
+    for (auto it = env().nvs.begin(); it != env().nvs.end();) {
+        it = it->first.compare(0, prefix.size(), prefix) == 0 ? env().nvs.erase(it) : std::next(it);
+    }
+    return true;
+}
@@ -0,0 +1,178 @@
+#include <PubSubClient.h>
+#include "native_hal.h"
+
+using native_hal::env;
+
+namespace native_hal {
+
+void deliver(const char* topic, const char* payload) {
+    env().pendingMessages.emplace_back(topic, payload);
+}
+
+void retain(const char* topic, const char* payload) {
+    if (*payload == '\0') {
+        env().retainedMessages.erase(topic);
+        return;
+    }
+    env().retainedMessages[topic] = payload;
+    deliver(topic, payload);
+}
+
+}  // namespace native_hal
+
+namespace {
+
+// MQTT topic filter match with '+' and '#' wildcards
+bool topicMatches(const std::string& filter, const char* topic) {
+    size_t f = 0;
+    const char* t = topic;
+    while (f < filter.size()) {
+        if (filter[f] == '#') {
+            return true;
+        }
+        if (filter[f] == '+') {
+            while (*t && *t != '/') t++;
+            f++;
+            continue;
+        }
+        if (*t != filter[f]) {
+            return false;
+        }
+        t++;
+        f++;
+    }
+    return *t == '\0';
+}
+
+}  // namespace
+
+PubSubClient& PubSubClient::setServer(const char* domain, uint16_t port) {
+    this->domain = domain;
+    this->port = port;
+    return *this;
+}
+
+PubSubClient& PubSubClient::setCallback(MQTT_CALLBACK_SIGNATURE) {
+    this->callback = callback;
+    return *this;
+}
+
+bool PubSubClient::setBufferSize(uint16_t size) {
+    bufferSize = size;
+    return true;
+}
+
+bool PubSubClient::connect(const char* id) {
+    return connect(id, nullptr, nullptr);
+}
+
+bool PubSubClient::connect(const char* id, const char* user, const char* pass) {
+    if (connected()) {
+        return true;
+    }
+    if (!client->connect(domain ? domain : "broker", port)) {
+        currentState = MQTT_CONNECT_FAILED;
+        return false;
+    }
+    isOpen = true;
+    currentState = MQTT_CONNECTED;
+    return true;
+}
+
+void PubSubClient::disconnect() {
+    client->stop();
+    isOpen = false;
+    subscriptions.clear();
+    currentState = MQTT_DISCONNECTED;
+}
+
+bool PubSubClient::connected() {
+    if (isOpen && !client->connected()) {
+        isOpen = false;
+        subscriptions.clear();
+        currentState = MQTT_CONNECTION_LOST;
+    }
+    return isOpen;
+}
+
+bool PubSubClient::loop() {
+    if (!connected()) {
+        return false;
+    }
+    auto& pending = env().pendingMessages;
+    for (size_t i = 0; i < pending.size();) {
+        bool subscribed = false;
+        for (const auto& filter : subscriptions) {
+            if (topicMatches(filter, pending[i].first.c_str())) {
+                subscribed = true;
+                break;
+            }
+        }
+        if (!subscribed) {
+            i++;
+            continue;
+        }
+        auto message = pending[i];
+        pending.erase(pending.begin() + i);
+        if (callback) {
+            callback(&message.first[0], (uint8_t*)&message.second[0], message.second.size());
+        }
+    }
+    return true;
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), false);
+}
+
+bool PubSubClient::publish(const char* topic, const char* payload, bool retained) {
+    return publish(topic, (const uint8_t*)payload, strlen(payload), retained);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length) {
+    return publish(topic, payload, length, false);
+}
+
+bool PubSubClient::publish(const char* topic, const uint8_t* payload, unsigned int length, bool retained) {
+    if (!connected()) {
+        return false;
+    }
+    // Same limit as the real client: fixed header + topic + payload must fit the buffer
+    if (5 + 2 + strlen(topic) + length > bufferSize) {
+        return false;
+    }
+    env().publishCount++;
+    env().publishBytes += length;
+    if (retained && length == 0) {
+        env().retainedMessages.erase(topic);
+    } else if (retained) {
+        env().retainedMessages[topic] = std::string((const char*)payload, length);
+    }
+    if (env().publishHook) {
+        env().publishHook(topic, payload, length, retained);
+    }
+    return true;
+}
+
+bool PubSubClient::subscribe(const char* topic) {
+    if (!connected()) {
+        return false;
+    }
+    subscriptions.push_back(topic);
+    for (const auto& message : env().retainedMessages) {
+        if (topicMatches(subscriptions.back(), message.first.c_str())) {
+            env().pendingMessages.push_back(message);
+        }
+    }
+    return true;
+}
+
+bool PubSubClient::unsubscribe(const char* topic) {
+    for (auto it = subscriptions.begin(); it != subscriptions.end(); ++it) {
+        if (*it == topic) {
+            subscriptions.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,257 @@
+#include <WiFi.h>
+#include <algorithm>
+#include <string.h>
+#include "native_hal.h"
+
+WiFiClass WiFi;
+
+using native_hal::env;
+
+wifi_event_id_t WiFiClass::onEvent(WiFiEventFuncCb callback, arduino_event_id_t event) {
+    handlers.push_back(Handler{nextHandlerId, event, callback});
+    return nextHandlerId++;
+}
+
+void WiFiClass::removeEvent(wifi_event_id_t id) {
+    for (auto it = handlers.begin(); it != handlers.end(); ++it) {
+        if (it->id == id) {
+            handlers.erase(it);
+            return;
+        }
+    }
+}
+
+void WiFiClass::disconnected(uint8_t reason) {
+    arduino_event_info_t info;
+    memset(&info, 0, sizeof(info));
+    info.wifi_sta_disconnected.ssid_len = (uint8_t)std::min<size_t>(ssid.length(), sizeof(info.wifi_sta_disconnected.ssid));
+    memcpy(info.wifi_sta_disconnected.ssid, ssid.c_str(), info.wifi_sta_disconnected.ssid_len);
+    memcpy(info.wifi_sta_disconnected.bssid, joinedBssid, sizeof(joinedBssid));
+    info.wifi_sta_disconnected.reason = reason;
+    // A copy, so a handler may remove itself
+    std::vector<Handler> current = handlers;
+    for (const Handler& handler : current) {
+        if (handler.event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || handler.event == ARDUINO_EVENT_MAX) {
+            handler.callback(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, info);
+        }
+    }
+}
+
+int WiFiClass::findAccessPoint(int32_t channel, const uint8_t* bssid) const {
+    const std::vector<native_hal::ScanResult>& found = env().scanResults;
+    for (size_t i = 0; i < found.size(); i++) {
+        if (found[i].channel == channel && memcmp(found[i].bssid, bssid, 6) == 0 && found[i].ssid == ssid.c_str()) {
+            return (int)i;
+        }
+    }
+    return -1;
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+    currentMode = mode;
+    return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel, const uint8_t* bssid,
+                             bool connect) {
+    if (started && joined) {
+        disconnected(WIFI_REASON_ASSOC_LEAVE);
+    }
+    this->ssid = ssid;
+    started = true;
+    joined = false;
+    lost = false;
+    beganAt = millis();
+    env().wifiBegins++;
+
+    bool directed = channel > 0 && bssid != nullptr;
+    joinedAp = -1;
+    apFound = !directed || (channel == env().wifiChannel && memcmp(bssid, env().wifiBssid, 6) == 0);
+    if (!apFound) {
+        joinedAp = findAccessPoint(channel, bssid);
+        apFound = joinedAp >= 0;
+    }
+    joinMs = directed ? env().wifiProbeMs : env().wifiScanMs;
+    if (apFound) {
+        joinMs += env().wifiAssociateMs + ((uint32_t)staticIP == 0 ? env().dhcpMs : 0);
+    }
+    return status();
+}
+
+bool WiFiClass::config(IPAddress localIP, IPAddress gateway, IPAddress subnet, IPAddress dns1, IPAddress dns2) {
+    staticIP = localIP;
+    staticGateway = gateway;
+    staticSubnet = subnet;
+    staticDns = (uint32_t)dns1 != 0 ? dns1 : gateway;
+    return true;
+}
+
+bool WiFiClass::disconnect(bool wifiOff) {
+    if (started && joined) {
+        disconnected(WIFI_REASON_ASSOC_LEAVE);
+    }
+    started = false;
+    joined = false;
+    return true;
+}
+
+wl_status_t WiFiClass::status() {
+    if (!started) {
+        return WL_IDLE_STATUS;
+    }
+    if (lost) {
+        return WL_CONNECTION_LOST;
+    }
+    if (joined) {
+        if (!env().wifiAvailable) {
+            joined = false;
+            lost = true;
+            disconnected(env().wifiDisconnectReason);
+            return WL_CONNECTION_LOST;
+        }
+        return WL_CONNECTED;
+    }
+    if (millis() - beganAt < joinMs) {
+        return WL_DISCONNECTED;
+    }
+    if (!apFound || !env().wifiAvailable) {
+        return WL_NO_SSID_AVAIL;
+    }
+    joined = true;
+    const uint8_t* bssid = joinedAp >= 0 ? env().scanResults[joinedAp].bssid : env().wifiBssid;
+    memcpy(joinedBssid, bssid, sizeof(joinedBssid));
+    return WL_CONNECTED;
+}
+
+IPAddress WiFiClass::localIP() {
+    if (status() != WL_CONNECTED) return IPAddress();
+    return (uint32_t)staticIP != 0 ? staticIP : IPAddress(192, 168, 31, 50);
+}
+
+IPAddress WiFiClass::gatewayIP() {
+    if (status() != WL_CONNECTED) return IPAddress();
+    return (uint32_t)staticIP != 0 ? staticGateway : IPAddress(192, 168, 31, 1);
+}
+
+IPAddress WiFiClass::subnetMask() {
+    if (status() != WL_CONNECTED) return IPAddress();
+    return (uint32_t)staticIP != 0 ? staticSubnet : IPAddress(255, 255, 255, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index) {
+    if (status() != WL_CONNECTED) return IPAddress();
+    return (uint32_t)staticIP != 0 ? staticDns : IPAddress(192, 168, 31, 1);
+}
+
+String WiFiClass::macAddress() {
+    return String("24:DC:C3:A7:36:EC");
+}
+
+String WiFiClass::SSID() {
+    return status() == WL_CONNECTED ? ssid : String();
+}
+
+int32_t WiFiClass::RSSI() {
+    if (status() != WL_CONNECTED) return 0;
+    return joinedAp >= 0 ? env().scanResults[joinedAp].rssi : env().wifiRssi;
+}
+
+uint8_t* WiFiClass::BSSID() {
+    return status() == WL_CONNECTED ? joinedBssid : nullptr;
+}
+
+String WiFiClass::BSSIDstr() {
+    uint8_t* bssid = BSSID();
+    if (!bssid) return String();
+    char text[18];
+    snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", bssid[0], bssid[1], bssid[2], bssid[3], bssid[4],
+             bssid[5]);
+    return String(text);
+}
+
+int32_t WiFiClass::channel() {
+    if (status() != WL_CONNECTED) return 0;
+    return joinedAp >= 0 ? env().scanResults[joinedAp].channel : env().wifiChannel;
+}
+
+bool WiFiClass::softAP(const char* ssid, const char* password) {
+    return true;
+}
+
+IPAddress WiFiClass::softAPIP() {
+    return IPAddress(192, 168, 4, 1);
+}
+
+int16_t WiFiClass::scanNetworks(bool async) {
+    env().wifiScans++;
+    if (async) {
+        scanRunning = true;
+        scanStartedAt = millis();
+        return WIFI_SCAN_RUNNING;
+    }
+    delay(env().wifiScanMs);
+    return (int16_t)env().scanResults.size();
+}
+
+int16_t WiFiClass::scanComplete() {
+    if (!scanRunning) {
+        return WIFI_SCAN_FAILED;
+    }
+    if (millis() - scanStartedAt < env().wifiScanMs) {
+        return WIFI_SCAN_RUNNING;
+    }
+    return (int16_t)env().scanResults.size();
+}
+
+String WiFiClass::SSID(uint8_t index) {
+    return index < env().scanResults.size() ? String(env().scanResults[index].ssid.c_str()) : String();
+}
+
+int32_t WiFiClass::RSSI(uint8_t index) {
+    return index < env().scanResults.size() ? env().scanResults[index].rssi : 0;
+}
+
+wifi_auth_mode_t WiFiClass::encryptionType(uint8_t index) {
+    return index < env().scanResults.size() ? (wifi_auth_mode_t)env().scanResults[index].encryption : WIFI_AUTH_OPEN;
+}
+
+uint8_t* WiFiClass::BSSID(uint8_t index) {
+    return index < env().scanResults.size() ? env().scanResults[index].bssid : nullptr;
+}
+
+int32_t WiFiClass::channel(uint8_t index) {
+    return index < env().scanResults.size() ? env().scanResults[index].channel : 0;
+}
+
+void WiFiClass::scanDelete() {
+    scanRunning = false;
+}
+
+int WiFiClient::connect(IPAddress ip, uint16_t port) {
+    return connect("", port);
+}
+
+int WiFiClient::connect(const char* host, uint16_t port) {
+    this->host = host ? host : "";
+    open = WiFi.status() == WL_CONNECTED && env().brokerAvailable && env().brokersDown.count(this->host) == 0;
+    unsigned long delayMs = open ? 0 : env().connectDelayMs;
+    auto connectMs = env().brokerConnectMs.find(this->host);
+    if (open && connectMs != env().brokerConnectMs.end()) {
+        delayMs = connectMs->second;
+    }
+    if (delayMs > 0) {
+        delay(delayMs);
+    }
+    return open ? 1 : 0;
+}
+
+int WiFiClient::available() {
+    return open ? (int)env().pendingMessages.size() : 0;
+}
+
+uint8_t WiFiClient::connected() {
+    if (open && (WiFi.status() != WL_CONNECTED || !env().brokerAvailable || env().brokersDown.count(host) > 0)) {
+        open = false;
+    }
+    return open ? 1 : 0;
+}
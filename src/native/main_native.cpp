@@ -0,0 +1,238 @@
+// Host entry point for the `native` PlatformIO environment.
+//
+//   program [loop] [--iterations N] [--pace-ms N] [--get URL]
+//       Runs the real App against the HAL stand-ins in src/native/hal and
+//       reports the cost of each main-loop iteration. --get prints the
+//       response of one of the app's HTTP endpoints (e.g. /metrics) afterwards.
+//   program sim [--days N] [--interval MS] [--upload MS] [--profile FILE] [--outage-hours H]
+//                 [--batch N] [--heartbeat MS]
+//       Replays days of operation on a virtual clock with scripted sensors
+//       and checks LED timer, publish and heap behaviour (exit code 1 on failure).
+//   program bench eventbus [--iterations N]
+//   program bench gorilla [--samples N] [--interval MS] [--profile FILE]
+//   program bench publish [--iterations N]
+//   program bench codec [--samples N] [--profile FILE]
+//   program bench mqtt [--samples N] [--ack-delay-ms MS] [--broker HOST:PORT]
+//   program bench router [--iterations N]
+//   program bench tls [--reconnects N]
+//   program bench scan [--requests N]
+//       Host micro-benchmarks, see bench/benchmarks.h.
+//   program reconfig
+//       Retunes a running App through the retained config topic and checks
+//       the new rates, the config/status replies and the flash writes.
+//   program failover
+//       Takes the preferred MQTT broker and its fallbacks down and up under
+//       a running App and checks the failover, probing and switch-back.
+//   program wifi
+//       Drops, resets and power-cycles a WiFiManager against an access point
+//       with ESP32 join times and checks the cached fast reconnect.
+//   program roam
+//       Fades the signal of one access point of a network with two and
+//       checks the link telemetry and the RSSI roaming policy.
+//   program jitter [--dual-core] [--seconds N] [--connect-ms MS]
+//       Measures sensor sampling jitter in real time while every broker
+//       connect blocks, in the single loop or the dual-core task split.
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include <SPIFFS.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+#include "../core/app.h"
+#include "bench/benchmarks.h"
+#include "hal/native_hal.h"
+#include "sim/failover.h"
+#include "sim/jitter.h"
+#include "sim/reconfig.h"
+#include "sim/simulator.h"
+#include "sim/wifi_reconnect.h"
+#include "sim/wifi_roaming.h"
+
+namespace {
+
+struct LoopOptions {
+    unsigned long iterations = 2000;
+    unsigned long paceMs = 0;
+    const char* getUrl = nullptr;
+};
+
+const char* optionValue(int argc, char** argv, const char* name) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return argv[i + 1];
+        }
+    }
+    return nullptr;
+}
+
+bool hasFlag(int argc, char** argv, const char* name) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+unsigned long optionNumber(int argc, char** argv, const char* name, unsigned long fallback) {
+    const char* value = optionValue(argc, argv, name);
+    return value ? strtoul(value, nullptr, 10) : fallback;
+}
+
+// First run on a host: give the firmware Wi-Fi credentials so it takes the
+// station + MQTT path instead of parking in access point mode.
+void seedConfig() {
+    SPIFFS.begin(true);
+    if (SPIFFS.exists("/config.json")) {
+        return;
+    }
+    Config seed;
+    seed.setDefaults();
+    strcpy(seed.wifi.ssid, "native-ap");
+    strcpy(seed.wifi.password, "native-password");
+    seed.saveToFile("/config.json");
+}
+
+int runLoopTiming(const LoopOptions& options) {
+    // A lit room so the night light stays off unless the scenario changes it
+    native_hal::env().analogPins[39] = 2000;
+    seedConfig();
+
+    App app;
+    if (app.initialize() != ErrorCode::SUCCESS) {
+        Serial.println("Failed to initialize application");
+        return 1;
+    }
+    app.start();
+
+    std::vector<double> samples;
+    samples.reserve(options.iterations);
+    for (unsigned long i = 0; i < options.iterations; i++) {
+        auto begin = std::chrono::steady_clock::now();
+        unsigned long idleMs = app.runOnce();
+        auto end = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(end - begin).count());
+        if (options.paceMs > 0) {
+            delay(options.paceMs);
+        } else {
+            app.idle(idleMs);
+        }
+    }
+
+    if (samples.empty()) {
+        return 0;
+    }
+
+    double total = 0;
+    for (double sample : samples) {
+        total += sample;
+    }
+    std::sort(samples.begin(), samples.end());
+    Serial.printf("[native] App::runOnce() over %lu iterations: mean %.2f us, p50 %.2f us, p99 %.2f us, max %.2f us\n",
+                  (unsigned long)samples.size(), total / samples.size(), samples[samples.size() / 2],
+                  samples[samples.size() * 99 / 100], samples.back());
+    Serial.printf("[native] MQTT publishes: %lu (%lu payload bytes)\n", native_hal::env().publishCount,
+                  native_hal::env().publishBytes);
+
+    if (options.getUrl) {
+        AsyncWebServer* server = AsyncWebServer::current();
+        if (!server) {
+            Serial.println("[native] Web server not started");
+            return 1;
+        }
+        AsyncWebServerRequest request(HTTP_GET, options.getUrl);
+        server->handle(request);
+        Serial.printf("[native] GET %s -> %d %s\n%s\n", options.getUrl, request.responseCode,
+                      request.responseType.c_str(), request.responseBody.c_str());
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    const char* command = argc > 1 && argv[1][0] != '-' ? argv[1] : "loop";
+
+    if (strcmp(command, "sim") == 0) {
+        SimulationOptions options;
+        options.days = optionNumber(argc, argv, "--days", options.days);
+        options.sensorReadingInterval = optionNumber(argc, argv, "--interval", 0);
+        options.uploadFrequency = optionNumber(argc, argv, "--upload", 0);
+        options.profilePath = optionValue(argc, argv, "--profile");
+        options.outageHours = optionNumber(argc, argv, "--outage-hours", 0);
+        options.batchSamples = optionNumber(argc, argv, "--batch", 0);
+        if (optionValue(argc, argv, "--heartbeat")) {
+            options.heartbeat = optionNumber(argc, argv, "--heartbeat", 0);
+        }
+        return runSimulation(options);
+    }
+
+    if (strcmp(command, "bench") == 0) {
+        const char* name = argc > 2 ? argv[2] : "";
+        if (strcmp(name, "eventbus") == 0) {
+            return runEventBusBench(optionNumber(argc, argv, "--iterations", 5000000));
+        }
+        if (strcmp(name, "gorilla") == 0) {
+            return runGorillaBench(optionValue(argc, argv, "--profile"), optionNumber(argc, argv, "--samples", 86400),
+                                   optionNumber(argc, argv, "--interval", 1000));
+        }
+        if (strcmp(name, "publish") == 0) {
+            return runPublishBench(optionNumber(argc, argv, "--iterations", 100000));
+        }
+        if (strcmp(name, "codec") == 0) {
+            return runCodecBench(optionValue(argc, argv, "--profile"), optionNumber(argc, argv, "--samples", 86400));
+        }
+        if (strcmp(name, "mqtt") == 0) {
+            return runMqttBench(optionNumber(argc, argv, "--samples", 500), optionNumber(argc, argv, "--ack-delay-ms", 5),
+                                optionValue(argc, argv, "--broker"));
+        }
+        if (strcmp(name, "router") == 0) {
+            return runRouterBench(optionNumber(argc, argv, "--iterations", 1000000));
+        }
+        if (strcmp(name, "tls") == 0) {
+            return runTlsBench(optionNumber(argc, argv, "--reconnects", 50));
+        }
+        if (strcmp(name, "scan") == 0) {
+            return runScanBench(optionNumber(argc, argv, "--requests", 120));
+        }
+        Serial.printf("Unknown benchmark '%s' (expected eventbus, gorilla, publish, codec, mqtt, router, tls or scan)\n",
+                      name);
+        return 2;
+    }
+
+    if (strcmp(command, "reconfig") == 0) {
+        return runReconfigCheck();
+    }
+
+    if (strcmp(command, "failover") == 0) {
+        return runFailoverCheck();
+    }
+
+    if (strcmp(command, "wifi") == 0) {
+        return runWiFiReconnectCheck();
+    }
+
+    if (strcmp(command, "roam") == 0) {
+        return runWiFiRoamingCheck();
+    }
+
+    if (strcmp(command, "jitter") == 0) {
+        JitterOptions options;
+        options.seconds = optionNumber(argc, argv, "--seconds", options.seconds);
+        options.connectMs = optionNumber(argc, argv, "--connect-ms", options.connectMs);
+        options.dualCore = hasFlag(argc, argv, "--dual-core");
+        return runJitterBench(options);
+    }
+
+    if (strcmp(command, "loop") == 0) {
+        LoopOptions options;
+        options.iterations = optionNumber(argc, argv, "--iterations", options.iterations);
+        options.paceMs = optionNumber(argc, argv, "--pace-ms", options.paceMs);
+        options.getUrl = optionValue(argc, argv, "--get");
+        return runLoopTiming(options);
+    }
+
+    Serial.printf("Unknown command '%s' (expected loop, sim, reconfig, failover, wifi, roam, jitter or bench)\n", command);
+    return 2;
+}
@@ -0,0 +1,150 @@
+#include "failover.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <memory>
+#include <string>
+#include "../../core/app.h"
+#include "../hal/native_hal.h"
+#include "sensor_profile.h"
+#include "sim_checks.h"
+#include "sim_hardware.h"
+
+namespace {
+
+const unsigned long SECOND_MS = 1000;
+const unsigned long MINUTE_MS = 60000;
+const unsigned long PROBE_INTERVAL = 5 * MINUTE_MS;
+const unsigned long TCP_TIMEOUT_MS = 5000;  // What a connect to a broker that is down costs
+
+unsigned long brokerFailures(const char* host) {
+    return readMetric((std::string("mqtt_broker_connect_failures_total{broker=\"") + host + ":1883\"}").c_str());
+}
+
+void setDown(const char* host, bool down) {
+    if (down) {
+        native_hal::env().brokersDown.insert(host);
+    } else {
+        native_hal::env().brokersDown.erase(host);
+    }
+}
+
+// Runs until the client has connected to another broker, or timeoutMs
+// passes; ms it took, or timeoutMs
+unsigned long untilSwitch(App& app, unsigned long timeoutMs) {
+    unsigned long switches = readMetric("mqtt_broker_switches_total");
+    unsigned long start = millis();
+    while (readMetric("mqtt_broker_switches_total") == switches && millis() - start < timeoutMs) {
+        runFor(app, 100);
+    }
+    return millis() - start < timeoutMs ? millis() - start : timeoutMs;
+}
+
+}  // namespace
+
+int runFailoverCheck() {
+    native_hal::env().spiffsRoot = ".native_failover_spiffs";
+    native_hal::useVirtualClock(true);
+    native_hal::env().retainedMessages.clear();
+    native_hal::env().connectDelayMs = TCP_TIMEOUT_MS;
+    native_hal::env().brokerConnectMs["broker-a"] = 30;
+    native_hal::env().brokerConnectMs["broker-b"] = 800;
+    native_hal::env().brokerConnectMs["broker-c"] = 50;
+
+    Config seeded;
+    seeded.setDefaults();
+    strcpy(seeded.wifi.ssid, "sim-ap");
+    strcpy(seeded.wifi.password, "sim-password");
+    strcpy(seeded.mqtt.broker, "broker-a");
+    seeded.mqtt.addFallbackBroker("broker-b", 1883);
+    seeded.mqtt.addFallbackBroker("broker-c", 1883);
+    seeded.mqtt.brokerProbeInterval = PROBE_INTERVAL;
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    seeded.saveToFile("/config.json");
+    Config loaded;
+    loaded.loadFromFile("/config.json");
+    bool configRoundTrip = loaded.mqtt.brokerCount() == 3 && strcmp(loaded.mqtt.brokerHost(2), "broker-c") == 0 &&
+                           loaded.mqtt.brokerPort(2) == 1883 && loaded.mqtt.brokerProbeInterval == PROBE_INTERVAL;
+
+    DayNightProfile profile;
+    RecordingLed* led = new RecordingLed();
+    ScriptedSensor* sensor = new ScriptedSensor(profile, led, millis());
+    App app;
+    app.useHardware(std::unique_ptr<ISensorReader>(sensor), std::unique_ptr<IDisplayDriver>(new RecordingDisplay()),
+                    std::unique_ptr<ILedController>(led));
+    if (app.initialize() != ErrorCode::SUCCESS) {
+        Serial.println("[failover] App failed to initialize");
+        return 2;
+    }
+    Logger::setLevel(LogLevel::WARN);
+    app.start();
+
+    runFor(app, MINUTE_MS);
+    bool bootedOnPreferred = readMetric("mqtt_broker_active") == 0 && readMetric("mqtt_broker_switches_total") == 0;
+
+    // The preferred broker is patched: one timeout on it, then the first fallback
+    setDown("broker-a", true);
+    unsigned long failoverMs = untilSwitch(app, MINUTE_MS);
+    unsigned long activeAfterFailover = readMetric("mqtt_broker_active");
+
+    // Probes find it still down for 20 minutes; the client stays put
+    runFor(app, 20 * MINUTE_MS);
+    bool stayedOnFallback = readMetric("mqtt_broker_active") == 1 && readMetric("mqtt_broker_switches_total") == 1 &&
+                            readMetric("mqtt_broker_failbacks_total") == 0;
+    unsigned long attemptsWhileDown = readMetric("mqtt_connect_attempts_total");
+
+    setDown("broker-a", false);
+    unsigned long failbackMs = untilSwitch(app, PROBE_INTERVAL + MINUTE_MS);
+    bool failedBack = readMetric("mqtt_broker_active") == 0 && readMetric("mqtt_broker_failbacks_total") == 1;
+
+    // Two brokers down at once: the round goes on to the last one
+    runFor(app, MINUTE_MS);
+    setDown("broker-a", true);
+    setDown("broker-b", true);
+    unsigned long secondFallbackMs = untilSwitch(app, MINUTE_MS);
+    unsigned long activeAfterBoth = readMetric("mqtt_broker_active");
+    setDown("broker-a", false);
+    setDown("broker-b", false);
+    untilSwitch(app, PROBE_INTERVAL + MINUTE_MS);
+
+    // Both fallbacks have connected once and their failures are old news:
+    // the faster one wins over config order
+    runFor(app, MQTTClient::FAILURE_MEMORY);
+    setDown("broker-a", true);
+    untilSwitch(app, MINUTE_MS);
+    unsigned long activeByLatency = readMetric("mqtt_broker_active");
+
+    // Losing that one too: the preferred broker just failed, so the other
+    // fallback is tried before it
+    runFor(app, MINUTE_MS);
+    unsigned long failuresBefore = brokerFailures("broker-a");
+    setDown("broker-c", true);
+    unsigned long skipDownMs = untilSwitch(app, MINUTE_MS);
+    unsigned long activeSkipDown = readMetric("mqtt_broker_active");
+    bool skippedDown = brokerFailures("broker-a") == failuresBefore;
+
+    Check checks[] = {
+        {"Fallback brokers survive a config save and load", configRoundTrip},
+        {"Connects to the preferred broker first", bootedOnPreferred},
+        {"Fails over to the first fallback within 10 s", failoverMs <= 10 * SECOND_MS && activeAfterFailover == 1},
+        {"Stays on the fallback while the preferred broker is down", stayedOnFallback},
+        {"Switches back within one probe interval of the preferred broker returning",
+         failbackMs <= PROBE_INTERVAL + 5 * SECOND_MS && failedBack},
+        {"Goes on to the second fallback when the first is down too",
+         secondFallbackMs <= 20 * SECOND_MS && activeAfterBoth == 2},
+        {"Prefers the fallback that connects faster", activeByLatency == 2},
+        {"A broker that just failed is tried after the others",
+         skipDownMs <= 2 * TCP_TIMEOUT_MS && activeSkipDown == 1 && skippedDown},
+        {"Switch counts are exported", readMetric("mqtt_broker_switches_total") == 6 &&
+                                            readMetric("mqtt_broker_failbacks_total") == 2},
+    };
+
+    Serial.printf("[failover] failover %lu ms, failback %lu ms after the broker returned, two down %lu ms\n",
+                  failoverMs, failbackMs, secondFallbackMs);
+    Serial.printf("[failover] fallback chosen by connect time: %lu, after losing it: %lu in %lu ms\n",
+                  activeByLatency, activeSkipDown, skipDownMs);
+    Serial.printf("[failover] %lu connect attempts by the end of the 20 min outage; switches %lu, failbacks %lu\n",
+                  attemptsWhileDown, readMetric("mqtt_broker_switches_total"),
+                  readMetric("mqtt_broker_failbacks_total"));
+    return reportChecks("failover", checks);
+}
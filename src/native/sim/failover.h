@@ -0,0 +1,11 @@
+#ifndef NATIVE_SIM_FAILOVER_H
+#define NATIVE_SIM_FAILOVER_H
+
+// Runs App on a virtual clock against three brokers (a preferred one and
+// two fallbacks) and takes them down and up: the client must move to a
+// fallback within seconds of losing its broker, stay there while the
+// preferred one is down, switch back within one probe interval of it
+// returning, and order fallbacks by their failures and connect times.
+int runFailoverCheck();
+
+#endif
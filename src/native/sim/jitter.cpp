@@ -0,0 +1,114 @@
+#include "jitter.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../../core/app.h"
+#include "../hal/native_hal.h"
+#include "sim_hardware.h"
+
+namespace {
+
+// Constant readings; records when each sample was taken
+class TimingSensor : public ISensorReader {
+public:
+    static const size_t MAX_SAMPLES = 4096;
+
+    TimingSensor() : count(0) {
+        timesUs.resize(MAX_SAMPLES);
+    }
+
+    Result<SensorData> read() override {
+        size_t index = count.load(std::memory_order_relaxed);
+        if (index < MAX_SAMPLES) {
+            timesUs[index] = micros();
+            count.store(index + 1, std::memory_order_release);
+        }
+        return Result<SensorData>(SensorData(24.0f, 55.0f, 2000, false, millis()));
+    }
+
+    bool isReady() override {
+        return true;
+    }
+
+    // Safe to call while the sensing task is still running
+    std::vector<unsigned long> snapshot() const {
+        size_t n = count.load(std::memory_order_acquire);
+        return std::vector<unsigned long>(timesUs.begin(), timesUs.begin() + n);
+    }
+
+private:
+    std::vector<unsigned long> timesUs;
+    std::atomic<size_t> count;
+};
+
+int report(const JitterOptions& options, const TimingSensor& sensor, unsigned long periodMs) {
+    std::vector<unsigned long> times = sensor.snapshot();
+    if (times.size() < 3) {
+        Serial.println("[jitter] Not enough samples");
+        return 1;
+    }
+
+    std::vector<double> deviationsMs;
+    for (size_t i = 1; i < times.size(); i++) {
+        double intervalMs = (times[i] - times[i - 1]) / 1000.0;
+        deviationsMs.push_back(std::abs(intervalMs - (double)periodMs));
+    }
+    std::sort(deviationsMs.begin(), deviationsMs.end());
+
+    Serial.printf("[jitter] %s, broker down, %lu ms blocking connects, %lu s\n",
+                  options.dualCore ? "dual-core" : "single loop", options.connectMs, options.seconds);
+    Serial.printf("[jitter] %lu samples at %lu ms: deviation p50 %.1f ms, p99 %.1f ms, max %.1f ms\n",
+                  (unsigned long)times.size(), periodMs, deviationsMs[deviationsMs.size() / 2],
+                  deviationsMs[deviationsMs.size() * 99 / 100], deviationsMs.back());
+    return 0;
+}
+
+}  // namespace
+
+int runJitterBench(const JitterOptions& options) {
+    native_hal::env().spiffsRoot = ".native_jitter_spiffs";
+    native_hal::env().brokerAvailable = false;
+    native_hal::env().connectDelayMs = options.connectMs;
+
+    Config config;
+    config.setDefaults();
+    strcpy(config.wifi.ssid, "jitter-ap");
+    strcpy(config.wifi.password, "jitter-password");
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    config.saveToFile("/config.json");
+
+    // Never destroyed: in dual-core mode its tasks run until the process exits
+    TimingSensor* sensor = new TimingSensor();
+    App* app = new App();
+    app->useHardware(std::unique_ptr<ISensorReader>(sensor), std::unique_ptr<IDisplayDriver>(new RecordingDisplay()),
+                     std::unique_ptr<ILedController>(new RecordingLed()));
+    if (app->initialize() != ErrorCode::SUCCESS) {
+        Serial.println("[jitter] App failed to initialize");
+        return 2;
+    }
+    Logger::setLevel(LogLevel::ERROR);
+
+    const unsigned long durationMs = options.seconds * 1000;
+    if (options.dualCore) {
+        std::thread([app]() { app->runDualCore(); }).detach();
+        std::this_thread::sleep_for(std::chrono::milliseconds(durationMs));
+        int result = report(options, *sensor, config.sensor.sensorReadingInterval);
+        // App tasks never return, as on the device
+        fflush(stdout);
+        std::_Exit(result);
+    }
+
+    app->start();
+    unsigned long startMs = millis();
+    while (millis() - startMs < durationMs) {
+        app->idle(app->runOnce());
+    }
+    return report(options, *sensor, config.sensor.sensorReadingInterval);
+}
@@ -0,0 +1,15 @@
+#ifndef NATIVE_SIM_JITTER_H
+#define NATIVE_SIM_JITTER_H
+
+struct JitterOptions {
+    unsigned long seconds = 12;
+    unsigned long connectMs = 2000;  // How long each failed broker connect blocks
+    bool dualCore = false;
+};
+
+// Runs App in real time with the broker unreachable and blocking connects,
+// and reports how far sensor sampling drifts from sensorReadingInterval.
+// The dual-core run never returns; the process exits after the report.
+int runJitterBench(const JitterOptions& options);
+
+#endif
@@ -0,0 +1,270 @@
+#include "loopback_broker.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+
+namespace {
+
+// MQTT filter match with '+' and '#' wildcards
+bool topicMatches(const char* filter, const char* topic) {
+    while (*filter) {
+        if (*filter == '#') return true;
+        if (*filter == '+') {
+            while (*topic && *topic != '/') topic++;
+            filter++;
+            continue;
+        }
+        if (*filter != *topic) return false;
+        filter++;
+        topic++;
+    }
+    return *topic == '\0';
+}
+
+size_t writeLength(uint8_t* out, size_t remaining) {
+    size_t bytes = 0;
+    do {
+        uint8_t digit = remaining % 128;
+        remaining /= 128;
+        out[bytes++] = remaining > 0 ? (digit | 0x80) : digit;
+    } while (remaining > 0);
+    return bytes;
+}
+
+}  // namespace
+
+LoopbackBroker::LoopbackBroker()
+    : listenFd(-1), port(0), running(false), ackDelayMs(0), dropInterval(0), publishCount(0), dropCount(0),
+      qos1SinceDrop(0) {
+    for (Connection& connection : connections) {
+        connection.fd = -1;
+    }
+}
+
+LoopbackBroker::~LoopbackBroker() {
+    stop();
+}
+
+bool LoopbackBroker::start() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenFd < 0) return false;
+    int reuse = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    socklen_t length = sizeof(address);
+    if (bind(listenFd, (struct sockaddr*)&address, sizeof(address)) != 0 || listen(listenFd, 4) != 0 ||
+        getsockname(listenFd, (struct sockaddr*)&address, &length) != 0) {
+        ::close(listenFd);
+        listenFd = -1;
+        return false;
+    }
+    port = ntohs(address.sin_port);
+    running = true;
+    thread = std::thread([this]() { run(); });
+    return true;
+}
+
+void LoopbackBroker::stop() {
+    if (!running) return;
+    running = false;
+    thread.join();
+    for (Connection& connection : connections) {
+        close(connection);
+    }
+    ::close(listenFd);
+    listenFd = -1;
+}
+
+uint64_t LoopbackBroker::nowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+void LoopbackBroker::run() {
+    while (running) {
+        fd_set readSet;
+        FD_ZERO(&readSet);
+        FD_SET(listenFd, &readSet);
+        int maxFd = listenFd;
+        for (Connection& connection : connections) {
+            if (connection.fd < 0) continue;
+            FD_SET(connection.fd, &readSet);
+            if (connection.fd > maxFd) maxFd = connection.fd;
+        }
+        // Short enough to release held-back acks on time
+        struct timeval timeout = {0, 1000};
+        if (select(maxFd + 1, &readSet, nullptr, nullptr, &timeout) < 0) continue;
+
+        if (FD_ISSET(listenFd, &readSet)) accept();
+        uint64_t now = nowMs();
+        for (Connection& connection : connections) {
+            if (connection.fd >= 0 && FD_ISSET(connection.fd, &readSet)) receive(connection);
+            if (connection.fd >= 0) sendAcks(connection, now);
+        }
+    }
+}
+
+void LoopbackBroker::accept() {
+    int fd = ::accept(listenFd, nullptr, nullptr);
+    if (fd < 0) return;
+    for (Connection& connection : connections) {
+        if (connection.fd >= 0) continue;
+        int noDelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+        connection.fd = fd;
+        connection.length = 0;
+        connection.filter[0] = '\0';
+        connection.ackHead = 0;
+        connection.ackCount = 0;
+        return;
+    }
+    ::close(fd);
+}
+
+void LoopbackBroker::close(Connection& connection) {
+    if (connection.fd < 0) return;
+    ::close(connection.fd);
+    connection.fd = -1;
+}
+
+void LoopbackBroker::receive(Connection& connection) {
+    ssize_t received = recv(connection.fd, connection.buffer + connection.length, BUFFER_BYTES - connection.length, 0);
+    if (received <= 0) {
+        close(connection);
+        return;
+    }
+    connection.length += received;
+
+    size_t offset = 0;
+    while (connection.length - offset >= 2) {
+        size_t remaining = 0;
+        size_t headerBytes = 1;
+        bool complete = false;
+        while (headerBytes <= 4 && offset + headerBytes < connection.length) {
+            uint8_t digit = connection.buffer[offset + headerBytes];
+            remaining |= (size_t)(digit & 0x7F) << (7 * (headerBytes - 1));
+            headerBytes++;
+            if ((digit & 0x80) == 0) {
+                complete = true;
+                break;
+            }
+        }
+        if (!complete || offset + headerBytes + remaining > connection.length) break;
+        if (!handle(connection, connection.buffer[offset], connection.buffer + offset + headerBytes, remaining)) {
+            return;
+        }
+        offset += headerBytes + remaining;
+    }
+    memmove(connection.buffer, connection.buffer + offset, connection.length - offset);
+    connection.length -= offset;
+    if (connection.length == BUFFER_BYTES) close(connection);  // Packet too large for the stand-in
+}
+
+bool LoopbackBroker::handle(Connection& connection, uint8_t header, const uint8_t* body, size_t length) {
+    switch (header >> 4) {
+    case 1: {  // CONNECT
+        const uint8_t connack[] = {0x20, 0x02, 0x00, 0x00};
+        sendAll(connection.fd, connack, sizeof(connack));
+        return true;
+    }
+    case 3: {  // PUBLISH
+        uint8_t qos = (header >> 1) & 0x03;
+        size_t topicLength = (body[0] << 8) | body[1];
+        size_t headerLength = 2 + topicLength + (qos > 0 ? 2 : 0);
+        if (headerLength > length || topicLength >= 64) {
+            close(connection);
+            return false;
+        }
+        char topic[64];
+        memcpy(topic, body + 2, topicLength);
+        topic[topicLength] = '\0';
+        publishCount++;
+
+        // Subscribers get it at QoS0: same topic and payload, no packet id
+        static uint8_t forward[BUFFER_BYTES + 8];
+        size_t payloadLength = length - headerLength;
+        size_t remaining = 2 + topicLength + payloadLength;
+        forward[0] = 0x30 | (header & 0x01);
+        size_t at = 1 + writeLength(forward + 1, remaining);
+        memcpy(forward + at, body, 2 + topicLength);
+        memcpy(forward + at + 2 + topicLength, body + headerLength, payloadLength);
+        route(topic, forward, at + remaining);
+
+        if (qos == 0) return true;
+        if (dropInterval > 0 && ++qos1SinceDrop >= dropInterval) {
+            // Received but never acknowledged, like a link dying mid-flight
+            qos1SinceDrop = 0;
+            dropCount++;
+            close(connection);
+            return false;
+        }
+        if (connection.ackCount < MAX_PENDING_ACKS) {
+            PendingAck& ack = connection.acks[(connection.ackHead + connection.ackCount) % MAX_PENDING_ACKS];
+            ack.packetId = (body[2 + topicLength] << 8) | body[3 + topicLength];
+            ack.dueMs = nowMs() + ackDelayMs;
+            connection.ackCount++;
+            sendAcks(connection, nowMs());
+        }
+        return true;
+    }
+    case 8: {  // SUBSCRIBE, one filter
+        if (length < 5) return true;
+        size_t filterLength = (body[2] << 8) | body[3];
+        if (filterLength < sizeof(connection.filter) && 4 + filterLength <= length) {
+            memcpy(connection.filter, body + 4, filterLength);
+            connection.filter[filterLength] = '\0';
+        }
+        const uint8_t suback[] = {0x90, 0x03, body[0], body[1], 0x00};
+        sendAll(connection.fd, suback, sizeof(suback));
+        return true;
+    }
+    case 12: {  // PINGREQ
+        const uint8_t pingresp[] = {0xD0, 0x00};
+        sendAll(connection.fd, pingresp, sizeof(pingresp));
+        return true;
+    }
+    case 14:  // DISCONNECT
+        close(connection);
+        return false;
+    default:
+        return true;
+    }
+}
+
+void LoopbackBroker::route(const char* topic, const uint8_t* packet, size_t length) {
+    for (Connection& connection : connections) {
+        if (connection.fd >= 0 && connection.filter[0] && topicMatches(connection.filter, topic)) {
+            sendAll(connection.fd, packet, length);
+        }
+    }
+}
+
+// Acks leave in the order the publishes came in, as MQTT requires
+void LoopbackBroker::sendAcks(Connection& connection, uint64_t now) {
+    while (connection.ackCount > 0 && connection.acks[connection.ackHead].dueMs <= now) {
+        uint16_t packetId = connection.acks[connection.ackHead].packetId;
+        const uint8_t puback[] = {0x40, 0x02, (uint8_t)(packetId >> 8), (uint8_t)(packetId & 0xFF)};
+        sendAll(connection.fd, puback, sizeof(puback));
+        connection.ackHead = (connection.ackHead + 1) % MAX_PENDING_ACKS;
+        connection.ackCount--;
+    }
+}
+
+void LoopbackBroker::sendAll(int fd, const uint8_t* data, size_t length) {
+    while (length > 0) {
+        ssize_t sent = send(fd, data, length, MSG_NOSIGNAL);
+        if (sent <= 0) return;
+        data += sent;
+        length -= sent;
+    }
+}
@@ -0,0 +1,90 @@
+#ifndef NATIVE_SIM_LOOPBACK_BROKER_H
+#define NATIVE_SIM_LOOPBACK_BROKER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+// Minimal MQTT 3.1.1 broker on 127.0.0.1, run on its own thread, for
+// exercising AsyncMqttClient over real sockets. It accepts any CONNECT,
+// forwards PUBLISHes to matching subscribers at QoS0, acknowledges QoS1
+// and answers pings. Two faults can be injected: PUBACKs held back for a
+// while (a slow link), and the publisher's connection closed every N QoS1
+// publishes with the last ones unacknowledged (a flaky one).
+//
+// Uses fixed buffers only, so it doesn't disturb heap accounting.
+class LoopbackBroker {
+public:
+    static const size_t MAX_CLIENTS = 8;
+    static const size_t BUFFER_BYTES = 8192;
+    static const size_t MAX_PENDING_ACKS = 256;
+
+    LoopbackBroker();
+    ~LoopbackBroker();
+
+    // Listens on an ephemeral port; false if the socket can't be set up
+    bool start();
+    void stop();
+
+    uint16_t getPort() const {
+        return port;
+    }
+
+    void setAckDelay(unsigned long ms) {
+        ackDelayMs = ms;
+    }
+
+    // 0 turns the fault off
+    void dropEvery(unsigned long qos1Publishes) {
+        dropInterval = qos1Publishes;
+    }
+
+    unsigned long getPublishCount() const {
+        return publishCount;
+    }
+
+    unsigned long getDropCount() const {
+        return dropCount;
+    }
+
+private:
+    struct PendingAck {
+        uint16_t packetId;
+        uint64_t dueMs;
+    };
+
+    struct Connection {
+        int fd;
+        uint8_t buffer[BUFFER_BYTES];
+        size_t length;
+        char filter[64];  // One subscription per connection is all the tests need
+        PendingAck acks[MAX_PENDING_ACKS];
+        size_t ackHead;
+        size_t ackCount;
+    };
+
+    int listenFd;
+    uint16_t port;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<unsigned long> ackDelayMs;
+    std::atomic<unsigned long> dropInterval;
+    std::atomic<unsigned long> publishCount;
+    std::atomic<unsigned long> dropCount;
+    unsigned long qos1SinceDrop;
+    Connection connections[MAX_CLIENTS];
+
+    void run();
+    void accept();
+    void close(Connection& connection);
+    void receive(Connection& connection);
+    // false if the connection was closed while handling the packet
+    bool handle(Connection& connection, uint8_t header, const uint8_t* body, size_t length);
+    void route(const char* topic, const uint8_t* packet, size_t length);
+    void sendAcks(Connection& connection, uint64_t nowMs);
+    static void sendAll(int fd, const uint8_t* data, size_t length);
+    static uint64_t nowMs();
+};
+
+#endif
@@ -0,0 +1,181 @@
+#include "reconfig.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <memory>
+#include <string>
+#include "../../core/app.h"
+#include "../hal/native_hal.h"
+#include "sensor_profile.h"
+#include "sim_checks.h"
+#include "sim_hardware.h"
+
+namespace {
+
+const char* CONFIG_TOPIC = "Advantech/24dcc3a736ec/config";
+const char* STATUS_TOPIC = "Advantech/24dcc3a736ec/config/status";
+const char* REBOOT_TOPIC = "Advantech/24dcc3a736ec/cmd/reboot";
+const unsigned long MINUTE_MS = 60000;
+
+unsigned long uploadTicks() {
+    return readMetric("data_reports_sent_total") + readMetric("data_reports_suppressed_total");
+}
+
+struct Status {
+    std::string payload;
+    unsigned long at = 0;
+    unsigned long count = 0;
+};
+
+// Runs until a new status arrives or timeoutMs passes; ms it took, or timeoutMs
+unsigned long untilStatus(App& app, const Status& status, unsigned long timeoutMs) {
+    unsigned long seen = status.count;
+    unsigned long start = millis();
+    while (status.count == seen && millis() - start < timeoutMs) {
+        runFor(app, 10);
+    }
+    return status.count == seen ? timeoutMs : status.at - start;
+}
+
+bool contains(const std::string& text, const char* part) {
+    return text.find(part) != std::string::npos;
+}
+
+}  // namespace
+
+int runReconfigCheck() {
+    native_hal::env().spiffsRoot = ".native_reconfig_spiffs";
+    native_hal::useVirtualClock(true);
+    native_hal::env().retainedMessages.clear();
+
+    Config seeded;
+    seeded.setDefaults();
+    strcpy(seeded.wifi.ssid, "sim-ap");
+    strcpy(seeded.wifi.password, "sim-password");
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    seeded.saveToFile("/config.json");
+
+    Status status;
+    native_hal::env().publishHook = [&](const char* topic, const uint8_t* payload, unsigned int length, bool) {
+        if (strcmp(topic, STATUS_TOPIC) == 0) {
+            status.payload.assign((const char*)payload, length);
+            status.at = millis();
+            status.count++;
+        }
+    };
+
+    DayNightProfile profile;
+    RecordingLed* led = new RecordingLed();
+    ScriptedSensor* sensor = new ScriptedSensor(profile, led, millis());
+    App app;
+    app.useHardware(std::unique_ptr<ISensorReader>(sensor), std::unique_ptr<IDisplayDriver>(new RecordingDisplay()),
+                    std::unique_ptr<ILedController>(led));
+    if (app.initialize() != ErrorCode::SUCCESS) {
+        Serial.println("[reconfig] App failed to initialize");
+        return 2;
+    }
+    Logger::setLevel(LogLevel::WARN);
+    app.start();
+
+    // Defaults: a DHT read every second (the sensor's floor), a publish tick every 5 s
+    runFor(app, MINUTE_MS);
+    unsigned long reads = sensor->getReadCount();
+    unsigned long ticks = uploadTicks();
+    runFor(app, 10 * MINUTE_MS);
+    unsigned long readsBefore = sensor->getReadCount() - reads;
+    unsigned long ticksBefore = uploadTicks() - ticks;
+
+    native_hal::retain(CONFIG_TOPIC, "{\"sensor\":{\"sensorReadingInterval\":5000,\"uploadFrequency\":30000,"
+                                     "\"photoresisterThreshold\":700,\"nightLightDuration\":300000}}");
+    unsigned long applyMs = untilStatus(app, status, 10000);
+    std::string applied = status.payload;
+    Config saved;
+    saved.loadFromFile("/config.json");
+    bool savedMatches = saved.sensor.sensorReadingInterval == 5000 && saved.sensor.uploadFrequency == 30000 &&
+                        saved.sensor.photoresisterThreshold == 700 && saved.sensor.nightLightDuration == 300000 &&
+                        strcmp(saved.wifi.ssid, "sim-ap") == 0;
+
+    runFor(app, MINUTE_MS);
+    reads = sensor->getReadCount();
+    ticks = uploadTicks();
+    runFor(app, 10 * MINUTE_MS);
+    unsigned long readsAfter = sensor->getReadCount() - reads;
+    unsigned long ticksAfter = uploadTicks() - ticks;
+
+    // The broker goes away and comes back: the retained patch arrives again
+    unsigned long statusesBefore = status.count;
+    native_hal::env().brokerAvailable = false;
+    runFor(app, 2 * MINUTE_MS);
+    native_hal::env().brokerAvailable = true;
+    runFor(app, 2 * MINUTE_MS);
+    bool redelivered = status.count > statusesBefore;
+    std::string reapplied = status.payload;
+    unsigned long writesAfterReconnect = readMetric("config_writes_total");
+
+    native_hal::retain(CONFIG_TOPIC, "{\"sensor\":{\"uploadFrequency\":5}}");
+    untilStatus(app, status, 10000);
+    std::string outOfRange = status.payload;
+    native_hal::retain(CONFIG_TOPIC, "{\"sensor\":{\"dhtPin\":4}}");
+    untilStatus(app, status, 10000);
+    std::string notLive = status.payload;
+    native_hal::retain(CONFIG_TOPIC, "{\"sensor\":");
+    untilStatus(app, status, 10000);
+    std::string malformed = status.payload;
+
+    // Still on the first patch's rates
+    reads = sensor->getReadCount();
+    ticks = uploadTicks();
+    runFor(app, 10 * MINUTE_MS);
+    unsigned long readsRejected = sensor->getReadCount() - reads;
+    unsigned long ticksRejected = uploadTicks() - ticks;
+    unsigned long writesAfterRejected = readMetric("config_writes_total");
+    unsigned long rejected = readMetric("config_patches_rejected_total");
+
+    // A later patch only needs the setting it changes
+    native_hal::retain(CONFIG_TOPIC, "{\"sensor\":{\"uploadFrequency\":10000}}");
+    untilStatus(app, status, 10000);
+    std::string partial = status.payload;
+    saved.loadFromFile("/config.json");
+
+    // A stray retained reboot, seen again on the reconnect: the native
+    // ESP.restart() exits, so still being here is the check
+    native_hal::retain(REBOOT_TOPIC, "now");
+    runFor(app, 10000);
+    native_hal::env().brokerAvailable = false;
+    runFor(app, MINUTE_MS);
+    native_hal::env().brokerAvailable = true;
+    runFor(app, MINUTE_MS);
+    native_hal::retain(REBOOT_TOPIC, "");
+
+    Check checks[] = {
+        {"Patch is applied and acknowledged within two seconds", applyMs <= 2000},
+        {"Status reports four settings changed and saved",
+         contains(applied, "\"ok\":true,\"changed\":4,\"persisted\":true")},
+        {"/config.json holds the patched settings and keeps the rest", savedMatches},
+        {"Sensor read rate follows sensorReadingInterval", readsBefore >= 595 && readsBefore <= 605 &&
+                                                               readsAfter >= 119 && readsAfter <= 121},
+        {"Publish rate follows uploadFrequency", ticksBefore >= 119 && ticksBefore <= 121 && ticksAfter >= 19 &&
+                                                     ticksAfter <= 21},
+        {"Retained patch after a reconnect is applied without a flash write",
+         redelivered && contains(reapplied, "\"changed\":0,\"persisted\":false") && writesAfterReconnect == 1},
+        {"Out-of-range value is rejected with its range",
+         contains(outOfRange, "\"ok\":false") && contains(outOfRange, "uploadFrequency must be 1000-86400000")},
+        {"Settings that need a restart are rejected", contains(notLive, "\"ok\":false")},
+        {"Malformed JSON is rejected", contains(malformed, "\"ok\":false")},
+        {"Rejected patches change nothing", readsRejected >= 119 && readsRejected <= 121 && ticksRejected >= 19 &&
+                                                ticksRejected <= 21 && writesAfterRejected == 1 && rejected == 3},
+        {"A partial patch keeps the other saved settings",
+         contains(partial, "\"changed\":1,\"persisted\":true") && saved.sensor.uploadFrequency == 10000 &&
+             saved.sensor.sensorReadingInterval == 5000},
+        {"A retained reboot without the edgeId is ignored", true},
+    };
+
+    Serial.printf("[reconfig] applied in %lu ms: %s\n", applyMs, applied.c_str());
+    Serial.printf("[reconfig] per 10 min: reads %lu -> %lu, upload ticks %lu -> %lu\n", readsBefore, readsAfter,
+                  ticksBefore, ticksAfter);
+    Serial.printf("[reconfig] after reconnect: %s\n", reapplied.c_str());
+    Serial.printf("[reconfig] rejected: %s\n", outOfRange.c_str());
+    Serial.printf("[reconfig] rejected: %s\n", notLive.c_str());
+    Serial.printf("[reconfig] rejected: %s\n", malformed.c_str());
+    return reportChecks("reconfig", checks);
+}
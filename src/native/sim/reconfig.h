@@ -0,0 +1,12 @@
+#ifndef NATIVE_SIM_RECONFIG_H
+#define NATIVE_SIM_RECONFIG_H
+
+// Runs App on a virtual clock and retunes it through the retained config
+// topic: a patch must change the read and publish rates within seconds,
+// be acknowledged on config/status and saved to /config.json once. The
+// same patch arriving again after a reconnect must not rewrite flash, and
+// invalid patches must be rejected without changing anything. A retained
+// cmd/reboot that doesn't name the device must not restart it.
+int runReconfigCheck();
+
+#endif
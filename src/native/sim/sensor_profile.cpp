@@ -0,0 +1,64 @@
+#include "sensor_profile.h"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+
+namespace {
+
+const unsigned long HOUR_MS = 3600UL * 1000UL;
+const unsigned long DAY_MS = 24 * HOUR_MS;
+
+}  // namespace
+
+ProfileSample DayNightProfile::at(unsigned long elapsedMs) const {
+    unsigned long timeOfDay = elapsedMs % DAY_MS;
+    double hours = (double)timeOfDay / HOUR_MS;
+
+    ProfileSample sample;
+    // Peak 28C at 15:00, low 20C at 03:00
+    sample.temperature = (float)(24.0 + 4.0 * cos((hours - 15.0) * M_PI / 12.0));
+    sample.humidity = (float)(55.0 - 10.0 * cos((hours - 15.0) * M_PI / 12.0));
+
+    if (hours >= 6.0 && hours < 19.0) {
+        sample.light = 2600;
+    } else if (hours >= 20.0 && hours < 22.5) {
+        sample.light = 1400;
+    } else {
+        sample.light = 120;
+    }
+    return sample;
+}
+
+bool CsvProfile::load(const char* path) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        return false;
+    }
+
+    char line[128];
+    while (fgets(line, sizeof(line), file)) {
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+        double seconds;
+        Row row;
+        if (sscanf(line, "%lf,%f,%f,%d", &seconds, &row.sample.temperature, &row.sample.humidity,
+                   &row.sample.light) == 4) {
+            row.ms = (unsigned long)(seconds * 1000.0);
+            rows.push_back(row);
+        }
+    }
+    fclose(file);
+
+    std::sort(rows.begin(), rows.end(), [](const Row& a, const Row& b) { return a.ms < b.ms; });
+    return !rows.empty();
+}
+
+ProfileSample CsvProfile::at(unsigned long elapsedMs) const {
+    auto it = std::upper_bound(rows.begin(), rows.end(), elapsedMs,
+                               [](unsigned long ms, const Row& row) { return ms < row.ms; });
+    if (it == rows.begin()) {
+        return rows.front().sample;
+    }
+    return (it - 1)->sample;
+}
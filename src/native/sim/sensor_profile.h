@@ -0,0 +1,42 @@
+#ifndef NATIVE_SIM_SENSOR_PROFILE_H
+#define NATIVE_SIM_SENSOR_PROFILE_H
+
+#include <vector>
+
+// What the room looks like to the sensors at a point in simulated time.
+struct ProfileSample {
+    float temperature;
+    float humidity;
+    int light;  // Photoresistor ADC reading, 0-4095
+};
+
+class SensorProfile {
+public:
+    virtual ~SensorProfile() = default;
+    virtual ProfileSample at(unsigned long elapsedMs) const = 0;
+};
+
+// Built-in daily cycle starting at midnight: daylight 06:00-19:00, a room
+// lamp 20:00-22:30, dark otherwise. Temperature follows a sinusoid peaking
+// mid-afternoon with humidity moving the opposite way.
+class DayNightProfile : public SensorProfile {
+public:
+    ProfileSample at(unsigned long elapsedMs) const override;
+};
+
+// Recorded trace in CSV form: `seconds,temperature,humidity,light` per line,
+// held stepwise until the next row. Lines starting with '#' are ignored.
+class CsvProfile : public SensorProfile {
+public:
+    bool load(const char* path);
+    ProfileSample at(unsigned long elapsedMs) const override;
+
+private:
+    struct Row {
+        unsigned long ms;
+        ProfileSample sample;
+    };
+    std::vector<Row> rows;
+};
+
+#endif
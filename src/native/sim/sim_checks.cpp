@@ -0,0 +1,32 @@
+#include "sim_checks.h"
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "../../core/app.h"
+
+unsigned long readMetric(const char* name) {
+    AsyncWebServer* server = AsyncWebServer::current();
+    if (!server) return 0;
+    AsyncWebServerRequest request(HTTP_GET, "/metrics");
+    server->handle(request);
+    String pattern = String("\n") + name + " ";
+    int at = request.responseBody.indexOf(pattern.c_str());
+    return at < 0 ? 0 : strtoul(request.responseBody.c_str() + at + pattern.length(), nullptr, 10);
+}
+
+void runFor(App& app, unsigned long ms) {
+    unsigned long until = millis() + ms;
+    while ((long)(until - millis()) > 0) {
+        unsigned long idleMs = app.runOnce();
+        unsigned long left = until - millis();
+        app.idle(idleMs < left ? idleMs : left);
+    }
+}
+
+int reportChecks(const char* tag, const Check* checks, size_t count) {
+    bool passed = true;
+    for (size_t i = 0; i < count; i++) {
+        Serial.printf("[%s] %s: %s\n", tag, checks[i].passed ? "PASS" : "FAIL", checks[i].name);
+        passed = passed && checks[i].passed;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#ifndef NATIVE_SIM_SIM_CHECKS_H
+#define NATIVE_SIM_SIM_CHECKS_H
+
+#include <cstddef>
+
+class App;
+
+// What the scenario checks share. Each runs its scenario on the virtual
+// clock, collects one Check per property and returns reportChecks(): 0
+// when every check passed, 1 otherwise.
+
+struct Check {
+    const char* name;
+    bool passed;
+};
+
+// A counter or gauge from the app's /metrics page, labels included in
+// name; 0 if it isn't there
+unsigned long readMetric(const char* name);
+
+// Drives the app's loop for ms, idling between passes as the firmware does
+void runFor(App& app, unsigned long ms);
+
+// Prints "[tag] PASS: name" or "[tag] FAIL: name" for each check
+int reportChecks(const char* tag, const Check* checks, size_t count);
+
+template <size_t N>
+int reportChecks(const char* tag, const Check (&checks)[N]) {
+    return reportChecks(tag, checks, N);
+}
+
+#endif
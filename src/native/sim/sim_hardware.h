@@ -0,0 +1,127 @@
+#ifndef NATIVE_SIM_SIM_HARDWARE_H
+#define NATIVE_SIM_SIM_HARDWARE_H
+
+#include <Arduino.h>
+#include <vector>
+#include "../../core/interfaces.h"
+#include "sensor_profile.h"
+
+// LED controller that records every transition with its timestamp.
+class RecordingLed : public ILedController {
+public:
+    struct Transition {
+        unsigned long timeMs;
+        bool on;
+    };
+
+    RecordingLed() : state(false) {
+        transitions.reserve(4096);
+    }
+
+    ErrorCode turnOn() override {
+        record(true);
+        return ErrorCode::SUCCESS;
+    }
+
+    ErrorCode turnOff() override {
+        record(false);
+        return ErrorCode::SUCCESS;
+    }
+
+    bool isOn() override {
+        return state;
+    }
+
+    const std::vector<Transition>& getTransitions() const {
+        return transitions;
+    }
+
+private:
+    bool state;
+    std::vector<Transition> transitions;
+
+    void record(bool on) {
+        if (on != state && transitions.size() < transitions.capacity()) {
+            transitions.push_back(Transition{millis(), on});
+        }
+        state = on;
+    }
+};
+
+// Display driver that counts frames instead of drawing them.
+class RecordingDisplay : public IDisplayDriver {
+public:
+    RecordingDisplay() : frames(0), ledStatusFrames(0), timerFrames(0) {}
+
+    ErrorCode initialize() override {
+        return ErrorCode::SUCCESS;
+    }
+
+    ErrorCode show(const DisplayData& data) override {
+        frames++;
+        if (data.showLedStatus) ledStatusFrames++;
+        if (data.showLedTimer) timerFrames++;
+        lastFrame = data;
+        return ErrorCode::SUCCESS;
+    }
+
+    ErrorCode clear() override {
+        return ErrorCode::SUCCESS;
+    }
+
+    unsigned long frames;
+    unsigned long ledStatusFrames;
+    unsigned long timerFrames;
+    DisplayData lastFrame;
+};
+
+// DHT11 + photoresistor replaying a SensorProfile. Mirrors DHTSensor: a
+// read inside the 1 s DHT interval returns the cached sample, and values
+// are quantised to the DHT11's 1 degree / 1 % resolution.
+class ScriptedSensor : public ISensorReader {
+public:
+    ScriptedSensor(const SensorProfile& profile, ILedController* led, unsigned long startMs)
+        : profile(profile), led(led), startMs(startMs), lastReadTime(0), readInterval(1000), reads(0) {}
+
+    Result<SensorData> read() override {
+        unsigned long now = millis();
+        if (reads > 0 && now - lastReadTime < readInterval) {
+            return Result<SensorData>(lastData);
+        }
+
+        ProfileSample sample = profile.at(now - startMs);
+        bool ledOn = led->isOn();
+        lastData = SensorData(roundf(sample.temperature), roundf(sample.humidity), sample.light, ledOn, now);
+        lastReadTime = now;
+        reads++;
+        return Result<SensorData>(lastData);
+    }
+
+    bool isReady() override {
+        return millis() - lastReadTime >= readInterval;
+    }
+
+    // Same floor as DHTSensor
+    void setReadInterval(unsigned long interval) override {
+        readInterval = interval > 1000 ? interval : 1000;
+    }
+
+    unsigned long getReadCount() const {
+        return reads;
+    }
+
+    const SensorData& getLastData() const {
+        return lastData;
+    }
+
+private:
+    const SensorProfile& profile;
+    ILedController* led;
+    unsigned long startMs;
+    unsigned long lastReadTime;
+    unsigned long readInterval;
+    unsigned long reads;
+    SensorData lastData;
+};
+
+#endif
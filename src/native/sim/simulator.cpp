@@ -0,0 +1,293 @@
+#include "simulator.h"
+#include <Arduino.h>
+#include <SPIFFS.h>
+#include <chrono>
+#include <memory>
+#include "../../core/app.h"
+#include "../hal/native_hal.h"
+#include "sensor_profile.h"
+#include "sim_checks.h"
+#include "sim_hardware.h"
+
+namespace {
+
+const unsigned long DAY_MS = 24UL * 3600UL * 1000UL;
+
+Config seedConfig(const SimulationOptions& options) {
+    Config config;
+    config.setDefaults();
+    strcpy(config.wifi.ssid, "sim-ap");
+    strcpy(config.wifi.password, "sim-password");
+    if (options.sensorReadingInterval > 0) {
+        config.sensor.sensorReadingInterval = options.sensorReadingInterval;
+    }
+    if (options.uploadFrequency > 0) {
+        config.sensor.uploadFrequency = options.uploadFrequency;
+    }
+    config.mqtt.batchMaxSamples = options.batchSamples;
+    if (options.heartbeat >= 0) {
+        config.sensor.publishHeartbeat = options.heartbeat;
+    }
+
+    SPIFFS.format();
+    SPIFFS.begin(true);
+    config.saveToFile("/config.json");
+    return config;
+}
+
+bool isBright(const SensorProfile& profile, unsigned long elapsedMs, int threshold) {
+    return profile.at(elapsedMs).light >= threshold;
+}
+
+// Bright-to-dark edges in the profile, sampled once a second: each one
+// should arm exactly one night light activation.
+unsigned long countDuskEdges(const SensorProfile& profile, unsigned long durationMs, int threshold) {
+    unsigned long edges = 0;
+    bool wasBright = false;
+    for (unsigned long t = 0; t < durationMs; t += 1000) {
+        bool bright = isBright(profile, t, threshold);
+        if (wasBright && !bright) edges++;
+        wasBright = bright;
+    }
+    return edges;
+}
+
+// Was the room bright at any point in [fromMs, toMs]?
+bool brightBetween(const SensorProfile& profile, unsigned long fromMs, unsigned long toMs, int threshold) {
+    for (unsigned long t = fromMs; t <= toMs; t += 1000) {
+        if (isBright(profile, t, threshold)) return true;
+    }
+    return false;
+}
+
+// Would the app have to publish `current` after having published `reported`?
+bool beyondDeadband(const SensorConfig& sensor, const SensorData& current, const SensorData& reported) {
+    return current.ledOn() != reported.ledOn() ||
+           fabsf(current.temperature() - reported.temperature()) > sensor.temperatureDeadband + 0.005f ||
+           fabsf(current.humidity() - reported.humidity()) > sensor.humidityDeadband + 0.05f ||
+           abs(current.photoresisterValue - reported.photoresisterValue) > sensor.photoresisterDeadband;
+}
+
+}  // namespace
+
+int runSimulation(const SimulationOptions& options) {
+    native_hal::env().spiffsRoot = ".native_sim_spiffs";
+    native_hal::useVirtualClock(true);
+
+    DayNightProfile dayNight;
+    CsvProfile csv;
+    const SensorProfile* profile = &dayNight;
+    if (options.profilePath) {
+        if (!csv.load(options.profilePath)) {
+            Serial.printf("[sim] Cannot load profile %s\n", options.profilePath);
+            return 2;
+        }
+        profile = &csv;
+    }
+
+    Config config = seedConfig(options);
+    const int threshold = config.sensor.photoresisterThreshold;
+    const unsigned long nightLight = config.sensor.nightLightDuration;
+    const unsigned long startMs = millis();
+    const unsigned long durationMs = options.days * DAY_MS;
+
+    const unsigned long outageStart = 10 * 3600UL * 1000UL;
+    const unsigned long outageEnd = outageStart + options.outageHours * 3600UL * 1000UL;
+
+    unsigned long dataPublishes = 0;
+    unsigned long backlogPublishes = 0;
+    unsigned long batchPublishes = 0;
+    unsigned long batchedReadings = 0;
+    // What /data last carried, and the longest silence between two live publishes
+    SensorData published;
+    unsigned long publishedAt = 0;
+    bool hasPublished = false;
+    unsigned long longestSilence = 0;
+    // First backlog publish after the outage, i.e. when the client got back in
+    unsigned long firstBacklogAt = 0;
+    native_hal::env().publishHook = [&](const char* topic, const uint8_t* payload, unsigned int length, bool) {
+        size_t len = strlen(topic);
+        if (len >= 6 && strcmp(topic + len - 6, "/batch") == 0) {
+            batchPublishes++;
+            // One "[age,...]" row per reading
+            for (unsigned int i = 0; i < length; i++) {
+                if (payload[i] == '[' && i > 0 && payload[i - 1] != ':') batchedReadings++;
+            }
+        }
+        if (len >= 5 && strcmp(topic + len - 5, "/data") == 0) {
+            dataPublishes++;
+            std::string json((const char*)payload, length);
+            float temperature = 0;
+            float humidity = 0;
+            int light = 0;
+            sscanf(json.c_str(), "{\"temp\":%f,\"humi\":%f,\"photoresister\":%d", &temperature, &humidity, &light);
+            unsigned long now = millis() - startMs;
+            if (hasPublished && now - publishedAt > longestSilence) longestSilence = now - publishedAt;
+            published = SensorData(temperature, humidity, light, json.find("\"ledState\":\"on\"") != std::string::npos, 0);
+            publishedAt = now;
+            hasPublished = true;
+        }
+        if (len >= 8 && strcmp(topic + len - 8, "/backlog") == 0) {
+            backlogPublishes++;
+            unsigned long now = millis() - startMs;
+            if (now >= outageEnd && firstBacklogAt == 0) firstBacklogAt = now;
+        }
+    };
+
+    RecordingLed* led = new RecordingLed();
+    RecordingDisplay* display = new RecordingDisplay();
+    ScriptedSensor* sensor = new ScriptedSensor(*profile, led, startMs);
+
+    App app;
+    app.useHardware(std::unique_ptr<ISensorReader>(sensor), std::unique_ptr<IDisplayDriver>(display),
+                    std::unique_ptr<ILedController>(led));
+    if (app.initialize() != ErrorCode::SUCCESS) {
+        Serial.println("[sim] App failed to initialize");
+        return 2;
+    }
+    Logger::setLevel(LogLevel::WARN);
+    app.start();
+
+    // Worst case from light change to LED off: DHT cache + read interval
+    const unsigned long brightOffBound = 1000 + config.sensor.sensorReadingInterval + 50;
+    const unsigned long timerBound = nightLight + 50;
+
+    unsigned long brightSince = 0;
+    bool wasBright = false;
+    unsigned long onSince = 0;
+    bool wasOn = false;
+    unsigned long brightOffViolations = 0;
+    unsigned long timerViolations = 0;
+    // Heap baseline once the app has settled: end of day one, or halfway for short runs
+    const unsigned long baselineAt = durationMs > DAY_MS ? DAY_MS : durationMs / 2;
+    uint32_t freeHeapBaseline = 0;
+
+    // A reading past a deadband must reach /data by the next publish tick
+    const unsigned long reportBound = config.sensor.uploadFrequency + 1000;
+    unsigned long unreportedSince = 0;
+    bool unreported = false;
+    unsigned long lateReports = 0;
+
+    unsigned long wakeups = 0;
+    auto wallStart = std::chrono::steady_clock::now();
+    for (unsigned long elapsed = 0; elapsed < durationMs; elapsed = millis() - startMs) {
+        bool brokerUp = elapsed < outageStart || elapsed >= outageEnd;
+        native_hal::env().brokerAvailable = brokerUp;
+        // Silence across an outage is expected, so restart the gap measurement after it
+        if (!brokerUp) hasPublished = false;
+        unsigned long idleMs = app.runOnce();
+        wakeups++;
+
+        bool bright = isBright(*profile, elapsed, threshold);
+        if (bright && !wasBright) brightSince = elapsed;
+        wasBright = bright;
+
+        bool on = led->isOn();
+        if (on && !wasOn) onSince = elapsed;
+        wasOn = on;
+
+        if (on && bright && elapsed - brightSince > brightOffBound) brightOffViolations++;
+        if (on && elapsed - onSince > timerBound) timerViolations++;
+        if (freeHeapBaseline == 0 && elapsed >= baselineAt) freeHeapBaseline = ESP.getFreeHeap();
+
+        bool pending = brokerUp && hasPublished && sensor->getReadCount() > 0 &&
+                       beyondDeadband(config.sensor, sensor->getLastData(), published);
+        if (pending && !unreported) unreportedSince = elapsed;
+        if (pending && elapsed - unreportedSince > reportBound) {
+            lateReports++;
+            unreportedSince = elapsed;  // Count each stale stretch once per bound
+        }
+        unreported = pending;
+
+        app.idle(idleMs);
+    }
+    double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    uint32_t freeHeapAtEnd = ESP.getFreeHeap();
+    uint32_t freeHeapMinimum = ESP.getMinFreeHeap();
+
+    // Every activation must follow a bright period since the previous one
+    unsigned long activations = 0;
+    unsigned long unarmedActivations = 0;
+    unsigned long previousOn = 0;
+    for (const auto& transition : led->getTransitions()) {
+        if (!transition.on) continue;
+        unsigned long at = transition.timeMs - startMs;
+        if (!brightBetween(*profile, previousOn, at, threshold)) unarmedActivations++;
+        previousOn = at;
+        activations++;
+    }
+    unsigned long expectedActivations = countDuskEdges(*profile, durationMs, threshold);
+
+    unsigned long expectedTicks = durationMs / config.sensor.uploadFrequency;
+    unsigned long reportsSent = readMetric("data_reports_sent_total");
+    unsigned long reportsSuppressed = readMetric("data_reports_suppressed_total");
+    unsigned long outboxLost = readMetric("outbox_evicted_total") + readMetric("outbox_pending");
+    unsigned long outageMs = outageEnd < durationMs ? outageEnd - outageStart : 0;
+    // During an outage at least every heartbeat is stored, at most every tick.
+    // The outbox keeps the newest samples once an outage outgrows it.
+    unsigned long outboxCapacity = Outbox(SPIFFS, "/outbox", config.mqtt.outboxMaxBytes).getCapacity();
+    unsigned long heartbeat = config.sensor.publishHeartbeat;
+    unsigned long maxMissed = outageMs / config.sensor.uploadFrequency;
+    unsigned long minMissed = heartbeat > 0 ? outageMs / heartbeat : maxMissed;
+    if (minMissed > outboxCapacity) minMissed = outboxCapacity;
+    unsigned long silenceBound = (heartbeat > 0 ? heartbeat : 0) + config.sensor.uploadFrequency + 1000;
+    // Backoff: retries average at least a quarter of the cap during an outage,
+    // and the first attempt after it starts within the cap
+    unsigned long connectAttempts = readMetric("mqtt_connect_attempts_total");
+    unsigned long maxAttempts = 10 + outageMs / (MQTTClient::RECONNECT_MAX_DELAY / 4);
+    unsigned long reconnectBound = MQTTClient::RECONNECT_MAX_DELAY + 1000;
+    long heapDrift = (long)freeHeapBaseline - (long)freeHeapAtEnd;
+
+    // Readings not batched yet at the end, plus any the history overwrote
+    // during an outage, are the only ones allowed to be missing
+    unsigned long reads = sensor->getReadCount();
+    unsigned long batchSlack = options.batchSamples + outageMs / config.sensor.sensorReadingInterval;
+
+    Check checks[] = {
+        {"LED turns off within one read cycle of the room getting bright", brightOffViolations == 0},
+        {"LED timer never outlives nightLightDuration", timerViolations == 0},
+        {"LED only re-arms after the room was bright (roomWasBright)", unarmedActivations == 0},
+        {"One activation per dusk edge in the profile", activations == expectedActivations},
+        {"Every uploadFrequency tick is reported or suppressed",
+         reportsSent + reportsSuppressed >= expectedTicks * 9 / 10 && reportsSent + reportsSuppressed <= expectedTicks + 1},
+        {"Data publishes (live + backlog) match the reports sent",
+         dataPublishes + backlogPublishes <= reportsSent && dataPublishes + backlogPublishes + outboxLost >= reportsSent},
+        {"Readings past a deadband are published by the next tick", lateReports == 0},
+        {"Silence on /data never outlasts the heartbeat", longestSilence <= silenceBound},
+        // Plus the few samples taken at boot, before the first connect
+        {"Samples missed while the broker was down are sent as backlog",
+         backlogPublishes >= minMissed * 9 / 10 && backlogPublishes <= maxMissed + 5},
+        {"Reconnects back off while the broker is down", connectAttempts <= maxAttempts},
+        {"Client reconnects within the backoff cap once the broker is back",
+         outageMs == 0 || (firstBacklogAt > 0 && firstBacklogAt - outageEnd <= reconnectBound)},
+        {"No heap growth once settled", heapDrift <= 1024},
+        {"Batches carry every reading (when batching)",
+         options.batchSamples == 0 || (batchedReadings <= reads && batchedReadings + batchSlack >= reads)},
+    };
+
+    Serial.printf("[sim] %lu simulated days in %.1f s wall time (%.0fx)\n", options.days, wallSeconds,
+                  durationMs / 1000.0 / (wallSeconds > 0 ? wallSeconds : 1));
+    Serial.printf("[sim] loop wakeups %lu (%.1f/s)\n", wakeups, wakeups * 1000.0 / durationMs);
+    Serial.printf("[sim] sensor reads %lu, display frames %lu (LED status %lu, timer %lu)\n",
+                  sensor->getReadCount(), display->frames, display->ledStatusFrames, display->timerFrames);
+    Serial.printf("[sim] LED activations %lu (expected %lu), data publishes %lu, total publishes %lu\n",
+                  activations, expectedActivations, dataPublishes, native_hal::env().publishCount);
+    Serial.printf("[sim] reports sent %lu, suppressed %lu of %lu ticks (%.0f%% saved), longest silence %lu s\n",
+                  reportsSent, reportsSuppressed, expectedTicks,
+                  100.0 * reportsSuppressed / (reportsSent + reportsSuppressed > 0 ? reportsSent + reportsSuppressed : 1),
+                  longestSilence / 1000);
+    Serial.printf("[sim] broker outage %lu h, backlog publishes %lu (expected %lu-%lu)\n", outageMs / 3600000,
+                  backlogPublishes, minMissed, maxMissed);
+    Serial.printf("[sim] broker connect attempts %lu (at most %lu), back online after %lu s\n", connectAttempts,
+                  maxAttempts, outageMs > 0 && firstBacklogAt > 0 ? (firstBacklogAt - outageEnd) / 1000 : 0);
+    if (options.batchSamples > 0) {
+        Serial.printf("[sim] batch publishes %lu carrying %lu of %lu readings\n", batchPublishes, batchedReadings,
+                      reads);
+    }
+    Serial.printf("[sim] free heap settled: %u, at end: %u, minimum: %u bytes\n", freeHeapBaseline,
+                  freeHeapAtEnd, freeHeapMinimum);
+
+    native_hal::env().publishHook = nullptr;
+    native_hal::env().brokerAvailable = true;
+    return reportChecks("sim", checks);
+}
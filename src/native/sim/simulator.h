@@ -0,0 +1,20 @@
+#ifndef NATIVE_SIM_SIMULATOR_H
+#define NATIVE_SIM_SIMULATOR_H
+
+struct SimulationOptions {
+    unsigned long days = 7;
+    unsigned long sensorReadingInterval = 0;   // 0 keeps the config default
+    unsigned long uploadFrequency = 0;         // 0 keeps the config default
+    const char* profilePath = nullptr;         // CSV trace; built-in day/night cycle if null
+    unsigned long outageHours = 0;             // Broker unreachable this long from 10:00 on day one
+    unsigned long batchSamples = 0;            // mqtt.batchMaxSamples; 0 keeps batching off
+    long heartbeat = -1;                       // sensor.publishHeartbeat; -1 keeps the default
+};
+
+// Runs App against scripted sensors on a virtual clock for the requested
+// number of days, then checks LED timer/auto-control behaviour, publish
+// counts (including backlog sent after a broker outage), report-by-exception
+// deadbands and heartbeat, and heap drift.
+int runSimulation(const SimulationOptions& options);
+
+#endif
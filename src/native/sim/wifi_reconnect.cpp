@@ -0,0 +1,159 @@
+#include "wifi_reconnect.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include "../../hardware/wifi_manager.h"
+#include "../hal/native_hal.h"
+#include "sim_checks.h"
+
+namespace {
+
+const unsigned long POLL_MS = 10;
+const unsigned long MINUTE_MS = 60000;
+
+// Rough ESP32 figures: an active scan of 13 channels, a probe of one,
+// the WPA2 handshake and a DHCP exchange with a home router
+const unsigned long SCAN_MS = 2400;
+const unsigned long PROBE_MS = 60;
+const unsigned long ASSOCIATE_MS = 250;
+const unsigned long DHCP_MS = 1200;
+
+struct Attempt {
+    bool connected;
+    unsigned long ms;
+    bool cached;
+};
+
+// Polls update() until connected or timeoutMs passes
+Attempt untilConnected(WiFiManager& wifi, unsigned long timeoutMs) {
+    unsigned long start = millis();
+    while (!(wifi.isConnected() && !wifi.isConnecting()) && millis() - start < timeoutMs) {
+        wifi.update();
+        if (!wifi.isConnected()) native_hal::advanceClock(POLL_MS);
+    }
+    const WiFiManager::ConnectStats& stats = wifi.getConnectStats();
+    return Attempt{wifi.isConnected(), stats.lastConnectMs, stats.lastCached};
+}
+
+// The access point disappears long enough for the manager to notice
+Attempt afterDrop(WiFiManager& wifi) {
+    native_hal::env().wifiAvailable = false;
+    wifi.update();
+    native_hal::env().wifiAvailable = true;
+    return untilConnected(wifi, MINUTE_MS);
+}
+
+// A reset: the old manager goes, the radio starts over, and RTC memory is
+// kept or not depending on the reason
+std::unique_ptr<WiFiManager> reboot(std::unique_ptr<WiFiManager> old, const WiFiConfig& config,
+                                    esp_reset_reason_t reason) {
+    old.reset();
+    WiFi.disconnect();
+    native_hal::env().resetReason = reason;
+    std::unique_ptr<WiFiManager> wifi(new WiFiManager(config));
+    wifi->initialize();
+    wifi->connect();
+    return wifi;
+}
+
+bool fast(const Attempt& attempt) {
+    return attempt.connected && attempt.cached && attempt.ms < 1000;
+}
+
+}  // namespace
+
+int runWiFiReconnectCheck() {
+    Logger::setLevel(LogLevel::ERROR);
+    native_hal::useVirtualClock(true);
+    native_hal::Environment& env = native_hal::env();
+    env.wifiAvailable = true;
+    env.wifiChannel = 6;
+    env.wifiScanMs = SCAN_MS;
+    env.wifiProbeMs = PROBE_MS;
+    env.wifiAssociateMs = ASSOCIATE_MS;
+    env.dhcpMs = DHCP_MS;
+    env.nvs.clear();
+    env.nvsWrites = 0;
+
+    WiFiConfig config;
+    strcpy(config.ssid, "sim-ap");
+    strcpy(config.password, "sim-password");
+    config.reuseIp = true;  // As on a network that reserves the address
+
+    // Nothing cached yet: scan and DHCP
+    std::unique_ptr<WiFiManager> wifi = reboot(nullptr, config, ESP_RST_POWERON);
+    Attempt first = untilConnected(*wifi, MINUTE_MS);
+    String leasedIp = WiFi.localIP().toString();
+
+    Attempt dropped = afterDrop(*wifi);
+    bool keptAddress = WiFi.localIP().toString() == leasedIp;
+
+    // A software reset keeps RTC memory; NVS is hidden to show it isn't needed
+    std::map<std::string, std::vector<uint8_t>> nvs = env.nvs;
+    env.nvs.clear();
+    wifi = reboot(std::move(wifi), config, ESP_RST_SW);
+    Attempt warm = untilConnected(*wifi, MINUTE_MS);
+    env.nvs = nvs;
+
+    // A power cycle loses RTC memory: NVS has the link
+    wifi = reboot(std::move(wifi), config, ESP_RST_POWERON);
+    Attempt cold = untilConnected(*wifi, MINUTE_MS);
+
+    // The access point moves to another channel
+    env.wifiChannel = 11;
+    Attempt moved = afterDrop(*wifi);
+    unsigned long misses = wifi->getConnectStats().cachedMisses;
+    Attempt afterMove = afterDrop(*wifi);
+
+    // The access point is gone for five minutes: retries back off, and the
+    // first one after it returns goes straight to it
+    unsigned long beginsBefore = env.wifiBegins;
+    env.wifiAvailable = false;
+    wifi->update();
+    unsigned long outageStart = millis();
+    while (millis() - outageStart < 5 * MINUTE_MS) {
+        wifi->update();
+        native_hal::advanceClock(POLL_MS);
+    }
+    unsigned long outageBegins = env.wifiBegins - beginsBefore;
+    env.wifiAvailable = true;
+    unsigned long returnedAt = millis();
+    Attempt back = untilConnected(*wifi, MINUTE_MS);
+    unsigned long backMs = millis() - returnedAt;
+    unsigned long failures = wifi->getConnectStats().failures;
+    unsigned long nvsWrites = env.nvsWrites;
+
+    // Without reuseIp the cached connect still skips the scan, not DHCP
+    config.reuseIp = false;
+    Attempt dhcp = afterDrop(*wifi);
+    config.reuseIp = true;
+
+    Check checks[] = {
+        {"First connect scans every channel and asks DHCP", first.connected && !first.cached &&
+                                                                first.ms >= SCAN_MS + ASSOCIATE_MS + DHCP_MS},
+        {"Reconnect after a drop goes to the cached access point in under a second", fast(dropped) && keptAddress},
+        {"Warm reset reconnects from RTC memory in under a second", fast(warm)},
+        {"Power cycle reconnects from NVS in under a second", fast(cold)},
+        {"Access point on another channel: scan, then cached again",
+         moved.connected && !moved.cached && misses == 1 && fast(afterMove) && WiFi.channel() == 11},
+        {"Retries back off while the access point is gone", failures > 0 && outageBegins <= 40},
+        {"Reconnects within the retry cap once it is back", back.connected && backMs <= WiFiManager::RETRY_MAX_DELAY + 1000},
+        {"NVS written only when the link changed", nvsWrites == 2},
+        {"reuseIp off: cached connect with DHCP", dhcp.connected && dhcp.cached && dhcp.ms < first.ms &&
+                                                      dhcp.ms >= DHCP_MS},
+    };
+
+    Serial.printf("[wifi] first connect   %5lu ms (full scan + DHCP)\n", first.ms);
+    Serial.printf("[wifi] after a drop    %5lu ms (%s)\n", dropped.ms, dropped.cached ? "cached" : "scan");
+    Serial.printf("[wifi] warm reset      %5lu ms (%s)\n", warm.ms, warm.cached ? "cached" : "scan");
+    Serial.printf("[wifi] power cycle     %5lu ms (%s)\n", cold.ms, cold.cached ? "cached" : "scan");
+    Serial.printf("[wifi] moved channel   %5lu ms, then %lu ms\n", moved.ms, afterMove.ms);
+    Serial.printf("[wifi] 5 min outage: %lu connect attempts, back %lu ms after the access point\n", outageBegins,
+                  backMs);
+    Serial.printf("[wifi] cached with DHCP %4lu ms; %lu NVS writes\n", dhcp.ms, nvsWrites);
+    native_hal::useVirtualClock(false);
+    return reportChecks("wifi", checks);
+}
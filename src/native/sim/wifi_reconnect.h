@@ -0,0 +1,12 @@
+#ifndef NATIVE_SIM_WIFI_RECONNECT_H
+#define NATIVE_SIM_WIFI_RECONNECT_H
+
+// Runs WiFiManager on a virtual clock against an access point with ESP32
+// scan, association and DHCP times: the first connect scans, and later
+// ones (after a drop, a warm reset or a power cycle) must go straight to
+// the cached access point in under a second, fall back to a scan when the
+// access point moved channel, back off while it is gone, and write NVS
+// only when the link changed.
+int runWiFiReconnectCheck();
+
+#endif
@@ -0,0 +1,196 @@
+#include "wifi_roaming.h"
+#include <Arduino.h>
+#include <WiFi.h>
+#include <string.h>
+#include "../../hardware/wifi_manager.h"
+#include "../hal/native_hal.h"
+#include "sim_checks.h"
+
+namespace {
+
+const unsigned long POLL_MS = 100;
+const unsigned long MINUTE_MS = 60000;
+
+// Same ESP32 figures as the reconnect check
+const unsigned long SCAN_MS = 2400;
+const unsigned long PROBE_MS = 60;
+const unsigned long ASSOCIATE_MS = 250;
+const unsigned long DHCP_MS = 1200;
+
+const int ROAM_RSSI = -75;
+const unsigned long ROAM_WINDOW = 30000;
+
+// The access point the station joins first (env().wifiBssid), a second
+// one of the same network on another channel, and a stronger network
+// that isn't ours
+const uint8_t HALL[6] = {0x9C, 0x9D, 0x7E, 0x41, 0x20, 0x0A};
+const uint8_t OFFICE[6] = {0x9C, 0x9D, 0x7E, 0x41, 0x31, 0x5B};
+const uint8_t NEIGHBOUR[6] = {0x44, 0x07, 0x0B, 0x12, 0x9F, 0x01};
+const size_t HALL_INDEX = 0;
+const size_t OFFICE_INDEX = 1;
+
+native_hal::ScanResult accessPoint(const char* ssid, int32_t rssi, const uint8_t* bssid, int32_t channel) {
+    native_hal::ScanResult result;
+    result.ssid = ssid;
+    result.rssi = rssi;
+    result.encryption = WIFI_AUTH_WPA2_PSK;
+    memcpy(result.bssid, bssid, sizeof(result.bssid));
+    result.channel = channel;
+    return result;
+}
+
+// The hall access point as heard both by the station and in scans
+void setHallRssi(int32_t rssi) {
+    native_hal::env().wifiRssi = rssi;
+    native_hal::env().scanResults[HALL_INDEX].rssi = rssi;
+}
+
+void setOfficeRssi(int32_t rssi) {
+    native_hal::env().scanResults[OFFICE_INDEX].rssi = rssi;
+}
+
+bool on(const uint8_t* bssid) {
+    const uint8_t* joined = WiFi.BSSID();
+    return joined && memcmp(joined, bssid, 6) == 0;
+}
+
+void run(WiFiManager& wifi, unsigned long ms) {
+    unsigned long start = millis();
+    while (millis() - start < ms) {
+        wifi.update();
+        native_hal::advanceClock(POLL_MS);
+    }
+}
+
+// Polls until connected to bssid; returns how long it took, or timeoutMs
+unsigned long runUntilOn(WiFiManager& wifi, const uint8_t* bssid, unsigned long timeoutMs) {
+    unsigned long start = millis();
+    while (!(wifi.isConnected() && !wifi.isConnecting() && on(bssid)) && millis() - start < timeoutMs) {
+        wifi.update();
+        native_hal::advanceClock(POLL_MS);
+    }
+    return millis() - start;
+}
+
+// The link drops with the given reason and comes back
+void drop(WiFiManager& wifi, uint8_t reason) {
+    native_hal::env().wifiDisconnectReason = reason;
+    native_hal::env().wifiAvailable = false;
+    wifi.update();
+    native_hal::env().wifiAvailable = true;
+    run(wifi, 5000);
+}
+
+}  // namespace
+
+int runWiFiRoamingCheck() {
+    Logger::setLevel(LogLevel::ERROR);
+    native_hal::useVirtualClock(true);
+    native_hal::Environment& env = native_hal::env();
+    env.wifiAvailable = true;
+    memcpy(env.wifiBssid, HALL, sizeof(env.wifiBssid));
+    env.wifiChannel = 6;
+    env.wifiScanMs = SCAN_MS;
+    env.wifiProbeMs = PROBE_MS;
+    env.wifiAssociateMs = ASSOCIATE_MS;
+    env.dhcpMs = DHCP_MS;
+    env.nvs.clear();
+    env.resetReason = ESP_RST_POWERON;
+    env.scanResults.clear();
+    env.scanResults.push_back(accessPoint("sim-ap", -55, HALL, 6));
+    env.scanResults.push_back(accessPoint("sim-ap", -60, OFFICE, 1));
+    env.scanResults.push_back(accessPoint("neighbour", -40, NEIGHBOUR, 11));
+    setHallRssi(-55);
+
+    WiFiConfig config;
+    strcpy(config.ssid, "sim-ap");
+    strcpy(config.password, "sim-password");
+    config.reuseIp = true;  // As on a network that reserves the address
+    config.roamRssi = ROAM_RSSI;
+    config.roamWindow = ROAM_WINDOW;
+
+    unsigned long createdAt = millis();
+    WiFiManager wifi(config);
+    wifi.initialize();
+    wifi.connect();
+    runUntilOn(wifi, HALL, MINUTE_MS);
+
+    // A good link, sampled for a minute
+    run(wifi, MINUTE_MS);
+    WiFiManager::LinkStats steady = wifi.getLinkStats();
+
+    // Someone walks past: ten seconds of weak signal are ridden out
+    setHallRssi(-82);
+    run(wifi, 10000);
+    setHallRssi(-55);
+    run(wifi, ROAM_WINDOW);
+    WiFiManager::LinkStats dipped = wifi.getLinkStats();
+    bool stayed = on(HALL);
+
+    // The hall access point fades for good: over to the office one
+    String leasedIp = WiFi.localIP().toString();
+    setHallRssi(-82);
+    unsigned long roamMs = runUntilOn(wifi, OFFICE, 2 * MINUTE_MS);
+    run(wifi, 5000);
+    WiFiManager::LinkStats roamed = wifi.getLinkStats();
+    bool keptAddress = WiFi.localIP().toString() == leasedIp;
+    int32_t roamedRssi = WiFi.RSSI();
+    int32_t roamedChannel = WiFi.channel();
+
+    // Both fade: weak, but nothing 8 dB better, so no moves and few scans
+    setOfficeRssi(-80);
+    run(wifi, 5 * MINUTE_MS);
+    WiFiManager::LinkStats stuck = wifi.getLinkStats();
+    bool stuckOnOffice = on(OFFICE);
+    unsigned long stuckScans = stuck.roamScans - roamed.roamScans;
+    unsigned long maxStuckScans = 5 * MINUTE_MS / WiFiManager::ROAM_HOLDOFF + 1;
+
+    // Roaming off: the weak link is left alone
+    config.roamRssi = 0;
+    run(wifi, 3 * MINUTE_MS);
+    WiFiManager::LinkStats off = wifi.getLinkStats();
+    setOfficeRssi(-60);
+
+    // Drops, by cause
+    drop(wifi, WIFI_REASON_BEACON_TIMEOUT);
+    drop(wifi, WIFI_REASON_4WAY_HANDSHAKE_TIMEOUT);
+    drop(wifi, WIFI_REASON_BEACON_TIMEOUT);
+    WiFiManager::LinkStats dropped = wifi.getLinkStats();
+    unsigned long elapsed = millis() - createdAt;
+    uint64_t accounted = 0;
+    for (size_t i = 0; i < WiFiManager::WIFI_STATES; i++) {
+        accounted += dropped.stateMs[i];
+    }
+    uint64_t connectedMs = dropped.stateMs[(size_t)WiFiState::CONNECTED];
+
+    Check checks[] = {
+        {"RSSI sampled every 2 s while connected", steady.rssiSamples >= 30 && steady.rssiSamples <= 32 &&
+                                                       steady.rssi == -55 && (int)steady.rssiAverage == -55},
+        {"A 10 s dip does not trigger a roam scan", dipped.roamScans == 0 && dipped.rssiMin == -82 && stayed},
+        {"Sustained weak signal roams to the stronger access point of the same SSID",
+         roamed.roams == 1 && roamed.roamScans == 1 && roamedRssi == -60 && roamedChannel == 1},
+        {"Roam lands within the window plus a scan and a join",
+         roamMs <= ROAM_WINDOW + WiFiManager::RSSI_SAMPLE_INTERVAL + SCAN_MS + 1000},
+        {"A roam is not counted as a lost link and keeps the address",
+         roamed.reconnects == 0 && keptAddress && roamed.disconnects[(size_t)DisconnectCause::AP_LEFT] == 0},
+        {"Nowhere better to go: no roam, scans held off",
+         stuck.roams == 1 && stuckScans >= 1 && stuckScans <= maxStuckScans && stuckOnOffice},
+        {"roamRssi 0 turns roaming off", off.roamScans == stuck.roamScans && off.roams == 1},
+        {"Disconnects counted by cause, reconnects counted",
+         dropped.disconnects[(size_t)DisconnectCause::BEACON_TIMEOUT] == 2 &&
+             dropped.disconnects[(size_t)DisconnectCause::AUTH] == 1 && dropped.reconnects == 3 &&
+             dropped.lastDisconnectReason == WIFI_REASON_BEACON_TIMEOUT && on(OFFICE)},
+        {"Time in state adds up to the run", accounted == elapsed && connectedMs * 100 >= (uint64_t)elapsed * 98},
+    };
+
+    Serial.printf("[roam] steady link: %lu samples, %d dBm average\n", steady.rssiSamples, (int)steady.rssiAverage);
+    Serial.printf("[roam] faded to -82 dBm: roamed after %lu ms to channel %d at %d dBm (%lu roam scans)\n", roamMs,
+                  (int)roamedChannel, (int)roamedRssi, roamed.roamScans);
+    Serial.printf("[roam] 5 min weak with nowhere to go: %lu roam scans (at most %lu)\n", stuckScans, maxStuckScans);
+    Serial.printf("[roam] disconnects: %lu beacon timeout, %lu auth, %lu reconnects; %.2f%% of %lu s connected\n",
+                  dropped.disconnects[(size_t)DisconnectCause::BEACON_TIMEOUT],
+                  dropped.disconnects[(size_t)DisconnectCause::AUTH], dropped.reconnects,
+                  elapsed > 0 ? 100.0 * connectedMs / elapsed : 0.0, elapsed / 1000);
+    native_hal::useVirtualClock(false);
+    return reportChecks("roam", checks);
+}
@@ -0,0 +1,12 @@
+#ifndef NATIVE_SIM_WIFI_ROAMING_H
+#define NATIVE_SIM_WIFI_ROAMING_H
+
+// Runs WiFiManager on a virtual clock between two access points of one
+// network while the signal of the joined one fades: RSSI is sampled
+// continuously, a brief dip is ridden out, a sustained one moves the
+// station to the stronger access point without a full reconnect, a weak
+// link with nowhere better to go is rescanned only once per holdoff, and
+// disconnects are counted by cause with the time spent in each state.
+int runWiFiRoamingCheck();
+
+#endif